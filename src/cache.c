@@ -0,0 +1,427 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file cache.c
+ *  This file contains the persistent contact cache. Addresses of contacts
+ *  are stored together with the time they have been seen last, their
+ *  connect time and the amount of successful and failed connects in a file
+ *  of fixed-size records. The file is mapped into memory and updated in
+ *  place, so that the best contacts can be reconnected after a restart.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "dchat_h/cache.h"
+#include "dchat_h/types.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Opens and maps the contact cache file.
+ *  If no path has been set with the command line option, the file
+ *  CACHE_DEF_FILE in the home directory will be used. A missing file will
+ *  be created, a file that is not a contact cache or has been written by
+ *  a client with a different record layout will be reset.
+ *  @param cc Pointer to contact cache
+ *  @return 0 on success (even if no cache is used), -1 in case of error
+ */
+int
+init_cache(contact_cache_t* cc)
+{
+    struct stat st; // status of cache file
+    size_t size = sizeof(cache_hdr_t) + CACHE_RECORDS * sizeof(cache_rec_t);
+    char* home;
+
+    cc->hdr = NULL;
+    cc->rec = NULL;
+
+    if (pthread_mutex_init(&cc->cc_mx, NULL))
+    {
+        ui_log_errno(LOG_ERR, "Initialization of contact cache mutex failed!");
+        return -1;
+    }
+
+    if (cc->path[0] == '\0')
+    {
+        // without home directory no cache will be used
+        if ((home = getenv("HOME")) == NULL)
+        {
+            return 0;
+        }
+
+        snprintf(cc->path, sizeof(cc->path), CACHE_DEF_FILE, home, _cnf->me.lport);
+    }
+
+    if ((cc->fd = open(cc->path, O_RDWR | O_CREAT, 0600)) == -1)
+    {
+        ui_log_errno(LOG_WARN, "Could not open contact cache '%s'!", cc->path);
+        return 0;
+    }
+
+    if (fstat(cc->fd, &st) == -1 ||
+        ((st.st_size < 0 || (size_t) st.st_size != size) && ftruncate(cc->fd, size) == -1))
+    {
+        ui_log_errno(LOG_WARN, "Could not resize contact cache '%s'!", cc->path);
+        close(cc->fd);
+        return 0;
+    }
+
+    if ((cc->hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cc->fd, 0))
+        == MAP_FAILED)
+    {
+        ui_log_errno(LOG_WARN, "Could not map contact cache '%s'!", cc->path);
+        cc->hdr = NULL;
+        close(cc->fd);
+        return 0;
+    }
+
+    cc->rec = (cache_rec_t*) (cc->hdr + 1);
+
+    if (memcmp(cc->hdr->magic, CACHE_MAGIC, CACHE_MAGIC_LEN) ||
+        cc->hdr->rec_size != sizeof(cache_rec_t) || cc->hdr->records != CACHE_RECORDS)
+    {
+        if (st.st_size)
+        {
+            ui_log(LOG_WARN, "Invalid contact cache '%s' - resetting it!", cc->path);
+        }
+
+        memset(cc->hdr, 0, size);
+        memcpy(cc->hdr->magic, CACHE_MAGIC, CACHE_MAGIC_LEN);
+        cc->hdr->rec_size = sizeof(cache_rec_t);
+        cc->hdr->records = CACHE_RECORDS;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Writes the contact cache back to its file and unmaps it.
+ *  @param cc Pointer to contact cache
+ */
+void
+destroy_cache(contact_cache_t* cc)
+{
+    size_t size = sizeof(cache_hdr_t) + CACHE_RECORDS * sizeof(cache_rec_t);
+
+    pthread_mutex_lock(&cc->cc_mx);
+
+    if (cc->hdr != NULL)
+    {
+        msync(cc->hdr, size, MS_SYNC);
+        munmap(cc->hdr, size);
+        close(cc->fd);
+        cc->hdr = NULL;
+        cc->rec = NULL;
+    }
+
+    pthread_mutex_unlock(&cc->cc_mx);
+    pthread_mutex_destroy(&cc->cc_mx);
+}
+
+
+/**
+ *  Records a successful connect to an address.
+ *  The connect time is smoothed with the previous ones (weight 1/4), so
+ *  that a single slow circuit does not spoil the record.
+ *  @param cc       Pointer to contact cache
+ *  @param onion_id Onion address connected to
+ *  @param lport    Port connected to
+ *  @param rtt      Time the connect took in ms
+ */
+void
+cache_success(contact_cache_t* cc, char* onion_id, uint16_t lport, uint32_t rtt)
+{
+    cache_rec_t* rec;
+
+    pthread_mutex_lock(&cc->cc_mx);
+
+    if ((rec = cache_get_rec(cc, onion_id, lport, 1)) != NULL)
+    {
+        rec->rtt = rec->successes ? (3 * (uint64_t) rec->rtt + rtt) / 4 : rtt;
+        rec->successes++;
+        rec->last_seen = time(NULL);
+    }
+
+    pthread_mutex_unlock(&cc->cc_mx);
+}
+
+
+/**
+ *  Records a failed connect to an address.
+ *  @param cc       Pointer to contact cache
+ *  @param onion_id Onion address connected to
+ *  @param lport    Port connected to
+ */
+void
+cache_failure(contact_cache_t* cc, char* onion_id, uint16_t lport)
+{
+    cache_rec_t* rec;
+
+    pthread_mutex_lock(&cc->cc_mx);
+
+    // unknown addresses are not added, only known ones get worse
+    if ((rec = cache_get_rec(cc, onion_id, lport, 0)) != NULL)
+    {
+        rec->failures++;
+    }
+
+    pthread_mutex_unlock(&cc->cc_mx);
+}
+
+
+/**
+ *  Records that a contact has been seen right now, i.e. it identified
+ *  itself or disconnected.
+ *  @param cc       Pointer to contact cache
+ *  @param onion_id Onion address of contact
+ *  @param lport    Listening port of contact
+ */
+void
+cache_seen(contact_cache_t* cc, char* onion_id, uint16_t lport)
+{
+    cache_rec_t* rec;
+
+    pthread_mutex_lock(&cc->cc_mx);
+
+    if ((rec = cache_get_rec(cc, onion_id, lport, 1)) != NULL)
+    {
+        rec->last_seen = time(NULL);
+    }
+
+    pthread_mutex_unlock(&cc->cc_mx);
+}
+
+
+/**
+ *  Selects the best addresses of the contact cache (see: cache_score()).
+ *  The caller has to free the returned records.
+ *  @param cc   Pointer to contact cache
+ *  @param max  Max. amount of addresses to select
+ *  @param recs Pointer to which the copies of the selected records will be
+ *              stored, ordered by descending score
+ *  @return amount of records selected
+ */
+int
+cache_select(contact_cache_t* cc, int max, cache_rec_t** recs)
+{
+    double* score;   // score of every record, -1 if unused or selected
+    time_t now = time(NULL);
+    int best;        // index of best remaining record
+    int cnt = 0;     // amount of records selected
+    int i;
+
+    if ((*recs = malloc(max * sizeof(cache_rec_t))) == NULL ||
+        (score = malloc(CACHE_RECORDS * sizeof(double))) == NULL)
+    {
+        ui_fatal("Memory allocation for cached contacts failed!");
+    }
+
+    pthread_mutex_lock(&cc->cc_mx);
+
+    for (i = 0; i < CACHE_RECORDS; i++)
+    {
+        score[i] = cc->rec != NULL && cc->rec[i].used ? cache_score(&cc->rec[i], now) : -1;
+    }
+
+    while (cnt < max)
+    {
+        for (best = -1, i = 0; i < CACHE_RECORDS; i++)
+        {
+            if (score[i] >= 0 && (best == -1 || score[i] > score[best]))
+            {
+                best = i;
+            }
+        }
+
+        if (best == -1)
+        {
+            break;
+        }
+
+        memcpy(&(*recs)[cnt++], &cc->rec[best], sizeof(cache_rec_t));
+        score[best] = -1;
+    }
+
+    pthread_mutex_unlock(&cc->cc_mx);
+    free(score);
+    return cnt;
+}
+
+
+/**
+ *  Reconnects to the best addresses of the contact cache.
+ *  Called at startup: the CACHE_RECONNECT best addresses are queued at
+ *  once, so that the connector threads connect to them in parallel. In
+ *  overlay mode only as many addresses as fit into the active view are
+ *  queued, the others are added to the passive view.
+ *  @param cc Pointer to contact cache
+ *  @return amount of connection requests queued
+ */
+int
+cache_reconnect(contact_cache_t* cc)
+{
+    cache_rec_t* recs; // best cached addresses
+    int cnt;           // amount of cached addresses
+    int limit = CACHE_RECONNECT; // max. connection requests
+    int queued = 0;
+
+    if (_cnf->ovl.enabled)
+    {
+        limit = _cnf->ovl.degree;
+    }
+
+    cnt = cache_select(cc, limit + (_cnf->ovl.enabled ? OVL_PASSIVE_SIZE : 0), &recs);
+
+    for (int i = 0; i < cnt; i++)
+    {
+        // skip ourself
+        if (recs[i].lport == _cnf->me.lport && !strcmp(recs[i].onion_id, _cnf->me.onion_id))
+        {
+            continue;
+        }
+
+        if (queued >= limit)
+        {
+            ovl_add_passive(recs[i].onion_id, recs[i].lport);
+        }
+        else if (enqueue_conn(&_cnf->cq, recs[i].onion_id, recs[i].lport, NULL, 0,
+                              CONN_PRIO_CACHE) == 0)
+        {
+            queued++;
+        }
+    }
+
+    free(recs);
+    cc->reconnects += queued;
+    return queued;
+}
+
+
+/**
+ *  Counts the records in use.
+ *  @param cc Pointer to contact cache
+ *  @return amount of addresses stored in the contact cache
+ */
+int
+cache_used(contact_cache_t* cc)
+{
+    int used = 0;
+
+    pthread_mutex_lock(&cc->cc_mx);
+
+    for (int i = 0; cc->rec != NULL && i < CACHE_RECORDS; i++)
+    {
+        used += cc->rec[i].used;
+    }
+
+    pthread_mutex_unlock(&cc->cc_mx);
+    return used;
+}
+
+
+/**
+ *  Returns the record of an address and optionally adds it, if it is not
+ *  cached yet. If all records are in use, the one with the lowest score
+ *  will be replaced. Caller must hold the mutex of the cache.
+ *  @param cc       Pointer to contact cache
+ *  @param onion_id Onion address
+ *  @param lport    Port
+ *  @param add      If set, a missing address will be added
+ *  @return pointer to record or NULL if not found or no cache is used
+ */
+cache_rec_t*
+cache_get_rec(contact_cache_t* cc, char* onion_id, uint16_t lport, int add)
+{
+    time_t now = time(NULL);
+    int victim = -1; // free record or record with lowest score
+    int i;
+
+    if (cc->rec == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < CACHE_RECORDS; i++)
+    {
+        if (!cc->rec[i].used)
+        {
+            if (victim == -1 || cc->rec[victim].used)
+            {
+                victim = i;
+            }
+        }
+        else if (cc->rec[i].lport == lport && !strcmp(cc->rec[i].onion_id, onion_id))
+        {
+            return &cc->rec[i];
+        }
+        else if (victim == -1 || (cc->rec[victim].used &&
+                 cache_score(&cc->rec[i], now) < cache_score(&cc->rec[victim], now)))
+        {
+            victim = i;
+        }
+    }
+
+    if (!add)
+    {
+        return NULL;
+    }
+
+    memset(&cc->rec[victim], 0, sizeof(cache_rec_t));
+    strncat(cc->rec[victim].onion_id, onion_id, ONION_ADDRLEN);
+    cc->rec[victim].lport = lport;
+    cc->rec[victim].used = 1;
+    return &cc->rec[victim];
+}
+
+
+/**
+ *  Rates a cached address.
+ *  The score is the ratio of successful connects (with one success and one
+ *  failure assumed in advance), which decreases with the hours since the
+ *  address has been seen last and with its connect time in seconds.
+ *  @param rec Pointer to record
+ *  @param now Current time
+ *  @return score of address, the higher the better
+ */
+double
+cache_score(cache_rec_t* rec, time_t now)
+{
+    double ratio = (rec->successes + 1.0) / (rec->successes + rec->failures + 2.0);
+    double hours = rec->last_seen ? (now - rec->last_seen) / 3600.0 : 24 * 365;
+
+    if (hours < 0)
+    {
+        hours = 0;
+    }
+
+    return ratio / (1 + hours) / (1 + rec->rtt / 1000.0);
+}
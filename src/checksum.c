@@ -0,0 +1,299 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+
+
+/** @file checksum.c
+ *  This file contains the CRC-32C (Castagnoli) checksums of the content of
+ *  PDUs. Clients offer to verify checksums by CK_OFFER in the Server header
+ *  of their hello. Chunks of files sent to such a contact carry the header
+ *  "Content-CRC32C" (DChat/1) or the flag V2_FLG_CRC (DChat/2) with the
+ *  CRC-32C of the content as it is sent. The receiver updates the checksum
+ *  with every read of the content and drops the connection, if it does not
+ *  match, so the content is not read twice. The checksum is computed with
+ *  the crc32 instruction of SSE4.2, if the CPU supports it, otherwise 8
+ *  bytes at a time with 8 tables (slicing-by-8). Since every crc32
+ *  instruction waits for the previous one, the instruction runs on three
+ *  lanes of CK_LANE bytes at once, whose CRCs are combined by shifting
+ *  them over the following lanes (see: ck_shift()).
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CK_SSE42
+#endif
+
+#include "dchat_h/checksum.h"
+#include "dchat_h/types.h"
+#include "dchat_h/consoleui.h"
+
+
+// tables of slicing-by-8, table 0 is the byte-wise table
+static uint32_t ck_table[8][256];
+// CRC of CK_LANE zero bytes appended, per byte of the CRC before
+static uint32_t ck_lane[4][256];
+
+
+/**
+ *  Shifts a CRC over CK_LANE zero bytes, which is the same as appending
+ *  them, since the CRC is linear.
+ *  @param crc CRC without final inversion
+ *  @return CRC after CK_LANE zero bytes
+ */
+static uint32_t
+ck_shift(uint32_t crc)
+{
+    return ck_lane[0][crc & 0xff] ^ ck_lane[1][(crc >> 8) & 0xff] ^
+           ck_lane[2][(crc >> 16) & 0xff] ^ ck_lane[3][crc >> 24];
+}
+
+
+/**
+ *  Builds the tables of slicing-by-8 and selects the fastest kernel.
+ *  @param ck Pointer to checksums
+ */
+void
+init_checksums(checksums_t* ck)
+{
+    uint32_t crc;
+
+    for (int i = 0; i < 256; i++)
+    {
+        crc = i;
+
+        for (int b = 0; b < 8; b++)
+        {
+            crc = crc & 1 ? (crc >> 1) ^ CK_POLY : crc >> 1;
+        }
+
+        ck_table[0][i] = crc;
+    }
+
+    // table k advances the CRC of a byte by k more bytes
+    for (int i = 0; i < 256; i++)
+    {
+        for (int k = 1; k < 8; k++)
+        {
+            ck_table[k][i] = (ck_table[k - 1][i] >> 8) ^ ck_table[0][ck_table[k - 1][i] & 0xff];
+        }
+    }
+
+    // the shift of a CRC is the xor of the shifts of its bits
+    for (int bit = 0; bit < 32; bit++)
+    {
+        crc = 1u << bit;
+
+        for (int i = 0; i < CK_LANE; i++)
+        {
+            crc = (crc >> 8) ^ ck_table[0][crc & 0xff];
+        }
+
+        for (int i = 0; i < 256; i++)
+        {
+            if (i & (1 << (bit % 8)))
+            {
+                ck_lane[bit / 8][i] ^= crc;
+            }
+        }
+    }
+
+    ck->crc = ck_hw() ? ck_crc32c_hw : ck_crc32c_sw;
+    ck->kernel = ck_hw() ? "sse4.2" : "slicing-by-8";
+}
+
+
+/**
+ *  Updates a CRC-32C with the kernel selected by init_checksums().
+ *  @param crc CRC of the bytes before, 0 for the first bytes
+ *  @param buf Bytes to add
+ *  @param len Amount of bytes
+ *  @return CRC including the bytes
+ */
+uint32_t
+ck_crc32c(uint32_t crc, const void* buf, size_t len)
+{
+    return _cnf->ck.crc(crc, buf, len);
+}
+
+
+/**
+ *  Updates a CRC-32C 8 bytes at a time with the tables of slicing-by-8.
+ *  The bytes are combined in little-endian order regardless of the CPU.
+ *  @param crc CRC of the bytes before, 0 for the first bytes
+ *  @param buf Bytes to add
+ *  @param len Amount of bytes
+ *  @return CRC including the bytes
+ */
+uint32_t
+ck_crc32c_sw(uint32_t crc, const void* buf, size_t len)
+{
+    const unsigned char* p = buf;
+    uint32_t lo;    // bytes 0 - 3 xored with the CRC
+    uint32_t hi;    // bytes 4 - 7
+
+    crc = ~crc;
+
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        lo = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 |
+                    (uint32_t) p[3] << 24);
+        hi = (uint32_t) p[4] | (uint32_t) p[5] << 8 | (uint32_t) p[6] << 16 |
+             (uint32_t) p[7] << 24;
+        crc = ck_table[7][lo & 0xff] ^ ck_table[6][(lo >> 8) & 0xff] ^
+              ck_table[5][(lo >> 16) & 0xff] ^ ck_table[4][lo >> 24] ^
+              ck_table[3][hi & 0xff] ^ ck_table[2][(hi >> 8) & 0xff] ^
+              ck_table[1][(hi >> 16) & 0xff] ^ ck_table[0][hi >> 24];
+    }
+
+    while (len--)
+    {
+        crc = (crc >> 8) ^ ck_table[0][(crc ^ *p++) & 0xff];
+    }
+
+    return ~crc;
+}
+
+
+#ifdef CK_SSE42
+/**
+ *  Updates a CRC-32C with the crc32 instruction of SSE4.2, 8 bytes at a
+ *  time on three lanes at once. Must only be called if ck_hw() is true.
+ *  @param crc CRC of the bytes before, 0 for the first bytes
+ *  @param buf Bytes to add
+ *  @param len Amount of bytes
+ *  @return CRC including the bytes
+ */
+__attribute__((target("sse4.2"))) uint32_t
+ck_crc32c_hw(uint32_t crc, const void* buf, size_t len)
+{
+    const unsigned char* p = buf;
+    uint64_t crc64 = ~crc;
+    uint64_t lane[3];   // CRCs of the lanes, the later ones start at 0
+    uint64_t val;
+
+    for (; len >= 3 * CK_LANE; len -= 3 * CK_LANE, p += 3 * CK_LANE)
+    {
+        lane[0] = crc64;
+        lane[1] = 0;
+        lane[2] = 0;
+
+        for (int i = 0; i < CK_LANE; i += 8)
+        {
+            memcpy(&val, p + i, 8);
+            lane[0] = _mm_crc32_u64(lane[0], val);
+            memcpy(&val, p + CK_LANE + i, 8);
+            lane[1] = _mm_crc32_u64(lane[1], val);
+            memcpy(&val, p + 2 * CK_LANE + i, 8);
+            lane[2] = _mm_crc32_u64(lane[2], val);
+        }
+
+        crc64 = ck_shift(ck_shift(lane[0]) ^ lane[1]) ^ lane[2];
+    }
+
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        memcpy(&val, p, 8);
+        crc64 = _mm_crc32_u64(crc64, val);
+    }
+
+    crc = crc64;
+
+    while (len--)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+
+    return ~crc;
+}
+
+
+/**
+ *  Checks if the CPU supports the crc32 instruction of SSE4.2.
+ *  @return 1 if supported, 0 otherwise
+ */
+int
+ck_hw(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2") != 0;
+}
+#else
+/**
+ *  Falls back to slicing-by-8 on CPUs without SSE4.2.
+ */
+uint32_t
+ck_crc32c_hw(uint32_t crc, const void* buf, size_t len)
+{
+    return ck_crc32c_sw(crc, buf, len);
+}
+
+
+/**
+ *  Checks if the CPU supports the crc32 instruction of SSE4.2.
+ *  @return 0, the instruction is not available on this architecture
+ */
+int
+ck_hw(void)
+{
+    return 0;
+}
+#endif
+
+
+/**
+ *  Updates a CRC-32C with bytes of a file. The file offset of fd is not
+ *  changed, the bytes are read in CK_BUF_LEN blocks.
+ *  @param fd     File to read
+ *  @param offset Offset of the bytes in the file
+ *  @param len    Amount of bytes
+ *  @param crc    Pointer to the CRC of the bytes before, updated
+ *  @return 0 on success, -1 if the file could not be read
+ */
+int
+ck_file(int fd, off_t offset, int len, uint32_t* crc)
+{
+    char buf[CK_BUF_LEN];
+    ssize_t ret;
+    int n;  // bytes read at once
+
+    for (int b = 0; b < len; b += ret)
+    {
+        n = len - b < CK_BUF_LEN ? len - b : CK_BUF_LEN;
+
+        if ((ret = pread(fd, buf, n, offset + b)) == -1 || !ret)
+        {
+            ui_log_errno(LOG_ERR, "Could not read file to checksum it!");
+            return -1;
+        }
+
+        *crc = ck_crc32c(*crc, buf, ret);
+    }
+
+    return 0;
+}
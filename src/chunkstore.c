@@ -0,0 +1,898 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+
+/** @file chunkstore.c
+ *  This file contains the chunking of files and the store of the chunks of
+ *  received files. Files are split into content-defined chunks (FastCDC):
+ *  a rolling gear hash over the bytes of the file ends a chunk wherever
+ *  its masked bits are zero, so that the boundaries move along with
+ *  inserted or removed bytes and the chunks around a change stay the same.
+ *  Every chunk is identified by its SHA-256. The sender of a file sends the
+ *  list of its chunks ahead of the file, the receiver takes the chunks it
+ *  holds from its store and only the missing ones are sent (see:
+ *  filetransfer.c). The store is a directory of chunk files in the
+ *  download directory, limited in size by evicting the least recently
+ *  used chunks.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "dchat_h/chunkstore.h"
+#include "dchat_h/types.h"
+#include "dchat_h/consoleui.h"
+
+
+static uint64_t cs_gear[256];   //!< random values of bytes for the gear hash
+static int cs_gear_ready;       //!< cs_gear has been filled
+
+//! round constants of SHA-256
+static const uint32_t cs_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+    0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+    0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+    0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+    0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+    0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+    0xc67178f2
+};
+
+
+/**
+ *  Compares two entries of the store by their time of last use for qsort(3).
+ */
+static int
+cs_cmp_used(const void* a, const void* b)
+{
+    uint64_t x = ((const cs_entry_t*) a)->used;
+    uint64_t y = ((const cs_entry_t*) b)->used;
+
+    return x < y ? -1 : x > y;
+}
+
+
+/**
+ *  Returns the current time in nanoseconds, the time of use of chunks.
+ */
+static uint64_t
+cs_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+/**
+ *  Fills the gear table with pseudo random values. The table has to be
+ *  the same for all clients, so that a file is chunked the same way
+ *  everywhere, and is therefore derived from a fixed seed (splitmix64).
+ */
+static void
+cs_init_gear(void)
+{
+    uint64_t x = CS_GEAR_SEED;
+    uint64_t z;
+
+    for (int i = 0; i < 256; i++)
+    {
+        z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        cs_gear[i] = z ^ (z >> 31);
+    }
+
+    cs_gear_ready = 1;
+}
+
+
+/**
+ *  Finds the end of the chunk starting at the given bytes (FastCDC).
+ *  The first CS_MIN_CHUNK bytes are skipped. Up to CS_AVG_CHUNK bytes the
+ *  boundary is tested with the stricter mask CS_MASK_S, beyond with the
+ *  looser mask CS_MASK_L, which narrows the lengths of the chunks around
+ *  CS_AVG_CHUNK.
+ *  @param data Bytes of file
+ *  @param len  Amount of bytes, the end of the file is not farther away
+ *  @return length of chunk
+ */
+static uint32_t
+cs_cut(unsigned char* data, size_t len)
+{
+    uint64_t fp = 0;    // gear hash
+    size_t normal = CS_AVG_CHUNK;
+    size_t i = CS_MIN_CHUNK;
+
+    if (len <= CS_MIN_CHUNK)
+    {
+        return len;
+    }
+
+    if (len > CS_MAX_CHUNK)
+    {
+        len = CS_MAX_CHUNK;
+    }
+
+    if (normal > len)
+    {
+        normal = len;
+    }
+
+    for (; i < normal; i++)
+    {
+        fp = (fp << 1) + cs_gear[data[i]];
+
+        if (!(fp & CS_MASK_S))
+        {
+            return i;
+        }
+    }
+
+    for (; i < len; i++)
+    {
+        fp = (fp << 1) + cs_gear[data[i]];
+
+        if (!(fp & CS_MASK_L))
+        {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+
+/**
+ *  Processes a block of 64 bytes of SHA-256.
+ *  @param h     Hash state
+ *  @param block Block
+ */
+static void
+cs_sha256_block(uint32_t* h, const unsigned char* block)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, k, t1, t2;
+
+#define CS_ROR(X, N) (((X) >> (N)) | ((X) << (32 - (N))))
+
+    for (int i = 0; i < 16; i++)
+    {
+        w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16 |
+               (uint32_t) block[4 * i + 2] << 8 | block[4 * i + 3];
+    }
+
+    for (int i = 16; i < 64; i++)
+    {
+        t1 = CS_ROR(w[i - 2], 17) ^ CS_ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        t2 = CS_ROR(w[i - 15], 7) ^ CS_ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        w[i] = w[i - 16] + t2 + w[i - 7] + t1;
+    }
+
+    a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+
+    for (int i = 0; i < 64; i++)
+    {
+        t1 = k + (CS_ROR(e, 6) ^ CS_ROR(e, 11) ^ CS_ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+             cs_k[i] + w[i];
+        t2 = (CS_ROR(a, 2) ^ CS_ROR(a, 13) ^ CS_ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g, g = f, f = e, e = d + t1, d = c, c = b, b = a, a = t1 + t2;
+    }
+
+#undef CS_ROR
+
+    h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e, h[5] += f, h[6] += g, h[7] += k;
+}
+
+
+/**
+ *  Opens the chunk store in the download directory. All chunks found are
+ *  indexed, their modification time is the time of their last use. The
+ *  store is disabled without download directory or if its size limit is 0.
+ *  @param cs           Pointer to chunk store, its size limit has been set
+ *  @param download_dir Download directory, empty if files are declined
+ *  @return 0 on success, -1 on error
+ */
+int
+init_chunk_store(chunk_store_t* cs, char* download_dir)
+{
+    DIR* dir;
+    struct dirent* ent;
+    struct stat st;
+    char path[CS_MAX_FILE_PATH + 1];
+    unsigned char hash[CS_HASH_LEN];
+
+    cs->dir[0] = '\0';
+    cs->entry = NULL;
+    cs->table = NULL;
+    cs->used = cs->size = cs->slots = 0;
+    cs->bytes = 0;
+    cs_rehash(cs, 1024);
+
+    if (download_dir[0] == '\0' || !cs->max)
+    {
+        return 0;
+    }
+
+    snprintf(cs->dir, sizeof(cs->dir), "%s/" CS_DIR, download_dir);
+
+    if (mkdir(cs->dir, 0700) == -1 && errno != EEXIST)
+    {
+        ui_log_errno(LOG_ERR, "Could not create chunk store '%s'!", cs->dir);
+        cs->dir[0] = '\0';
+        return -1;
+    }
+
+    if ((dir = opendir(cs->dir)) == NULL)
+    {
+        ui_log_errno(LOG_ERR, "Could not open chunk store '%s'!", cs->dir);
+        cs->dir[0] = '\0';
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (cs_parse_hash(ent->d_name, hash) == -1)
+        {
+            continue;
+        }
+
+        // the path is rebuilt from the hash, the name has been checked by it
+        cs_path(cs, hash, path);
+
+        // a chunk of illegal size has not been written by this client
+        if (stat(path, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size < 1 ||
+            st.st_size > CS_MAX_CHUNK || cs_find(cs, hash) != NULL)
+        {
+            continue;
+        }
+
+        cs_insert(cs, hash, st.st_size,
+                  (uint64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec);
+    }
+
+    closedir(dir);
+
+    // the limit may have been lowered since the last session
+    cs_evict(cs);
+
+    ui_log(LOG_INFO, "Chunk store '%s': %d chunks, %lld of %lld bytes!", cs->dir, cs->used,
+           cs->bytes, cs->max);
+    return 0;
+}
+
+
+/**
+ *  Frees the index of the chunk store, the chunks are kept.
+ *  @param cs Pointer to chunk store
+ */
+void
+destroy_chunk_store(chunk_store_t* cs)
+{
+    free(cs->entry);
+    free(cs->table);
+    cs->entry = NULL;
+    cs->table = NULL;
+    cs->used = cs->size = cs->slots = 0;
+}
+
+
+/**
+ *  Searches a chunk in the store and marks it as used, so that it is
+ *  evicted last.
+ *  @param cs   Pointer to chunk store
+ *  @param hash SHA-256 of chunk
+ *  @return pointer to entry or NULL if the chunk is not held
+ */
+cs_entry_t*
+cs_lookup(chunk_store_t* cs, unsigned char* hash)
+{
+    char path[CS_MAX_FILE_PATH + 1];
+    cs_entry_t* e;
+
+    if ((e = cs_find(cs, hash)) == NULL)
+    {
+        return NULL;
+    }
+
+    e->used = cs_now();
+    cs_path(cs, hash, path);
+
+    // the time of use outlasts the session (see: init_chunk_store())
+    if (utimensat(AT_FDCWD, path, NULL, 0) == -1 && errno == ENOENT)
+    {
+        ui_log(LOG_WARN, "Chunk '%s' has been removed from the store!", path);
+        return NULL;
+    }
+
+    return e;
+}
+
+
+/**
+ *  Searches a chunk in the index of the store.
+ *  @param cs   Pointer to chunk store
+ *  @param hash SHA-256 of chunk
+ *  @return pointer to entry or NULL if the chunk is not held
+ */
+cs_entry_t*
+cs_find(chunk_store_t* cs, unsigned char* hash)
+{
+    uint32_t slot;
+    int i;
+
+    // the hash is uniformly distributed, so its first bytes pick the slot
+    memcpy(&slot, hash, sizeof(slot));
+
+    for (slot &= cs->slots - 1; (i = cs->table[slot]) != -1; slot = (slot + 1) & (cs->slots - 1))
+    {
+        if (!memcmp(cs->entry[i].hash, hash, CS_HASH_LEN))
+        {
+            return &cs->entry[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ *  Reads a chunk from the store. The chunk is checked against its hash,
+ *  a damaged chunk is removed from the store by the next eviction.
+ *  @param cs  Pointer to chunk store
+ *  @param e   Pointer to entry of chunk
+ *  @param buf Buffer of at least CS_MAX_CHUNK bytes
+ *  @return 0 on success, -1 on error
+ */
+int
+cs_read(chunk_store_t* cs, cs_entry_t* e, char* buf)
+{
+    char path[CS_MAX_FILE_PATH + 1];
+    unsigned char hash[CS_HASH_LEN];
+    ssize_t ret = -1;
+    int fd;
+
+    cs_path(cs, e->hash, path);
+
+    if ((fd = open(path, O_RDONLY)) != -1)
+    {
+        ret = read(fd, buf, e->len);
+        close(fd);
+    }
+
+    if (ret != e->len)
+    {
+        ui_log_errno(LOG_WARN, "Could not read chunk '%s'!", path);
+        e->used = 0;
+        return -1;
+    }
+
+    cs_sha256((unsigned char*) buf, e->len, hash);
+
+    if (memcmp(hash, e->hash, CS_HASH_LEN))
+    {
+        ui_log(LOG_WARN, "Chunk '%s' is damaged!", path);
+        e->used = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Adds a chunk to the store. The chunk is written to a temporary file,
+ *  which is renamed to its hash, so that a chunk file is always complete.
+ *  If the store exceeds its size limit, the least recently used chunks
+ *  are evicted.
+ *  @param cs   Pointer to chunk store
+ *  @param hash SHA-256 of chunk
+ *  @param data Chunk
+ *  @param len  Length of chunk
+ *  @return 0 on success, -1 on error
+ */
+int
+cs_put(chunk_store_t* cs, unsigned char* hash, char* data, uint32_t len)
+{
+    char path[CS_MAX_FILE_PATH + 1];
+    char tmp[CS_MAX_FILE_PATH + 1];
+    ssize_t ret = -1;
+    int fd;
+
+    if (cs->dir[0] == '\0' || len < 1 || len > CS_MAX_CHUNK || cs_lookup(cs, hash) != NULL)
+    {
+        return 0;
+    }
+
+    cs_path(cs, hash, path);
+    snprintf(tmp, sizeof(tmp), "%s/tmp", cs->dir);
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) != -1)
+    {
+        ret = write(fd, data, len);
+
+        if (close(fd) == -1)
+        {
+            ret = -1;
+        }
+    }
+
+    if (ret != len || rename(tmp, path) == -1)
+    {
+        ui_log_errno(LOG_WARN, "Could not store chunk '%s'!", path);
+        unlink(tmp);
+        return -1;
+    }
+
+    cs_insert(cs, hash, len, cs_now());
+    cs->stored++;
+    cs_evict(cs);
+    return 0;
+}
+
+
+/**
+ *  Evicts the least recently used chunks, if the store exceeds its size
+ *  limit, until it is filled to CS_EVICT_TO percent of its limit, so that
+ *  evictions happen in batches. The index is rebuilt afterwards.
+ *  @param cs Pointer to chunk store
+ */
+void
+cs_evict(chunk_store_t* cs)
+{
+    char path[CS_MAX_FILE_PATH + 1];
+    long long target = cs->max / 100 * CS_EVICT_TO;
+    int i;
+
+    if (cs->bytes <= cs->max)
+    {
+        return;
+    }
+
+    qsort(cs->entry, cs->used, sizeof(cs_entry_t), cs_cmp_used);
+
+    for (i = 0; i < cs->used && cs->bytes > target; i++)
+    {
+        cs_path(cs, cs->entry[i].hash, path);
+
+        if (unlink(path) == -1 && errno != ENOENT)
+        {
+            ui_log_errno(LOG_WARN, "Could not evict chunk '%s'!", path);
+        }
+
+        cs->bytes -= cs->entry[i].len;
+        cs->evicted++;
+    }
+
+    cs->used -= i;
+    memmove(cs->entry, cs->entry + i, cs->used * sizeof(cs_entry_t));
+    cs_rehash(cs, cs->slots);
+}
+
+
+/**
+ *  Adds a chunk to the index of the store.
+ *  @param cs   Pointer to chunk store
+ *  @param hash SHA-256 of chunk
+ *  @param len  Length of chunk
+ *  @param used Time of last use in ns
+ *  @return index of entry
+ */
+int
+cs_insert(chunk_store_t* cs, unsigned char* hash, uint32_t len, uint64_t used)
+{
+    cs_entry_t* e;
+    uint32_t slot;
+
+    if (cs->used == cs->size)
+    {
+        cs->size = cs->size ? 2 * cs->size : 1024;
+
+        if ((cs->entry = realloc(cs->entry, cs->size * sizeof(cs_entry_t))) == NULL)
+        {
+            ui_fatal("Memory allocation for chunk store failed!");
+        }
+    }
+
+    // the table is kept at most half full, so that probing stays short
+    if (2 * (cs->used + 1) > cs->slots)
+    {
+        cs_rehash(cs, 2 * cs->slots);
+    }
+
+    e = &cs->entry[cs->used];
+    memcpy(e->hash, hash, CS_HASH_LEN);
+    e->len = len;
+    e->used = used;
+    cs->bytes += len;
+
+    memcpy(&slot, hash, sizeof(slot));
+
+    for (slot &= cs->slots - 1; cs->table[slot] != -1; slot = (slot + 1) & (cs->slots - 1));
+
+    cs->table[slot] = cs->used;
+    return cs->used++;
+}
+
+
+/**
+ *  Rebuilds the hash table of the store.
+ *  @param cs    Pointer to chunk store
+ *  @param slots Size of the table, a power of 2
+ */
+void
+cs_rehash(chunk_store_t* cs, int slots)
+{
+    uint32_t slot;
+
+    free(cs->table);
+    cs->slots = slots;
+
+    if ((cs->table = malloc(slots * sizeof(int))) == NULL)
+    {
+        ui_fatal("Memory allocation for chunk store failed!");
+    }
+
+    memset(cs->table, -1, slots * sizeof(int));
+
+    for (int i = 0; i < cs->used; i++)
+    {
+        memcpy(&slot, cs->entry[i].hash, sizeof(slot));
+
+        for (slot &= slots - 1; cs->table[slot] != -1; slot = (slot + 1) & (slots - 1));
+
+        cs->table[slot] = i;
+    }
+}
+
+
+/**
+ *  Splits a file into content-defined chunks and hashes them.
+ *  Files of more than CS_MAX_CHUNKS chunks are not chunked.
+ *  @param fd   File, read with pread(2)
+ *  @param size Size of file
+ *  @return chunk list of file, has to be released with cs_release(), or
+ *  NULL if the file could not be chunked
+ */
+cs_list_t*
+cs_chunk_file(int fd, off_t size)
+{
+    cs_list_t* list;
+    cs_chunk_t* c;
+    unsigned char* buf;
+    off_t off = 0;      // offset of buf in file
+    size_t have = 0;    // bytes in buf
+    size_t pos = 0;     // start of next chunk in buf
+    ssize_t ret;
+    int size_chunks = 0;
+
+    // chunks are CS_AVG_CHUNK bytes long on average
+    if (size > (off_t) CS_MAX_CHUNKS * CS_AVG_CHUNK)
+    {
+        return NULL;
+    }
+
+    if (!cs_gear_ready)
+    {
+        cs_init_gear();
+    }
+
+    if ((buf = malloc(CS_BUF_LEN)) == NULL)
+    {
+        ui_fatal("Memory allocation for chunk buffer failed!");
+    }
+
+    list = cs_new_list(0);
+
+    while (off + (off_t) pos < size)
+    {
+        // a chunk is cut from at least CS_MAX_CHUNK bytes, unless the
+        // end of the file is closer
+        if (have - pos < CS_MAX_CHUNK && off + (off_t) have < size)
+        {
+            memmove(buf, buf + pos, have - pos);
+            off += pos;
+            have -= pos;
+            pos = 0;
+
+            while (have < CS_BUF_LEN && off + (off_t) have < size)
+            {
+                if ((ret = pread(fd, buf + have, CS_BUF_LEN - have, off + have)) <= 0)
+                {
+                    ui_log_errno(LOG_WARN, "Could not read file to be chunked!");
+                    free(buf);
+                    cs_release(list);
+                    return NULL;
+                }
+
+                have += ret;
+            }
+        }
+
+        if (list->count == CS_MAX_CHUNKS)
+        {
+            free(buf);
+            cs_release(list);
+            return NULL;
+        }
+
+        if (list->count == size_chunks)
+        {
+            size_chunks = size_chunks ? 2 * size_chunks : 64;
+
+            if ((list->chunk = realloc(list->chunk, size_chunks * sizeof(cs_chunk_t))) == NULL)
+            {
+                ui_fatal("Memory allocation for chunk list failed!");
+            }
+        }
+
+        c = &list->chunk[list->count++];
+        c->off = off + pos;
+        c->len = cs_cut(buf + pos, have - pos);
+        cs_sha256(buf + pos, c->len, c->hash);
+        pos += c->len;
+    }
+
+    free(buf);
+    return list;
+}
+
+
+/**
+ *  Allocates a chunk list with a reference of the caller.
+ *  @param count Amount of chunks
+ *  @return chunk list, has to be released with cs_release()
+ */
+cs_list_t*
+cs_new_list(int count)
+{
+    cs_list_t* list;
+
+    if ((list = calloc(1, sizeof(cs_list_t))) == NULL ||
+        (count && (list->chunk = calloc(count, sizeof(cs_chunk_t))) == NULL))
+    {
+        ui_fatal("Memory allocation for chunk list failed!");
+    }
+
+    list->count = count;
+    list->refs = 1;
+    return list;
+}
+
+
+/**
+ *  Releases a reference to a chunk list, the last one frees it.
+ *  @param list Pointer to chunk list or NULL
+ */
+void
+cs_release(cs_list_t* list)
+{
+    if (list != NULL && !--list->refs)
+    {
+        free(list->chunk);
+        free(list);
+    }
+}
+
+
+/**
+ *  Encodes records of a chunk list: the length of each chunk in network
+ *  byte order followed by its SHA-256.
+ *  @param list  Pointer to chunk list
+ *  @param first Index of first chunk
+ *  @param recs  Amount of records
+ *  @param buf   Buffer of at least recs * CS_REC_LEN bytes
+ *  @return length of records
+ */
+int
+cs_encode(cs_list_t* list, int first, int recs, char* buf)
+{
+    uint32_t len;
+
+    for (int i = 0; i < recs; i++, buf += CS_REC_LEN)
+    {
+        len = htonl(list->chunk[first + i].len);
+        memcpy(buf, &len, sizeof(len));
+        memcpy(buf + sizeof(len), list->chunk[first + i].hash, CS_HASH_LEN);
+    }
+
+    return recs * CS_REC_LEN;
+}
+
+
+/**
+ *  Decodes records of a chunk list (see: cs_encode()). The offsets of the
+ *  chunks follow from the lengths of the chunks in front of them.
+ *  @param list  Pointer to chunk list
+ *  @param first Index of first chunk, the chunks in front are decoded
+ *  @param data  Records
+ *  @param recs  Amount of records, fit into the list
+ *  @return 0 on success, -1 if a chunk has an illegal length
+ */
+int
+cs_decode(cs_list_t* list, int first, char* data, int recs)
+{
+    cs_chunk_t* c;
+    uint32_t len;
+    off_t off = first ? list->chunk[first - 1].off + list->chunk[first - 1].len : 0;
+
+    for (int i = 0; i < recs; i++, data += CS_REC_LEN)
+    {
+        c = &list->chunk[first + i];
+        memcpy(&len, data, sizeof(len));
+        len = ntohl(len);
+
+        if (len < 1 || len > CS_MAX_CHUNK)
+        {
+            return -1;
+        }
+
+        c->off = off;
+        c->len = len;
+        memcpy(c->hash, data + sizeof(len), CS_HASH_LEN);
+        off += len;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Searches the chunk of a chunk list containing an offset of the file.
+ *  @param list Pointer to chunk list
+ *  @param off  Offset in file
+ *  @param from Index of a chunk not behind the offset
+ *  @return index of chunk, list->count if the offset is the end of the file
+ */
+int
+cs_find_chunk(cs_list_t* list, off_t off, int from)
+{
+    int lo = from;
+    int hi = list->count;
+    int mid;
+
+    // the first chunk ending behind the offset
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if (list->chunk[mid].off + list->chunk[mid].len > off)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+
+    return lo;
+}
+
+
+/**
+ *  Calculates the SHA-256 of the given bytes.
+ *  @param data Bytes
+ *  @param len  Amount of bytes
+ *  @param hash Buffer of CS_HASH_LEN bytes for the hash
+ */
+void
+cs_sha256(unsigned char* data, size_t len, unsigned char* hash)
+{
+    uint32_t h[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    unsigned char last[128];    // remaining bytes and padding
+    size_t rest = len % 64;
+    size_t pad;
+    uint64_t bits = (uint64_t) len * 8;
+
+    for (size_t i = 0; i + 64 <= len; i += 64)
+    {
+        cs_sha256_block(h, data + i);
+    }
+
+    memcpy(last, data + len - rest, rest);
+    last[rest] = 0x80;
+    pad = rest < 56 ? 64 : 128;
+    memset(last + rest + 1, 0, pad - rest - 1);
+
+    for (int i = 0; i < 8; i++)
+    {
+        last[pad - 1 - i] = bits >> (8 * i);
+    }
+
+    for (size_t i = 0; i < pad; i += 64)
+    {
+        cs_sha256_block(h, last + i);
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        hash[4 * i] = h[i] >> 24;
+        hash[4 * i + 1] = h[i] >> 16;
+        hash[4 * i + 2] = h[i] >> 8;
+        hash[4 * i + 3] = h[i];
+    }
+}
+
+
+/**
+ *  Builds the path of the file of a chunk.
+ *  @param cs   Pointer to chunk store
+ *  @param hash SHA-256 of chunk
+ *  @param path Buffer of at least CS_MAX_FILE_PATH + 1 bytes
+ */
+void
+cs_path(chunk_store_t* cs, unsigned char* hash, char* path)
+{
+    int len = snprintf(path, CS_MAX_FILE_PATH + 1, "%s/", cs->dir);
+
+    for (int i = 0; i < CS_HASH_LEN; i++)
+    {
+        len += snprintf(path + len, CS_MAX_FILE_PATH + 1 - len, "%02x", hash[i]);
+    }
+}
+
+
+/**
+ *  Parses the name of a chunk file, the hex digits of its SHA-256.
+ *  @param name Name of file
+ *  @param hash Buffer of CS_HASH_LEN bytes for the hash
+ *  @return 0 on success, -1 if the name is not the name of a chunk
+ */
+int
+cs_parse_hash(char* name, unsigned char* hash)
+{
+    unsigned int byte;
+
+    if (strlen(name) != 2 * CS_HASH_LEN || strspn(name, "0123456789abcdef") != 2 * CS_HASH_LEN)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < CS_HASH_LEN; i++)
+    {
+        sscanf(name + 2 * i, "%2x", &byte);
+        hash[i] = byte;
+    }
+
+    return 0;
+}
@@ -26,12 +26,27 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
 #include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
 
 #include "dchat_h/cmdinterpreter.h"
 #include "dchat_h/types.h"
 #include "dchat_h/util.h"
 #include "dchat_h/consoleui.h"
+#include "dchat_h/connector.h"
+#include "dchat_h/overlay.h"
+#include "dchat_h/cache.h"
+#include "dchat_h/reconnect.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/filetransfer.h"
+#include "dchat_h/msglog.h"
+#include "dchat_h/search.h"
+#include "dchat_h/compress.h"
+#include "dchat_h/fragment.h"
+#include "dchat_h/swarm.h"
+#include "dchat_h/checksum.h"
 
 
 /**
@@ -105,7 +120,14 @@ init_cmds(cmds_t* cmds)
     {
         COMMAND(CMD_ID_HLP, CMD_NAME_HLP, CMD_ARG_HLP, hlp_exec),
         COMMAND(CMD_ID_CON, CMD_NAME_CON, CMD_ARG_CON, con_exec),
-        COMMAND(CMD_ID_LST, CMD_NAME_LST, CMD_ARG_LST, lst_exec)
+        COMMAND(CMD_ID_LST, CMD_NAME_LST, CMD_ARG_LST, lst_exec),
+        COMMAND(CMD_ID_STA, CMD_NAME_STA, CMD_ARG_STA, sta_exec),
+        COMMAND(CMD_ID_CIR, CMD_NAME_CIR, CMD_ARG_CIR, cir_exec),
+        COMMAND(CMD_ID_REC, CMD_NAME_REC, CMD_ARG_REC, rec_exec),
+        COMMAND(CMD_ID_BEN, CMD_NAME_BEN, CMD_ARG_BEN, ben_exec),
+        COMMAND(CMD_ID_SND, CMD_NAME_SND, CMD_ARG_SND, snd_exec),
+        COMMAND(CMD_ID_SEA, CMD_NAME_SEA, CMD_ARG_SEA, sea_exec),
+        COMMAND(CMD_ID_SHR, CMD_NAME_SHR, CMD_ARG_SHR, shr_exec)
     };
     temp_size = sizeof(temp) / sizeof(temp[0]);
 
@@ -185,13 +207,8 @@ con_exec(char* arg)
         return 1;
     }
 
-    // write onion address to connector pipe
-    if (write(_cnf->connect_fd[1], address, ONION_ADDRLEN) == -1)
-    {
-        return -1;
-    }
-
-    if (write(_cnf->connect_fd[1], &port, sizeof(uint16_t)) == -1)
+    // queue connection request for the connector threads
+    if (enqueue_conn(&_cnf->cq, address, port, NULL, 0, CONN_PRIO_USER) == -1)
     {
         return -1;
     }
@@ -226,9 +243,550 @@ lst_exec(char* arg)
                 ui_log(LOG_NOTICE, "Contact................%s", _cnf->cl.contact[i].name);
                 ui_log(LOG_NOTICE, "Onion-ID...............%s", _cnf->cl.contact[i].onion_id);
                 ui_log(LOG_NOTICE, "Hidden-Port............%hu", _cnf->cl.contact[i].lport);
+                ui_log(LOG_NOTICE, "Protocol...............DChat/%.1f",
+                       _cnf->cl.contact[i].version == DCHAT_V2 ? DCHAT_V2 : DCHAT_V1);
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * Prints traffic statistics of this client.
+ * @return 0 on success, 1 on syntax error, -1 otherwise
+ */
+int
+sta_exec(char* arg)
+{
+    dchat_stats_t* stats = &_cnf->stats;
+    socks_endpoint_t* ep;       // TOR client
+    file_transfer_t* ft;        // file transfer in progress
+    ft_link_t* link;            // chunks in flight to contact
+    swarm_t* sw;                // swarm of a shared file
+    int peers;                  // members of a swarm
+    char ip[INET_ADDRSTRLEN];   // address of TOR client
+    int n;                      // index of contact
+    dchat_content_types_t ctt;  // names of content types
+    zc_count_t* zc;             // compression of a content type
+    int accepting = 0;          // contacts accepting deflated PDUs
+
+    ui_log(LOG_NOTICE, "Contactlist-Version....%u", _cnf->cl.version);
+    ui_log(LOG_NOTICE, "Digests-Sent...........%lu (%lu bytes)", stats->dgs_pdus,
+           stats->dgs_bytes);
+    ui_log(LOG_NOTICE, "Discovers-Sent.........%lu (%lu bytes)", stats->dsc_pdus,
+           stats->dsc_bytes);
+    ui_log(LOG_NOTICE, "Contacts-Sent..........%lu", stats->dsc_contacts);
+    ui_log(LOG_NOTICE, "Coalescing-Window......%d us, max. %d bytes", _cnf->co_window,
+           _cnf->co_max);
+    ui_log(LOG_NOTICE, "Cells-Per-Message......%.2f before, %.2f after (%lu PDUs, %lu writes)",
+           stats->pdus ? (double) stats->pdu_cells / stats->pdus : 0.0,
+           stats->pdus ? (double) stats->write_cells / stats->pdus : 0.0,
+           stats->pdus, stats->writes);
+    ui_log(LOG_NOTICE, "Bytes-Per-PDU..........%.1f (%lu bytes)",
+           stats->pdus ? (double) stats->pdu_bytes / stats->pdus : 0.0, stats->pdu_bytes);
+
+    for (int i = 0; i < _cnf->cl.cl_size; i++)
+    {
+        accepting += _cnf->cl.contact[i].fd && _cnf->cl.contact[i].zc.offered;
+    }
+
+    ui_log(LOG_NOTICE, "Compression............%s, min. %d bytes, %d contacts accepting",
+           _cnf->zc.min ? ZC_ENCODING : "off", _cnf->zc.min, accepting);
+    init_dchat_content_types(&ctt);
+
+    // ratio and CPU time per content type, in both directions
+    for (int i = 0; i < CTT_AMOUNT * 2; i++)
+    {
+        if ((n = ctt.type[i % CTT_AMOUNT].ctt_id) >= ZC_MAX_TYPES)
+        {
+            continue;
+        }
+
+        zc = i < CTT_AMOUNT ? &_cnf->zc.deflated[n] : &_cnf->zc.inflated[n];
+
+        if (zc->pdus)
+        {
+            ui_log(LOG_NOTICE, "%s...............%s: %lu PDUs, %lu -> %lu bytes (%.1f%%), "
+                   "%.1f us CPU per PDU", i < CTT_AMOUNT ? "Deflated" : "Inflated",
+                   ctt.type[i % CTT_AMOUNT].ctt_name, zc->pdus, zc->in, zc->out,
+                   zc->in ? 100.0 * zc->out / zc->in : 0.0, zc->ns / 1000.0 / zc->pdus);
+        }
+    }
+
+    ui_log(LOG_NOTICE, "Fragmented-Messages....%lu sent (%lu fragments), %lu reassembled, "
+           "%lu expired, %lu dropped", _cnf->fg.sent, _cnf->fg.fragments,
+           _cnf->fg.reassembled, _cnf->fg.expired, _cnf->fg.dropped);
+    ui_log(LOG_NOTICE, "Reassembly-Buffers.....%ld bytes, peak %ld of max. %d bytes",
+           _cnf->fg.bytes, _cnf->fg.peak, FG_MAX_BYTES);
+    pthread_mutex_lock(&_cnf->cq.cq_mx);
+    ui_log(LOG_NOTICE, "Connects-Pending.......%d", _cnf->cq.used - _cnf->cq.inflight);
+    ui_log(LOG_NOTICE, "Connects-In-Flight.....%d", _cnf->cq.inflight);
+    pthread_mutex_unlock(&_cnf->cq.cq_mx);
+
+    if (_cnf->ovl.enabled)
+    {
+        ui_log(LOG_NOTICE, "Active-View............%d/%d", ovl_active_count(-1),
+               _cnf->ovl.degree);
+        ui_log(LOG_NOTICE, "Passive-View...........%d/%d", _cnf->ovl.passive_used,
+               OVL_PASSIVE_SIZE);
+        ui_log(LOG_NOTICE, "Messages-Forwarded.....%lu", _cnf->ovl.fwd_pdus);
+    }
+
+    ui_log(LOG_NOTICE, "Seen-Set...............%zu KB, %d hashes, %d x %d ids",
+           _cnf->seen.memory, _cnf->seen.hashes, SEEN_BUCKETS, _cnf->seen.capacity);
+    ui_log(LOG_NOTICE, "Duplicates-Dropped.....%lu of %lu", _cnf->seen.dups,
+           _cnf->seen.lookups);
+    ui_log(LOG_NOTICE, "Cached-Contacts........%d/%d", cache_used(&_cnf->cache),
+           CACHE_RECORDS);
+    ui_log(LOG_NOTICE, "Cache-Reconnects.......%lu", _cnf->cache.reconnects);
+
+    if (_cnf->wp.budget)
+    {
+        pthread_mutex_lock(&_cnf->wp.wp_mx);
+        ui_log(LOG_NOTICE, "Warm-Pool..............%d/%d ready, %lu built, %lu claimed, "
+               "%lu expired", _cnf->wp.used, _cnf->wp.budget, _cnf->wp.built,
+               _cnf->wp.claimed, _cnf->wp.expired);
+        pthread_mutex_unlock(&_cnf->wp.wp_mx);
+    }
+
+    ui_log(LOG_NOTICE, "File-Transfers.........%d in progress, %lu completed, %lu bytes sent, "
+           "%lu bytes received", _cnf->ft.used, _cnf->ft.completed, _cnf->ft.sent_bytes,
+           _cnf->ft.recv_bytes);
+
+    if (_cnf->cs.dir[0] != '\0' || _cnf->ft.saved_bytes)
+    {
+        ui_log(LOG_NOTICE, "Chunk-Store............%d chunks, %lld/%lld bytes, %lu stored, "
+               "%lu evicted, %lu hits (%llu bytes), %lu bytes of files skipped",
+               _cnf->cs.used, _cnf->cs.bytes, _cnf->cs.max, _cnf->cs.stored,
+               _cnf->cs.evicted, _cnf->cs.hits, _cnf->cs.hit_bytes, _cnf->ft.saved_bytes);
+    }
+
+    if (_cnf->sw.used || _cnf->sw.completed)
+    {
+        ui_log(LOG_NOTICE, "Swarms.................%d active, %lu completed, %lu bytes sent, "
+               "%lu bytes received", _cnf->sw.used, _cnf->sw.completed, _cnf->sw.up_bytes,
+               _cnf->sw.down_bytes);
+    }
+
+    for (int i = 0; i < _cnf->sw.used; i++)
+    {
+        sw = &_cnf->sw.sw[i];
+        peers = 0;
+
+        for (int k = 0; k < SW_MAX_PEERS; k++)
+        {
+            peers += sw->peer[k].used && sw->peer[k].joined;
+        }
+
+        ui_log(LOG_NOTICE, "Swarm..................%08x '%s' %d/%d pieces, %d peers, "
+               "%lu bytes sent, %lu bytes received%s", sw->id, sw->name, sw->held,
+               sw->pieces, peers, sw->up, sw->down,
+               sw->recs < sw->list->count ? " (listing)" : "");
+    }
+
+    for (int i = 0; i < _cnf->ft.used; i++)
+    {
+        ft = &_cnf->ft.ft[i];
+        ui_log(LOG_NOTICE, "File-Transfer..........'%s' %s '%s:%hu' %lld/%lld bytes%s",
+               ft->name, ft->dir == FT_SEND ? "to" : "from", ft->onion_id, ft->lport,
+               (long long) ft->offset, (long long) ft->size,
+               ft->state == FT_OFFERED ? " (offered)" : "");
+
+        // the round trip of chunks above the min. is the time a chat
+        // message queues up behind them
+        if (ft->dir == FT_SEND && (n = ft_contact(ft)) != -1)
+        {
+            link = &_cnf->cl.contact[n].link;
+            ui_log(LOG_NOTICE, "File-Window............%ld/%ld bytes in flight, %ld bytes/s, "
+                   "rtt %ld ms, queued %ld ms (max. %d ms)", link->inflight,
+                   ft_window(&_cnf->ft, link), link->rate, link->min_rtt / 1000,
+                   (link->srtt - link->min_rtt) / 1000, _cnf->ft.latency);
+        }
+    }
+
+    if (_cnf->ck.sent || _cnf->ck.verified || _cnf->ck.failed)
+    {
+        ui_log(LOG_NOTICE, "Checksums..............%s, %lu chunks sent with CRC-32C, %lu "
+               "verified, %lu failed", _cnf->ck.kernel, _cnf->ck.sent, _cnf->ck.verified,
+               _cnf->ck.failed);
+    }
+
+    if (_cnf->ml.used)
+    {
+        ui_log(LOG_NOTICE, "Message-Log............%d segments, %zu bytes, %lu messages "
+               "appended, %lu replayed on %lu requests, %lu segments removed", _cnf->ml.used,
+               ml_size(&_cnf->ml), _cnf->ml.appended, _cnf->ml.replayed, _cnf->ml.requests,
+               _cnf->ml.removed);
+    }
+
+    if (_cnf->si.path[0] != '\0')
+    {
+        ui_log(LOG_NOTICE, "Search-Index...........%u terms (%zu bytes mapped), %d new terms "
+               "(%zu bytes), %lu messages indexed, %lu merges, %lu queries", _cnf->si.terms,
+               _cnf->si.map != NULL ? _cnf->si.size : (size_t) 0, _cnf->si.lists,
+               _cnf->si.bytes, _cnf->si.indexed, _cnf->si.merges, _cnf->si.queries);
+    }
+
+    if (_cnf->seeds.used)
+    {
+        ui_log(LOG_NOTICE, "Seeds-Kept.............%d/%d", _cnf->seeds.kept,
+               _cnf->seeds.used);
+        ui_log(LOG_NOTICE, "Seeds-Failed...........%d", _cnf->seeds.failed);
+        ui_log(LOG_NOTICE, "Seeds-Canceled.........%d", _cnf->seeds.canceled);
+    }
+
+    pthread_mutex_lock(&_cnf->socks.sp_mx);
+
+    for (int i = 0; i < _cnf->socks.used; i++)
+    {
+        ep = &_cnf->socks.ep[i];
+        inet_ntop(AF_INET, &ep->sa.sin_addr, ip, sizeof(ip));
+        ui_log(LOG_NOTICE, "Tor-Client.............%s:%hu %s, %d outstanding, %u ms, "
+               "%lu granted, %lu failed", ip, ntohs(ep->sa.sin_port),
+               ep->down_until > time(NULL) ? "down" : "up", ep->outstanding, ep->latency,
+               ep->granted, ep->failed);
+    }
+
+    pthread_mutex_unlock(&_cnf->socks.sp_mx);
+    return 0;
+}
+
+
+/**
+ * Prints the circuit build times per group of isolated peers, so that
+ * the effect of the stream isolation policy can be compared. Without
+ * isolation all peers are reported in one group, with per peer isolation
+ * peers are reported in SOCKS_MAX_GROUPS buckets.
+ * @return 0 on success, 1 on syntax error, -1 otherwise
+ */
+int
+cir_exec(char* arg)
+{
+    socks_pool_t* sp = &_cnf->socks;
+    socks_group_t* g;   // group of peers
+
+    if (sp->isolate == SOCKS_ISO_NONE)
+    {
+        ui_log(LOG_NOTICE, "Isolation..............none");
+    }
+    else if (sp->isolate == SOCKS_ISO_PEER)
+    {
+        ui_log(LOG_NOTICE, "Isolation..............peer");
+    }
+    else
+    {
+        ui_log(LOG_NOTICE, "Isolation..............%d groups", sp->isolate);
+    }
+
+    pthread_mutex_lock(&sp->sp_mx);
+
+    for (int i = 0; i < SOCKS_MAX_GROUPS; i++)
+    {
+        g = &sp->grp[i];
+
+        if (!g->granted && !g->rejected && !g->failed)
+        {
+            continue;
+        }
+
+        ui_log(LOG_NOTICE, "Circuit-Group..........%d: %u ms (min %u, max %u), %lu granted, "
+               "%lu rejected, %lu failed", i, g->latency, g->min_latency, g->max_latency,
+               g->granted, g->rejected, g->failed);
+    }
+
+    pthread_mutex_unlock(&sp->sp_mx);
+    return 0;
+}
+
+
+/**
+ * Prints the lost contacts waiting to be reconnected.
+ * @return 0 on success, 1 on syntax error, -1 otherwise
+ */
+int
+rec_exec(char* arg)
+{
+    reconnect_list_t* rl = &_cnf->rc;
+    reconnect_t* rc;        // lost contact
+    struct timespec now;
+    char* state[] = { "waiting", "queued", "up" }; // see: RC_*
+
+    if (!rl->enabled)
+    {
+        ui_log(LOG_NOTICE, "Reconnects are disabled in overlay mode!");
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&rl->rc_mx);
+    ui_log(LOG_NOTICE, "Reconnects-Queued......%lu", rl->scheduled);
+    ui_log(LOG_NOTICE, "Reconnects-Healed......%lu", rl->healed);
+    ui_log(LOG_NOTICE, "Reconnects-Dropped.....%lu", rl->dropped);
+
+    for (int i = 0; i < rl->used; i++)
+    {
+        rc = &rl->peer[i];
+        ui_log(LOG_NOTICE, "Reconnect..............%s:%hu %s %s %ld s, %d failed, score %d/%d",
+               rc->onion_id, rc->lport, state[rc->state],
+               rc->state == RC_WAITING ? "in" : "since",
+               labs(rc->due.tv_sec - now.tv_sec), rc->attempts, rc->score, RC_MAX_SCORE);
+    }
+
+    pthread_mutex_unlock(&rl->rc_mx);
+    return 0;
+}
+
+
+/**
+ * Compares the framings of both protocol versions. A typical chat message
+ * is encoded COUNT times with each framing, written to a pipe and parsed
+ * again with read_pdu(), so that the bytes sent per message and the time
+ * spent parsing a message can be compared. Then the throughput of the
+ * checksum kernels is measured over a random buffer checksummed COUNT
+ * times (see: ben_checksums()).
+ * @return 0 on success, 1 on syntax error, -1 otherwise
+ */
+int
+ben_exec(char* arg)
+{
+    dchat_pdu_t pdu;            // typical chat message
+    dchat_pdu_t rx;             // parsed chat message
+    float version[] = { DCHAT_V1, DCHAT_V2 };
+    char* frame;                // encoded chat message
+    char* batch;                // chat messages fitting into the pipe
+    int len;                    // length of encoded chat message
+    int n;                      // chat messages per batch
+    int fd[2];                  // pipe
+    long count = BEN_DEF_COUNT; // chat messages per framing
+    long ns;                    // time spent parsing
+    char* endptr;
+    struct timespec start;
+    struct timespec end;
+
+    if ((arg = remove_leading_spaces(arg)) != NULL && *arg != '\0')
+    {
+        count = strtol(arg, &endptr, 10);
+
+        if (count < 1 || count > BEN_MAX_COUNT || (*endptr != '\0' && !isspace(*endptr)))
+        {
+            ui_log(LOG_WARN, "Invalid count '%s'!", arg);
+            return 1;
+        }
+    }
+
+    if (pipe(fd) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Could not create pipe for benchmark!");
+        return -1;
+    }
+
+    init_dchat_pdu(&pdu, DCHAT_V1, CTT_ID_TXT, _cnf->me.onion_id, _cnf->me.lport,
+                   _cnf->me.name);
+    init_dchat_pdu_content(&pdu, BEN_MESSAGE, strlen(BEN_MESSAGE));
+    init_dchat_pdu_msg_id(&pdu, _cnf->msg_seq);
+
+    for (int v = 0; v < (int) (sizeof(version) / sizeof(version[0])); v++)
+    {
+        if ((len = encode_frame(&pdu, version[v], &frame)) == -1)
+        {
+            break;
+        }
+
+        // batches must fit into the pipe, otherwise the writes would block
+        n = BEN_PIPE_SIZE / len;
+
+        if ((batch = malloc(n * len)) == NULL)
+        {
+            ui_fatal("Memory allocation for benchmark failed!");
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            memcpy(batch + i * len, frame, len);
+        }
+
+        ns = 0;
+
+        for (long done = 0; done < count; done += n)
+        {
+            if (n > count - done)
+            {
+                n = count - done;
+            }
+
+            if (write(fd[1], batch, n * len) != n * len)
+            {
+                ui_log_errno(LOG_ERR, "Could not write benchmark to pipe!");
+                break;
             }
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+
+            for (int i = 0; i < n; i++)
+            {
+                if (read_pdu(fd[0], &rx, &_cnf->me) == -1)
+                {
+                    break;
+                }
+
+                free_pdu(&rx);
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            ns += (end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+        }
+
+        ui_log(LOG_NOTICE, "Bench-DChat/%.1f........%d bytes/msg, %ld ns/msg parse",
+               version[v], len, ns / count);
+        free(batch);
+        free(frame);
+    }
+
+    free_pdu(&pdu);
+    close(fd[0]);
+    close(fd[1]);
+    return ben_checksums(count);
+}
+
+
+/**
+ * Measures the throughput of the CRC-32C kernels over a buffer in memory,
+ * which is filled with pseudo-random bytes and as large as a chunk of a
+ * file. No file is read. The kernel with SSE4.2 is only measured if the
+ * CPU supports it.
+ * @param count Amount of times the buffer is checksummed per kernel
+ * @return 0 on success, -1 if the kernels disagree
+ */
+int
+ben_checksums(long count)
+{
+    uint32_t (*kernel[])(uint32_t, const void*, size_t) = { ck_crc32c_sw, ck_crc32c_hw };
+    char* name[] = { "slicing-by-8", "sse4.2" };
+    uint32_t crc[2] = { 0, 0 };     // checksum of the chunks per kernel
+    unsigned char* chunk;           // random buffer of BEN_CHUNK_LEN bytes
+    int kernels = ck_hw() ? 2 : 1;  // kernels measured
+    long ns;                        // time spent checksumming
+    struct timespec start;
+    struct timespec end;
+
+    if ((chunk = malloc(BEN_CHUNK_LEN)) == NULL)
+    {
+        ui_fatal("Memory allocation for benchmark failed!");
+    }
+
+    for (int i = 0; i < BEN_CHUNK_LEN; i++)
+    {
+        chunk[i] = rand();
+    }
+
+    for (int k = 0; k < kernels; k++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (long i = 0; i < count; i++)
+        {
+            crc[k] = kernel[k](crc[k], chunk, BEN_CHUNK_LEN);
         }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ns = (end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+        ui_log(LOG_NOTICE, "Bench-CRC32C...........%s: %d bytes/chunk, %ld ns/chunk, "
+               "%.0f MB/s", name[k], BEN_CHUNK_LEN, ns / count,
+               ns ? (double) BEN_CHUNK_LEN * count * 1000 / ns : 0.0);
+    }
+
+    free(chunk);
+
+    if (kernels == 2 && crc[0] != crc[1])
+    {
+        ui_log(LOG_ERR, "Checksum kernels disagree (%08x, %08x)!", crc[0], crc[1]);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Trims the path given as argument of a command sending a file. Spaces
+ * within the path are kept.
+ * @param arg Argument of the command
+ * @return Pointer to the path within arg, NULL if there is none
+ */
+static char*
+file_arg(char* arg)
+{
+    char* end;
+
+    if ((arg = remove_leading_spaces(arg)) == NULL || *arg == '\0')
+    {
+        return NULL;
+    }
+
+    // the path may contain spaces, but not the line break
+    for (end = arg + strlen(arg); end > arg && isspace(end[-1]); end--);
+
+    *end = '\0';
+
+    if (*arg == '\0')
+    {
+        return NULL;
+    }
+
+    return arg;
+}
+
+
+/**
+ * Offers a file to all contacts accepting files. The file is sent to
+ * every contact that accepts it (see: ft_send()).
+ * @return 0 on success, 1 on syntax error, -1 otherwise
+ */
+int
+snd_exec(char* arg)
+{
+    if ((arg = file_arg(arg)) == NULL)
+    {
+        return 1;
+    }
+
+    ft_send(&_cnf->ft, arg);
+    return 0;
+}
+
+
+/**
+ * Searches the message log for the messages containing all given terms
+ * and displays the newest of them (see: si_query()).
+ * @return 0 on success, 1 on syntax error, -1 otherwise
+ */
+int
+sea_exec(char* arg)
+{
+    if (arg == NULL)
+    {
+        return 1;
+    }
+
+    return si_query(&_cnf->si, &_cnf->ml, arg);
+}
+
+
+/**
+ * Shares a file with the contacts joining swarms. Every contact receiving
+ * the file passes it on to the others (see: sw_share()).
+ * @return 0 on success, 1 on syntax error, -1 otherwise
+ */
+int
+shr_exec(char* arg)
+{
+    if ((arg = file_arg(arg)) == NULL)
+    {
+        return 1;
     }
 
+    sw_share(&_cnf->sw, arg);
     return 0;
 }
@@ -0,0 +1,276 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/** @file compress.c
+ *  This file contains the compression of PDUs. Clients offer to accept
+ *  deflated PDUs by ZC_OFFER in the Server header of their hello. The
+ *  content of a PDU sent to such a contact is deflated, if its content type
+ *  is one of ZC_TYPES and it is at least as long as the min. length. Such
+ *  PDUs carry the header "Content-Encoding: deflate" (DChat/1) or the flag
+ *  V2_FLG_DEF (DChat/2), their Content-Length is the length of the deflated
+ *  content. The content of all PDUs sent over a connection is a single
+ *  deflate stream, so the receiver has to inflate every deflated PDU in
+ *  the order received, even if it is dropped afterwards.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "dchat_h/compress.h"
+#include "dchat_h/types.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Deflates the content of a PDU sent to a contact, if the contact accepts
+ *  it and the content is eligible. The PDU is copied with the deflated
+ *  content, the copy shares all other members with the PDU.
+ *  @param zs   Pointer to compression of the connection
+ *  @param pdu  Pointer to PDU
+ *  @param zpdu Pointer to which the copy is stored, only its content has
+ *              to be freed
+ *  @return 0 if the content has been deflated, 1 if it is sent as is (the
+ *          stream is ended, if it fails, see: zc_abort())
+ */
+int
+zc_deflate(zc_stream_t* zs, dchat_pdu_t* pdu, dchat_pdu_t* zpdu)
+{
+    struct timespec start;
+    unsigned char* buf;
+    int size = pdu->content_length + ZC_SLACK;
+    int len;
+    zc_count_t* cnt;
+
+    // the deflated content must not exceed the max. Content-Length
+    if (!zs->offered || !_cnf->zc.min || pdu->content_length < _cnf->zc.min ||
+        pdu->content_type >= ZC_MAX_TYPES || !(ZC_TYPES & (1 << pdu->content_type)) ||
+        !is_valid_content_length(pdu->content_type, size))
+    {
+        return 1;
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+    if (zs->def == NULL)
+    {
+        if ((zs->def = calloc(1, sizeof(z_stream))) == NULL)
+        {
+            ui_fatal("Memory allocation for deflate stream failed!");
+        }
+
+        if (deflateInit2(zs->def, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -ZC_WINDOW_BITS,
+                         ZC_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            ui_log(LOG_ERR, "Could not create deflate stream!");
+            free(zs->def);
+            zs->def = NULL;
+            zs->offered = 0;
+            return 1;
+        }
+
+        deflateSetDictionary(zs->def, (unsigned char*) ZC_DICTIONARY,
+                             sizeof(ZC_DICTIONARY) - 1);
+    }
+
+    if ((buf = malloc(size)) == NULL)
+    {
+        ui_fatal("Memory allocation for deflated content failed!");
+    }
+
+    zs->def->next_in = (unsigned char*) pdu->content;
+    zs->def->avail_in = pdu->content_length;
+    zs->def->next_out = buf;
+    zs->def->avail_out = size;
+
+    // the flush ends every PDU with ZC_TAIL, which is restored by the receiver
+    if (deflate(zs->def, Z_SYNC_FLUSH) != Z_OK || zs->def->avail_in ||
+        !zs->def->avail_out || (len = size - zs->def->avail_out) < ZC_TAIL_LEN ||
+        memcmp(buf + len - ZC_TAIL_LEN, ZC_TAIL, ZC_TAIL_LEN))
+    {
+        // the stream has moved on, the receiver would not follow it anymore
+        ui_log(LOG_ERR, "Could not deflate PDU - sending uncompressed PDUs from now on!");
+        free(buf);
+        zc_abort(zs);
+        return 1;
+    }
+
+    memcpy(zpdu, pdu, sizeof(*zpdu));
+    zpdu->content = (char*) buf;
+    zpdu->content_length = len - ZC_TAIL_LEN;
+    zpdu->encoding = 1;
+
+    cnt = &_cnf->zc.deflated[pdu->content_type];
+    cnt->pdus++;
+    cnt->in += pdu->content_length;
+    cnt->out += zpdu->content_length;
+    cnt->ns += zc_cpu_ns(&start);
+    return 0;
+}
+
+
+/**
+ *  Inflates the content of a deflated PDU received from a contact. The
+ *  content is replaced by the inflated content.
+ *  @param zs  Pointer to compression of the connection, NULL if the PDU
+ *             has not been received from a contact
+ *  @param pdu Pointer to PDU, whose content is deflated
+ *  @return 0 on success, -1 if the content is illegal
+ */
+int
+zc_inflate(zc_stream_t* zs, dchat_pdu_t* pdu)
+{
+    struct timespec start;
+    char* buf;
+    int len;
+    int ret;
+    zc_count_t* cnt;
+
+    if (zs == NULL || !_cnf->zc.min || pdu->content_type >= ZC_MAX_TYPES ||
+        !(ZC_TYPES & (1 << pdu->content_type)))
+    {
+        ui_log(LOG_ERR, "Deflated PDU has not been accepted!");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+    if (zs->inf == NULL)
+    {
+        if ((zs->inf = calloc(1, sizeof(z_stream))) == NULL)
+        {
+            ui_fatal("Memory allocation for inflate stream failed!");
+        }
+
+        if (inflateInit2(zs->inf, -ZC_WINDOW_BITS) != Z_OK ||
+            inflateSetDictionary(zs->inf, (unsigned char*) ZC_DICTIONARY,
+                                 sizeof(ZC_DICTIONARY) - 1) != Z_OK)
+        {
+            ui_log(LOG_ERR, "Could not create inflate stream!");
+            inflateEnd(zs->inf);
+            free(zs->inf);
+            zs->inf = NULL;
+            return -1;
+        }
+    }
+
+    // the content read has room for the terminating null (see: read_pdu())
+    if ((pdu->content = realloc(pdu->content, pdu->content_length + ZC_TAIL_LEN)) == NULL ||
+        (buf = malloc(MAX_CONTENT_LEN + 1)) == NULL)
+    {
+        ui_fatal("Memory allocation for inflated content failed!");
+    }
+
+    memcpy(pdu->content + pdu->content_length, ZC_TAIL, ZC_TAIL_LEN);
+    zs->inf->next_in = (unsigned char*) pdu->content;
+    zs->inf->avail_in = pdu->content_length + ZC_TAIL_LEN;
+    zs->inf->next_out = (unsigned char*) buf;
+    zs->inf->avail_out = MAX_CONTENT_LEN + 1;
+
+    // content inflated beyond the max. Content-Length leaves no room
+    if (((ret = inflate(zs->inf, Z_SYNC_FLUSH)) != Z_OK && ret != Z_BUF_ERROR) ||
+        zs->inf->avail_in || !zs->inf->avail_out)
+    {
+        ui_log(LOG_ERR, "Illegal deflated PDU received!");
+        free(buf);
+        return -1;
+    }
+
+    len = MAX_CONTENT_LEN + 1 - zs->inf->avail_out;
+    buf[len] = '\0';
+
+    cnt = &_cnf->zc.inflated[pdu->content_type];
+    cnt->pdus++;
+    cnt->in += pdu->content_length;
+    cnt->out += len;
+    cnt->ns += zc_cpu_ns(&start);
+
+    free(pdu->content);
+    pdu->content = buf;
+    pdu->content_length = len;
+    pdu->encoding = 0;
+    return 0;
+}
+
+
+/**
+ *  Ends the deflate stream of a connection, whose deflated PDUs have not
+ *  all been sent, and stops deflating PDUs sent over it. The receiver
+ *  only inflates the PDUs it has received, so it stays in sync as long as
+ *  no further deflated PDU is sent.
+ *  @param zs Pointer to compression of the connection
+ */
+void
+zc_abort(zc_stream_t* zs)
+{
+    if (zs->def != NULL)
+    {
+        deflateEnd(zs->def);
+        free(zs->def);
+        zs->def = NULL;
+    }
+
+    zs->offered = 0;
+}
+
+
+/**
+ *  Frees the streams of a connection.
+ *  @param zs Pointer to compression of the connection
+ */
+void
+zc_free(zc_stream_t* zs)
+{
+    if (zs->def != NULL)
+    {
+        deflateEnd(zs->def);
+        free(zs->def);
+    }
+
+    if (zs->inf != NULL)
+    {
+        inflateEnd(zs->inf);
+        free(zs->inf);
+    }
+
+    memset(zs, 0, sizeof(*zs));
+}
+
+
+/**
+ *  Returns the CPU time of the calling thread since the given time.
+ *  @param start CPU time of the thread (CLOCK_THREAD_CPUTIME_ID)
+ *  @return nanoseconds passed
+ */
+long
+zc_cpu_ns(struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000000L + now.tv_nsec - start->tv_nsec;
+}
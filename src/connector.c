@@ -0,0 +1,314 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file connector.c
+ *  This file contains the queue of outgoing connection requests. Requests
+ *  are deduplicated by onion address and port and handed out to the
+ *  connector threads in order of their priority, whereas the amount of
+ *  concurrent connects in total and per source contact is limited.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "dchat_h/connector.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Initializes an empty connection queue.
+ *  @param cq Pointer to connection queue
+ *  @return 0 on success, -1 in case of error
+ */
+int
+init_conn_queue(conn_queue_t* cq)
+{
+    memset(cq, 0, sizeof(*cq));
+
+    if (pthread_mutex_init(&cq->cq_mx, NULL))
+    {
+        ui_log_errno(LOG_ERR, "Initialization of connection queue mutex failed!");
+        return -1;
+    }
+
+    if (pthread_cond_init(&cq->cq_cv, NULL))
+    {
+        ui_log_errno(LOG_ERR, "Initialization of connection queue condition failed!");
+        pthread_mutex_destroy(&cq->cq_mx);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Frees all resources of a connection queue.
+ *  @param cq Pointer to connection queue
+ */
+void
+destroy_conn_queue(conn_queue_t* cq)
+{
+    pthread_cond_destroy(&cq->cq_cv);
+    pthread_mutex_destroy(&cq->cq_mx);
+}
+
+
+/**
+ *  Adds a connection request to the queue.
+ *  Requests for an onion address and port, which are already pending or
+ *  in progress, are dropped, so that a contact received several times
+ *  will only be connected once.
+ *  @param cq        Pointer to connection queue
+ *  @param onion_id  Onion address to connect to
+ *  @param lport     Port to connect to
+ *  @param src_onion Onion address of the contact who sent us the address,
+ *                   NULL if requested by the user
+ *  @param src_lport Port of the contact who sent us the address
+ *  @param prio      Priority of the request (see: CONN_PRIO_*)
+ *  @return 0 if request has been queued, 1 if it is a duplicate, -1 if
+ *  the queue is full
+ */
+int
+enqueue_conn(conn_queue_t* cq, char* onion_id, uint16_t lport,
+             char* src_onion, uint16_t src_lport, int prio)
+{
+    conn_req_t* req; // new request
+    int ret = 0;
+
+    pthread_mutex_lock(&cq->cq_mx);
+
+    if (find_conn(cq, onion_id, lport) != -1)
+    {
+        ret = 1;
+    }
+    else if (cq->used == CONN_MAX_QUEUED)
+    {
+        ui_log(LOG_WARN, "Connection queue is full - dropped '%s:%hu'!", onion_id,
+               lport);
+        ret = -1;
+    }
+    else
+    {
+        req = &cq->req[cq->used++];
+        memset(req, 0, sizeof(*req));
+        strncat(req->onion_id, onion_id, ONION_ADDRLEN);
+        req->lport = lport;
+
+        if (src_onion != NULL)
+        {
+            strncat(req->src_onion, src_onion, ONION_ADDRLEN);
+            req->src_lport = src_lport;
+        }
+
+        req->prio = prio;
+        req->seq  = cq->seq++;
+        pthread_cond_broadcast(&cq->cq_cv);
+    }
+
+    pthread_mutex_unlock(&cq->cq_mx);
+    return ret;
+}
+
+
+/**
+ *  Takes the next connection request from the queue.
+ *  Blocks until a pending request can be started without exceeding the
+ *  limit of concurrent connects in total (CONN_MAX_INFLIGHT) and per
+ *  source contact (CONN_MAX_PER_SOURCE). Out of all startable requests
+ *  the one with the highest priority is chosen, requests of equal priority
+ *  are served in order of arrival. The request is marked as in progress
+ *  and must be finished with finish_conn().
+ *  @param cq  Pointer to connection queue
+ *  @param req Pointer to request where the chosen request will be copied to
+ *  @return 0 on success
+ */
+int
+dequeue_conn(conn_queue_t* cq, conn_req_t* req)
+{
+    int i;
+    int best; // index of chosen request
+
+    pthread_mutex_lock(&cq->cq_mx);
+    // unlock queue if thread gets canceled while waiting
+    pthread_cleanup_push(unlock_conn_queue, cq);
+
+    for (;;)
+    {
+        best = -1;
+
+        for (i = 0; cq->inflight < CONN_MAX_INFLIGHT && i < cq->used; i++)
+        {
+            if (!is_startable_conn(cq, &cq->req[i]))
+            {
+                continue;
+            }
+
+            if (best == -1 || cq->req[i].prio < cq->req[best].prio ||
+                (cq->req[i].prio == cq->req[best].prio &&
+                 cq->req[i].seq < cq->req[best].seq))
+            {
+                best = i;
+            }
+        }
+
+        if (best != -1)
+        {
+            break;
+        }
+
+        pthread_cond_wait(&cq->cq_cv, &cq->cq_mx);
+    }
+
+    cq->req[best].inflight = 1;
+    cq->inflight++;
+    memcpy(req, &cq->req[best], sizeof(*req));
+    pthread_cleanup_pop(1);
+    return 0;
+}
+
+
+/**
+ *  Removes a connection request, that is in progress, from the queue.
+ *  Should be called as soon as the connection has been established
+ *  and added to the contactlist or the connect failed.
+ *  @param cq  Pointer to connection queue
+ *  @param req Pointer to request returned by dequeue_conn()
+ */
+void
+finish_conn(conn_queue_t* cq, conn_req_t* req)
+{
+    int n;
+
+    pthread_mutex_lock(&cq->cq_mx);
+
+    if ((n = find_conn(cq, req->onion_id, req->lport)) != -1)
+    {
+        if (cq->req[n].inflight)
+        {
+            cq->inflight--;
+        }
+
+        // keep queue compact by moving the last request
+        cq->used--;
+
+        if (n != cq->used)
+        {
+            memcpy(&cq->req[n], &cq->req[cq->used], sizeof(conn_req_t));
+        }
+
+        pthread_cond_broadcast(&cq->cq_cv);
+    }
+
+    pthread_mutex_unlock(&cq->cq_mx);
+}
+
+
+/**
+ *  Counts the pending and in-flight connection requests of the queue.
+ *  @param cq Pointer to connection queue
+ *  @return amount of requests stored
+ */
+int
+count_conn(conn_queue_t* cq)
+{
+    int used;
+
+    pthread_mutex_lock(&cq->cq_mx);
+    used = cq->used;
+    pthread_mutex_unlock(&cq->cq_mx);
+    return used;
+}
+
+
+/**
+ *  Searches a connection request in the queue.
+ *  Caller must hold the mutex of the queue.
+ *  @param cq       Pointer to connection queue
+ *  @param onion_id Onion address of the request
+ *  @param lport    Port of the request
+ *  @return index of request or -1 if not found
+ */
+int
+find_conn(conn_queue_t* cq, char* onion_id, uint16_t lport)
+{
+    for (int i = 0; i < cq->used; i++)
+    {
+        if (cq->req[i].lport == lport && !strcmp(cq->req[i].onion_id, onion_id))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ *  Checks if a pending request may be started without exceeding the
+ *  limit of concurrent connects of its source contact.
+ *  Caller must hold the mutex of the queue.
+ *  @param cq  Pointer to connection queue
+ *  @param req Pointer to request to check
+ *  @return 1 if request can be started, 0 otherwise
+ */
+int
+is_startable_conn(conn_queue_t* cq, conn_req_t* req)
+{
+    int same_src = 0; // in-flight requests of the same source
+
+    if (req->inflight)
+    {
+        return 0;
+    }
+
+    // requests of the user are not limited per source
+    if (!req->src_lport)
+    {
+        return 1;
+    }
+
+    for (int i = 0; i < cq->used; i++)
+    {
+        if (cq->req[i].inflight && cq->req[i].src_lport == req->src_lport &&
+            !strcmp(cq->req[i].src_onion, req->src_onion))
+        {
+            same_src++;
+        }
+    }
+
+    return same_src < CONN_MAX_PER_SOURCE;
+}
+
+
+/**
+ *  Cleanup handler that unlocks the mutex of a connection queue.
+ *  @param arg Pointer to connection queue
+ */
+void
+unlock_conn_queue(void* arg)
+{
+    pthread_mutex_unlock(&((conn_queue_t*) arg)->cq_mx);
+}
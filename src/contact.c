@@ -30,6 +30,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
 
 #include "dchat_h/contact.h"
 #include "dchat_h/types.h"
@@ -37,23 +44,39 @@
 #include "dchat_h/dchat.h"
 #include "dchat_h/util.h"
 #include "dchat_h/consoleui.h"
+#include "dchat_h/connector.h"
+#include "dchat_h/overlay.h"
+#include "dchat_h/filetransfer.h"
+#include "dchat_h/compress.h"
+#include "dchat_h/fragment.h"
+#include "dchat_h/chunkstore.h"
+#include "dchat_h/swarm.h"
+#include "dchat_h/checksum.h"
 
 
 /**
  *  Sends local contactlist to a contact.
- *  Sends all known contacts stored in the contactlist within the global config
- *  in form of a "control/discover" PDU to the given contact.
- *  @param n   Index of contact to whom we send our contactlist (excluding him)
+ *  Sends known contacts stored in the contactlist within the global config
+ *  in form of a "control/discover" PDU to the given contact. If a digest of
+ *  the contacts already known by the remote client is given, only contacts
+ *  missing in this digest will be sent (delta).
+ *  @see receive_digest()
+ *  @param n          Index of contact to whom we send our contactlist (excluding him)
+ *  @param known      Sorted contact hashes known by the contact or NULL to send
+ *                    all contacts
+ *  @param known_len  Amount of hashes in known
  *  @return amount of bytes that have been written as content, -1 on error
  */
 int
-send_contacts(int n)
+send_contacts(int n, uint32_t* known, int known_len)
 {
     dchat_pdu_t pdu;    // pdu with contact information
     char* contact_str;  // pointer to a string representation of a contact
     int i;
     int ret;            // return value
     int pdu_len = 0;    // total content length of pdu-packet that will be sent
+    int contacts = 0;   // amount of contacts added to the pdu
+    uint32_t hash;      // hash of a contact
     contact_t* contact; // contact that will be converted to a string
     // initialize PDU
     init_dchat_pdu(&pdu, 1.0, CTT_ID_DSC, _cnf->me.onion_id, _cnf->me.lport,
@@ -74,6 +97,18 @@ send_contacts(int n)
         // if its not an empty contact slot and contact is not temporary (has not sent "control/discover" yet)
         if (contact->lport != 0)
         {
+            // skip contacts the remote client already knows
+            if (known != NULL)
+            {
+                hash = contact_hash(contact);
+
+                if (bsearch(&hash, known, known_len, sizeof(uint32_t),
+                            cmp_hash) != NULL)
+                {
+                    continue;
+                }
+            }
+
             // convert contact to a string
             if ((contact_str = contact_to_string(contact)) == NULL)
             {
@@ -84,7 +119,6 @@ send_contacts(int n)
 
             // (re)allocate memory for pdu for contact string
             pdu.content = realloc(pdu.content, pdu_len + strlen(contact_str) + 1);
-            pdu.content[pdu_len] = '\0'; // set the first byte to \0.. used for strcat
 
             // could not allocate memory for content
             if (pdu.content == NULL)
@@ -92,38 +126,327 @@ send_contacts(int n)
                 ui_fatal("Memory reallocation for contactlist failed!");
             }
 
-            // add contact information to content
-            strncat(pdu.content, contact_str, strlen(contact_str));
+            // add contact information to content, long lists are
+            // fragmented (see: fg_send())
+            memcpy(pdu.content + pdu_len, contact_str, strlen(contact_str) + 1);
             // increase size of pdu content-length
             pdu_len += strlen(contact_str);
+            contacts++;
             free(contact_str);
         }
     }
 
+    // remote client already knows all of our contacts
+    if (known != NULL && !contacts)
+    {
+        free_pdu(&pdu);
+        return 0;
+    }
+
     // set content-length of this pdu
     pdu.content_length = pdu_len;
 
     // write pdu inkluding all addresses of our contacts
-    if ((ret = write_pdu(_cnf->cl.contact[n].fd, &pdu)) == -1)
+    if ((ret = send_pdu(n, &pdu)) == -1)
     {
         ui_log(LOG_ERR, "Sending of contactlist failed!");
     }
+    else
+    {
+        _cnf->stats.dsc_pdus++;
+        _cnf->stats.dsc_bytes += ret;
+        _cnf->stats.dsc_contacts += contacts;
+    }
+
+    free_pdu(&pdu);
+    return ret;
+}
+
+
+/**
+ *  Initializes a "control/hello" PDU identifying this client.
+ *  Unless disabled, binary framing is offered by appending V2_OFFER to the
+ *  Server header, which clients without DChat/2 ignore. Hellos themselves
+ *  are always sent as text PDUs. FT_OFFER announces, that files can be
+ *  sent to this client, ZC_OFFER, that deflated PDUs are accepted
+ *  (unless compression is disabled), FG_OFFER, that messages exceeding
+ *  MAX_CONTENT_LEN are reassembled from fragments, CS_OFFER, that
+ *  chunks held in the chunk store are skipped (if there is a store),
+ *  SW_OFFER, that swarms of shared files are joined, and CK_OFFER, that
+ *  checksums of chunks of files are verified.
+ *  @param pdu  Pointer to PDU, has to be freed with free_pdu()
+ *  @param prio Neighbor priority (see: OVL_PRIO_*)
+ *  @return 0 on success, -1 on error
+ */
+int
+init_hello(dchat_pdu_t* pdu, char* prio)
+{
+    char offer[sizeof(V2_OFFER) + sizeof(FT_OFFER) + sizeof(ZC_OFFER) +
+               sizeof(FG_OFFER) + sizeof(CS_OFFER) + sizeof(SW_OFFER) +
+               sizeof(CK_OFFER) + 7]; // tokens of features offered
+
+    if (init_dchat_pdu(pdu, 1.0, CTT_ID_HLO, _cnf->me.onion_id, _cnf->me.lport,
+                       _cnf->me.name) == -1)
+    {
+        return -1;
+    }
+
+    if (prio[0] != '\0')
+    {
+        init_dchat_pdu_content(pdu, prio, strlen(prio));
+    }
+
+    offer[0] = '\0';
+
+    if (!_cnf->text_only)
+    {
+        strcat(offer, " " V2_OFFER);
+    }
+
+    strcat(offer, " " FT_OFFER);
+
+    if (_cnf->zc.min)
+    {
+        strcat(offer, " " ZC_OFFER);
+    }
+
+    strcat(offer, " " FG_OFFER);
+
+    if (_cnf->cs.dir[0] != '\0')
+    {
+        strcat(offer, " " CS_OFFER);
+    }
+
+    strcat(offer, " " SW_OFFER);
+    strcat(offer, " " CK_OFFER);
+
+    if ((pdu->server = realloc(pdu->server, strlen(pdu->server) + strlen(offer) + 1)) == NULL)
+    {
+        ui_fatal("Memory reallocation for server failed!");
+    }
+
+    strcat(pdu->server, offer);
+
+    return 0;
+}
+
+
+/**
+ *  Sends a hello to a contact.
+ *  A "control/hello" PDU is the first PDU sent on every new connection. Its
+ *  headers identify this client, so that duplicate connections can be
+ *  resolved before any contacts are exchanged. The contact answers a hello
+ *  with a digest of his contactlist. In overlay mode the content contains
+ *  the priority of our request to be added to the active view of the
+ *  contact, otherwise it is empty.
+ *  @see send_digest()
+ *  @see ovl_admit()
+ *  @param n    Index of contact to whom we send the hello
+ *  @param prio Neighbor priority (see: OVL_PRIO_*)
+ *  @return amount of bytes that have been written, -1 on error
+ */
+int
+send_hello(int n, char* prio)
+{
+    dchat_pdu_t pdu; // hello pdu
+    int ret;
+
+    if (init_hello(&pdu, prio) == -1)
+    {
+        return -1;
+    }
+
+    if ((ret = send_pdu(n, &pdu)) == -1)
+    {
+        ui_log(LOG_ERR, "Sending of hello failed!");
+    }
+
+    free_pdu(&pdu);
+    return ret;
+}
+
+
+/**
+ *  Sends a digest of the local contactlist to a contact.
+ *  Instead of the whole contactlist, only the hashes of all known contacts
+ *  (see contact_hash()) are sent in form of a "control/digest" PDU. The
+ *  first line of the content contains the version of the local contactlist,
+ *  every following line a hash as hexadecimal number. Hashes are sorted in
+ *  ascending order. The remote client answers with a "control/discover" PDU
+ *  that only contains contacts missing in this digest.
+ *  @see receive_digest()
+ *  @param n Index of contact to whom we send the digest
+ *  @return amount of bytes that have been written, -1 on error
+ */
+int
+send_digest(int n)
+{
+    dchat_pdu_t pdu;    // pdu with contact digest
+    uint32_t* hashes;   // hashes of all known contacts
+    int hash_cnt = 0;   // amount of hashes
+    int pdu_len = 0;    // content length of pdu
+    int i;
+    int ret;
+
+    if ((hashes = malloc((_cnf->cl.cl_size + 1) * sizeof(uint32_t))) == NULL)
+    {
+        ui_fatal("Memory allocation for contact digest failed!");
+    }
 
-    if (pdu.content_length != 0)
+    // hash every identified contact, including the one we send the digest to
+    // since he knows himself anyway
+    for (i = 0; i < _cnf->cl.cl_size; i++)
     {
-        free(pdu.content);
+        if (_cnf->cl.contact[i].lport != 0)
+        {
+            hashes[hash_cnt++] = contact_hash(&_cnf->cl.contact[i]);
+        }
     }
 
+    qsort(hashes, hash_cnt, sizeof(uint32_t), cmp_hash);
+
+    if (init_dchat_pdu(&pdu, 1.0, CTT_ID_DGS, _cnf->me.onion_id, _cnf->me.lport,
+                       _cnf->me.name) == -1)
+    {
+        free(hashes);
+        return -1;
+    }
+
+    // version line and one line for every hash
+    if ((pdu.content = malloc(MAX_INT_STR + 2 + hash_cnt * (DGS_HASH_LEN + 1))) == NULL)
+    {
+        ui_fatal("Memory allocation for contact digest failed!");
+    }
+
+    pdu_len += sprintf(pdu.content, "%u\n", _cnf->cl.version);
+
+    for (i = 0; i < hash_cnt; i++)
+    {
+        pdu_len += sprintf(pdu.content + pdu_len, "%08x\n", hashes[i]);
+    }
+
+    pdu.content_length = pdu_len;
+    free(hashes);
+
+    if ((ret = send_pdu(n, &pdu)) == -1)
+    {
+        ui_log(LOG_ERR, "Sending of contact digest failed!");
+    }
+    else
+    {
+        _cnf->stats.dgs_pdus++;
+        _cnf->stats.dgs_bytes += ret;
+    }
+
+    free_pdu(&pdu);
+    return ret;
+}
+
+
+/**
+ *  Handles a digest received from a contact.
+ *  Parses the contact hashes of the given "control/digest" PDU and sends
+ *  all contacts of the local contactlist, which are not part of the digest,
+ *  back to the contact. Digests with a version lower or equal than the
+ *  version of the last digest received from this contact are outdated and
+ *  will be ignored.
+ *  @see send_digest()
+ *  @param n   Index of contact from whom the digest has been received
+ *  @param pdu PDU with the contact digest in its content
+ *  @return amount of bytes written as response, 0 if nothing has been sent,
+ *  -1 on error
+ */
+int
+receive_digest(int n, dchat_pdu_t* pdu)
+{
+    uint32_t* hashes;   // hashes parsed from the digest
+    int hash_cnt = 0;   // amount of hashes parsed
+    int hash_max;       // amount of hashes fitting into the digest
+    uint32_t version;   // version of the remote contactlist
+    int line_begin = 0; // offset of content of given pdu
+    int line_end = 0;   // offset (end) of content of given pdu
+    char* line;         // line of the digest
+    char* ptr;          // used for strtoul
+    int ret;
+
+    // every hash line has DGS_HASH_LEN digits and the line break
+    hash_max = pdu->content_length / (DGS_HASH_LEN + 1) + 1;
+
+    if ((hashes = malloc(hash_max * sizeof(uint32_t))) == NULL)
+    {
+        ui_fatal("Memory allocation for contact digest failed!");
+    }
+
+    while (line_end < pdu->content_length)
+    {
+        line_begin = line_end;
+
+        if ((line_end = get_content_part(pdu, line_begin, '\n', &line)) == -1)
+        {
+            ui_log(LOG_ERR, "Extraction of digest line from received PDU failed!");
+            free(hashes);
+            return -1;
+        }
+
+        // first line contains the version, all other lines are hashes
+        if (!line_begin)
+        {
+            version = strtoul(line, &ptr, 10);
+        }
+        else if (hash_cnt < hash_max && strspn(line, DGS_HEX_DIGITS) == DGS_HASH_LEN &&
+                 line[DGS_HASH_LEN] == '\n')
+        {
+            hashes[hash_cnt++] = strtoul(line, &ptr, 16);
+        }
+        else
+        {
+            ptr = line; // hashes have exactly DGS_HASH_LEN hex digits (see: send_digest())
+        }
+
+        if (ptr == line || *ptr != '\n')
+        {
+            ui_log(LOG_ERR, "Illegal line in received contact digest!");
+            free(line);
+            free(hashes);
+            return -1;
+        }
+
+        free(line);
+        line_end++;
+    }
+
+    if (!line_end)
+    {
+        ui_log(LOG_ERR, "Received contact digest is empty!");
+        free(hashes);
+        return -1;
+    }
+
+    // outdated digest
+    if (_cnf->cl.contact[n].dgs_version && version <= _cnf->cl.contact[n].dgs_version)
+    {
+        free(hashes);
+        return 0;
+    }
+
+    _cnf->cl.contact[n].dgs_version = version;
+    qsort(hashes, hash_cnt, sizeof(uint32_t), cmp_hash);
+    ret = send_contacts(n, hashes, hash_cnt);
+    free(hashes);
     return ret;
 }
 
 
 /**
  *  Contacts transferred via PDU will be added to the contactlist.
- *  Parses the contact information stored in the given PDU, connects to this remote client
- *  , if this client is unknown, the local contactlist within the global config will be sent
- *  to him. Finally the remote client is added as contact to the local contactlist.
- *  For every parsed contact information, this procedure is repeated.
+ *  Parses the contact information stored in the given PDU and, if this client is
+ *  unknown, queues a connection request for it. The connector threads connect to
+ *  the remote client, send a hello to him and add him as contact to the local
+ *  contactlist (see: th_new_conn()). In overlay mode unknown clients are added
+ *  to the passive view instead (see: ovl_add_passive()).
+ *  For every parsed contact information, this procedure is repeated. Since contacts
+ *  already known are skipped, the PDU may contain a complete contactlist as well as
+ *  a delta sent as answer to a digest (see: receive_digest()).
  *  @param pdu PDU with the contact information in its content
  *  @return amount of new contacts added to the contactlist, -1 on error
  */
@@ -155,18 +478,28 @@ receive_contacts(dchat_pdu_t* pdu)
         if (string_to_contact(&contact, line) == -1)
         {
             ui_log(LOG_WARN, "Conversion of string to contact failed! - Skipped");
+            free(line);
+            line_end++;
             ret = -1;
             continue;
         }
 
+        free(line);
+
         // if parsed contact is unknown
         if (find_contact(&contact, 0) == -2)
         {
             // increment new contacts counter
             new_contacts++;
 
-            // connect to new contact, add him as contact, and send contactlist to him
-            if (handle_local_conn_request(contact.onion_id, contact.lport) == -1)
+            // keep address as backup peer of the overlay
+            if (_cnf->ovl.enabled)
+            {
+                ovl_add_passive(contact.onion_id, contact.lport);
+            }
+            // let the connector threads connect to the new contact
+            else if (enqueue_conn(&_cnf->cq, contact.onion_id, contact.lport,
+                             pdu->onion_id, pdu->lport, CONN_PRIO_DISCOVER) == -1)
             {
                 ui_log(LOG_WARN, "Connection to new contact failed!");
                 ret = -1;
@@ -207,7 +540,6 @@ check_duplicates(int n)
     contact_t* temp;         // temporay contact variable
     int connect_contact = 0; // index of contact to whom we connected to
     int accept_contact = 0;  // index of contact from whom we accepted a connection
-    int ret;
     // check if given contact is in the contactlist
     fst_oc = find_contact(&_cnf->cl.contact[n], 0);
 
@@ -245,33 +577,288 @@ check_duplicates(int n)
         accept_contact = sec_oc;
     }
 
-    // if local onion address is greater than the remote one
-    // than the index of the  contact, who got added because of a "connect",
-    // will be returned
-    ret = strcmp(_cnf->me.onion_id, _cnf->cl.contact[n].onion_id);
+    return keep_connect(&_cnf->cl.contact[n]) ? accept_contact : connect_contact;
+}
+
+
+/**
+ *  Decides which of two duplicate connections to a contact will be kept.
+ *  If the local onion address is greater than the remote one, the connection
+ *  accepted from the contact will be kept, otherwise the one we established.
+ *  If the onion addresses are equal, the same is done for the listening ports.
+ *  Since both clients come to the same decision, the same connection will be
+ *  kept on both sides.
+ *  @param contact Pointer to contact with onion address and listening port
+ *  @return 1 if the connection established by us should be kept, 0 if the
+ *  accepted one should be kept
+ */
+int
+keep_connect(contact_t* contact)
+{
+    int ret = strcmp(_cnf->me.onion_id, contact->onion_id);
 
-    if (ret > 0)
+    if (ret)
     {
-        return connect_contact;
+        return ret < 0;
     }
-    // otherwise it is the other way round
-    else if (ret < 0)
+
+    return _cnf->me.lport <= contact->lport;
+}
+
+
+/**
+ *  Sends a PDU to a contact.
+ *  PDUs are not written at once, but coalesced with further PDUs sent to
+ *  the same contact within the coalescing window, so that a burst of PDUs
+ *  (e.g. a pasted block of lines) is packed into as few TOR cells as
+ *  possible. The buffer is written as soon as it holds the max. amount of
+ *  bytes, otherwise the main loop writes it when the window has passed
+ *  (see: flush_contacts()). The content is deflated, if the contact
+ *  accepts it (see: zc_deflate()). Content exceeding MAX_CONTENT_LEN is
+ *  sent as fragments (see: fg_send()). The contactlist has to be locked.
+ *  @param n   Index of contact
+ *  @param pdu Pointer to PDU
+ *  @return length of PDU or -1 in case of error
+ */
+int
+send_pdu(int n, dchat_pdu_t* pdu)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    dchat_pdu_t zpdu; // PDU with deflated content
+    char* pdu_str;    // encoded PDU
+    int len;          // length of PDU
+    int ret;
+
+    if (pdu->content_length > MAX_CONTENT_LEN && pdu->content_type != CTT_ID_BIN)
     {
-        return accept_contact;
+        return fg_send(n, pdu);
     }
-    // if ip addresses are equal, do the same for the listening port
-    else if (_cnf->me.lport > _cnf->cl.contact[n].lport)
+
+    ret = zc_deflate(&contact->zc, pdu, &zpdu);
+    len = encode_frame(ret ? pdu : &zpdu, contact->version, &pdu_str);
+
+    if (!ret)
     {
-        return connect_contact;
+        free(zpdu.content);
     }
-    else if (_cnf->me.lport < _cnf->cl.contact[n].lport)
+
+    if (len == -1)
     {
-        return accept_contact;
+        // the deflated content has entered the stream, but is never sent
+        if (!ret)
+        {
+            zc_abort(&contact->zc);
+        }
+
+        return -1;
     }
-    else
+
+    _cnf->stats.pdus++;
+    _cnf->stats.pdu_bytes += len;
+    _cnf->stats.pdu_cells += (len + TOR_CELL_DATA - 1) / TOR_CELL_DATA;
+    buffer_pdu(n, pdu_str, len);
+    free(pdu_str);
+
+    if ((!_cnf->co_window || contact->olen >= _cnf->co_max) && flush_contact(n) == -1)
     {
-        return accept_contact;
+        return -1;
     }
+
+    return len;
+}
+
+
+/**
+ *  Sends a PDU, whose content is followed by bytes of a file, to a contact.
+ *  The headers and the content of the PDU are written together with the
+ *  coalesced PDUs, then the bytes of the file are passed from the file to
+ *  the socket by the kernel without copying them (see: sendfile(2)). The
+ *  file offset of fd is not changed. Contacts verifying checksums are sent
+ *  the CRC-32C of the content and the bytes of the file, which are read
+ *  from the page cache for it. The contactlist has to be locked.
+ *  @param n      Index of contact
+ *  @param pdu    Pointer to PDU, its Content-Length excludes the file
+ *  @param fd     File to send
+ *  @param offset Offset of the bytes in the file
+ *  @param len    Amount of bytes of the file
+ *  @return length of PDU including the file or -1 in case of error
+ */
+int
+send_pdu_file(int n, dchat_pdu_t* pdu, int fd, off_t offset, int len)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    char* head;     // encoded headers
+    int hlen;       // length of headers
+    ssize_t ret;
+
+    if (contact->checksums)
+    {
+        pdu->crc = ck_crc32c(0, pdu->content, pdu->content_length);
+
+        if (ck_file(fd, offset, len, &pdu->crc) == -1)
+        {
+            return -1;
+        }
+
+        pdu->has_crc = 1;
+        _cnf->ck.sent++;
+    }
+
+    // the headers announce the content including the file
+    pdu->content_length += len;
+    hlen = encode_frame_head(pdu, contact->version, &head);
+    pdu->content_length -= len;
+
+    if (hlen == -1)
+    {
+        return -1;
+    }
+
+    buffer_pdu(n, head, hlen);
+    buffer_pdu(n, pdu->content, pdu->content_length);
+    free(head);
+
+    if (flush_contact(n) == -1)
+    {
+        return -1;
+    }
+
+    for (int b = 0; b < len; b += ret)
+    {
+        if ((ret = sendfile(contact->fd, fd, &offset, len - b)) == -1 || !ret)
+        {
+            ui_log_errno(LOG_ERR, "Could not send file to contact (%d)!", n);
+            return -1;
+        }
+    }
+
+    len += hlen + pdu->content_length;
+    _cnf->stats.pdus++;
+    _cnf->stats.pdu_bytes += len;
+    _cnf->stats.pdu_cells += (len + TOR_CELL_DATA - 1) / TOR_CELL_DATA;
+    _cnf->stats.writes++;
+    _cnf->stats.write_cells += (len - hlen - pdu->content_length + TOR_CELL_DATA - 1) /
+                               TOR_CELL_DATA;
+    return len;
+}
+
+
+/**
+ *  Appends an encoded PDU to the coalesced PDUs of a contact. The
+ *  coalescing window starts with the first PDU buffered.
+ *  @param n   Index of contact
+ *  @param buf Encoded PDU
+ *  @param len Length of encoded PDU
+ */
+void
+buffer_pdu(int n, char* buf, int len)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+
+    if (contact->olen + len > contact->osize)
+    {
+        contact->osize = contact->olen + len;
+
+        if ((contact->obuf = realloc(contact->obuf, contact->osize)) == NULL)
+        {
+            ui_fatal("Memory reallocation for coalesced PDUs failed!");
+        }
+    }
+
+    // the window starts with the first PDU buffered
+    if (!contact->olen)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &contact->oflush);
+        contact->oflush.tv_nsec += (long) _cnf->co_window * 1000;
+        contact->oflush.tv_sec += contact->oflush.tv_nsec / 1000000000;
+        contact->oflush.tv_nsec %= 1000000000;
+    }
+
+    memcpy(contact->obuf + contact->olen, buf, len);
+    contact->olen += len;
+}
+
+
+/**
+ *  Writes the coalesced PDUs of a contact with a single write. Since the
+ *  sockets of contacts are set to TCP_NODELAY (see: add_contact()), the
+ *  data leaves at once instead of waiting for outstanding ACKs.
+ *  @param n Index of contact
+ *  @return 0 on success, -1 in case of error (buffer will be dropped)
+ */
+int
+flush_contact(int n)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    int len = contact->olen;
+    int ret = 0;
+
+    if (!len)
+    {
+        return 0;
+    }
+
+    contact->olen = 0;
+    _cnf->stats.writes++;
+    _cnf->stats.write_cells += (len + TOR_CELL_DATA - 1) / TOR_CELL_DATA;
+
+    if (write(contact->fd, contact->obuf, len) != len)
+    {
+        ui_log_errno(LOG_ERR, "Could not write to contact (%d)!", n);
+        ret = -1;
+    }
+
+    // do not keep the memory of a large burst
+    if (contact->osize > _cnf->co_max)
+    {
+        free(contact->obuf);
+        contact->obuf = NULL;
+        contact->osize = 0;
+    }
+
+    return ret;
+}
+
+
+/**
+ *  Writes the coalesced PDUs of all contacts, whose coalescing window has
+ *  passed. The contactlist has to be locked.
+ *  @return microseconds until the next window passes or -1 if no PDUs are
+ *  buffered
+ */
+long
+flush_contacts()
+{
+    struct timespec now;
+    long next = -1;  // time until the next window passes
+    long left;       // time until the window of a contact passes
+    contact_t* contact;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (int i = 0; i < _cnf->cl.cl_size; i++)
+    {
+        contact = &_cnf->cl.contact[i];
+
+        if (!contact->olen)
+        {
+            continue;
+        }
+
+        left = (contact->oflush.tv_sec - now.tv_sec) * 1000000 +
+               (contact->oflush.tv_nsec - now.tv_nsec) / 1000;
+
+        if (left <= 0)
+        {
+            flush_contact(i);
+        }
+        else if (next == -1 || left < next)
+        {
+            next = left;
+        }
+    }
+
+    return next;
 }
 
 
@@ -379,6 +966,31 @@ string_to_contact(contact_t* contact, char* string)
 }
 
 
+/**
+ *  Calculates a hash of a contact.
+ *  The hash is a 32 bit FNV-1a hash over the string representation of the
+ *  contact (see: contact_to_string()) and is used to build contact digests.
+ *  @see send_digest()
+ *  @param contact Pointer to contact that should be hashed
+ *  @return hash of the contact, 0 if contact could not be converted
+ */
+uint32_t
+contact_hash(contact_t* contact)
+{
+    uint32_t hash;      // hash value
+    char* contact_str;  // string representation of contact
+
+    if ((contact_str = contact_to_string(contact)) == NULL)
+    {
+        return 0;
+    }
+
+    hash = fnv_hash(FNV_OFFSET, contact_str, strlen(contact_str));
+    free(contact_str);
+    return hash;
+}
+
+
 /**
  *  Resizes the contactlist.
  *  Function to resize the contactlist to a given size. Old contacts are copied to the new
@@ -444,6 +1056,11 @@ int
 add_contact(int fd)
 {
     int i;
+    int on = 1;
+
+    // coalesced PDUs are written at once (see: flush_contact()), fails
+    // silently for unix sockets
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
 
     // if contactlist is full - resize it so that we can store more contacts in it
     if (_cnf->cl.used_contacts == _cnf->cl.cl_size)
@@ -462,6 +1079,7 @@ add_contact(int fd)
         {
             _cnf->cl.contact[i].fd = fd;
             _cnf->cl.used_contacts++; // increase contact counter
+            _cnf->cl.version++;
             break;
         }
     }
@@ -487,16 +1105,28 @@ del_contact(int n)
         return -1;
     }
 
-    if (_cnf->cl.contact[n].fd == 0)
+    // empty slot (fake contacts have no socket, but an address)
+    if (_cnf->cl.contact[n].fd == 0 && _cnf->cl.contact[n].lport == 0 &&
+        _cnf->cl.contact[n].onion_id[0] == '\0')
     {
         return 0;
     }
 
-    close(_cnf->cl.contact[n].fd);
+    if (_cnf->cl.contact[n].fd)
+    {
+        flush_contact(n);
+        close(_cnf->cl.contact[n].fd);
+    }
+
+    free(_cnf->cl.contact[n].obuf);
+    zc_free(&_cnf->cl.contact[n].zc);
+    fg_free(&_cnf->cl.contact[n].fg);
+
     // zero out the contact on index 'n'
     memset(&_cnf->cl.contact[n], 0, sizeof(contact_t));
     // decrease contacts counter variable
     _cnf->cl.used_contacts--;
+    _cnf->cl.version++;
 
     // if contacts counter has been decreased INIT_CONTACTS time, resize the contactlist to free
     // unused memory
@@ -551,7 +1181,7 @@ find_contact(contact_t* contact, int begin)
         // dont check empty contacts or temporary contacts
         if (c->lport)
         {
-            if (strcmp(contact_to_string(contact), contact_to_string(c)) == 0)
+            if (c->lport == contact->lport && !strcmp(c->onion_id, contact->onion_id))
             {
                 return i;
             }
@@ -560,3 +1190,21 @@ find_contact(contact_t* contact, int begin)
 
     return -2; // not found
 }
+
+
+/**
+ *  Compares two contact hashes.
+ *  Comparison function used for sorting and searching contact hashes
+ *  with qsort(3) and bsearch(3).
+ *  @param a Pointer to first hash
+ *  @param b Pointer to second hash
+ *  @return <0, 0 or >0 if a is lower, equal or greater than b
+ */
+int
+cmp_hash(const void* a, const void* b)
+{
+    uint32_t ha = *(const uint32_t*) a;
+    uint32_t hb = *(const uint32_t*) b;
+
+    return ha < hb ? -1 : ha > hb;
+}
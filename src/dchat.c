@@ -48,9 +48,12 @@
 #include <pthread.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <signal.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <time.h>
 
 #include "dchat_h/dchat.h"
 #include "dchat_h/types.h"
@@ -60,6 +63,21 @@
 #include "dchat_h/network.h"
 #include "dchat_h/util.h"
 #include "dchat_h/option.h"
+#include "dchat_h/connector.h"
+#include "dchat_h/overlay.h"
+#include "dchat_h/seen.h"
+#include "dchat_h/cache.h"
+#include "dchat_h/seed.h"
+#include "dchat_h/reconnect.h"
+#include "dchat_h/warmpool.h"
+#include "dchat_h/filetransfer.h"
+#include "dchat_h/msglog.h"
+#include "dchat_h/search.h"
+#include "dchat_h/compress.h"
+#include "dchat_h/fragment.h"
+#include "dchat_h/chunkstore.h"
+#include "dchat_h/swarm.h"
+#include "dchat_h/checksum.h"
 
 
 #include "dchat_h/consoleui.h"
@@ -79,6 +97,7 @@ main(int argc, char** argv)
     int found_opt;                      // boolean if opt has been found
     cli_options_t options;              // available command line options
     char* remote_onion = NULL;          // onion id of remote host
+    char remote_addr[ONION_ADDRLEN + 1] = ""; // copy of remote onion id
     int rport;                          // remote port
     int ret;
 
@@ -181,6 +200,12 @@ main(int argc, char** argv)
         ui_log_errno(LOG_WARN, "Could not read configuration file '%s'!", CONFIG_PATH);
     }
 
+    // read bootstrap peers of the seed file
+    if (_cnf->seeds.path[0] != '\0' && (ret = read_seeds(&_cnf->seeds)) != -1)
+    {
+        ui_log(LOG_INFO, "Read %d seeds from '%s'!", ret, _cnf->seeds.path);
+    }
+
     // check if all required options have been specified
     if (required != required_set)
     {
@@ -193,12 +218,52 @@ main(int argc, char** argv)
         usage(EXIT_FAILURE, &options, "Invalid command-line arguments!");
     }
 
-    // create listening socket
-    if (init_listening(LISTEN_ADDR) == -1)
+    if (!_cnf->me.lport)
+    {
+        _cnf->me.lport = DEFAULT_PORT;
+    }
+
+    if (_cnf->co_window == -1)
+    {
+        _cnf->co_window = CO_DEF_WINDOW;
+    }
+
+    if (!_cnf->co_max)
+    {
+        _cnf->co_max = CO_DEF_MAX;
+    }
+
+    if (!_cnf->ft.latency)
+    {
+        _cnf->ft.latency = FT_DEF_LATENCY;
+    }
+
+    if (_cnf->cs.max == -1)
+    {
+        _cnf->cs.max = CS_DEF_SIZE * 1048576LL;
+    }
+
+    if (_cnf->zc.min == -1)
+    {
+        _cnf->zc.min = ZC_DEF_MIN;
+    }
+
+    if (_cnf->unix_only && _cnf->unix_path[0] == '\0')
+    {
+        usage(EXIT_FAILURE, &options, "Listening on a unix socket only requires its path!");
+    }
+
+    // create listening sockets
+    if (!_cnf->unix_only && init_listening(LISTEN_ADDR) == -1)
     {
         ui_fatal("Initialization of listening socket failed!");
     }
 
+    if (_cnf->unix_path[0] != '\0' && init_unix_listening(_cnf->unix_path) == -1)
+    {
+        ui_fatal("Initialization of listening unix socket failed!");
+    }
+
     if (_cnf->cl.used_contacts == 1)
     {
         remote_onion = _cnf->cl.contact[0].onion_id;
@@ -236,12 +301,36 @@ main(int argc, char** argv)
             rport = DEFAULT_PORT;
         }
 
+        // remember address, because the fake contact has to be deleted
+        // before a connector thread looks for duplicates
+        strncat(remote_addr, remote_onion, ONION_ADDRLEN);
         // delete fake contact
         del_contact(0);
         // inform connection handler to connect to the specified
         // remote host
-        write(_cnf->connect_fd[1], remote_onion, ONION_ADDRLEN);
-        write(_cnf->connect_fd[1], &rport,       sizeof(uint16_t));
+        enqueue_conn(&_cnf->cq, remote_addr, rport, NULL, 0, CONN_PRIO_USER);
+    }
+
+    // connect to the fastest seeds
+    if (start_seed_probe(&_cnf->seeds) == -1)
+    {
+        ui_log(LOG_WARN, "Could not probe seeds!");
+    }
+
+    // reconnect to the best contacts of earlier sessions in parallel
+    pthread_mutex_lock(&_cnf->cl.cl_mx);
+
+    if ((ret = cache_reconnect(&_cnf->cache)) > 0)
+    {
+        ui_log(LOG_INFO, "Reconnecting to %d cached contacts!", ret);
+    }
+
+    pthread_mutex_unlock(&_cnf->cl.cl_mx);
+
+    // build connections to the peers likely connected to next
+    if (start_warm_pool(&_cnf->wp) == -1)
+    {
+        ui_log(LOG_WARN, "Could not start warm pool!");
     }
 
     // handle userinput
@@ -263,6 +352,13 @@ init_global_config()
     memset(_cnf, 0, sizeof(*_cnf));
     _cnf->cl.cl_size       = 0;    // set initial size of contactlist
     _cnf->cl.used_contacts = 0;    // no known contacts, at start
+    _cnf->acpt_fd = -1;            // not listening yet
+    _cnf->unix_fd = -1;
+    _cnf->co_window = -1;          // coalescing window not set yet
+    _cnf->zc.min = -1;             // min. length of deflated content not set yet
+    _cnf->cs.max = -1;             // size limit of the chunk store not set yet
+    // message ids of an earlier session must not be reused
+    _cnf->msg_seq = (uint64_t) time(NULL) << 20;
     return 0;
 }
 
@@ -290,16 +386,7 @@ init_listening(char* address)
     }
 
     ((struct sockaddr_in*)&sa)->sin_family = AF_INET;
-
-    if (!_cnf->me.lport)
-    {
-        _cnf->me.lport = DEFAULT_PORT;
-        ((struct sockaddr_in*)&sa)->sin_port = htons(DEFAULT_PORT);
-    }
-    else
-    {
-        ((struct sockaddr_in*)&sa)->sin_port = htons(_cnf->me.lport);
-    }
+    ((struct sockaddr_in*)&sa)->sin_port = htons(_cnf->me.lport);
 
     // create socket
     if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1)
@@ -340,6 +427,65 @@ init_listening(char* address)
 }
 
 
+/**
+ * Initializes the listening unix socket.
+ * TOR can forward the hidden service port to a unix socket instead of a
+ * TCP port, which saves the loopback TCP overhead and avoids port
+ * collisions between several clients on one host. Accepted connections are
+ * handled like those of the TCP listener. A stale socket file of an
+ * earlier session is removed, other files are left untouched.
+ * @param path Path of the unix socket
+ * @return socket descriptor or -1 if an error occurs
+ */
+int
+init_unix_listening(char* path)
+{
+    int s;                  // local socket descriptor
+    struct sockaddr_un sa;  // local socket address
+    struct stat st;         // status of existing file
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(sa.sun_path))
+    {
+        ui_log(LOG_ERR, "Path of unix socket '%s' is too long!", path);
+        return -1;
+    }
+
+    strncat(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+
+    if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Creation of unix socket failed!");
+        return -1;
+    }
+
+    if (bind(s, (struct sockaddr*) &sa, sizeof(sa)) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Binding to unix socket '%s' failed!", path);
+        close(s);
+        return -1;
+    }
+
+    if (listen(s, LISTEN_BACKLOG) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Listening on unix socket failed!");
+        close(s);
+        unlink(path);
+        return -1;
+    }
+
+    _cnf->unix_fd = s;
+    return s;
+}
+
+
 /**
  * Initializes neccessary internal ressources like threads and pipes.
  * Initializes pipes and threads used for parallel processing of user input
@@ -367,11 +513,76 @@ init_threads()
     sigaction(SIGQUIT, &sa_terminate, NULL); // quit programm
     sigaction(SIGINT,  &sa_terminate, NULL); // interrupt programm
     sigaction(SIGTERM, &sa_terminate, NULL); // software termination
+    // a contact may go away while chunks are acknowledged or PDUs are
+    // written to it, write() fails with EPIPE then
+    signal(SIGPIPE, SIG_IGN);
+
+    // transport used by th_new_conn and the seed probes
+    if (init_transport(&_cnf->tp) == -1)
+    {
+        return -1;
+    }
 
-    // pipe to the th_new_conn
-    if (pipe(_cnf->connect_fd) == -1)
+    // TOR clients used by th_new_conn and the seed probes
+    if (init_socks_pool(&_cnf->socks) == -1)
+    {
+        return -1;
+    }
+
+    // queue of connection requests served by th_new_conn
+    if (init_conn_queue(&_cnf->cq) == -1)
+    {
+        return -1;
+    }
+
+    // active and passive view of the overlay mode
+    if (init_overlay() == -1)
+    {
+        return -1;
+    }
+
+    // lost contacts reconnected by the main loop (not in overlay mode)
+    if (init_reconnects(&_cnf->rc) == -1)
+    {
+        return -1;
+    }
+
+    // connections built in advance, claimed by th_new_conn
+    if (init_warm_pool(&_cnf->wp) == -1)
+    {
+        return -1;
+    }
+
+    // ids of recently seen messages
+    if (init_seen(&_cnf->seen) == -1)
+    {
+        return -1;
+    }
+
+    // contacts of earlier sessions
+    if (init_cache(&_cnf->cache) == -1)
+    {
+        return -1;
+    }
+
+    // kernel and tables of the checksums of PDUs
+    init_checksums(&_cnf->ck);
+
+    // messages of earlier sessions, marks the newest ones as seen
+    if (init_msg_log(&_cnf->ml) == -1)
+    {
+        return -1;
+    }
+
+    // index of the message log, indexes the messages not indexed yet
+    if (init_search_index(&_cnf->si, &_cnf->ml) == -1)
+    {
+        return -1;
+    }
+
+    // chunks of files received in earlier sessions
+    if (init_chunk_store(&_cnf->cs, _cnf->ft.dir) == -1)
     {
-        ui_log_errno(LOG_ERR, "Creation of connection pipe failed!");
         return -1;
     }
 
@@ -396,12 +607,15 @@ init_threads()
         return -1;
     }
 
-    // create new th_new_conn-thread
-    if (pthread_create
-        (&_cnf->conn_th, NULL, (void* (*)(void*)) th_new_conn, _cnf) == -1)
+    // create th_new_conn-threads, each of them handles one connect at a time
+    for (int i = 0; i < CONN_MAX_INFLIGHT; i++)
     {
-        ui_log_errno(LOG_ERR, "Creation of connection thread failed!");
-        return -1;
+        if (pthread_create
+            (&_cnf->conn_th[i], NULL, (void* (*)(void*)) th_new_conn, _cnf) == -1)
+        {
+            ui_log_errno(LOG_ERR, "Creation of connection thread failed!");
+            return -1;
+        }
     }
 
     // create new thread for handling userinput from stdin
@@ -430,16 +644,48 @@ destroy()
     pthread_cancel(_cnf->select_th);
     // wait for termination of select thread
     pthread_join(_cnf->select_th, NULL);
-    // cancel connection thread
-    pthread_cancel(_cnf->conn_th);
-    // cancel connection thread
-    // wait for termination of connection thread
-    pthread_join(_cnf->conn_th, NULL);
-    // wait for termination of select thread
+    // keep files not received completely for a later session
+    destroy_file_transfers(&_cnf->ft);
+    // drop files not received from swarms, their chunks are kept in the store
+    destroy_swarms(&_cnf->sw);
+    // free the index of the chunk store, the chunks are kept
+    destroy_chunk_store(&_cnf->cs);
+    // write new terms to the index file, it refers to the message log
+    destroy_search_index(&_cnf->si, &_cnf->ml);
+    // truncate and unmap segments of the message log
+    destroy_msg_log(&_cnf->ml);
+    // cancel probes of seeds
+    destroy_seeds(&_cnf->seeds);
+    // cancel building of connections in advance and close them
+    destroy_warm_pool(&_cnf->wp);
+    // cancel connection threads
+    for (int i = 0; i < CONN_MAX_INFLIGHT; i++)
+    {
+        pthread_cancel(_cnf->conn_th[i]);
+    }
+
+    // wait for termination of connection threads
+    for (int i = 0; i < CONN_MAX_INFLIGHT; i++)
+    {
+        pthread_join(_cnf->conn_th[i], NULL);
+    }
+
     // destroy contact mutex
     pthread_mutex_destroy(&_cnf->cl.cl_mx);
-    // close write pipe for thread function th_new_conn
-    close(_cnf->connect_fd[1]);
+    // destroy queue of connection requests
+    destroy_conn_queue(&_cnf->cq);
+    // destroy reconnect scheduler
+    destroy_reconnects(&_cnf->rc);
+    // destroy pool of TOR clients
+    destroy_socks_pool(&_cnf->socks);
+    // free routes of the direct transport
+    destroy_transport(&_cnf->tp);
+    // free ids of recently seen messages
+    destroy_seen(&_cnf->seen);
+    // write back and unmap contact cache
+    destroy_cache(&_cnf->cache);
+    // close write pipe used by thread function th_new_conn
+    close(_cnf->cl_change[1]);
     // close write pipe for thread function th_new_input
     close(_cnf->user_input[1]);
     // delete readline prompt and return to beginning of current line
@@ -471,8 +717,10 @@ terminate(int sig)
  * Interpretes the given line and reacts correspondently to it. If the
  * line is a command it will be executed, otherwise it will be treated as
  * text message and send to all known contacts stored in the contactlist
- * in the global configuration.
+ * in the global configuration. In overlay mode the message is sent to
+ * random contacts of the active view, who forward it to their contacts.
  * @see write_pdu()
+ * @see send_overlay()
  * @return 0 on success, -1 on error
  */
 int
@@ -480,6 +728,7 @@ handle_local_input(char* line)
 {
     dchat_pdu_t msg; // pdu containing the chat text message
     int i, ret = 0, len;
+    int64_t seq;     // sequence number of the message in the log
 
     // check if user entered command
     if ((ret = parse_cmd(line)) == 0 || ret == 1)
@@ -492,6 +741,14 @@ handle_local_input(char* line)
         ret = 0;
         len = strlen(line); // memory for text message
 
+        // longer messages would not be reassembled by contacts
+        if (len > FG_MAX_MESSAGE)
+        {
+            ui_log(LOG_WARN, "Message of %d bytes is longer than %d bytes!", len,
+                   FG_MAX_MESSAGE);
+            return 0;
+        }
+
         if (len != 0)
         {
             // inititialize pdu
@@ -504,16 +761,37 @@ handle_local_input(char* line)
 
             // set content of pdu
             init_dchat_pdu_content(&msg, line, strlen(line));
+            // identify message and do not display it if it comes back
+            init_dchat_pdu_msg_id(&msg, _cnf->msg_seq++);
+            check_seen(&_cnf->seen, msg.msg_id, strlen(msg.msg_id));
 
-            // write pdu to known contacts
-            for (i = 0; i < _cnf->cl.cl_size; i++)
+            if (_cnf->ovl.enabled)
+            {
+                // we are the author of this message
+                msg.hop_limit = OVL_HOP_LIMIT;
+                strncat(msg.origin_id, _cnf->me.onion_id, ONION_ADDRLEN);
+                msg.origin_lport = _cnf->me.lport;
+                strncat(msg.origin_name, _cnf->me.name, MAX_NICKNAME);
+                ret = send_overlay(-1, &msg);
+            }
+            else
             {
-                if (_cnf->cl.contact[i].fd)
+                // write pdu to known contacts
+                for (i = 0; i < _cnf->cl.cl_size; i++)
                 {
-                    ret = write_pdu(_cnf->cl.contact[i].fd, &msg);
+                    if (_cnf->cl.contact[i].fd)
+                    {
+                        ret = send_pdu(i, &msg);
+                    }
                 }
             }
 
+            // contacts missing the message get it replayed, it can be searched
+            if ((seq = ml_append(&_cnf->ml, &msg)) > 0)
+            {
+                si_add(&_cnf->si, &_cnf->ml, seq, msg.content, msg.content_length);
+            }
+
             free_pdu(&msg);
         }
     }
@@ -534,14 +812,14 @@ int
 handle_remote_input(int n)
 {
     dchat_pdu_t pdu;    // pdu read from contact file descriptor
-    char* txt_msg;      // message used to store remote input
     int ret;            // return value
     int len;            // amount of bytes read
     contact_t* contact; // contact to send a message to
+    int64_t seq;        // sequence number of the message in the log
     contact = &_cnf->cl.contact[n];
 
     // read pdu from file descriptor (-1 indicates error)
-    if ((len = read_pdu(contact->fd, &pdu)) == -1)
+    if ((len = read_pdu(contact->fd, &pdu, contact)) == -1)
     {
         ui_log(LOG_ERR, "Illegal PDU from '%s'!", contact->name);
         return -1;
@@ -553,11 +831,34 @@ handle_remote_input(int n)
         return 0;
     }
 
+    // binary framing is accepted only if it has been offered
+    if (pdu.version == DCHAT_V2 && _cnf->text_only)
+    {
+        ui_log(LOG_ERR, "'%s' sent a binary PDU, which has not been offered!",
+               contact->name);
+        free_pdu(&pdu);
+        return -1;
+    }
+
+    // messages exceeding MAX_CONTENT_LEN are handled once reassembled
+    if ((ret = fg_receive(n, &pdu)) != 1)
+    {
+        return ret == -1 ? -1 : len;
+    }
+
+    // drop messages which reached us over another path before
+    if (pdu.msg_id[0] != '\0' && check_seen(&_cnf->seen, pdu.msg_id, strlen(pdu.msg_id)))
+    {
+        free_pdu(&pdu);
+        return len;
+    }
+
     // the first pdus of a newly connected client have to be a
-    // "control/discover" containing the onion-id and listening
-    // port, otherwise raise an error and delete
-    // this contact
+    // "control/hello", "control/digest" or "control/discover"
+    // containing the onion-id and listening port, otherwise raise
+    // an error and delete this contact
     if ((contact->onion_id[0] == '\0' || !contact->lport)  &&
+        pdu.content_type != CTT_ID_HLO && pdu.content_type != CTT_ID_DGS &&
         pdu.content_type != CTT_ID_DSC)
     {
         ui_log(LOG_ERR, "Client '%d' omitted identification!", n);
@@ -610,18 +911,29 @@ handle_remote_input(int n)
      */
     if (pdu.content_type == CTT_ID_TXT)
     {
-        // allocate memory for text message
-        if ((txt_msg = malloc(pdu.content_length + 1)) == NULL)
+        // messages with an origin have been forwarded
+        if (pdu.origin_id[0] != '\0')
+        {
+            // pass message on to our contacts
+            if (_cnf->ovl.enabled && pdu.hop_limit > 1 && forward_pdu(n, &pdu) == -1)
+            {
+                ui_log(LOG_WARN, "Could not forward message of '%s'!", pdu.origin_name);
+            }
+
+            // display the nickname of the author instead of the forwarder
+            pdu.nickname[0] = '\0';
+            strncat(pdu.nickname, pdu.origin_name[0] != '\0' ? pdu.origin_name :
+                    pdu.origin_id, MAX_NICKNAME);
+        }
+
+        // keep message for contacts that missed it and index it
+        if ((seq = ml_append(&_cnf->ml, &pdu)) > 0)
         {
-            ui_fatal("Memory allocation for text message failed!");
+            si_add(&_cnf->si, &_cnf->ml, seq, pdu.content, pdu.content_length);
         }
 
-        // store bytes from pdu in txt_msg and terminate it
-        memcpy(txt_msg, pdu.content, pdu.content_length);
-        txt_msg[pdu.content_length] = '\0';
-        // print text message
-        ui_write(pdu.nickname, txt_msg);
-        free(txt_msg);
+        // print text message, the content read is null terminated
+        ui_write(pdu.nickname, pdu.content);
     }
     /*
      * == CONTROL/DISCOVER ==
@@ -643,6 +955,117 @@ handle_remote_input(int n)
             ui_log(LOG_WARN, "Could not add all contacts from the received contactlist!");
         }
     }
+    /*
+     * == CONTROL/HELLO ==
+     */
+    else if (pdu.content_type == CTT_ID_HLO)
+    {
+        // the contact reads binary frames, if his hello offers them
+        if (!_cnf->text_only && pdu.server != NULL && strstr(pdu.server, V2_OFFER) != NULL)
+        {
+            contact->version = DCHAT_V2;
+        }
+
+        // files are only sent to contacts that accept them
+        contact->files = pdu.server != NULL && strstr(pdu.server, FT_OFFER) != NULL;
+
+        // PDUs are deflated for contacts that accept them
+        contact->zc.offered = _cnf->zc.min && pdu.server != NULL &&
+                              strstr(pdu.server, ZC_OFFER) != NULL;
+
+        // long messages are fragmented for contacts that reassemble them
+        contact->fg.offered = pdu.server != NULL && strstr(pdu.server, FG_OFFER) != NULL;
+
+        // chunks of files are skipped for contacts that hold them
+        contact->chunks = pdu.server != NULL && strstr(pdu.server, CS_OFFER) != NULL;
+
+        // shared files are announced to contacts that join swarms
+        contact->swarms = pdu.server != NULL && strstr(pdu.server, SW_OFFER) != NULL;
+
+        // chunks of files carry checksums for contacts that verify them
+        contact->checksums = pdu.server != NULL && strstr(pdu.server, CK_OFFER) != NULL;
+
+        // resolve simultaneous connects before contacts are exchanged
+        if ((ret = check_duplicates(n)) != -1)
+        {
+            ui_log(LOG_INFO, "Detected duplicate contact - removing it!");
+            del_contact(ret);  // delete duplicate
+        }
+
+        // in overlay mode the contact has to fit into the active view
+        if (ret != n && _cnf->cl.contact[n].accepted &&
+            ovl_admit(n, pdu.content) == -1)
+        {
+            free_pdu(&pdu);
+            return -1;
+        }
+
+        // remember contact for later sessions
+        if (ret != n)
+        {
+            cache_seen(&_cnf->cache, contact->onion_id, contact->lport);
+        }
+
+        // continue with the contact exchange if this connection is kept
+        if (ret != n && send_digest(n) == -1)
+        {
+            ui_log(LOG_WARN, "Could not send digest of the contactlist!");
+        }
+
+        // catch up on the messages missed while not connected
+        if (ret != n && ml_request(&_cnf->ml, n) == -1)
+        {
+            ui_log(LOG_WARN, "Could not request replay of messages!");
+        }
+    }
+    /*
+     * == CONTROL/DIGEST ==
+     */
+    else if (pdu.content_type == CTT_ID_DGS)
+    {
+        // duplicates are detected as soon as a contact identified itself
+        if ((ret = check_duplicates(n)) != -1)
+        {
+            ui_log(LOG_INFO, "Detected duplicate contact - removing it!");
+            del_contact(ret);  // delete duplicate
+        }
+
+        // answer with the contacts missing in the digest
+        if (ret != n && receive_digest(n, &pdu) == -1)
+        {
+            ui_log(LOG_WARN, "Could not send contacts missing in the received digest!");
+        }
+    }
+    /*
+     * == CONTROL/REPLAY ==
+     */
+    else if (pdu.content_type == CTT_ID_RPY)
+    {
+        // requests to replay logged messages and their answers
+        if (ml_receive(&_cnf->ml, n, pdu.content, pdu.content_length) == -1)
+        {
+            ui_log(LOG_WARN, "Could not handle replay of '%s'!", contact->name);
+        }
+    }
+    /*
+     * == APPLICATION/OCTET ==
+     */
+    else if (pdu.content_type == CTT_ID_BIN)
+    {
+        // announcements, requests and pieces of swarms
+        if (pdu.content_length > 2 && !memcmp(pdu.content, SW_PREFIX, 2))
+        {
+            if (sw_receive(&_cnf->sw, n, pdu.content, pdu.content_length) == -1)
+            {
+                ui_log(LOG_WARN, "Could not handle swarm of '%s'!", contact->name);
+            }
+        }
+        // offers, answers and chunks of files
+        else if (ft_receive(&_cnf->ft, n, pdu.content, pdu.content_length) == -1)
+        {
+            ui_log(LOG_WARN, "Could not handle file transfer of '%s'!", contact->name);
+        }
+    }
     /*
      * == UNKNOWN CONTENT-TYPE ==
      */
@@ -656,47 +1079,234 @@ handle_remote_input(int n)
 }
 
 
+/**
+ * Forwards a chat message received from a contact.
+ * The message will be passed on with a decremented hop limit to random
+ * contacts of the active view (see: send_overlay()). The origin, date and
+ * content of the message are kept, whereas all other headers identify this
+ * client as the forwarder.
+ * @param n   Index of contact from whom the message has been received
+ * @param pdu Pointer to the received message
+ * @return amount of contacts the message has been forwarded to, -1 on error
+ */
+int
+forward_pdu(int n, dchat_pdu_t* pdu)
+{
+    dchat_pdu_t fwd; // forwarded message
+    int ret;
+
+    if (init_dchat_pdu(&fwd, 1.0, pdu->content_type, _cnf->me.onion_id,
+                       _cnf->me.lport, _cnf->me.name) == -1)
+    {
+        return -1;
+    }
+
+    init_dchat_pdu_content(&fwd, pdu->content, pdu->content_length);
+    memcpy(&fwd.sent, &pdu->sent, sizeof(struct tm));
+    fwd.hop_limit = pdu->hop_limit - 1;
+    strncat(fwd.origin_id, pdu->origin_id, ONION_ADDRLEN);
+    fwd.origin_lport = pdu->origin_lport;
+    strncat(fwd.origin_name, pdu->origin_name, MAX_NICKNAME);
+    strncat(fwd.msg_id, pdu->msg_id, MAX_MSGID_LEN);
+
+    if ((ret = send_overlay(n, &fwd)) > 0)
+    {
+        _cnf->ovl.fwd_pdus++;
+    }
+
+    free_pdu(&fwd);
+    return ret;
+}
+
+
+/**
+ * Sends a PDU to random contacts of the active view.
+ * The PDU will be sent to at most `fanout` identified contacts, except the
+ * contact we received it from and the author of the PDU.
+ * @param n   Index of contact to exclude, -1 to exclude nobody
+ * @param pdu Pointer to the PDU to send
+ * @return amount of contacts the PDU has been sent to, -1 on error
+ */
+int
+send_overlay(int n, dchat_pdu_t* pdu)
+{
+    int* peers;     // active contacts in random order
+    int peer_cnt;   // amount of contacts selected
+    int sent = 0;   // amount of contacts the pdu has been sent to
+    contact_t* contact;
+
+    peer_cnt = ovl_select_peers(n, _cnf->ovl.fanout, &peers);
+
+    for (int i = 0; i < peer_cnt; i++)
+    {
+        contact = &_cnf->cl.contact[peers[i]];
+
+        // the author already knows his message
+        if (contact->lport == pdu->origin_lport &&
+            !strcmp(contact->onion_id, pdu->origin_id))
+        {
+            continue;
+        }
+
+        if (send_pdu(peers[i], pdu) == -1)
+        {
+            free(peers);
+            return -1;
+        }
+
+        sent++;
+    }
+
+    free(peers);
+    return sent;
+}
+
+
 /**
  * Handles local connection requests from the user.
  * Connects to the remote client with the given onion address, who will
- * be added as contact. This new contact will be sent that all of our known
- * contacts as specified in the DChat protocol.
+ * be added as contact. This new contact will be sent a hello as specified in
+ * the DChat protocol. No circuit will be built to clients which are already
+ * connected. If the remote client connected to us while our circuit has been
+ * built, the duplicate is resolved before anything has been sent (see:
+ * keep_connect()). The contactlist is only locked before and after the
+ * connection has been established.
  * @param onion_id Destination onion address to connect to
  * @param port     Destination port to connect to
+ * @param prio     Priority of the connection request (see: CONN_PRIO_*)
  * @return The index where the contact has been added in the contactlist,
- * -1 on error
+ * -1 on error, -2 if the connection is a duplicate
  */
 int
-handle_local_conn_request(char* onion_id, uint16_t port)
+handle_local_conn_request(char* onion_id, uint16_t port, int prio)
 {
-    int s; // socket of the contact we have connected to
-    int n; // index of the contact in our contactlist
+    int s;          // socket of the contact we have connected to
+    int n;          // index of the contact in our contactlist
+    contact_t temp; // contact to connect to
+    struct timespec start, end; // duration of connect
+    dchat_pdu_t hello;          // hello sent as optimistic data
+    char* hello_str = NULL;     // encoded hello, NULL if not sent optimistically
+    int hello_len = 0;          // length of encoded hello
+
+    memset(&temp, 0, sizeof(temp));
+    strncat(temp.onion_id, onion_id, ONION_ADDRLEN);
+    temp.lport = port;
+
+    // do not get canceled while holding the lock of the contactlist
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_mutex_lock(&_cnf->cl.cl_mx);
+    // contact is ourself or already connected (e.g. he connected to us)
+    n = find_contact(&temp, 0);
+    pthread_mutex_unlock(&_cnf->cl.cl_mx);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+
+    if (n != -2)
+    {
+        return -2;
+    }
+
+    // a connection built in advance has passed the rendezvous already
+    if ((s = wp_claim(&_cnf->wp, onion_id, port)) != -1)
+    {
+        ui_log(LOG_INFO, "Using ready connection to '%s:%hu'!", onion_id, port);
+        return add_tor_contact(s, onion_id, port, prio, 0);
+    }
+
+    // send the hello together with the SOCKS request, so that it does not
+    // have to wait for the circuit
+    if (_cnf->socks.optimistic && init_hello(&hello, ovl_hello_prio(-1, prio)) != -1)
+    {
+        if ((hello_len = encode_pdu(&hello, &hello_str)) == -1)
+        {
+            hello_str = NULL;
+            hello_len = 0;
+        }
+
+        free_pdu(&hello);
+    }
 
     // connect to given address
-    if ((s = create_tor_socket(onion_id, port)) == -1)
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    s = create_peer_socket(onion_id, port, hello_str, hello_len);
+    free(hello_str);
+
+    if (s == -1)
     {
+        cache_failure(&_cnf->cache, onion_id, port);
         return -1;
     }
-    else
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cache_success(&_cnf->cache, onion_id, port, (end.tv_sec - start.tv_sec) * 1000 +
+                  (end.tv_nsec - start.tv_nsec) / 1000000);
+    return add_tor_contact(s, onion_id, port, prio, hello_len > 0);
+}
+
+
+/**
+ * Adds a connection established through TOR as new contact.
+ * The contactlist will be locked while the contact is added. If the remote
+ * client connected to us in the meantime, the duplicate is resolved (see:
+ * keep_connect()), otherwise the new contact will be sent a hello, unless
+ * it has already been sent as optimistic data.
+ * @param s          Socket connected to the remote client
+ * @param onion_id   Onion address of the remote client
+ * @param port       Listening port of the remote client
+ * @param prio       Priority of the connection request (see: CONN_PRIO_*)
+ * @param hello_sent Hello has been sent together with the SOCKS request
+ * @return The index where the contact has been added in the contactlist,
+ * -1 on error, -2 if the connection is a duplicate (socket will be closed)
+ */
+int
+add_tor_contact(int s, char* onion_id, uint16_t port, int prio, int hello_sent)
+{
+    int n;          // index of the contact in our contactlist
+    contact_t temp; // contact connected to
+
+    memset(&temp, 0, sizeof(temp));
+    strncat(temp.onion_id, onion_id, ONION_ADDRLEN);
+    temp.lport = port;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_mutex_lock(&_cnf->cl.cl_mx);
+
+    // contact identified himself on an accepted connection in the meantime
+    if ((n = find_contact(&temp, 0)) != -2)
     {
-        // add contact
-        if ((n = add_contact(s)) == -1)
+        if (n == -1 || !_cnf->cl.contact[n].accepted || !keep_connect(&temp))
         {
-            ui_log_errno(LOG_ERR, "Could not add new contact!");
-            return -1;
+            close(s);
+            pthread_mutex_unlock(&_cnf->cl.cl_mx);
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            return -2;
         }
-        else
+
+        // our connection will be kept, the remote client drops his one
+        del_contact(n);
+    }
+
+    // add contact
+    if ((n = add_contact(s)) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Could not add new contact!");
+        close(s);
+    }
+    else
+    {
+        // set onion id of new contact
+        _cnf->cl.contact[n].onion_id[0] = '\0';
+        strncat(_cnf->cl.contact[n].onion_id, onion_id, ONION_ADDRLEN);
+        // set listening port of new contact
+        _cnf->cl.contact[n].lport = port;
+        // identify ourself to the newly connected client
+        if (!hello_sent)
         {
-            // set onion id of new contact
-            _cnf->cl.contact[n].onion_id[0] = '\0';
-            strncat(_cnf->cl.contact[n].onion_id, onion_id, ONION_ADDRLEN);
-            // set listening port of new contact
-            _cnf->cl.contact[n].lport = port;
-            // send all our known contacts to the newly connected client
-            send_contacts(n);
+            send_hello(n, ovl_hello_prio(n, prio));
         }
     }
 
+    pthread_mutex_unlock(&_cnf->cl.cl_mx);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
     return n;
 }
 
@@ -708,16 +1318,17 @@ handle_local_conn_request(char* onion_id, uint16_t port)
  * host will be added as new contact in the contactlist and the local contactlist
  * will be sent to him.
  * @see add_contact()
+ * @param lfd Listening socket (TCP or unix socket) to accept from
  * @return return value of function add_contact, or -1 on error
  */
 int
-handle_remote_conn_request()
+handle_remote_conn_request(int lfd)
 {
     int s;                      // socket file descriptor
     int n;                      // index of new contact
 
     // accept connection request
-    if ((s = accept(_cnf->acpt_fd, NULL, NULL)) == -1)
+    if ((s = accept(lfd, NULL, NULL)) == -1)
     {
         ui_log_errno(LOG_ERR, "Could not accept connection from remote host!");
         return -1;
@@ -735,95 +1346,63 @@ handle_remote_conn_request()
     }
 
     _cnf->cl.contact[n].accepted = 1;
-    send_contacts(n);
+    send_hello(n, OVL_PRIO_NONE);
     return n;
 }
 
 
 /**
- * Cleanup ressources used by the thread `conn_th` holded by the
- * global config.
- * Closes the reading pipe `connect_fd` and the writing pipe end
- * of `cl_change` stored in the global config.
- */
-void
-cleanup_th_new_conn(void* arg)
-{
-    /// close pipes used for in `th_new_conn`
-    close(_cnf->connect_fd[0]);
-    close(_cnf->cl_change[1]);
-}
-
-
-/**
- * Thread function that reads an onion address from a pipe and connects to this
- * address.
- * Establishes new connections to the given addresses read from the global config
- * pipe `connect_fd`. It reads an onion address and then connects to
- * this address via TOR. If a connection has been established successfully, a new
- * contact will be added and the contactlist will be sent to him. Furthermore
- * the character '1' will be written to the global config pipe `cl_change`.
+ * Thread function that takes connection requests from the connection queue
+ * and connects to the requested addresses.
+ * Establishes new connections to the addresses queued in the global config
+ * queue `cq`. Several of these threads run in parallel, so that a slow
+ * circuit does not delay other connects. If a connection has been
+ * established successfully, a new contact will be added and a hello will
+ * be sent to him. Furthermore the character '1' will be written to the
+ * global config pipe `cl_change`.
  * @see handle_local_conn_request()
+ * @see dequeue_conn()
  */
 void*
 th_new_conn()
 {
-    char onion_id[ONION_ADDRLEN + 1]; // onion address of remote host
-    uint16_t port;                    // port of remote host
-    char c = '1';                     // signal that a new connection has been established
+    conn_req_t req; // connection request
+    char c = '1';   // signal that a new connection has been established
     int ret;
-    // setup cleanup handler and cancelation attributes
-    pthread_cleanup_push(cleanup_th_new_conn, NULL);
+    // setup cancelation attributes
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
 
     for (;;)
     {
-        // read from pipe to get new address
-        if ((ret = read(_cnf->connect_fd[0], onion_id, ONION_ADDRLEN)) == -1)
-        
-        {
-            ui_log(LOG_WARN, "Could not read Onion-ID from connection pipe!");
-        }
+        // wait for a request that may be started
+        dequeue_conn(&_cnf->cq, &req);
 
-        // EOF
-        if (!ret)
-        {
-            break;
-        }
+        ret = handle_local_conn_request(req.onion_id, req.lport, req.prio);
 
-        // read from pipe to get new port
-        if ((ret = read(_cnf->connect_fd[0], &port, sizeof(uint16_t))) == -1)
+        // wake up the main loop to wait for a scheduled reconnect
+        if (rc_result(&_cnf->rc, req.onion_id, req.lport, req.prio, ret) &&
+            write(_cnf->cl_change[1], &c, sizeof(c)) == -1)
         {
-            ui_log(LOG_WARN, "Could not read Listening-Port from connection pipe!");
+            ui_log(LOG_WARN, "Could not write to change pipe!");
         }
 
-        // EOF
-        if (!ret)
+        if (ret == -1)
         {
-            break;
+            ui_log(LOG_WARN, "Connection to remote host failed!");
         }
-
-        // terminate address
-        onion_id[ONION_ADDRLEN] = '\0';
-        // lock contactlist
-        pthread_mutex_lock(&_cnf->cl.cl_mx);
-
-        if (handle_local_conn_request(onion_id, port) == -1)
+        else if (ret == -2)
         {
-            ui_log(LOG_WARN, "Connection to remote host failed!");
+            ui_log(LOG_INFO, "Already connected to '%s:%hu'!", req.onion_id, req.lport);
         }
         else if ((write(_cnf->cl_change[1], &c, sizeof(c))) == -1)
         {
             ui_log(LOG_WARN, "Could not write to change pipe!");
         }
 
-        // unlock contactlist
-        pthread_mutex_unlock(&_cnf->cl.cl_mx);
+        finish_conn(&_cnf->cq, &req);
     }
 
-    // execute cleanup handler
-    pthread_cleanup_pop(1);
     pthread_exit(NULL);
 }
 
@@ -914,8 +1493,17 @@ void
 cleanup_th_main_loop(void* arg)
 {
     int i;
-    // close local listening socket
-    close(_cnf->acpt_fd);
+    // close local listening sockets
+    if (_cnf->acpt_fd != -1)
+    {
+        close(_cnf->acpt_fd);
+    }
+
+    if (_cnf->unix_fd != -1)
+    {
+        close(_cnf->unix_fd);
+        unlink(_cnf->unix_path);
+    }
 
     // close file descriptors of contacts
     for (i = 0; i < _cnf->cl.cl_size; i++)
@@ -940,7 +1528,13 @@ cleanup_th_main_loop(void* arg)
  * It waits for local userinput, PDUs from remote clients, local connection
  * requests and remote connection requests. If select returns and a  file
  * descriptor can be read, this function will take action depending on which file
- * descriptor is able to read from.
+ * descriptor is able to read from. In overlay mode select(2) times out every
+ * OVL_TIMER_INTERVAL seconds to maintain the active and passive view. If PDUs
+ * are coalesced or lost contacts are reconnected, select(2) times out when the
+ * next coalescing window passes or the next reconnect is due.
+ * @see ovl_maintain()
+ * @see flush_contacts()
+ * @see rc_run()
  */
 void*
 th_main_loop()
@@ -952,6 +1546,16 @@ th_main_loop()
     char* line;     // line returned from user input
     int cancel = 0; // cancel main loop
     int i;
+    long timer;     // microseconds until coalesced PDUs are written or a
+                    // reconnect is due, -1 if nothing is waiting
+    long rc;        // microseconds until the next reconnect is due
+    long ft;        // microseconds until the socket buffers are checked for
+                    // chunks of files
+    long sw;        // microseconds until the socket buffers are checked for
+                    // pieces of swarms
+    long fg;        // microseconds until the next fragmented message expires
+    int b, rb;      // bytes of user input read (in total, at once)
+    struct timeval tv; // timeout of select
     // setup cleanup handler and cancelation attributes
     pthread_cleanup_push(cleanup_th_main_loop, NULL);
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
@@ -964,9 +1568,21 @@ th_main_loop()
         // ADD STDIN: pipe file descriptor that connects the thread
         // function 'th_new_input'
         FD_SET(_cnf->user_input[0], &rset);
-        // ADD LISTENING PORT: acpt_fd of global config
-        FD_SET(_cnf->acpt_fd, &rset);
-        nfds = max(_cnf->user_input[0], _cnf->acpt_fd);
+        nfds = _cnf->user_input[0];
+
+        // ADD LISTENING PORT: acpt_fd and unix_fd of global config
+        if (_cnf->acpt_fd != -1)
+        {
+            FD_SET(_cnf->acpt_fd, &rset);
+            nfds = max(nfds, _cnf->acpt_fd);
+        }
+
+        if (_cnf->unix_fd != -1)
+        {
+            FD_SET(_cnf->unix_fd, &rset);
+            nfds = max(nfds, _cnf->unix_fd);
+        }
+
         // ADD NEW CONN: pipe file descriptor that connects the thead
         // function 'th_new_conn'
         FD_SET(_cnf->cl_change[0], &rset);
@@ -985,17 +1601,61 @@ th_main_loop()
             }
         }
 
+        // write coalesced PDUs whose window has passed
+        timer = flush_contacts();
+
+        // send chunks of files as long as the socket buffers take them
+        if ((ft = ft_run(&_cnf->ft)) != -1 && (timer == -1 || ft < timer))
+        {
+            timer = ft;
+        }
+
+        // request pieces of swarms and send the pieces requested by peers
+        if ((sw = sw_run(&_cnf->sw)) != -1 && (timer == -1 || sw < timer))
+        {
+            timer = sw;
+        }
+
+        // drop messages whose fragments stopped arriving
+        if ((fg = fg_expire()) != -1 && (timer == -1 || fg < timer))
+        {
+            timer = fg;
+        }
+
         pthread_mutex_unlock(&_cnf->cl.cl_mx);
+
+        // queue reconnects whose backoff has passed
+        if ((rc = rc_run(&_cnf->rc, &_cnf->cq)) != -1 && (timer == -1 || rc < timer))
+        {
+            timer = rc;
+        }
+
         // used as backup since nfds will be overwritten if an
         // interrupt
         // occurs
         int old_nfds = nfds;
         pthread_testcancel();
+        tv.tv_sec = OVL_TIMER_INTERVAL;
+        tv.tv_usec = 0;
+
+        if (timer != -1 && (!_cnf->ovl.enabled || timer < OVL_TIMER_INTERVAL * 1000000L))
+        {
+            tv.tv_sec = timer / 1000000;
+            tv.tv_usec = timer % 1000000;
+        }
 
-        while ((nfds = select(old_nfds + 1, &rset, NULL, NULL, NULL))  <= 0)
+        while ((nfds = select(old_nfds + 1, &rset, NULL, NULL,
+                              _cnf->ovl.enabled || timer != -1 ? &tv : NULL))  <= 0)
         {
             pthread_testcancel();
 
+            // timeout: nothing to read, but maintain the overlay or
+            // write coalesced PDUs
+            if (nfds == 0)
+            {
+                break;
+            }
+
             if (nfds == -1)
             {
                 // something interrupted select(2) - try select again
@@ -1030,8 +1690,13 @@ th_main_loop()
             // allocate memory for the string entered from user
             line = malloc(ret + 1);
 
-            // read string
-            if (read(_cnf->user_input[0], line, ret) < 0 || ret <= 0)
+            // read string, long lines exceed the capacity of the pipe
+            for (b = 0, rb = 1; ret > 0 && b < ret && rb > 0; b += rb)
+            {
+                rb = read(_cnf->user_input[0], line + b, ret - b);
+            }
+
+            if (ret <= 0 || rb <= 0)
             {
                 free(line);
                 break;
@@ -1052,13 +1717,28 @@ th_main_loop()
 
         // CHECK LISTENING PORT: check if new connection can be
         // accepted
-        if (FD_ISSET(_cnf->acpt_fd, &rset))
+        if (_cnf->acpt_fd != -1 && FD_ISSET(_cnf->acpt_fd, &rset))
         {
             nfds--;
             pthread_mutex_lock(&_cnf->cl.cl_mx);
 
             // handle new connection request
-            if ((ret = handle_remote_conn_request()) == -1)
+            if ((ret = handle_remote_conn_request(_cnf->acpt_fd)) == -1)
+            {
+                break;
+            }
+
+            pthread_mutex_unlock(&_cnf->cl.cl_mx);
+        }
+
+        // CHECK LISTENING UNIX SOCKET: connections forwarded by TOR to
+        // the unix socket are handled the same way
+        if (_cnf->unix_fd != -1 && FD_ISSET(_cnf->unix_fd, &rset))
+        {
+            nfds--;
+            pthread_mutex_lock(&_cnf->cl.cl_mx);
+
+            if ((ret = handle_remote_conn_request(_cnf->unix_fd)) == -1)
             {
                 break;
             }
@@ -1092,11 +1772,21 @@ th_main_loop()
                 // -1 = error, 0 = EOF
                 if ((ret = handle_remote_input(i)) == -1 || ret == 0)
                 {
-                    del_contact(i);
+                    if (_cnf->cl.contact[i].lport)
+                    {
+                        cache_seen(&_cnf->cache, _cnf->cl.contact[i].onion_id,
+                                   _cnf->cl.contact[i].lport);
+                        rc_lost(&_cnf->rc, _cnf->cl.contact[i].onion_id,
+                                _cnf->cl.contact[i].lport);
+                    }
+
+                    ovl_del_contact(i);
                 }
             }
         }
 
+        // refill active view and shuffle (overlay mode only)
+        ovl_maintain();
         pthread_mutex_unlock(&_cnf->cl.cl_mx);
     }
 
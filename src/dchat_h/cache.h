@@ -0,0 +1,109 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "network.h"
+
+
+//*********************************
+//     CONTACT CACHE SETTINGS
+//*********************************
+#define CACHE_MAGIC      "DCHATCC1" // identifies a contact cache file
+#define CACHE_MAGIC_LEN  8
+#define CACHE_RECORDS    256        // max. addresses stored in the cache
+#define CACHE_RECONNECT  8          // addresses reconnected at startup
+#define CACHE_DEF_FILE   "%s/.dchat-%hu.cache" // home directory and port
+#define CACHE_MAX_PATH   4096
+
+
+/*!
+ * Structure for an address within the contact cache file.
+ * Only fixed-width fields are used, so that the file can be mapped as is.
+ */
+typedef struct cache_rec
+{
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address, empty if unused
+    uint8_t used;                       //!< record is in use
+    uint16_t lport;                     //!< listening port
+    int64_t last_seen;                  //!< time the contact has been seen last
+    uint32_t rtt;                       //!< smoothed connect time in ms
+    uint32_t successes;                 //!< successful connects
+    uint32_t failures;                  //!< failed connects
+} cache_rec_t;
+
+/*!
+ * Structure for the header of the contact cache file
+ */
+typedef struct cache_hdr
+{
+    char magic[CACHE_MAGIC_LEN];        //!< CACHE_MAGIC
+    uint32_t rec_size;                  //!< size of one record
+    uint32_t records;                   //!< amount of records
+} cache_hdr_t;
+
+/*!
+ * Structure for the contact cache of this client.
+ * The cache file consists of a header followed by CACHE_RECORDS records
+ * and is mapped into memory, so that every change is written back by the
+ * kernel without any further I/O.
+ */
+typedef struct contact_cache
+{
+    char path[CACHE_MAX_PATH + 1];      //!< path of the cache file
+    int fd;                             //!< file descriptor of the cache file
+    cache_hdr_t* hdr;                   //!< mapped file, NULL if disabled
+    cache_rec_t* rec;                   //!< records following the header
+    unsigned long reconnects;           //!< connects queued at startup
+    pthread_mutex_t cc_mx;              //!< mutex to lock the records
+} contact_cache_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int init_cache(contact_cache_t* cc);
+void destroy_cache(contact_cache_t* cc);
+
+
+//*********************************
+//       RECORD FUNCTIONS
+//*********************************
+void cache_success(contact_cache_t* cc, char* onion_id, uint16_t lport, uint32_t rtt);
+void cache_failure(contact_cache_t* cc, char* onion_id, uint16_t lport);
+void cache_seen(contact_cache_t* cc, char* onion_id, uint16_t lport);
+int cache_select(contact_cache_t* cc, int max, cache_rec_t** recs);
+int cache_used(contact_cache_t* cc);
+int cache_reconnect(contact_cache_t* cc);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+cache_rec_t* cache_get_rec(contact_cache_t* cc, char* onion_id, uint16_t lport, int add);
+double cache_score(cache_rec_t* rec, time_t now);
+
+
+#endif
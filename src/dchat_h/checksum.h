@@ -0,0 +1,73 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+
+//*********************************
+//      CHECKSUM SETTINGS
+//*********************************
+#define CK_OFFER      "DCHAT-CRC32C/1.0" // token in the Server header of a hello verifying checksums
+#define CK_POLY       0x82f63b78    // Castagnoli polynomial, reflected
+#define CK_BUF_LEN    16384         // bytes of a file read at once to checksum it
+#define CK_LANE       1024          // bytes per lane of the SSE4.2 kernel
+#define CK_STR_LEN    8             // length of a checksum in hex (Content-CRC32C header)
+
+
+/*!
+ * Structure for the verification of checksums.
+ * Chunks of files sent to contacts offering CK_OFFER carry the CRC-32C of
+ * their content, which the receiver computes while the content arrives
+ * (see: read_pdu()).
+ */
+typedef struct checksums
+{
+    uint32_t (*crc)(uint32_t, const void*, size_t); //!< fastest kernel available
+    char* kernel;                       //!< name of kernel
+    unsigned long sent;                 //!< PDUs sent with checksum
+    unsigned long verified;             //!< PDUs received with matching checksum
+    unsigned long failed;               //!< PDUs received with wrong checksum
+} checksums_t;
+
+
+//*********************************
+//          INIT FUNCTION
+//*********************************
+void init_checksums(checksums_t* ck);
+
+
+//*********************************
+//       CHECKSUM FUNCTIONS
+//*********************************
+uint32_t ck_crc32c(uint32_t crc, const void* buf, size_t len);
+uint32_t ck_crc32c_sw(uint32_t crc, const void* buf, size_t len);
+uint32_t ck_crc32c_hw(uint32_t crc, const void* buf, size_t len);
+int ck_hw(void);
+int ck_file(int fd, off_t offset, int len, uint32_t* crc);
+
+
+#endif
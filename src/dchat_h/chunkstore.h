@@ -0,0 +1,148 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+
+//*********************************
+//     CHUNK STORE SETTINGS
+//*********************************
+#define CS_OFFER         "DCHAT-CHUNKS/1.0" // token in the Server header of a hello holding a chunk store
+#define CS_DIR           ".chunks"  // directory of the store within the download directory
+#define CS_MAX_PATH      (255 + sizeof(CS_DIR)) // max. length of the store directory (see: FT_MAX_PATH)
+#define CS_MAX_FILE_PATH (CS_MAX_PATH + 2 * CS_HASH_LEN + 8) // max. length of a chunk file
+#define CS_DEF_SIZE      64         // default size limit of the store in MB
+#define CS_MAX_SIZE      1048576    // upper limit of the size limit in MB
+#define CS_EVICT_TO      90         // eviction shrinks the store to this percentage of its limit
+#define CS_HASH_LEN      32         // SHA-256 of a chunk
+#define CS_MIN_CHUNK     2048       // min. length of a chunk
+#define CS_AVG_CHUNK     8192       // chunk boundaries are normalized around this length
+#define CS_MAX_CHUNK     16384      // max. length of a chunk
+#define CS_MASK_S        0x0003590703530000ULL // 15 bits, boundary test below the avg. length
+#define CS_MASK_L        0x0000d90003530000ULL // 11 bits, boundary test above the avg. length
+#define CS_GEAR_SEED     0x44434843484b5331ULL // "DCHCHKS1", seeds the gear table of all clients
+#define CS_REC_LEN       (4 + CS_HASH_LEN) // length and hash of a chunk in a chunk list
+#define CS_MAX_CHUNKS    65536      // max. chunks of a file, larger files are not chunked
+#define CS_BUF_LEN       262144     // bytes of a file read at once while chunking
+#define CS_MAX_RECS      ((4096 - 48) / CS_REC_LEN) // max. records of a chunk list per PDU
+#define CS_MAX_HAVE      4000       // max. bytes of a bitmap of chunks held per PDU
+
+
+/*!
+ * Structure for a chunk of a file
+ */
+typedef struct cs_chunk
+{
+    off_t off;                          //!< offset of chunk in file
+    uint32_t len;                       //!< length of chunk
+    unsigned char hash[CS_HASH_LEN];    //!< SHA-256 of chunk
+} cs_chunk_t;
+
+/*!
+ * Structure for the chunk list of a file: its content-defined chunks.
+ * The list of a file sent is shared by the transfers to all contacts.
+ */
+typedef struct cs_list
+{
+    cs_chunk_t* chunk;                  //!< chunks in the order of the file
+    int count;                          //!< amount of chunks
+    int refs;                           //!< transfers using the list
+} cs_list_t;
+
+/*!
+ * Structure for a chunk held in the store
+ */
+typedef struct cs_entry
+{
+    unsigned char hash[CS_HASH_LEN];    //!< SHA-256 of chunk, name of its file
+    uint32_t len;                       //!< length of chunk
+    uint64_t used;                      //!< time of last use in ns
+} cs_entry_t;
+
+/*!
+ * Structure for the store of the chunks of received files.
+ * Every chunk is a file named by its hash in the directory CS_DIR of the
+ * download directory. The modification time of the files is the time of
+ * their last use, so that the least recently used chunks are evicted
+ * first, even across sessions. The entries are looked up by a hash table
+ * of their indices (open addressing), which is rebuilt whenever chunks
+ * are evicted.
+ */
+typedef struct chunk_store
+{
+    char dir[CS_MAX_PATH + 1];          //!< directory of chunks, empty if disabled
+    long long max;                      //!< size limit in bytes, -1 if not set yet
+    long long bytes;                    //!< bytes of chunks held
+    cs_entry_t* entry;                  //!< chunks held
+    int used;                           //!< amount of chunks held
+    int size;                           //!< amount of entries allocated
+    int* table;                         //!< indices of entries, -1 if empty
+    int slots;                          //!< size of table, a power of 2
+    unsigned long hits;                 //!< chunks taken from the store
+    unsigned long long hit_bytes;       //!< bytes taken from the store
+    unsigned long stored;               //!< chunks added
+    unsigned long evicted;              //!< chunks evicted
+} chunk_store_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int init_chunk_store(chunk_store_t* cs, char* download_dir);
+void destroy_chunk_store(chunk_store_t* cs);
+
+
+//*********************************
+//         STORE FUNCTIONS
+//*********************************
+cs_entry_t* cs_lookup(chunk_store_t* cs, unsigned char* hash);
+cs_entry_t* cs_find(chunk_store_t* cs, unsigned char* hash);
+int cs_read(chunk_store_t* cs, cs_entry_t* e, char* buf);
+int cs_put(chunk_store_t* cs, unsigned char* hash, char* data, uint32_t len);
+void cs_evict(chunk_store_t* cs);
+int cs_insert(chunk_store_t* cs, unsigned char* hash, uint32_t len, uint64_t used);
+void cs_rehash(chunk_store_t* cs, int slots);
+
+
+//*********************************
+//      CHUNK LIST FUNCTIONS
+//*********************************
+cs_list_t* cs_chunk_file(int fd, off_t size);
+cs_list_t* cs_new_list(int count);
+void cs_release(cs_list_t* list);
+int cs_encode(cs_list_t* list, int first, int recs, char* buf);
+int cs_decode(cs_list_t* list, int first, char* data, int recs);
+int cs_find_chunk(cs_list_t* list, off_t off, int from);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+void cs_sha256(unsigned char* data, size_t len, unsigned char* hash);
+void cs_path(chunk_store_t* cs, unsigned char* hash, char* path);
+int cs_parse_hash(char* name, unsigned char* hash);
+
+
+#endif
@@ -28,16 +28,33 @@
 //*********************************
 //          MISC
 //*********************************
-#define CMD_AMOUNT 3
+#define CMD_AMOUNT 10
 #define CMD_PREFIX "/"
 
 
+//*********************************
+//       BENCHMARK SETTINGS
+//*********************************
+#define BEN_DEF_COUNT 1000          // messages per framing, if no count is given
+#define BEN_MAX_COUNT 1000000       // upper limit of messages per framing
+#define BEN_PIPE_SIZE 32768         // bytes written to the pipe at once
+#define BEN_MESSAGE   "Hello, this is a typical chat message!\n"
+#define BEN_CHUNK_LEN 16384         // bytes checksummed at once, as many as a chunk of a file (see: FT_CHUNK_LEN)
+
+
 //*********************************
 //        ID OF COMMAND
 //*********************************
 #define CMD_ID_HLP 0x01
 #define CMD_ID_CON 0x02
 #define CMD_ID_LST 0x03
+#define CMD_ID_STA 0x04
+#define CMD_ID_CIR 0x05
+#define CMD_ID_REC 0x06
+#define CMD_ID_BEN 0x07
+#define CMD_ID_SND 0x08
+#define CMD_ID_SEA 0x09
+#define CMD_ID_SHR 0x0A
 
 
 //*********************************
@@ -46,6 +63,13 @@
 #define CMD_NAME_HLP CMD_PREFIX "help"
 #define CMD_NAME_CON CMD_PREFIX "connect"
 #define CMD_NAME_LST CMD_PREFIX "list"
+#define CMD_NAME_STA CMD_PREFIX "stats"
+#define CMD_NAME_CIR CMD_PREFIX "circuits"
+#define CMD_NAME_REC CMD_PREFIX "reconnects"
+#define CMD_NAME_BEN CMD_PREFIX "bench"
+#define CMD_NAME_SND CMD_PREFIX "send"
+#define CMD_NAME_SEA CMD_PREFIX "search"
+#define CMD_NAME_SHR CMD_PREFIX "share"
 
 
 //*********************************
@@ -54,6 +78,13 @@
 #define CMD_ARG_HLP ""
 #define CMD_ARG_CON CLI_OPT_ARG_RONI " " CLI_OPT_ARG_RPRT
 #define CMD_ARG_LST ""
+#define CMD_ARG_STA ""
+#define CMD_ARG_CIR ""
+#define CMD_ARG_REC ""
+#define CMD_ARG_BEN "[COUNT]"
+#define CMD_ARG_SND "FILE"
+#define CMD_ARG_SEA "TERMS"
+#define CMD_ARG_SHR "FILE"
 
 
 //*********************************
@@ -94,6 +125,14 @@ int parse_cmd(char* buf);
 int hlp_exec(char* arg);
 int con_exec(char* arg);
 int lst_exec(char* arg);
+int sta_exec(char* arg);
+int cir_exec(char* arg);
+int rec_exec(char* arg);
+int ben_exec(char* arg);
+int snd_exec(char* arg);
+int sea_exec(char* arg);
+int shr_exec(char* arg);
+int ben_checksums(long count);
 
 
 //*********************************
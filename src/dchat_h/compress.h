@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <time.h>
+
+
+//*********************************
+//     COMPRESSION SETTINGS
+//*********************************
+#define ZC_OFFER         "DEFLATE/1.0" // token in the Server header of a hello accepting deflated PDUs
+#define ZC_ENCODING      "deflate"  // value of the Content-Encoding header of a deflated PDU
+#define ZC_DEF_MIN       256        // default min. length of content deflated
+#define ZC_MAX_MIN       65536      // upper limit of the min. length
+#define ZC_WINDOW_BITS   15         // history of 32 KB shared by the PDUs of a connection
+#define ZC_MEM_LEVEL     6          // memory of the deflate state (about 160 KB per contact)
+#define ZC_SLACK         64         // max. bytes deflated content exceeds its content
+#define ZC_TAIL          "\x00\x00\xff\xff" // end of every flushed PDU, left out
+#define ZC_TAIL_LEN      4
+#define ZC_MAX_TYPES     8          // content types counted (ids 0 - 7)
+#define ZC_TYPES         ((1 << CTT_ID_TXT) | (1 << CTT_ID_DSC) | (1 << CTT_ID_DGS) | \
+                          (1 << CTT_ID_RPY)) // content types deflated
+// preset history of both streams, so that the first PDU is compressed as well
+#define ZC_DICTIONARY    "abcdefghijklmnopqrstuvwxyz234567.onion 0123456789\n" \
+                         ".onion 7000\n.onion 7001\n.onion 8080\n"
+
+// types.h includes this header ahead of the PDU structure
+struct dchat_pdu;
+struct z_stream_s;
+
+
+/*!
+ * Structure for the compression of the PDUs of a connection.
+ * Each direction is a single raw deflate stream, every PDU is flushed, so
+ * that it can be inflated as soon as it has been received. Later PDUs
+ * refer to the content of earlier ones, which makes repeated lists of
+ * contacts cheap. The streams are created with the first deflated PDU.
+ */
+typedef struct zc_stream
+{
+    struct z_stream_s* def;             //!< stream of PDUs sent, NULL if none deflated yet
+    struct z_stream_s* inf;             //!< stream of PDUs received, NULL if none inflated yet
+    int offered;                        //!< contact accepts deflated PDUs (see: ZC_OFFER)
+} zc_stream_t;
+
+/*!
+ * Structure for the compression statistics of a content type
+ */
+typedef struct zc_count
+{
+    unsigned long pdus;                 //!< PDUs deflated or inflated
+    unsigned long in;                   //!< bytes of content before
+    unsigned long out;                  //!< bytes of content after
+    unsigned long ns;                   //!< CPU time in nanoseconds
+} zc_count_t;
+
+/*!
+ * Structure for the compression of PDUs sent to contacts.
+ * The content of PDUs of the types ZC_TYPES is deflated, if it has at
+ * least the min. length and the contact accepts it.
+ */
+typedef struct compression
+{
+    int min;                            //!< min. length of content deflated, 0 if disabled
+    zc_count_t deflated[ZC_MAX_TYPES];  //!< PDUs sent per content type
+    zc_count_t inflated[ZC_MAX_TYPES];  //!< PDUs received per content type
+} compression_t;
+
+
+//*********************************
+//       STREAM FUNCTIONS
+//*********************************
+int zc_deflate(zc_stream_t* zs, struct dchat_pdu* pdu, struct dchat_pdu* zpdu);
+int zc_inflate(zc_stream_t* zs, struct dchat_pdu* pdu);
+void zc_abort(zc_stream_t* zs);
+void zc_free(zc_stream_t* zs);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+long zc_cpu_ns(struct timespec* start);
+
+
+#endif
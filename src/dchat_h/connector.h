@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef CONNECTOR_H
+#define CONNECTOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "network.h"
+
+
+//*********************************
+//      CONNECTOR SETTINGS
+//*********************************
+#define CONN_MAX_INFLIGHT   4   // max. concurrent connects (connector threads)
+#define CONN_MAX_PER_SOURCE 2   // max. concurrent connects per source contact
+#define CONN_MAX_QUEUED     256 // max. pending connection requests
+
+
+//*********************************
+//     CONNECTION PRIORITIES
+//*********************************
+#define CONN_PRIO_USER     0    // requested by the user (/connect, -d/-r)
+#define CONN_PRIO_CACHE    1    // reconnect from the contact cache at startup
+#define CONN_PRIO_RECONNECT 1   // reconnect of a lost contact (see: reconnect.h)
+#define CONN_PRIO_DISCOVER 2    // received within a contactlist
+
+
+/*!
+ * Structure for a connection request
+ */
+typedef struct conn_req
+{
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address to connect to
+    uint16_t lport;                     //!< port to connect to
+    char src_onion[ONION_ADDRLEN + 1];  //!< onion address of source contact
+    uint16_t src_lport;                 //!< port of source contact, 0 for user
+    int prio;                           //!< priority of request
+    int inflight;                       //!< connect is in progress
+    unsigned long seq;                  //!< order of arrival
+} conn_req_t;
+
+/*!
+ * Structure for the queue of connection requests
+ */
+typedef struct conn_queue
+{
+    conn_req_t req[CONN_MAX_QUEUED];    //!< pending and in-flight requests
+    int used;                           //!< amount of requests stored
+    int inflight;                       //!< amount of requests in progress
+    unsigned long seq;                  //!< sequence number of next request
+    pthread_mutex_t cq_mx;              //!< mutex to lock the queue
+    pthread_cond_t cq_cv;               //!< signals changes of the queue
+} conn_queue_t;
+
+
+//*********************************
+//       QUEUE FUNCTIONS
+//*********************************
+int init_conn_queue(conn_queue_t* cq);
+void destroy_conn_queue(conn_queue_t* cq);
+int enqueue_conn(conn_queue_t* cq, char* onion_id, uint16_t lport,
+                 char* src_onion, uint16_t src_lport, int prio);
+int dequeue_conn(conn_queue_t* cq, conn_req_t* req);
+void finish_conn(conn_queue_t* cq, conn_req_t* req);
+int count_conn(conn_queue_t* cq);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+int find_conn(conn_queue_t* cq, char* onion_id, uint16_t lport);
+int is_startable_conn(conn_queue_t* cq, conn_req_t* req);
+void unlock_conn_queue(void* arg);
+
+
+#endif
@@ -21,14 +21,49 @@
 #ifndef CONTACT_H
 #define CONTACT_H
 
+#include <stdint.h>
+
 #include "types.h"
 
+
+//*********************************
+//         DIGEST SETTINGS
+//*********************************
+#define DGS_HASH_LEN 8           // hex digits of a hash in a digest
+#define DGS_HEX_DIGITS "0123456789abcdefABCDEF" // digits of a hash in a digest
+
+
+//*********************************
+//       COALESCING SETTINGS
+//*********************************
+#define CO_DEF_WINDOW 500        // default coalescing window in microseconds
+#define CO_DEF_MAX    2490       // default max. bytes buffered (5 cells)
+#define CO_MAX_BYTES  65536      // upper limit of the max. bytes buffered
+#define CO_MAX_WINDOW 1000000    // upper limit of the coalescing window
+#define TOR_CELL_DATA 498        // payload of a TOR relay cell
+
+
 //*********************************
 //       DCHAT PROTO FUNCTIONS
 //*********************************
-int send_contacts(int n);
+int send_contacts(int n, uint32_t* known, int known_len);
 int receive_contacts(dchat_pdu_t* pdu);
+int init_hello(dchat_pdu_t* pdu, char* prio);
+int send_hello(int n, char* prio);
+int send_digest(int n);
+int receive_digest(int n, dchat_pdu_t* pdu);
 int check_duplicates(int n);
+int keep_connect(contact_t* contact);
+
+
+//*********************************
+//       COALESCING FUNCTIONS
+//*********************************
+int send_pdu(int n, dchat_pdu_t* pdu);
+int send_pdu_file(int n, dchat_pdu_t* pdu, int fd, off_t offset, int len);
+void buffer_pdu(int n, char* buf, int len);
+int flush_contact(int n);
+long flush_contacts();
 
 
 //*********************************
@@ -36,6 +71,7 @@ int check_duplicates(int n);
 //*********************************
 char* contact_to_string(contact_t* contact);
 int string_to_contact(contact_t* contact, char* string);
+uint32_t contact_hash(contact_t* contact);
 
 
 //*********************************
@@ -45,6 +81,7 @@ int realloc_contactlist(int newsize);
 int add_contact(int fd);
 int del_contact(int n);
 int find_contact(contact_t* contact, int begin);
+int cmp_hash(const void* a, const void* b);
 
 
 #endif
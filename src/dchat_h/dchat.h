@@ -40,9 +40,9 @@
 //*********************************
 int init_global_config();
 int init_listening(char* address);
+int init_unix_listening(char* path);
 int init_threads();
 void destroy();
-void cleanup_th_new_conn(void* arg);
 void cleanup_th_main_loop(void* arg);
 
 
@@ -52,8 +52,11 @@ void cleanup_th_main_loop(void* arg);
 void terminate(int sig);
 int handle_local_input(char* line);
 int handle_remote_input(int n);
-int handle_local_conn_request(char* onion_id, uint16_t port);
-int handle_remote_conn_request();
+int forward_pdu(int n, dchat_pdu_t* pdu);
+int send_overlay(int n, dchat_pdu_t* pdu);
+int handle_local_conn_request(char* onion_id, uint16_t port, int prio);
+int add_tor_contact(int s, char* onion_id, uint16_t port, int prio, int hello_sent);
+int handle_remote_conn_request(int lfd);
 
 
 //*********************************
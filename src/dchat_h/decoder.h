@@ -28,14 +28,32 @@
 //          LIMITS
 //*********************************
 #define MAX_CONTENT_LEN 4096
-#define HDR_AMOUNT      8
-#define CTT_AMOUNT      4
+#define MAX_OCTET_LEN   66048   // "application/octet": chunk of 64 KB and control line
+#define HDR_AMOUNT      16
+#define CTT_AMOUNT      6
+#define MAX_HOP_LIMIT   255
 
 
 //*********************************
 //          VERSION
 //*********************************
 #define DCHAT_V1 1.0
+#define DCHAT_V2 2.0
+
+
+//*********************************
+//     DCHAT/2 BINARY FRAMING
+//*********************************
+#define V2_MAGIC     0xD2        // first byte of a frame, text PDUs start with 'D'
+#define V2_OFFER     "DCHAT/2.0" // token in the Server header of a hello offering DChat/2
+#define V2_FLG_ORG   0x01        // hop limit, origin and date of a forwarded PDU follow
+#define V2_FLG_MID   0x02        // message id follows as string
+#define V2_FLG_MSEQ  0x04        // message id of the author follows as sequence number
+#define V2_FLG_DEF   0x08        // content is deflated (see: zc_deflate())
+#define V2_FLG_FRG   0x10        // fragment id, offset and total follow (see: fg_send())
+#define V2_FLG_CRC   0x20        // CRC-32C of the content follows (4 bytes, see: checksum.c)
+#define V2_MAX_HDR   192         // max. length of the fields ahead of the content
+#define V2_MAX_BODY  (V2_MAX_HDR + MAX_OCTET_LEN) // max. length of a frame body
 
 
 //*********************************
@@ -49,6 +67,14 @@
 #define HDR_ID_NIC 0x06
 #define HDR_ID_DAT 0x07
 #define HDR_ID_SRV 0x08
+#define HDR_ID_HOP 0x09
+#define HDR_ID_ORG 0x0A
+#define HDR_ID_MID 0x0B
+#define HDR_ID_CEN 0x0C
+#define HDR_ID_FID 0x0D
+#define HDR_ID_FOF 0x0E
+#define HDR_ID_FTO 0x0F
+#define HDR_ID_CRC 0x10
 
 
 //*********************************
@@ -62,6 +88,14 @@
 #define HDR_NAME_NIC "Nickname"
 #define HDR_NAME_DAT "Date"
 #define HDR_NAME_SRV "Server"
+#define HDR_NAME_HOP "Hop-Limit"
+#define HDR_NAME_ORG "Origin"
+#define HDR_NAME_MID "Message-Id"
+#define HDR_NAME_CEN "Content-Encoding"
+#define HDR_NAME_FID "Fragment-Id"
+#define HDR_NAME_FOF "Fragment-Offset"
+#define HDR_NAME_FTO "Fragment-Total"
+#define HDR_NAME_CRC "Content-CRC32C"
 
 
 //*********************************
@@ -71,8 +105,8 @@
 #define CTT_ID_BIN 0x02
 #define CTT_ID_DSC 0x03
 #define CTT_ID_RPY 0x04
-
-#define CTT_MASK_ALL 0x05
+#define CTT_ID_DGS 0x05
+#define CTT_ID_HLO 0x06
 
 
 //*********************************
@@ -82,6 +116,8 @@
 #define CTT_NAME_BIN "application/octet"
 #define CTT_NAME_DSC "control/discover"
 #define CTT_NAME_RPY "control/replay"
+#define CTT_NAME_DGS "control/digest"
+#define CTT_NAME_HLO "control/hello"
 
 
 //*********************************
@@ -144,14 +180,23 @@ typedef struct dchat_v1
 //*********************************
 int decode_header(dchat_pdu_t* pdu, char* line);
 int read_line(int fd, char** line);
-int read_pdu(int fd, dchat_pdu_t* pdu);
+int read_pdu(int fd, dchat_pdu_t* pdu, contact_t* session);
+int read_pdu_v2(int fd, dchat_pdu_t* pdu, contact_t* session);
+int decode_pdu_v2_head(unsigned char* body, int len, dchat_pdu_t* pdu, contact_t* session);
+int decode_pdu_v2_content(unsigned char* body, int len, int off, dchat_pdu_t* pdu);
 
 
 //*********************************
 //        ENCODE FUNCTIONS
 //*********************************
 int encode_header(dchat_pdu_t* pdu, int header_id, char** headerline);
-int write_pdu(int fd, dchat_pdu_t* pdu);
+int write_pdu(int fd, dchat_pdu_t* pdu, float version);
+int encode_pdu(dchat_pdu_t* pdu, char** pdu_str);
+int encode_pdu_head(dchat_pdu_t* pdu, char** head_str);
+int encode_pdu_v2(dchat_pdu_t* pdu, char** frame);
+int encode_pdu_v2_head(dchat_pdu_t* pdu, char** frame);
+int encode_frame(dchat_pdu_t* pdu, float version, char** frame);
+int encode_frame_head(dchat_pdu_t* pdu, float version, char** head);
 
 
 //*********************************
@@ -165,6 +210,14 @@ int lnp_str_to_pdu(char* value, dchat_pdu_t* pdu);
 int nic_str_to_pdu(char* value, dchat_pdu_t* pdu);
 int dat_str_to_pdu(char* value, dchat_pdu_t* pdu);
 int srv_str_to_pdu(char* value, dchat_pdu_t* pdu);
+int hop_str_to_pdu(char* value, dchat_pdu_t* pdu);
+int org_str_to_pdu(char* value, dchat_pdu_t* pdu);
+int mid_str_to_pdu(char* value, dchat_pdu_t* pdu);
+int cen_str_to_pdu(char* value, dchat_pdu_t* pdu);
+int fid_str_to_pdu(char* value, dchat_pdu_t* pdu);
+int fof_str_to_pdu(char* value, dchat_pdu_t* pdu);
+int fto_str_to_pdu(char* value, dchat_pdu_t* pdu);
+int crc_str_to_pdu(char* value, dchat_pdu_t* pdu);
 
 int ver_pdu_to_str(dchat_pdu_t* pdu, char** value);
 int ctt_pdu_to_str(dchat_pdu_t* pdu, char** value);
@@ -174,6 +227,14 @@ int lnp_pdu_to_str(dchat_pdu_t* pdu, char** value);
 int nic_pdu_to_str(dchat_pdu_t* pdu, char** value);
 int dat_pdu_to_str(dchat_pdu_t* pdu, char** value);
 int srv_pdu_to_str(dchat_pdu_t* pdu, char** value);
+int hop_pdu_to_str(dchat_pdu_t* pdu, char** value);
+int org_pdu_to_str(dchat_pdu_t* pdu, char** value);
+int mid_pdu_to_str(dchat_pdu_t* pdu, char** value);
+int cen_pdu_to_str(dchat_pdu_t* pdu, char** value);
+int fid_pdu_to_str(dchat_pdu_t* pdu, char** value);
+int fof_pdu_to_str(dchat_pdu_t* pdu, char** value);
+int fto_pdu_to_str(dchat_pdu_t* pdu, char** value);
+int crc_pdu_to_str(dchat_pdu_t* pdu, char** value);
 
 
 //*********************************
@@ -185,6 +246,7 @@ int init_dchat_pdu(dchat_pdu_t* pdu, float version, int content_type,
                    char* onion_id,
                    int lport, char* nickname);
 void init_dchat_pdu_content(dchat_pdu_t* pdu, char* content, int len);
+void init_dchat_pdu_msg_id(dchat_pdu_t* pdu, uint64_t seq);
 
 
 //*********************************
@@ -193,10 +255,14 @@ void init_dchat_pdu_content(dchat_pdu_t* pdu, char* content, int len);
 int is_valid_termination(char* value);
 int is_valid_version(float version);
 int is_valid_content_type(int content_type);
-int is_valid_content_length(int ctl);
+int is_valid_content_length(int content_type, int ctl);
 int is_valid_nickname(char* nickname);
 void free_pdu(dchat_pdu_t* pdu);
 int get_content_part(dchat_pdu_t* pdu, int offset, char term, char** content);
+int put_v2_string(char* str, int max, unsigned char* buf);
+int get_v2_string(unsigned char* buf, int len, char* str, int max);
+int get_msg_seq(dchat_pdu_t* pdu, char* onion_id, uint16_t lport, uint64_t* seq);
+int verify_crc(dchat_pdu_t* pdu, uint32_t crc);
 
 
 #endif
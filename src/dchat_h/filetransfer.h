@@ -0,0 +1,205 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FILETRANSFER_H
+#define FILETRANSFER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "network.h"
+#include "chunkstore.h"
+
+
+//*********************************
+//     FILE TRANSFER SETTINGS
+//*********************************
+#define FT_MAX_TRANSFERS 16         // max. transfers in progress
+#define FT_MAX_PATH      255        // max. length of the download directory
+#define FT_MAX_NAME      128        // max. length of a file name
+#define FT_MAX_FILE_PATH (FT_MAX_PATH + FT_MAX_NAME + 16) // max. length of a received file
+#define FT_MAX_LINE      (FT_MAX_NAME + 48) // max. length of a control line
+#define FT_MAX_COPIES    100        // received files of the same name numbered
+#define FT_CHUNK_LEN     16384      // max. bytes of a file per chunk (frame)
+#define FT_MIN_CHUNK     4096       // min. room in the socket buffer to send a chunk
+#define FT_POLL_US       10000      // microseconds between two checks of the socket buffers
+#define FT_MIN_WINDOW    32768      // min. bytes of chunks in flight per contact
+#define FT_MAX_INFLIGHT  512        // max. chunks in flight per contact
+#define FT_MAX_WINDOW    (FT_MAX_INFLIGHT * FT_CHUNK_LEN) // max. bytes of chunks in flight per contact
+#define FT_DEF_LATENCY   250        // default queueing delay of chat messages in ms
+#define FT_MAX_LATENCY   10000      // upper limit of the queueing delay in ms
+#define FT_RATE_DECAY    64         // the delivery rate decays by 1/64 per ACK
+#define FT_PART_EXT      ".part"    // extension of files not received completely
+#define FT_OFFER         "DCHAT-FILE/1.0" // token in the Server header of a hello accepting files
+
+
+//*********************************
+//   CONTROL LINES OF FILE PDUS
+//*********************************
+#define FT_CMD_OFFER  "OFFER"       // OFFER <id> <size> <name>: manifest of a file
+#define FT_CMD_ACCEPT "ACCEPT"      // ACCEPT <id> <offset>: send file from offset on
+#define FT_CMD_DATA   "DATA"        // DATA <id> <offset>: chunk of file follows the line
+#define FT_CMD_CANCEL "CANCEL"      // CANCEL <id>: file declined or transfer aborted
+#define FT_CMD_ACK    "ACK"         // ACK <id> <offset>: chunk up to offset has been written
+#define FT_CMD_CHUNKS "CHUNKS"      // CHUNKS <id> <first> <count>: records of the chunk list follow the line
+#define FT_CMD_HAVE   "HAVE"        // HAVE <id> <first>: bitmap of the chunks held follows the line
+
+
+//*********************************
+//   DIRECTION/STATE OF TRANSFER
+//*********************************
+#define FT_SEND     0               // file is sent to contact
+#define FT_RECV     1               // file is received from contact
+#define FT_OFFERED  0               // manifest sent, waiting for accept
+#define FT_ACTIVE   1               // chunks are sent or received
+#define FT_LISTED   2               // chunk list received, waiting for manifest
+
+
+/*!
+ * Structure for a chunk sent, but not acknowledged yet
+ */
+typedef struct ft_sent
+{
+    uint32_t id;                        //!< id of file
+    off_t end;                          //!< offset of the end of the chunk
+    int len;                            //!< length of chunk
+    uint64_t delivered;                 //!< bytes acknowledged when the chunk has been sent
+    struct timespec at;                 //!< time the chunk has been sent
+} ft_sent_t;
+
+/*!
+ * Structure for the delivery of chunks to a contact.
+ * Chunks are acknowledged by the receiver in the order they have been sent.
+ * The delivery rate and the min. round trip of the chunks limit the bytes
+ * in flight (see: ft_window()), so that chunks never queue up in the
+ * buffers between the contacts (TOR, socket buffers) for longer than the
+ * target latency. Chat messages are sent before all chunks not in flight,
+ * so they are delayed by at most that latency.
+ */
+typedef struct ft_link
+{
+    ft_sent_t sent[FT_MAX_INFLIGHT];    //!< chunks in flight (ring)
+    int head;                           //!< oldest chunk in flight
+    int count;                          //!< amount of chunks in flight
+    long inflight;                      //!< bytes of chunks in flight
+    uint64_t delivered;                 //!< bytes acknowledged in total
+    long rate;                          //!< max. delivery rate in bytes/s
+    long min_rtt;                       //!< min. round trip of a chunk in us
+    long srtt;                          //!< smoothed round trip of a chunk in us
+} ft_link_t;
+
+/*!
+ * Structure for a file transfer in progress
+ */
+typedef struct file_transfer
+{
+    uint32_t id;                        //!< id of file (see: ft_send())
+    int dir;                            //!< direction of transfer (see: FT_SEND, FT_RECV)
+    int state;                          //!< state of transfer (see: FT_OFFERED, FT_ACTIVE)
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address of contact
+    uint16_t lport;                     //!< listening port of contact
+    int sock;                           //!< socket of contact, transfer ends with it
+    char name[FT_MAX_NAME + 1];         //!< name of file
+    int fd;                             //!< file read from or written to
+    off_t size;                         //!< size of file
+    off_t offset;                       //!< bytes sent or received so far
+    off_t resumed;                      //!< offset the transfer has been started at
+    struct timespec started;            //!< time the transfer has been started
+    cs_list_t* list;                    //!< chunk list of file, NULL if not chunked
+    unsigned char* held;                //!< bitmap of the chunks held by the receiver
+    int chunk;                          //!< index of the chunk containing offset
+    int recs;                           //!< records of chunk list received (see: FT_LISTED)
+} file_transfer_t;
+
+/*!
+ * Structure for the file transfers in progress.
+ * Files are offered with a manifest and sent in chunks of up to
+ * FT_CHUNK_LEN bytes. Every transfer is a stream of chunks identified by
+ * the id of the file, the streams to a contact take turns. Chunks are
+ * passed from the file to the socket with sendfile(2), as long as the
+ * window of the contact (see: ft_link_t) and the socket buffer take them,
+ * and written by the receiver at their offset into the preallocated file.
+ * A file, that has not been received completely, is kept and resumed when
+ * it is offered again. Contacts holding a chunk store are sent the chunk
+ * list of a file ahead of its manifest ("CHUNKS") and answer with the
+ * chunks they hold already ("HAVE"), which both sides skip.
+ */
+typedef struct file_transfers
+{
+    file_transfer_t ft[FT_MAX_TRANSFERS];   //!< transfers in progress
+    int used;                               //!< amount of transfers
+    int turn;                               //!< transfer whose chunk is sent first
+    char dir[FT_MAX_PATH + 1];              //!< download directory, empty if files are declined
+    int latency;                            //!< target of the queueing delay in ms
+    unsigned long sent_bytes;               //!< bytes of files sent
+    unsigned long recv_bytes;               //!< bytes of files received
+    unsigned long saved_bytes;              //!< bytes skipped, since the receiver held them
+    unsigned long completed;                //!< files sent or received completely
+} file_transfers_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+void destroy_file_transfers(file_transfers_t* fl);
+
+
+//*********************************
+//      TRANSFER FUNCTIONS
+//*********************************
+int ft_send(file_transfers_t* fl, char* path);
+int ft_receive(file_transfers_t* fl, int n, char* content, int len);
+long ft_run(file_transfers_t* fl);
+int ft_offer(file_transfers_t* fl, int n, uint32_t id, off_t size, char* name);
+int ft_accept(file_transfers_t* fl, int n, uint32_t id, off_t offset);
+int ft_data(file_transfers_t* fl, int n, uint32_t id, off_t offset, char* data, int len);
+int ft_chunk(file_transfers_t* fl, file_transfer_t* t, int n);
+long ft_room(file_transfers_t* fl, int n);
+void ft_track(ft_link_t* link, uint32_t id, off_t end, int len);
+int ft_ack(file_transfers_t* fl, int n, uint32_t id, off_t offset);
+void ft_acked(ft_link_t* link, struct timespec* now);
+int ft_chunks(file_transfers_t* fl, int n, uint32_t id, int first, int count, char* data,
+              int len);
+int ft_have(file_transfers_t* fl, int n, uint32_t id, int first, char* data, int len);
+long ft_window(file_transfers_t* fl, ft_link_t* link);
+void ft_purge(ft_link_t* link, uint32_t id);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+file_transfer_t* ft_find(file_transfers_t* fl, int n, uint32_t id, int dir);
+file_transfer_t* ft_add(file_transfers_t* fl, int n, uint32_t id, int dir);
+int ft_contact(file_transfer_t* t);
+int ft_control(int n, char* line, int len);
+int ft_send_chunks(int n, file_transfer_t* t);
+int ft_fill(file_transfers_t* fl, file_transfer_t* t, int n);
+void ft_skip(file_transfers_t* fl, file_transfer_t* t);
+off_t ft_span(file_transfer_t* t, off_t max);
+void ft_verify(file_transfer_t* t, cs_chunk_t* c);
+int ft_complete(file_transfers_t* fl, file_transfer_t* t);
+int ft_move(file_transfers_t* fl, char* part, char* name, char* path);
+void ft_remove(file_transfers_t* fl, file_transfer_t* t, int cancel);
+void ft_part_path(file_transfers_t* fl, file_transfer_t* t, char* path);
+int is_valid_file_name(char* name);
+
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef FRAGMENT_H
+#define FRAGMENT_H
+
+#include <stdint.h>
+#include <time.h>
+
+
+//*********************************
+//    FRAGMENTATION SETTINGS
+//*********************************
+#define FG_OFFER         "FRAGMENT/1.0" // token in the Server header of a hello accepting fragments
+#define FG_FRAG_LEN      4032       // max. bytes of content per fragment (still deflated, see: ZC_SLACK)
+#define FG_MAX_MESSAGE   262144     // max. length of the content of a fragmented message
+#define FG_MAX_PENDING   4          // max. messages reassembled per contact at once
+#define FG_PEER_BYTES    (2 * FG_MAX_MESSAGE) // max. bytes reassembled per contact
+#define FG_MAX_BYTES     4194304    // max. bytes reassembled in total
+#define FG_TIMEOUT       30         // seconds a message waits for its next fragment
+
+// types.h includes this header ahead of the PDU structure
+struct dchat_pdu;
+
+
+/*!
+ * Structure for a message being reassembled.
+ * The buffer is allocated with the first fragment for the whole message,
+ * every further fragment is copied to its offset. The headers are the ones
+ * of the first fragment.
+ */
+typedef struct fg_message
+{
+    uint32_t id;                        //!< Fragment-Id of the message
+    struct dchat_pdu* head;             //!< first fragment, its content is the buffer
+    int received;                       //!< bytes of content received so far
+    struct timespec expires;            //!< time the message is dropped unless a fragment arrives
+} fg_message_t;
+
+/*!
+ * Structure for the fragmentation of the messages of a connection.
+ * Fragments of a message are sent in order and without other fragments
+ * in between, but the contact may mix in other PDUs.
+ */
+typedef struct fg_link
+{
+    fg_message_t msg[FG_MAX_PENDING];   //!< messages being reassembled
+    int used;                           //!< amount of messages being reassembled
+    long bytes;                         //!< bytes allocated for them
+    uint32_t next_id;                   //!< Fragment-Id of the next message sent
+    int offered;                        //!< contact accepts fragments (see: FG_OFFER)
+} fg_link_t;
+
+/*!
+ * Structure for the fragmentation of messages sent to and received from
+ * contacts. Messages, whose content exceeds MAX_CONTENT_LEN, are sent as
+ * fragments of up to FG_FRAG_LEN bytes, as long as their content does not
+ * exceed FG_MAX_MESSAGE.
+ */
+typedef struct fragmentation
+{
+    long bytes;                         //!< bytes being reassembled in total
+    long peak;                          //!< max. bytes that have been reassembled at once
+    unsigned long sent;                 //!< messages sent as fragments
+    unsigned long fragments;            //!< fragments sent
+    unsigned long reassembled;          //!< messages reassembled
+    unsigned long expired;              //!< messages dropped after FG_TIMEOUT
+    unsigned long dropped;              //!< messages dropped, since they exceeded a limit
+} fragmentation_t;
+
+
+//*********************************
+//     FRAGMENTATION FUNCTIONS
+//*********************************
+int fg_send(int n, struct dchat_pdu* pdu);
+int fg_receive(int n, struct dchat_pdu* pdu);
+long fg_expire();
+void fg_free(fg_link_t* fl);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+fg_message_t* fg_find(fg_link_t* fl, uint32_t id);
+void fg_remove(fg_link_t* fl, fg_message_t* m);
+
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef MSGLOG_H
+#define MSGLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/uio.h>
+
+
+//*********************************
+//     MESSAGE LOG SETTINGS
+//*********************************
+#define ML_MAGIC         0x444d4c31 // "DML1", starts every record
+#define ML_MAX_PATH      255        // max. length of the log directory
+#define ML_SEG_NAME      "%s/%016llx.log" // directory and first sequence number
+#define ML_SEG_EXT       ".log"     // extension of segment files
+#define ML_SEGMENT_SIZE  4194304    // max. bytes of a segment
+#define ML_MAX_SEGMENTS  16         // segments kept, the oldest is removed
+#define ML_INDEX_STEP    8192       // bytes of records between two index entries
+#define ML_MAX_INDEX     (ML_SEGMENT_SIZE / ML_INDEX_STEP + 1) // index entries per segment
+#define ML_MAX_RECORD    8192       // max. bytes of a record
+#define ML_ALIGN         8          // records start at multiples of 8
+#define ML_MAX_REPLAY    256        // max. messages replayed per request
+#define ML_MAX_IOV       64         // max. buffers written at once
+#define ML_REPLAY_SLACK  30         // seconds a replay reaches back before the newest message
+#define ML_MAX_LINE      64         // max. length of the content of a replay PDU
+#define ML_REC_SIZE(ID_LEN, LEN) ((sizeof(ml_rec_t) + (ID_LEN) + (LEN) + ML_ALIGN - 1) & \
+                                  ~(size_t) (ML_ALIGN - 1)) // bytes of a record
+
+// types.h includes this header ahead of the PDU structure
+struct dchat_pdu;
+
+
+//*********************************
+//  CONTENT OF CONTROL/REPLAY PDUS
+//*********************************
+#define ML_CMD_SINCE "SINCE"        // SINCE <time> <seq>: replay messages logged since time after seq
+#define ML_CMD_MORE  "MORE"         // MORE <time> <seq> <count>: replay has been cut off at seq
+#define ML_CMD_DONE  "DONE"         // DONE <seq> <count>: all messages have been replayed
+
+
+/*!
+ * Structure for the header of a record.
+ * The message id follows the header, the PDU of the message follows the
+ * id. The PDU lacks the headers identifying the sender (version, host,
+ * listening port and nickname), which are prepended when it is replayed.
+ */
+typedef struct ml_rec
+{
+    uint32_t magic;                     //!< ML_MAGIC, 0 behind the last record
+    uint32_t len;                       //!< length of PDU
+    uint64_t seq;                       //!< sequence number of record
+    int64_t time;                       //!< time the message has been logged
+    uint16_t id_len;                    //!< length of message id
+    uint16_t pad[3];
+} ml_rec_t;
+
+/*!
+ * Structure for an entry of the sparse index of a segment
+ */
+typedef struct ml_index
+{
+    uint64_t seq;                       //!< sequence number of record
+    int64_t time;                       //!< time the record has been logged
+    uint32_t off;                       //!< offset of record in segment
+} ml_index_t;
+
+/*!
+ * Structure for a segment of the message log.
+ * The active segment is preallocated to ML_SEGMENT_SIZE and mapped
+ * writable, all other segments are sealed: truncated to their records and
+ * mapped read-only.
+ */
+typedef struct ml_segment
+{
+    char* map;                          //!< mapped segment
+    size_t size;                        //!< length of mapping
+    size_t used;                        //!< bytes of records
+    int fd;                             //!< file of active segment, -1 if sealed
+    uint64_t first;                     //!< sequence number of first record
+    uint64_t last;                      //!< sequence number of last record, 0 if empty
+    int64_t last_time;                  //!< time of last record
+    ml_index_t index[ML_MAX_INDEX];     //!< first record of every ML_INDEX_STEP bytes
+    int entries;                        //!< amount of index entries
+} ml_segment_t;
+
+/*!
+ * Structure for the log of the chat messages sent and received.
+ * Messages are appended to the last segment, which is rotated when it is
+ * full. Replay requests of contacts are served by writing the records
+ * straight from the mapped segments (see: ml_replay()).
+ */
+typedef struct msg_log
+{
+    char dir[ML_MAX_PATH + 1];          //!< directory of segments, empty if disabled
+    ml_segment_t* seg;                  //!< segments, oldest first, last one is active
+    int used;                           //!< amount of segments
+    uint64_t next_seq;                  //!< sequence number of next record
+    int64_t last_time;                  //!< time of newest record, 0 if empty
+    unsigned long appended;             //!< messages appended in this session
+    unsigned long replayed;             //!< messages replayed to contacts
+    unsigned long requests;             //!< replay requests served
+    unsigned long removed;              //!< segments removed
+} msg_log_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int init_msg_log(msg_log_t* ml);
+void destroy_msg_log(msg_log_t* ml);
+
+
+//*********************************
+//         LOG FUNCTIONS
+//*********************************
+int64_t ml_append(msg_log_t* ml, struct dchat_pdu* pdu);
+int ml_request(msg_log_t* ml, int n);
+int ml_receive(msg_log_t* ml, int n, char* content, int len);
+int ml_replay(msg_log_t* ml, int n, int64_t since, uint64_t after);
+
+
+//*********************************
+//       SEGMENT FUNCTIONS
+//*********************************
+int ml_open(msg_log_t* ml, uint64_t first);
+int ml_scan(msg_log_t* ml, ml_segment_t* s);
+int ml_seal(ml_segment_t* s);
+int ml_rotate(msg_log_t* ml);
+int ml_find(msg_log_t* ml, int64_t since, uint64_t after, int* si, size_t* off);
+ml_rec_t* ml_get(msg_log_t* ml, uint64_t seq);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+int ml_control(int n, char* line);
+int ml_headers(struct dchat_pdu* pdu, int* ids, int amount, char* buf, int size);
+int ml_write(int fd, struct iovec* iov, int cnt);
+size_t ml_size(msg_log_t* ml);
+char* ml_content(ml_rec_t* r, int* len);
+char* ml_header(ml_rec_t* r, char* name, int* len);
+
+
+#endif
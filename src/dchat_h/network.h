@@ -22,7 +22,11 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 
+#include <pthread.h>
 #include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 
 
 //*********************************
@@ -33,6 +37,34 @@
 #define TOR_ADDR        "127.0.0.1"
 
 
+//*********************************
+//     SOCKS POOL SETTINGS
+//*********************************
+#define SOCKS_MAX_ENDPOINTS 16  // max. TOR clients used
+#define SOCKS_RETRY         5   // seconds an endpoint is skipped after a failure
+#define SOCKS_RETRY_MAX     300 // upper limit of the doubled retry interval
+
+
+//*********************************
+//   STREAM ISOLATION SETTINGS
+//*********************************
+#define SOCKS_ISO_NONE    0     // all connections may share circuits
+#define SOCKS_ISO_PEER    -1    // every peer is isolated on its own circuits
+#define SOCKS_MAX_GROUPS  64    // max. peer groups, reported buckets for SOCKS_ISO_PEER
+#define SOCKS_GROUP_USER  "dchat-group-%d"  // username of a peer group
+#define SOCKS_PEER_USER   "dchat-%s:%hu"    // username of a single peer
+#define SOCKS_ISO_PASS    "dchat"           // password sent with every username
+
+
+//*********************************
+//      SOCKS RESULT CODES
+//*********************************
+#define SOCKS_EP_OK       0     // request granted
+#define SOCKS_EP_REJECTED 1     // TOR client answered, but request failed
+#define SOCKS_EP_FAILED   2     // TOR client not reachable or not answering
+#define SOCKS_EP_CANCELED 3     // request canceled before it has been answered
+
+
 //*********************************
 //     SOCKS4a FIELDS
 //*********************************
@@ -41,34 +73,108 @@
 #define SOCKS_VERSION   0x04
 #define SOCKS_DELIM     0x00
 #define SOCKS_FAKEIP    0x01
+#define SOCKS4_GRANTED  90
+#define SOCKS4_REPLY_LEN 8
+
+
+//*********************************
+//      SOCKS5 FIELDS
+//*********************************
+#define SOCKS5_VERSION      0x05
+#define SOCKS5_NO_AUTH      0x00
+#define SOCKS5_USER_PASS    0x02
+#define SOCKS5_AUTH_VERSION 0x01
+#define SOCKS5_AUTH_FAILED  0xFE    // not sent by server, username/password refused
+#define SOCKS5_NO_METHOD    0xFF
+#define SOCKS5_ATYP_IPV4    0x01
+#define SOCKS5_ATYP_DOMAIN  0x03
+#define SOCKS5_ATYP_IPV6    0x04
 
 
+//*********************************
+//      SOCKS BUFFER SIZES
+//*********************************
+#define SOCKS_MAX_HOSTLEN   255
+#define SOCKS_MAX_USERLEN   255
+#define SOCKS_MAX_AUTH_LEN  (3 + SOCKS_MAX_USERLEN + sizeof(SOCKS_ISO_PASS) - 1)
+// SOCKS5 method selection, authentication and request
+#define SOCKS_MAX_REQ_LEN   (3 + SOCKS_MAX_AUTH_LEN + 7 + SOCKS_MAX_HOSTLEN)
+// SOCKS5 method, authentication and connect reply
+#define SOCKS_MAX_REPLY_LEN (2 + 2 + 7 + SOCKS_MAX_HOSTLEN)
+
 /*!
- * Structure for a SOCKS4a PDU
+ * Structure for a TOR client (SOCKS endpoint) of the SOCKS pool
  */
-typedef struct socks4a_pdu
+typedef struct socks_endpoint
 {
-    uint8_t  version;   //!< SOCKS version (e.g 4/5)
-    uint8_t  command;   //!< SOCKS command type (e.g. CONNECT, BIND, ...)
-    uint16_t port;      //!< port of remote client
-    uint32_t fakeip;    //!< invalid ip address (see: SOCKS4a protocol)
-    uint8_t  delim;     //!< SOCKS delimiter
-    char*    hostname;  //!< domain name of client to connect to
-} socks4a_pdu_t;
+    struct sockaddr_in sa;              //!< address of TOR client
+    int outstanding;                    //!< requests in progress
+    uint32_t latency;                   //!< smoothed time to build a circuit in ms
+    unsigned long granted;              //!< requests granted
+    unsigned long failed;               //!< requests failed due to the TOR client
+    int fails_in_row;                   //!< consecutive failures
+    time_t down_until;                  //!< endpoint is skipped until this time
+} socks_endpoint_t;
+
+/*!
+ * Structure for the connect statistics of a group of isolated peers
+ */
+typedef struct socks_group
+{
+    unsigned long granted;              //!< requests granted
+    unsigned long rejected;             //!< requests rejected by TOR
+    unsigned long failed;               //!< requests failed due to the TOR client
+    uint32_t latency;                   //!< smoothed time to build a circuit in ms
+    uint32_t min_latency;               //!< fastest circuit build time in ms
+    uint32_t max_latency;               //!< slowest circuit build time in ms
+} socks_group_t;
+
+/*!
+ * Structure for the pool of TOR clients outgoing connections are spread over
+ */
+typedef struct socks_pool
+{
+    socks_endpoint_t ep[SOCKS_MAX_ENDPOINTS]; //!< TOR clients
+    int used;                           //!< amount of TOR clients
+    int version;                        //!< SOCKS version used
+    int optimistic;                     //!< send the first PDU with the request
+    int isolate;                        //!< isolation policy: SOCKS_ISO_* or groups
+    socks_group_t grp[SOCKS_MAX_GROUPS]; //!< statistics per group of peers
+    pthread_mutex_t sp_mx;              //!< mutex to lock the pool
+} socks_pool_t;
 
 
 //*********************************
 //       SOCKS FUNCTIONS
 //*********************************
-int write_socks4a(int s, socks4a_pdu_t* pdu);
-int read_socks4a(int s, socks4a_pdu_t* pdu);
-char* parse_socks_status(unsigned char status);
+int build_socks_request(int version, char* user, char* hostname, uint16_t rport,
+                        uint8_t* buf);
+int write_socks_request(int s, int version, char* user, char* hostname, uint16_t rport,
+                        char* data, int data_len);
+int socks_reply_len(int version, int auth, uint8_t* reply, int len);
+int socks_reply_status(int version, int auth, uint8_t* reply);
+int read_socks_reply(int s, int version, int auth, uint8_t* reply);
+char* parse_socks_status(int version, unsigned char status);
+
+
+//*********************************
+//     SOCKS POOL FUNCTIONS
+//*********************************
+int init_socks_pool(socks_pool_t* sp);
+void destroy_socks_pool(socks_pool_t* sp);
+int add_socks_endpoint(socks_pool_t* sp, char* address);
+int acquire_socks_endpoint(socks_pool_t* sp, int tried, struct sockaddr_in* da);
+void release_socks_endpoint(socks_pool_t* sp, int i, int grp, int result,
+                            uint32_t latency);
+int socks_isolation(socks_pool_t* sp, char* hostname, uint16_t rport, char* user);
 
 
 //*********************************
 //       TOR FUNCTIONS
 //*********************************
-int create_tor_socket(char* hostname, uint16_t rport);
+int create_tor_socket(char* hostname, uint16_t rport, char* data, int data_len);
+int try_tor_socket(struct sockaddr_in* da, char* user, char* hostname, uint16_t rport,
+                   char* data, int data_len, int* s);
 
 
 //*********************************
@@ -29,7 +29,7 @@
 //*********************************
 //            MISC
 //*********************************
-#define CLI_OPT_AMOUNT 6
+#define CLI_OPT_AMOUNT 30
 
 //*********************************
 //  COMMAND LINE OPTIONS (SHORT)
@@ -39,6 +39,30 @@
 #define CLI_OPT_LPRT "l"
 #define CLI_OPT_RONI "d"
 #define CLI_OPT_RPRT "r"
+#define CLI_OPT_OVLY "o"
+#define CLI_OPT_DEGR "k"
+#define CLI_OPT_FOUT "f"
+#define CLI_OPT_SMEM "m"
+#define CLI_OPT_SFPR "e"
+#define CLI_OPT_CACHE "c"
+#define CLI_OPT_SEEDS "b"
+#define CLI_OPT_SKEEP "K"
+#define CLI_OPT_TOR "t"
+#define CLI_OPT_SOCKS5 "5"
+#define CLI_OPT_OPTIM "O"
+#define CLI_OPT_ISOL "i"
+#define CLI_OPT_DIRECT "T"
+#define CLI_OPT_UNIX "u"
+#define CLI_OPT_UONLY "U"
+#define CLI_OPT_COWIN "w"
+#define CLI_OPT_COMAX "W"
+#define CLI_OPT_WARM "p"
+#define CLI_OPT_TEXT "1"
+#define CLI_OPT_DOWN "D"
+#define CLI_OPT_LTCY "L"
+#define CLI_OPT_MLOG "M"
+#define CLI_OPT_ZMIN "z"
+#define CLI_OPT_CSTO "Z"
 #define CLI_OPT_HELP "h"
 
 
@@ -50,6 +74,30 @@
 #define CLI_LOPT_LPRT "lport"
 #define CLI_LOPT_RONI "ronion"
 #define CLI_LOPT_RPRT "rport"
+#define CLI_LOPT_OVLY "overlay"
+#define CLI_LOPT_DEGR "degree"
+#define CLI_LOPT_FOUT "fanout"
+#define CLI_LOPT_SMEM "seen-memory"
+#define CLI_LOPT_SFPR "seen-fpr"
+#define CLI_LOPT_CACHE "cache"
+#define CLI_LOPT_SEEDS "seeds"
+#define CLI_LOPT_SKEEP "seed-keep"
+#define CLI_LOPT_TOR "tor"
+#define CLI_LOPT_SOCKS5 "socks5"
+#define CLI_LOPT_OPTIM "optimistic"
+#define CLI_LOPT_ISOL "isolate"
+#define CLI_LOPT_DIRECT "direct"
+#define CLI_LOPT_UNIX "unix"
+#define CLI_LOPT_UONLY "unix-only"
+#define CLI_LOPT_COWIN "coalesce-window"
+#define CLI_LOPT_COMAX "coalesce-max"
+#define CLI_LOPT_WARM "warm-pool"
+#define CLI_LOPT_TEXT "text-only"
+#define CLI_LOPT_DOWN "download-dir"
+#define CLI_LOPT_LTCY "chat-latency"
+#define CLI_LOPT_MLOG "message-log"
+#define CLI_LOPT_ZMIN "compress-min"
+#define CLI_LOPT_CSTO "chunk-store"
 #define CLI_LOPT_HELP "help"
 
 
@@ -61,6 +109,30 @@
 #define CLI_OPT_ARG_LPRT "LOCALPORT"
 #define CLI_OPT_ARG_RONI "REMOTEONIONID"
 #define CLI_OPT_ARG_RPRT "REMOTEPORT"
+#define CLI_OPT_ARG_OVLY ""
+#define CLI_OPT_ARG_DEGR "DEGREE"
+#define CLI_OPT_ARG_FOUT "FANOUT"
+#define CLI_OPT_ARG_SMEM "KBYTES"
+#define CLI_OPT_ARG_SFPR "RATE"
+#define CLI_OPT_ARG_CACHE "FILE"
+#define CLI_OPT_ARG_SEEDS "FILE"
+#define CLI_OPT_ARG_SKEEP "COUNT"
+#define CLI_OPT_ARG_TOR "[IP:]PORT"
+#define CLI_OPT_ARG_SOCKS5 ""
+#define CLI_OPT_ARG_OPTIM ""
+#define CLI_OPT_ARG_ISOL "POLICY"
+#define CLI_OPT_ARG_DIRECT "FILE"
+#define CLI_OPT_ARG_UNIX "PATH"
+#define CLI_OPT_ARG_UONLY ""
+#define CLI_OPT_ARG_COWIN "USEC"
+#define CLI_OPT_ARG_COMAX "BYTES"
+#define CLI_OPT_ARG_WARM "COUNT"
+#define CLI_OPT_ARG_TEXT ""
+#define CLI_OPT_ARG_DOWN "DIR"
+#define CLI_OPT_ARG_LTCY "MS"
+#define CLI_OPT_ARG_MLOG "DIR"
+#define CLI_OPT_ARG_ZMIN "BYTES"
+#define CLI_OPT_ARG_CSTO "MBYTES"
 #define CLI_OPT_ARG_HELP ""
 
 
@@ -114,6 +186,30 @@ int nick_parse(char* value, int force);
 int lprt_parse(char* value, int force);
 int roni_parse(char* value, int force);
 int rprt_parse(char* value, int force);
+int ovly_parse(char* value, int force);
+int degr_parse(char* value, int force);
+int fout_parse(char* value, int force);
+int smem_parse(char* value, int force);
+int sfpr_parse(char* value, int force);
+int cach_parse(char* value, int force);
+int seed_parse(char* value, int force);
+int skep_parse(char* value, int force);
+int tor_parse(char* value, int force);
+int sck5_parse(char* value, int force);
+int optm_parse(char* value, int force);
+int isol_parse(char* value, int force);
+int dirc_parse(char* value, int force);
+int unix_parse(char* value, int force);
+int uonl_parse(char* value, int force);
+int cwin_parse(char* value, int force);
+int cmax_parse(char* value, int force);
+int warm_parse(char* value, int force);
+int text_parse(char* value, int force);
+int down_parse(char* value, int force);
+int ltcy_parse(char* value, int force);
+int mlog_parse(char* value, int force);
+int zmin_parse(char* value, int force);
+int csto_parse(char* value, int force);
 int help_parse(char* value, int force);
 
 #endif
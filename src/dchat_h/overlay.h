@@ -0,0 +1,103 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "network.h"
+
+
+//*********************************
+//       OVERLAY SETTINGS
+//*********************************
+#define OVL_DEF_DEGREE       5    // default max. size of the active view
+#define OVL_DEF_FANOUT       5    // default amount of peers a message is forwarded to
+#define OVL_MAX_DEGREE       64   // upper limit for degree and fanout
+#define OVL_PASSIVE_SIZE     30   // max. size of the passive view
+#define OVL_SHUFFLE_LEN      8    // max. contacts sent within a shuffle
+#define OVL_SHUFFLE_INTERVAL 10   // seconds between two shuffles
+#define OVL_TIMER_INTERVAL   1    // seconds between two maintenance runs
+#define OVL_HOP_LIMIT        8    // hops a chat message is forwarded
+
+
+//*********************************
+//     NEIGHBOR PRIORITIES
+//*********************************
+#define OVL_PRIO_NONE ""       // no neighbor request (full-mesh or accepted)
+#define OVL_PRIO_HIGH "high\n" // requester has no other active peers or joins
+#define OVL_PRIO_LOW  "low\n"  // requester wants to fill up its active view
+
+
+/*!
+ * Structure for an address within the passive view
+ */
+typedef struct ovl_peer
+{
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address of peer
+    uint16_t lport;                     //!< listening port of peer
+} ovl_peer_t;
+
+/*!
+ * Structure for the overlay state of this client
+ */
+typedef struct overlay
+{
+    int enabled;                        //!< overlay mode instead of full-mesh
+    int degree;                         //!< max. size of the active view
+    int fanout;                         //!< peers a chat message is forwarded to
+    ovl_peer_t passive[OVL_PASSIVE_SIZE]; //!< backup peers not connected to
+    int passive_used;                   //!< amount of peers in passive view
+    time_t next_timer;                  //!< time of next maintenance run
+    time_t next_shuffle;                //!< time of next shuffle
+    unsigned long fwd_pdus;             //!< chat messages forwarded
+} overlay_t;
+
+
+//*********************************
+//      INIT/TIMER FUNCTIONS
+//*********************************
+int init_overlay();
+void ovl_maintain();
+int ovl_fill_active();
+int ovl_shuffle();
+
+
+//*********************************
+//        VIEW FUNCTIONS
+//*********************************
+int ovl_admit(int n, char* prio);
+int ovl_del_contact(int n);
+int ovl_add_passive(char* onion_id, uint16_t lport);
+int ovl_take_passive(ovl_peer_t* peer);
+int ovl_find_passive(char* onion_id, uint16_t lport);
+int ovl_active_count(int exclude);
+int ovl_select_peers(int exclude, int max, int** peers);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+char* ovl_hello_prio(int n, int prio);
+
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef RECONNECT_H
+#define RECONNECT_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "network.h"
+#include "connector.h"
+
+
+//*********************************
+//     RECONNECT SETTINGS
+//*********************************
+#define RC_MAX_PEERS    64      // max. lost contacts tracked
+#define RC_BASE_MS      2000    // backoff of the first reconnect
+#define RC_MAX_MS       300000  // upper limit of the backoff
+#define RC_MAX_SHIFT    16      // max. doublings of the backoff
+#define RC_LOST_SCORE   1       // failure score added if a contact is lost
+#define RC_FAIL_SCORE   2       // failure score added if a reconnect fails
+#define RC_MAX_SCORE    10      // contacts above this score are dropped
+#define RC_STABLE_TIME  60      // seconds after which a connection is stable
+
+
+//*********************************
+//     STATES OF LOST CONTACTS
+//*********************************
+#define RC_WAITING  0           // waiting for the backoff to pass
+#define RC_QUEUED   1           // reconnect has been queued (see: enqueue_conn())
+#define RC_UP       2           // reconnected, but not stable yet
+
+
+/*!
+ * Structure for a lost contact
+ */
+typedef struct reconnect
+{
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address of contact
+    uint16_t lport;                     //!< listening port of contact
+    int prio;                           //!< priority of the reconnect (see: CONN_PRIO_*)
+    int state;                          //!< state of contact (see: RC_*)
+    int attempts;                       //!< failed reconnects in a row
+    int score;                          //!< failure score
+    struct timespec due;                //!< time of next reconnect or of reconnect (RC_UP)
+} reconnect_t;
+
+/*!
+ * Structure for the reconnect scheduler.
+ * Contacts that have been lost or could not be connected are retried with
+ * a capped exponential backoff, jittered so that contacts lost at the same
+ * time (e.g. because the TOR client hung) are not reconnected all at once.
+ */
+typedef struct reconnect_list
+{
+    reconnect_t peer[RC_MAX_PEERS];     //!< lost contacts
+    int used;                           //!< amount of lost contacts
+    int enabled;                        //!< scheduler is in use (not in overlay mode)
+    unsigned long scheduled;            //!< reconnects queued
+    unsigned long healed;               //!< lost contacts connected again
+    unsigned long dropped;              //!< lost contacts given up
+    pthread_mutex_t rc_mx;              //!< mutex to lock the lost contacts
+} reconnect_list_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int init_reconnects(reconnect_list_t* rl);
+void destroy_reconnects(reconnect_list_t* rl);
+
+
+//*********************************
+//      SCHEDULER FUNCTIONS
+//*********************************
+void rc_lost(reconnect_list_t* rl, char* onion_id, uint16_t lport);
+int rc_result(reconnect_list_t* rl, char* onion_id, uint16_t lport, int prio, int result);
+long rc_run(reconnect_list_t* rl, conn_queue_t* cq);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+reconnect_t* rc_get(reconnect_list_t* rl, char* onion_id, uint16_t lport, int add);
+void rc_schedule(reconnect_t* rc, struct timespec* now);
+void rc_remove(reconnect_list_t* rl, reconnect_t* rc);
+
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "msglog.h"
+
+
+//*********************************
+//     SEARCH INDEX SETTINGS
+//*********************************
+#define SI_MAGIC         "DCHATSI1" // starts the index file
+#define SI_FILE_NAME     "%s/search.idx" // index file in the directory of the message log
+#define SI_TMP_EXT       ".tmp"     // extension of the index file while it is written
+#define SI_MIN_TOKEN     2          // min. length of an indexed term
+#define SI_MAX_TOKEN     31         // max. length of a term, longer words are cut
+#define SI_MAX_TERMS     16         // max. terms of a query
+#define SI_MAX_RESULTS   20         // max. messages displayed per query
+#define SI_MIN_LISTS     1024       // initial size of the table of new terms
+#define SI_MIN_POSTINGS  16         // initial bytes of a posting list
+#define SI_MERGE_BYTES   1048576    // bytes of new postings merged into the index file
+
+
+/*!
+ * Structure for the header of the index file.
+ * The sorted terms follow the header, the posting lists follow the terms.
+ */
+typedef struct si_hdr
+{
+    char magic[8];                      //!< SI_MAGIC
+    uint64_t last;                      //!< sequence number of last message indexed
+    uint32_t terms;                     //!< amount of terms
+    uint32_t pad;
+} si_hdr_t;
+
+/*!
+ * Structure for a term of the index file
+ */
+typedef struct si_term
+{
+    char token[SI_MAX_TOKEN + 1];       //!< term, terminated by '\0'
+    uint64_t off;                       //!< offset of posting list in file
+    uint32_t len;                       //!< bytes of posting list
+    uint32_t count;                     //!< amount of messages in posting list
+} si_term_t;
+
+/*!
+ * Structure for the posting list of a term of the messages not merged
+ * into the index file yet
+ */
+typedef struct si_list
+{
+    char token[SI_MAX_TOKEN + 1];       //!< term, empty if slot is unused
+    unsigned char* post;                //!< posting list
+    int len;                            //!< bytes of posting list
+    int size;                           //!< size of buffer
+    uint32_t count;                     //!< amount of messages in posting list
+    uint64_t last;                      //!< sequence number of last message in list
+} si_list_t;
+
+/*!
+ * Structure for the full-text index of the message log.
+ * Every term maps to a posting list: the sequence numbers of the messages
+ * containing it in ascending order, stored as varints of the differences
+ * to their predecessors. The terms of new messages are added to a hash
+ * table in memory, which is merged into the index file from time to time
+ * (see: si_merge()). The index file is mapped read-only, its terms are
+ * sorted and searched binary, so that it is ready as soon as it is
+ * mapped.
+ */
+typedef struct search_index
+{
+    char path[ML_MAX_PATH + 16];        //!< index file, empty if disabled
+    unsigned char* map;                 //!< mapped index file, NULL if there is none
+    size_t size;                        //!< length of mapping
+    si_term_t* term;                    //!< sorted terms of index file
+    uint32_t terms;                     //!< amount of terms of index file
+    si_list_t* list;                    //!< hash table of new posting lists
+    int cap;                            //!< size of hash table, a power of 2
+    int lists;                          //!< amount of new posting lists
+    size_t bytes;                       //!< bytes of new posting lists
+    uint64_t last;                      //!< sequence number of last message indexed
+    unsigned long indexed;              //!< messages indexed in this session
+    unsigned long merges;               //!< merges into the index file
+    unsigned long queries;              //!< queries answered
+} search_index_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int init_search_index(search_index_t* si, msg_log_t* ml);
+void destroy_search_index(search_index_t* si, msg_log_t* ml);
+
+
+//*********************************
+//        INDEX FUNCTIONS
+//*********************************
+int si_add(search_index_t* si, msg_log_t* ml, uint64_t seq, char* content, int len);
+int si_post(search_index_t* si, char* token, uint64_t seq);
+int si_merge(search_index_t* si, msg_log_t* ml);
+int si_load(search_index_t* si);
+
+
+//*********************************
+//        QUERY FUNCTIONS
+//*********************************
+int si_query(search_index_t* si, msg_log_t* ml, char* query);
+int si_search(search_index_t* si, char* query, uint64_t** seqs);
+int si_postings(search_index_t* si, char* token, uint64_t** seqs);
+int si_intersect(uint64_t* a, int na, uint64_t* b, int nb);
+void si_print(msg_log_t* ml, uint64_t seq);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+int si_token(char** p, char* end, char* token);
+si_list_t* si_list(search_index_t* si, char* token, int create);
+si_term_t* si_term(search_index_t* si, char* token);
+int si_decode(unsigned char* post, int len, uint64_t** seqs, int count, int* size);
+int si_encode(uint64_t* seqs, int count, unsigned char* buf);
+
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SEED_H
+#define SEED_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "network.h"
+
+
+//*********************************
+//        SEED SETTINGS
+//*********************************
+#define SEED_MAX      64    // max. seeds read from the seed file
+#define SEED_DEF_KEEP 3     // default amount of seeds kept as contacts
+#define SEED_TIMEOUT  120   // seconds until pending probes are canceled
+#define SEED_MAX_PATH 4096
+
+
+//*********************************
+//         PROBE STATES
+//*********************************
+#define SEED_CONNECTING 1   // connecting to the TOR client
+#define SEED_REQUESTED  2   // SOCKS request sent, waiting for response
+#define SEED_DONE       3   // kept, canceled or failed
+
+
+/*!
+ * Structure for a bootstrap peer and the state of its probe
+ */
+typedef struct seed
+{
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address of seed
+    uint16_t lport;                     //!< listening port of seed
+    int fd;                             //!< socket of probe
+    int ep;                             //!< TOR client of the SOCKS pool used or -1
+    int grp;                            //!< group of peers (see: socks_isolation())
+    char user[SOCKS_MAX_USERLEN + 1];   //!< SOCKS5 username for stream isolation
+    int state;                          //!< state of probe (see: SEED_*)
+    uint8_t resp[SOCKS_MAX_REPLY_LEN];  //!< SOCKS response read so far
+    int resp_len;                       //!< bytes of SOCKS response read
+    struct timespec start;              //!< start of probe
+} seed_t;
+
+/*!
+ * Structure for the list of bootstrap peers
+ */
+typedef struct seed_list
+{
+    char path[SEED_MAX_PATH + 1];       //!< path of seed file
+    seed_t seed[SEED_MAX];              //!< seeds read from seed file
+    int used;                           //!< amount of seeds
+    int keep;                           //!< amount of seeds kept as contacts
+    int kept;                           //!< seeds added as contacts
+    int failed;                         //!< seeds which could not be reached
+    int canceled;                       //!< probes canceled
+    int probing;                        //!< probe thread has been started
+    pthread_t probe_th;                 //!< thread probing the seeds
+} seed_list_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int read_seeds(seed_list_t* sl);
+int start_seed_probe(seed_list_t* sl);
+void destroy_seeds(seed_list_t* sl);
+
+
+//*********************************
+//        PROBE FUNCTIONS
+//*********************************
+void* th_probe_seeds(void* arg);
+int start_probe(seed_t* seed);
+int continue_probe(seed_t* seed, short revents);
+void release_probe(seed_t* seed, int result);
+void cancel_probes(seed_list_t* sl);
+void cleanup_th_probe_seeds(void* arg);
+
+
+#endif
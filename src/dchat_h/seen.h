@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SEEN_H
+#define SEEN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+
+//*********************************
+//       SEEN-SET SETTINGS
+//*********************************
+#define SEEN_DEF_MEMORY  64     // default memory of the seen-set in KB
+#define SEEN_MAX_MEMORY  65536  // max. memory of the seen-set in KB
+#define SEEN_DEF_FPR     0.0001 // default false positive rate
+#define SEEN_BUCKETS     4      // amount of Bloom filters (time buckets)
+#define SEEN_BUCKET_SECS 60     // seconds until the oldest bucket is cleared
+#define SEEN_MAX_HASHES  32     // max. hash functions per Bloom filter
+#define SEEN_LN2         0.6931471805599453
+
+
+/*!
+ * Structure for the set of recently seen message ids.
+ * The set consists of SEEN_BUCKETS Bloom filters, new ids are added to
+ * the current one. Every SEEN_BUCKET_SECS seconds, or as soon as the
+ * current filter reached its capacity, the oldest filter is cleared and
+ * becomes the current one.
+ */
+typedef struct seen_set
+{
+    size_t memory;          //!< memory of all buckets in KB
+    double fpr;             //!< false positive rate of the whole set
+    uint8_t* bits;          //!< bits of all buckets
+    size_t bucket_bits;     //!< bits of one bucket
+    int hashes;             //!< hash functions per bucket
+    int capacity;           //!< ids per bucket until rotation
+    int current;            //!< bucket new ids are added to
+    int inserted;           //!< ids added to the current bucket
+    time_t bucket_start;    //!< time the current bucket has been cleared
+    unsigned long lookups;  //!< ids checked
+    unsigned long dups;     //!< ids which have been seen before
+} seen_set_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int init_seen(seen_set_t* ss);
+void destroy_seen(seen_set_t* ss);
+
+
+//*********************************
+//       SEEN-SET FUNCTIONS
+//*********************************
+int check_seen(seen_set_t* ss, char* id, int len);
+void rotate_seen(seen_set_t* ss);
+
+
+#endif
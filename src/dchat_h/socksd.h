@@ -0,0 +1,80 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SOCKSD_H
+#define SOCKSD_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#include "network.h"
+
+
+//*********************************
+//      STAND-IN SETTINGS
+//*********************************
+#define SD_DEF_TARGET   "127.0.0.1" // address every destination is mapped to
+#define SD_DIRTINESS    600     // seconds a circuit is reused for new streams
+#define SD_MAX_CIRCUITS 4096    // max. circuits (isolation keys) remembered
+#define SD_RELAY_BUF    4096    // size of relay buffer
+#define SD_BACKLOG      128
+
+
+/*!
+ * Structure for a circuit emulated by the stand-in
+ */
+typedef struct sd_circuit
+{
+    char key[SOCKS_MAX_USERLEN + 1];    //!< isolation key (SOCKS username)
+    time_t built;                       //!< time the circuit has been built
+} sd_circuit_t;
+
+/*!
+ * Structure for the configuration of the stand-in
+ */
+typedef struct sd_conf
+{
+    struct sockaddr_in listen;          //!< listening address
+    struct in_addr target;              //!< address every destination is mapped to
+    int circuit_ms;                     //!< time to build a new circuit
+    int connect_ms;                     //!< time to connect a stream
+    int jitter_ms;                      //!< max. random delay added to every stream
+    int fail_pct;                       //!< percentage of streams rejected
+    int kbps;                           //!< max. KB/s relayed per stream, 0 if unlimited
+    sd_circuit_t circuit[SD_MAX_CIRCUITS]; //!< circuits built so far
+    int used;                           //!< amount of circuits
+    pthread_mutex_t sd_mx;              //!< mutex to lock the circuits
+} sd_conf_t;
+
+
+//*********************************
+//       STREAM FUNCTIONS
+//*********************************
+void* th_stream(void* arg);
+int read_full(int fd, void* buf, int len);
+int read_request(int fd, uint16_t* rport, char* user);
+int write_reply(int fd, int version, int granted);
+int stream_delay(char* user);
+void relay(int a, int b);
+
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+
+#ifndef SWARM_H
+#define SWARM_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "network.h"
+#include "filetransfer.h"
+
+
+//*********************************
+//        SWARM SETTINGS
+//*********************************
+#define SW_OFFER         "DCHAT-SWARM/1.0" // token in the Server header of a hello joining swarms
+#define SW_PREFIX        "SW"       // control lines of swarm PDUs start with it
+#define SW_MAX_SWARMS    8          // max. swarms at once
+#define SW_MAX_PEERS     32         // max. peers per swarm
+#define SW_PIECE_CHUNKS  16         // chunks per piece, pieces are requested from peers
+#define SW_MAX_REQUESTS  2          // max. pieces requested from a peer at once
+#define SW_TIMEOUT       60         // seconds a piece or the chunk list may take
+#define SW_MAX_LINE      (FT_MAX_NAME + 2 * CS_HASH_LEN + 48) // max. length of a control line
+
+
+//*********************************
+//   CONTROL LINES OF SWARM PDUS
+//*********************************
+#define SW_CMD_SWARM "SWARM"        // SWARM <hash> <size> <count> <name>: sender is member of swarm
+#define SW_CMD_LIST  "SWLIST"       // SWLIST <id>: send chunk list of swarm
+#define SW_CMD_RECS  "SWRECS"       // SWRECS <id> <first>: records of the chunk list follow the line
+#define SW_CMD_BITS  "SWBITS"       // SWBITS <id> <first>: bitmap of the pieces held follows the line
+#define SW_CMD_GOT   "SWGOT"        // SWGOT <id> <piece>: piece has been received
+#define SW_CMD_GET   "SWGET"        // SWGET <id> <piece>: send the chunks of piece
+#define SW_CMD_DATA  "SWDATA"       // SWDATA <id> <chunk>: chunk follows the line
+#define SW_CMD_ACK   "SWACK"        // SWACK <id> <chunk>: chunk has been received
+
+
+/*!
+ * Structure for a peer of a swarm, a contact that is member of the swarm
+ */
+typedef struct sw_peer
+{
+    int used;                           //!< slot is in use
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address of contact
+    uint16_t lport;                     //!< listening port of contact
+    int sock;                           //!< socket of contact, the peer ends with it
+    int announced;                      //!< swarm has been announced to the contact
+    int joined;                         //!< contact has announced the swarm
+    unsigned char* have;                //!< bitmap of pieces held by the contact
+    int pieces;                         //!< amount of pieces held by the contact
+    int requests;                       //!< pieces requested from the contact
+    int dirty;                          //!< pieces of the contact changed, requests are due
+    int queue[SW_MAX_REQUESTS];         //!< pieces requested by the contact (ring)
+    int qhead;                          //!< first piece requested
+    int qlen;                           //!< amount of pieces requested
+    int cursor;                         //!< next chunk sent of the first piece requested
+    unsigned long up;                   //!< bytes sent to the contact
+    unsigned long down;                 //!< bytes received from the contact
+} sw_peer_t;
+
+/*!
+ * Structure for the swarm of a file.
+ * The file consists of the pieces of SW_PIECE_CHUNKS chunks of its chunk
+ * list (see: cs_chunk_file()). A swarm is identified by the SHA-256 of
+ * its chunk list, whose first 4 bytes are the id of the swarm.
+ */
+typedef struct swarm
+{
+    uint32_t id;                        //!< id of swarm
+    unsigned char hash[CS_HASH_LEN];    //!< SHA-256 of chunk list
+    char name[FT_MAX_NAME + 1];         //!< name of file
+    off_t size;                         //!< size of file
+    cs_list_t* list;                    //!< chunk list of file
+    int recs;                           //!< records of chunk list received
+    int asked;                          //!< peer asked for the chunk list
+    time_t asked_at;                    //!< time the chunk list has been asked for
+    int pieces;                         //!< amount of pieces
+    unsigned char* have;                //!< bitmap of pieces held
+    int held;                           //!< amount of pieces held
+    unsigned short* avail;              //!< amount of peers holding each piece
+    unsigned char* pending;             //!< peer each piece has been requested from + 1, 0 if none
+    time_t* since;                      //!< time each piece has been requested
+    int* next;                          //!< next chunk expected of each piece requested
+    int fd;                             //!< file read from or written to
+    int complete;                       //!< all pieces are held
+    time_t checked;                     //!< time the requests have been checked last
+    sw_peer_t peer[SW_MAX_PEERS];       //!< peers of swarm
+    unsigned long up;                   //!< bytes sent to peers
+    unsigned long down;                 //!< bytes received from peers
+    struct timespec started;            //!< time the swarm has been joined
+} swarm_t;
+
+/*!
+ * Structure for the swarms, which distribute files to all contacts.
+ * Every member of a swarm announces it to its contacts ("SWARM"),
+ * contacts without the swarm join it and fetch its chunk list, so that
+ * the swarm spreads along the connections. Members tell each other the
+ * pieces they hold ("SWBITS", "SWGOT") and request the missing ones from
+ * several members at once, rarest piece first ("SWGET"). Pieces are
+ * passed on as soon as they have been received, so that the upstream of
+ * every member carries the file, not only the one of its origin.
+ */
+typedef struct swarms
+{
+    swarm_t sw[SW_MAX_SWARMS];          //!< swarms
+    int used;                           //!< amount of swarms
+    unsigned long up_bytes;             //!< bytes of chunks sent
+    unsigned long down_bytes;           //!< bytes of chunks received
+    unsigned long completed;            //!< files received completely
+} swarms_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+void destroy_swarms(swarms_t* sl);
+
+
+//*********************************
+//        SWARM FUNCTIONS
+//*********************************
+int sw_share(swarms_t* sl, char* path);
+int sw_receive(swarms_t* sl, int n, char* content, int len);
+long sw_run(swarms_t* sl);
+int sw_swarm(swarms_t* sl, int n, unsigned char* hash, off_t size, int count, char* name);
+int sw_list(swarms_t* sl, int n, uint32_t id);
+int sw_recs(swarms_t* sl, int n, uint32_t id, int first, char* data, int len);
+int sw_bits(swarms_t* sl, int n, uint32_t id, int first, char* data, int len);
+int sw_got(swarms_t* sl, int n, uint32_t id, int piece);
+int sw_get(swarms_t* sl, int n, uint32_t id, int piece);
+int sw_data(swarms_t* sl, int n, uint32_t id, int chunk, char* data, int len);
+int sw_ack(int n, uint32_t id, int chunk);
+
+
+//*********************************
+//        PIECE FUNCTIONS
+//*********************************
+int sw_request(swarm_t* s, int p, int n);
+int sw_serve(swarms_t* sl, swarm_t* s, sw_peer_t* p, int n);
+int sw_open(swarm_t* s);
+int sw_finish(swarms_t* sl, swarm_t* s);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+swarm_t* sw_find(swarms_t* sl, uint32_t id);
+swarm_t* sw_add(swarms_t* sl, unsigned char* hash, off_t size, int count, char* name);
+void sw_remove(swarms_t* sl, swarm_t* s);
+int sw_peer(swarm_t* s, int n, int add);
+void sw_drop_peer(swarm_t* s, int p);
+int sw_contact(sw_peer_t* p);
+int sw_announce(swarm_t* s, int p, int n);
+int sw_send_bits(swarm_t* s, int n);
+int sw_control(int n, char* line, int len);
+void sw_part_path(swarm_t* s, char* path);
+
+
+#endif
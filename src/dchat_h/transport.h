@@ -0,0 +1,95 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "network.h"
+
+
+//*********************************
+//      TRANSPORT SETTINGS
+//*********************************
+#define TP_ID_TOR       0       // connections are relayed by TOR (SOCKS pool)
+#define TP_ID_DIRECT    1       // direct TCP connections (see: direct_route_t)
+#define TP_ROUTE_ANY    "*"     // route matching every onion address
+#define TP_INIT_ROUTES  32      // initial size of the route table
+#define TP_MAX_PATH     4096
+
+
+/*!
+ * Structure for an outgoing transport.
+ * The transport in use is selected by the command line options and every
+ * outgoing connection is created by its connect function.
+ */
+typedef struct transport
+{
+    int tp_id;                  //!< id of transport (see: TP_ID_*)
+    char* name;                 //!< name of transport
+    int socks;                  //!< connections are requested from a SOCKS pool
+    //! creates a connected socket, data is sent right after the connect
+    int (*connect)(char* hostname, uint16_t rport, char* data, int data_len);
+} transport_t;
+
+/*!
+ * Structure for a route of the direct transport, mapping an onion address
+ * to a local address
+ */
+typedef struct direct_route
+{
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address or TP_ROUTE_ANY
+    uint16_t lport;                     //!< listening port, 0 for every port
+    struct sockaddr_in sa;              //!< address, port 0 keeps the listening port
+} direct_route_t;
+
+/*!
+ * Structure for the transport configuration
+ */
+typedef struct transport_conf
+{
+    transport_t transport;              //!< transport in use
+    char path[TP_MAX_PATH + 1];         //!< route file of the direct transport
+    direct_route_t* route;              //!< routes of the direct transport
+    int used;                           //!< amount of routes
+    int size;                           //!< size of route table
+} transport_conf_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int init_transport(transport_conf_t* tc);
+void destroy_transport(transport_conf_t* tc);
+int read_routes(transport_conf_t* tc);
+
+
+//*********************************
+//      TRANSPORT FUNCTIONS
+//*********************************
+int create_peer_socket(char* hostname, uint16_t rport, char* data, int data_len);
+int create_direct_socket(char* hostname, uint16_t rport, char* data, int data_len);
+int direct_route(transport_conf_t* tc, char* hostname, uint16_t rport,
+                 struct sockaddr_in* da);
+
+
+#endif
@@ -24,10 +24,27 @@
 #include <netinet/in.h>
 #include <time.h>
 #include "network.h"
+#include "connector.h"
+#include "overlay.h"
+#include "seen.h"
+#include "cache.h"
+#include "seed.h"
+#include "transport.h"
+#include "reconnect.h"
+#include "warmpool.h"
+#include "filetransfer.h"
+#include "msglog.h"
+#include "search.h"
+#include "compress.h"
+#include "fragment.h"
+#include "swarm.h"
+#include "checksum.h"
 
 #define FRAME_BUF_LEN  4096
 #define INIT_CONTACTS  30
 #define MAX_NICKNAME   31
+#define MAX_MSGID_LEN  (ONION_ADDRLEN + 28) // onion-id, port and sequence number
+#define MAX_UNIX_PATH  107  // length of sun_path without terminating null
 
 
 //*********************************
@@ -48,6 +65,17 @@ typedef struct dchat_pdu
     char nickname[MAX_NICKNAME + 1];   //!< nickname of the client
     struct tm sent;                    //!< receive time of pdu (Date header)
     char* server;                      //!< type of server that crafted this pdu
+    int hop_limit;                     //!< remaining hops of a forwarded pdu
+    char origin_id[ONION_ADDRLEN + 1]; //!< onion address of the author
+    uint16_t origin_lport;             //!< listening port of the author
+    char origin_name[MAX_NICKNAME + 1]; //!< nickname of the author
+    char msg_id[MAX_MSGID_LEN + 1];    //!< unique id of a message
+    int encoding;                      //!< content is deflated (see: zc_deflate())
+    uint32_t frag_id;                  //!< id of fragmented message (see: fg_send())
+    int frag_offset;                   //!< offset of fragment in message
+    int frag_total;                    //!< length of fragmented message, 0 if no fragment
+    int has_crc;                       //!< crc is set (Content-CRC32C)
+    uint32_t crc;                      //!< CRC-32C of the content as sent (see: checksum.c)
 } dchat_pdu_t;
 
 /*!
@@ -60,6 +88,19 @@ typedef struct contact
     uint16_t lport;                   //!< listening port of hidden service
     char name[MAX_NICKNAME + 1];      //!< nickname
     int accepted;                     //!< connect to or accepted contact?
+    uint32_t dgs_version;             //!< version of last digest received
+    float version;                    //!< DChat version PDUs are written with
+    int files;                        //!< contact accepts files (see: FT_OFFER)
+    int chunks;                       //!< contact holds a chunk store (see: CS_OFFER)
+    int swarms;                       //!< contact joins swarms (see: SW_OFFER)
+    int checksums;                    //!< contact verifies checksums (see: CK_OFFER)
+    ft_link_t link;                   //!< chunks of files in flight
+    zc_stream_t zc;                   //!< compression of the connection
+    fg_link_t fg;                     //!< fragmentation of the connection
+    char* obuf;                       //!< PDUs not written yet (see: send_pdu())
+    int olen;                         //!< bytes in obuf
+    int osize;                        //!< size of obuf
+    struct timespec oflush;           //!< time obuf has to be written at latest
 } contact_t;
 
 /*!
@@ -71,8 +112,26 @@ typedef struct contactlist
     pthread_mutex_t cl_mx;      //!< mutex to signal lock
     int cl_size;                //!< size of array
     int used_contacts;          //!< elements used in contact array
+    uint32_t version;           //!< incremented on every contactlist change
 } contactlist_t;
 
+/*!
+ * Structure for traffic statistics of this client
+ */
+typedef struct dchat_stats
+{
+    unsigned long dsc_pdus;     //!< "control/discover" PDUs sent
+    unsigned long dsc_bytes;    //!< bytes of "control/discover" PDUs sent
+    unsigned long dsc_contacts; //!< contacts sent within "control/discover"
+    unsigned long dgs_pdus;     //!< "control/digest" PDUs sent
+    unsigned long dgs_bytes;    //!< bytes of "control/digest" PDUs sent
+    unsigned long pdus;         //!< PDUs sent to contacts
+    unsigned long pdu_bytes;    //!< bytes of PDUs sent to contacts
+    unsigned long pdu_cells;    //!< TOR cells needed if every PDU is written alone
+    unsigned long writes;       //!< writes of coalesced PDUs
+    unsigned long write_cells;  //!< TOR cells needed for the coalesced writes
+} dchat_stats_t;
+
 /*!
  * Structure for global configurations
  */
@@ -80,13 +139,37 @@ typedef struct dchat_conf
 {
     contactlist_t cl;           //!< contact list
     contact_t me;               //!< local contact information
+    dchat_stats_t stats;        //!< traffic statistics
+    overlay_t ovl;              //!< active and passive view in overlay mode
+    seen_set_t seen;            //!< ids of recently seen messages
+    uint64_t msg_seq;           //!< sequence number of next message id
+    contact_cache_t cache;      //!< persistent cache of known contacts
+    seed_list_t seeds;          //!< bootstrap peers of the seed file
+    socks_pool_t socks;         //!< TOR clients outgoing connections use
+    transport_conf_t tp;        //!< transport outgoing connections use
     struct sockaddr_storage sa; //!< local socket address
-    int acpt_fd;                //!< listening socket
+    int acpt_fd;                //!< listening TCP socket, -1 if not listening
+    int unix_fd;                //!< listening unix socket, -1 if not listening
+    char unix_path[MAX_UNIX_PATH + 1]; //!< path of unix socket, empty if unused
+    int unix_only;              //!< listen on the unix socket only
+    int co_window;              //!< time PDUs are coalesced in microseconds
+    int co_max;                 //!< max. bytes of coalesced PDUs
+    int text_only;              //!< do not offer binary framing (DChat/2)
+    compression_t zc;           //!< compression of PDUs sent to contacts
+    fragmentation_t fg;         //!< fragmentation of messages exceeding MAX_CONTENT_LEN
     int in_fd, out_fd, log_fd;  //!< console input, output and log
-    int connect_fd[2];          //!< pipe to connector
     int cl_change[2];           //!< pipe to signal wait loop from connect
     int user_input[2];          //!< pipe to signal a new user input from stdin
-    pthread_t conn_th;          //!< thread responsible for new connections
+    conn_queue_t cq;            //!< queue of outgoing connection requests
+    reconnect_list_t rc;        //!< lost contacts to reconnect
+    warm_pool_t wp;             //!< connections built in advance
+    file_transfers_t ft;        //!< files sent to or received from contacts
+    chunk_store_t cs;           //!< chunks of files received
+    swarms_t sw;                //!< swarms of files shared
+    checksums_t ck;             //!< checksums of chunks of files
+    msg_log_t ml;               //!< messages sent and received
+    search_index_t si;          //!< full-text index of the message log
+    pthread_t conn_th[CONN_MAX_INFLIGHT]; //!< threads responsible for new connections
     pthread_t select_th;        //!< thread responsible for select(2) fd
 } dchat_conf_t;
 
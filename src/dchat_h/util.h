@@ -23,10 +23,15 @@
 
 #include <netinet/in.h>
 #include <limits.h>
+#include <stdint.h>
 
 //max. amount of chars for integer str representation
 #define MAX_INT_STR ((CHAR_BIT * sizeof(int) - 1) / 3 + 2)
 
+#define FNV_OFFSET 2166136261u // FNV-1a 32 bit offset basis
+#define FNV_PRIME  16777619u   // FNV-1a 32 bit prime
+#define MAX_VARINT_LEN 10       // max. bytes of a 64 bit varint
+
 
 //*********************************
 //         MISC FUNCTIONS
@@ -35,5 +40,8 @@ int max(int a, int b);
 int file_exists(char* filename);
 char* remove_leading_spaces(char* value);
 int iszero(void* ptr, int n);
+uint32_t fnv_hash(uint32_t hash, void* data, int len);
+int put_varint(uint64_t value, unsigned char* buf);
+int get_varint(unsigned char* buf, int len, uint64_t* value);
 
 #endif
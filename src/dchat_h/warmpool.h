@@ -0,0 +1,105 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef WARMPOOL_H
+#define WARMPOOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "network.h"
+#include "overlay.h"
+
+
+//*********************************
+//      WARM POOL SETTINGS
+//*********************************
+#define WP_MAX_CONNS    16      // upper limit of the budget
+#define WP_MAX_FAILED   32      // failed addresses remembered
+#define WP_INTERVAL     5       // seconds between two maintenance runs
+#define WP_RETRY_TIME   300     // seconds a failed address is not retried
+#define WP_MAX_AGE      600     // seconds after which a connection is rebuilt
+#define WP_MAX_PENDING  16384   // max. unread bytes of a connection
+
+
+/*!
+ * Structure for a connection built in advance
+ */
+typedef struct warm_conn
+{
+    char onion_id[ONION_ADDRLEN + 1];   //!< onion address of peer
+    uint16_t lport;                     //!< listening port of peer
+    int fd;                             //!< connected socket, -1 if failed
+    time_t built;                       //!< time the connection has been built or failed
+} warm_conn_t;
+
+/*!
+ * Structure for the pool of connections built in advance.
+ * A thread keeps up to `budget` connections to the peers most likely
+ * connected to next, so that a connect does not have to wait for the
+ * hidden service rendezvous (see: wp_claim()).
+ */
+typedef struct warm_pool
+{
+    warm_conn_t conn[WP_MAX_CONNS];     //!< ready connections
+    int used;                           //!< amount of ready connections
+    int budget;                         //!< max. ready connections, 0 if disabled
+    warm_conn_t failed[WP_MAX_FAILED];  //!< recently failed addresses (ring)
+    int failed_next;                    //!< next slot of failed addresses
+    unsigned long built;                //!< connections built
+    unsigned long claimed;              //!< connections claimed by a connect
+    unsigned long expired;              //!< connections closed unused
+    int running;                        //!< thread has been started
+    pthread_t warm_th;                  //!< thread building the connections
+    pthread_mutex_t wp_mx;              //!< mutex to lock the pool
+    pthread_cond_t wp_cv;               //!< signals a claimed connection
+} warm_pool_t;
+
+
+//*********************************
+//     INIT/DESTROY FUNCTIONS
+//*********************************
+int init_warm_pool(warm_pool_t* wp);
+int start_warm_pool(warm_pool_t* wp);
+void destroy_warm_pool(warm_pool_t* wp);
+
+
+//*********************************
+//        POOL FUNCTIONS
+//*********************************
+void* th_warm_pool(void* arg);
+int wp_claim(warm_pool_t* wp, char* onion_id, uint16_t lport);
+void wp_check(warm_pool_t* wp);
+int wp_fill(warm_pool_t* wp);
+int wp_candidates(warm_pool_t* wp, ovl_peer_t** cand);
+
+
+//*********************************
+//         MISC FUNCTIONS
+//*********************************
+int wp_find(warm_pool_t* wp, char* onion_id, uint16_t lport);
+int wp_is_failed(warm_pool_t* wp, char* onion_id, uint16_t lport, time_t now);
+int wp_is_alive(int fd);
+void wp_remove(warm_pool_t* wp, int i);
+void unlock_warm_pool(void* arg);
+
+
+#endif
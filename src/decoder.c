@@ -27,15 +27,20 @@
 #endif
 
 #include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <ctype.h>
 
 #include "dchat_h/decoder.h"
 #include "dchat_h/network.h"
 #include "dchat_h/util.h"
 #include "dchat_h/consoleui.h"
+#include "dchat_h/compress.h"
+#include "dchat_h/fragment.h"
+#include "dchat_h/checksum.h"
 
 
 /**
@@ -90,7 +95,7 @@ decode_header(dchat_pdu_t* pdu, char* line)
 
     // only split the very first token from temp, to keep
     // the value one token (containing possible delim chars)
-    if (save_ptr != NULL)
+    if (value + strlen(value) < temp + strlen(line))
     {
         value[strlen(value)] = *delim;
     }
@@ -191,28 +196,59 @@ read_line(int fd, char** line)
  *  Read a whole DChat PDU from a file descriptor.
  *  Read linewise from a file descriptor to form a DChat protocol data unit.
  *  Information read from the file descriptor will be stored in this pdu.
- *  @param fd  File descriptor to read from
- *  @param pdu Pointer to a PDU structure whose headers will be filled.
+ *  Binary frames (DChat/2) are told apart from text PDUs by their first byte
+ *  and decoded with read_pdu_v2().
+ *  @param fd      File descriptor to read from
+ *  @param pdu     Pointer to a PDU structure whose headers will be filled.
+ *  @param session Contact the PDU is read from, its onion-id, listening
+ *                 port and nickname are filled into binary frames
  *  @return amount of bytes read in total if a protocol data unit has been read successfully, 0 on EOF ,
  *  -1 on error
  */
 int
-read_pdu(int fd, dchat_pdu_t* pdu)
+read_pdu(int fd, dchat_pdu_t* pdu, contact_t* session)
 {
     char* line;     // line read from file descriptor
     char* contentp; // content pointer
+    char c;         // first byte of pdu
     int ret;        // return value
     int b;          // amount of bytes read as content
     int len = 0;    // amount of bytes read in total
+    uint32_t crc = 0; // CRC-32C of the content read so far
     // zero out structure
     memset(pdu, 0, sizeof(*pdu));
 
-    // read each line of the received pdu
+    if ((ret = read(fd, &c, 1)) == -1 || !ret)
+    {
+        return ret;
+    }
+
+    if ((unsigned char) c == V2_MAGIC)
+    {
+        return read_pdu_v2(fd, pdu, session);
+    }
+
+    // read the rest of the first line of the received pdu
+    if (c == '\n')
+    {
+        ui_log(LOG_ERR, "Illegal PDU header received: '\\n'");
+        return -1;
+    }
+
     if ((ret = read_line(fd, &line)) == -1 || !ret)
     {
         return ret;
     }
 
+    if ((contentp = realloc(line, ret + 2)) == NULL)
+    {
+        ui_fatal("Reallocation of input string failed!");
+    }
+
+    line = contentp;
+    memmove(line + 1, line, ret + 1);
+    line[0] = c;
+
     // first header must be version header
     if (decode_header(pdu, line) == -1 || pdu->version != DCHAT_V1)
     {
@@ -267,24 +303,352 @@ read_pdu(int fd, dchat_pdu_t* pdu)
         return -1;
     }
 
+    // the limit of the content-length depends on the content-type
+    if (!is_valid_content_length(pdu->content_type, pdu->content_length))
+    {
+        ui_log(LOG_ERR, "Illegal Content-Length received!");
+        free(line);
+        return -1;
+    }
+
     // allocate memory for content
-    pdu->content = malloc(pdu->content_length + 1);
-    contentp = pdu->content; // point to the beginning
+    if ((pdu->content = malloc(pdu->content_length + 1)) == NULL)
+    {
+        ui_fatal("Memory allocation for PDU content failed!");
+    }
 
     // read content frm file descriptor
-    // read x bytes defined by Content-Length
-    for (b = 0, contentp = pdu->content; b < pdu->content_length;
-         b++, contentp++, len++)
+    // read x bytes defined by Content-Length, the content ends exactly
+    // there, so it can be read at once
+    for (b = 0, contentp = pdu->content; b < pdu->content_length; b += ret)
     {
-        if ((ret = read(fd, contentp, 1)) == -1 || !ret)
+        if ((ret = read(fd, contentp + b, pdu->content_length - b)) == -1 || !ret)
         {
             free(pdu->content);
             return ret;
         }
+
+        // the checksum is updated with every read, while the bytes are cached
+        if (pdu->has_crc)
+        {
+            crc = ck_crc32c(crc, contentp + b, ret);
+        }
+    }
+
+    contentp[b] = '\0'; // NULL terminate potential string
+    len += b;
+
+    if (pdu->has_crc && verify_crc(pdu, crc) == -1)
+    {
+        free(pdu->content);
+        return -1;
+    }
+
+    // deflated content is inflated in the order received
+    if (pdu->encoding && zc_inflate(session != NULL ? &session->zc : NULL, pdu) == -1)
+    {
+        free(pdu->content);
+        return -1;
+    }
+
+    return len; // amount of bytes read in total
+}
+
+
+/**
+ *  Reads a binary frame (DChat/2), whose first byte has been read already.
+ *  A frame consists of V2_MAGIC, the length of its body as varint and the
+ *  body (see: decode_pdu_v2()). The body is read at once instead of byte by
+ *  byte.
+ *  @param fd      File descriptor to read from
+ *  @param pdu     Pointer to a zeroed PDU structure
+ *  @param session Contact the frame is read from, has to be identified
+ *  @return amount of bytes read in total, 0 on EOF, -1 on error
+ */
+int
+read_pdu_v2(int fd, dchat_pdu_t* pdu, contact_t* session)
+{
+    unsigned char prefix[MAX_VARINT_LEN]; // length of body
+    unsigned char* body;                  // body of frame
+    uint64_t len;   // length of body
+    int size;       // length of body, checked against V2_MAX_BODY
+    int plen = 0;   // length of prefix
+    int b;          // amount of bytes of body read
+    int off = -1;   // offset of content, -1 until the fields have been read
+    int done = 0;   // bytes of content added to the checksum
+    uint32_t crc = 0; // CRC-32C of the content read so far
+    int ret;
+
+    // session-constant headers are only known after the hello
+    if (session == NULL || !session->lport)
+    {
+        ui_log(LOG_ERR, "Binary PDU received before hello!");
+        return -1;
+    }
+
+    do
+    {
+        if ((ret = read(fd, &prefix[plen], 1)) == -1 || !ret)
+        {
+            return ret;
+        }
+    }
+    while ((prefix[plen++] & 0x80) && plen < MAX_VARINT_LEN);
+
+    if (get_varint(prefix, plen, &len) == -1 || len < 2 || len > V2_MAX_BODY)
+    {
+        ui_log(LOG_ERR, "Illegal length of binary PDU received!");
+        return -1;
+    }
+
+    size = len;
+
+    if ((body = malloc(size)) == NULL)
+    {
+        ui_fatal("Memory allocation for binary PDU failed!");
+    }
+
+    for (b = 0; b < size; b += ret)
+    {
+        if ((ret = read(fd, body + b, size - b)) == -1 || !ret)
+        {
+            free(body);
+            return ret;
+        }
+
+        // the fields lie within the first V2_MAX_HDR bytes of the body
+        if (off == -1 && b + ret >= (size < V2_MAX_HDR ? size : V2_MAX_HDR))
+        {
+            if ((off = decode_pdu_v2_head(body, b + ret, pdu, session)) == -1)
+            {
+                free(body);
+                return -1;
+            }
+
+            done = off;
+        }
+
+        // the content is added to the checksum as it arrives
+        if (off != -1 && pdu->has_crc && b + ret > done)
+        {
+            crc = ck_crc32c(crc, body + done, b + ret - done);
+            done = b + ret;
+        }
+    }
+
+    ret = decode_pdu_v2_content(body, size, off, pdu);
+    free(body);
+
+    if (ret != -1 && pdu->has_crc && verify_crc(pdu, crc) == -1)
+    {
+        free(pdu->content);
+        return -1;
+    }
+
+    // deflated content is inflated in the order received
+    if (ret != -1 && pdu->encoding && zc_inflate(&session->zc, pdu) == -1)
+    {
+        free(pdu->content);
+        ret = -1;
+    }
+
+    return ret == -1 ? -1 : 1 + plen + size;
+}
+
+
+/**
+ *  Decodes the fields of the body of a binary frame (DChat/2).
+ *  The body consists of the content-type (1 byte), flags (1 byte), the
+ *  fields announced by the flags and the content, which fills the rest of
+ *  the body (see: decode_pdu_v2_content()):
+ *  - V2_FLG_ORG:  hop limit (varint), origin onion-id (string), origin
+ *                 listening port (varint), origin nickname (string) and
+ *                 date (varint, seconds since the epoch)
+ *  - V2_FLG_MID:  message id (string)
+ *  - V2_FLG_MSEQ: sequence number of the message id (varint), whose
+ *                 onion-id and port are the ones of the author
+ *  - V2_FLG_DEF:  no field, the content is deflated
+ *  - V2_FLG_FRG:  fragment id, offset and length of the fragmented message
+ *                 (varints each)
+ *  - V2_FLG_CRC:  CRC-32C of the content (4 bytes, big-endian)
+ *  Strings are prefixed by their length (1 byte). Onion-id, listening port
+ *  and nickname are constant for a session and taken from the contact. The
+ *  date of PDUs, that have not been forwarded, is the time of receipt.
+ *  @param body    Body of frame
+ *  @param len     Bytes of body read, at least the fields
+ *  @param pdu     Pointer to a zeroed PDU structure
+ *  @param session Contact the frame has been read from
+ *  @return offset of the content, -1 if the fields are illegal
+ */
+int
+decode_pdu_v2_head(unsigned char* body, int len, dchat_pdu_t* pdu, contact_t* session)
+{
+    uint64_t val;   // decoded varint
+    int flags;      // fields present
+    int off = 2;    // offset of next field
+    int ret;
+    char* author;   // onion-id of the author
+    uint16_t aport; // listening port of the author
+    time_t now;
+
+    pdu->version = DCHAT_V2;
+    pdu->content_type = body[0];
+    flags = body[1];
+    pdu->encoding = (flags & V2_FLG_DEF) != 0;
+
+    if (!is_valid_content_type(pdu->content_type))
+    {
+        ui_log(LOG_ERR, "Illegal Content-Type of binary PDU received!");
+        return -1;
+    }
+
+    strncat(pdu->onion_id, session->onion_id, ONION_ADDRLEN);
+    pdu->lport = session->lport;
+    strncat(pdu->nickname, session->name, MAX_NICKNAME);
+    author = pdu->onion_id;
+    aport = pdu->lport;
+    now = time(NULL);
+    gmtime_r(&now, &pdu->sent);
+
+    if (flags & V2_FLG_ORG)
+    {
+        if ((ret = get_varint(body + off, len - off, &val)) == -1 || !val ||
+            val > MAX_HOP_LIMIT)
+        {
+            return -1;
+        }
+
+        pdu->hop_limit = val;
+        off += ret;
+
+        if ((ret = get_v2_string(body + off, len - off, pdu->origin_id, ONION_ADDRLEN)) == -1 ||
+            !is_valid_onion(pdu->origin_id))
+        {
+            return -1;
+        }
+
+        off += ret;
+
+        if ((ret = get_varint(body + off, len - off, &val)) == -1 || !is_valid_port(val))
+        {
+            return -1;
+        }
+
+        pdu->origin_lport = val;
+        off += ret;
+
+        if ((ret = get_v2_string(body + off, len - off, pdu->origin_name, MAX_NICKNAME)) == -1)
+        {
+            return -1;
+        }
+
+        off += ret;
+
+        if ((ret = get_varint(body + off, len - off, &val)) == -1)
+        {
+            return -1;
+        }
+
+        now = val;
+        gmtime_r(&now, &pdu->sent);
+        off += ret;
+        author = pdu->origin_id;
+        aport = pdu->origin_lport;
+    }
+
+    if (flags & V2_FLG_MID)
+    {
+        if ((ret = get_v2_string(body + off, len - off, pdu->msg_id, MAX_MSGID_LEN)) == -1)
+        {
+            return -1;
+        }
+
+        off += ret;
+    }
+    else if (flags & V2_FLG_MSEQ)
+    {
+        if ((ret = get_varint(body + off, len - off, &val)) == -1)
+        {
+            return -1;
+        }
+
+        snprintf(pdu->msg_id, sizeof(pdu->msg_id), "%s %hu %llu", author, aport,
+                 (unsigned long long) val);
+        off += ret;
+    }
+
+    if (flags & V2_FLG_FRG)
+    {
+        if ((ret = get_varint(body + off, len - off, &val)) == -1 || val > UINT32_MAX)
+        {
+            return -1;
+        }
+
+        pdu->frag_id = val;
+        off += ret;
+
+        if ((ret = get_varint(body + off, len - off, &val)) == -1 || val >= FG_MAX_MESSAGE)
+        {
+            return -1;
+        }
+
+        pdu->frag_offset = val;
+        off += ret;
+
+        if ((ret = get_varint(body + off, len - off, &val)) == -1 || !val ||
+            val > FG_MAX_MESSAGE)
+        {
+            return -1;
+        }
+
+        pdu->frag_total = val;
+        off += ret;
+    }
+
+    if (flags & V2_FLG_CRC)
+    {
+        if (off + 4 > len)
+        {
+            return -1;
+        }
+
+        pdu->has_crc = 1;
+        pdu->crc = (uint32_t) body[off] << 24 | body[off + 1] << 16 | body[off + 2] << 8 |
+                   body[off + 3];
+        off += 4;
+    }
+
+    return off;
+}
+
+
+/**
+ *  Copies the content of a binary frame (DChat/2), which fills the body
+ *  behind the fields (see: decode_pdu_v2_head()).
+ *  @param body Body of frame
+ *  @param len  Length of body
+ *  @param off  Offset of content
+ *  @param pdu  Pointer to PDU structure whose fields have been decoded
+ *  @return 0 on success, -1 if the length of the content is illegal
+ */
+int
+decode_pdu_v2_content(unsigned char* body, int len, int off, dchat_pdu_t* pdu)
+{
+    if (off > len || !is_valid_content_length(pdu->content_type, len - off))
+    {
+        ui_log(LOG_ERR, "Illegal Content-Length of binary PDU received!");
+        return -1;
+    }
+
+    if ((pdu->content = malloc(len - off + 1)) == NULL)
+    {
+        ui_fatal("Memory allocation for PDU content failed!");
     }
 
-    *contentp = '\0'; // NULL terminate potential string
-    return len; // amount of bytes read as content == content length
+    pdu->content_length = len - off;
+    memcpy(pdu->content, body + off, pdu->content_length);
+    pdu->content[pdu->content_length] = '\0'; // NULL terminate potential string
+    return 0;
 }
 
 
@@ -368,16 +732,124 @@ encode_header(dchat_pdu_t* pdu, int header_id, char** headerline)
 /**
  * Converts a PDU to a string that will be written to a file descriptor.
  * Converts the given PDU to string which then will be written to the given file descriptor.
+ * (See: encode_frame())
+ * @param fd      File descriptor where the dchat PDU will be written to
+ * @param pdu     Pointer to a PDU structure holding the header and content data
+ * @param version Version negotiated with the receiver (DCHAT_V1 or DCHAT_V2)
+ * @return Amount of bytes that have been written or -1 in case of error
+ */
+int
+write_pdu(int fd, dchat_pdu_t* pdu, float version)
+{
+    char* pdu_raw; // Final PDU
+    int pdulen;    // Total length of PDU
+
+    if ((pdulen = encode_frame(pdu, version, &pdu_raw)) == -1)
+    {
+        return -1;
+    }
+
+    //write pdu to file descriptor
+    if (write(fd, pdu_raw, pdulen) != pdulen)
+    {
+        pdulen = -1;
+    }
+
+    free(pdu_raw);
+    return pdulen;
+}
+
+
+/**
+ * Encodes a PDU in the framing negotiated with the receiver.
+ * @param pdu     Pointer to a PDU structure holding the header and content data
+ * @param version Version negotiated with the receiver, text PDUs (DChat/1.0)
+ *                are written unless DCHAT_V2 has been negotiated
+ * @param frame   Pointer to which the encoded PDU will be stored, has to be freed
+ * @return Length of the encoded PDU or -1 in case of error
+ */
+int
+encode_frame(dchat_pdu_t* pdu, float version, char** frame)
+{
+    if (version == DCHAT_V2)
+    {
+        return encode_pdu_v2(pdu, frame);
+    }
+
+    return encode_pdu(pdu, frame);
+}
+
+
+/**
+ * Encodes a PDU up to its content in the framing negotiated with the
+ * receiver. The Content-Length of the PDU has to include the bytes
+ * written after the encoded string.
+ * @param pdu     Pointer to a PDU structure holding the header data
+ * @param version Version negotiated with the receiver (see: encode_frame())
+ * @param head    Pointer to which the encoded headers will be stored, has to be freed
+ * @return Length of the encoded headers or -1 in case of error
+ */
+int
+encode_frame_head(dchat_pdu_t* pdu, float version, char** head)
+{
+    if (version == DCHAT_V2)
+    {
+        return encode_pdu_v2_head(pdu, head);
+    }
+
+    return encode_pdu_head(pdu, head);
+}
+
+
+/**
+ * Converts a PDU to a string.
  * First the headers of the PDU will be written, then an empty line and at last the content.
  * (See specification of the dchat protocol)
- * @param fd  File descriptor where the dchat PDU will be written to
- * @param pdu Pointer to a PDU structure holding the header and content data
- * @return Amount of bytes of content that that have been written. This should be equal
- *         to the value defined in the attribute "content_length" of the given PDU structure
- *         or -1 in case of error
+ * @param pdu     Pointer to a PDU structure holding the header and content data
+ * @param pdu_str Pointer to which the terminated string will be stored, has to be freed
+ * @return Length of the string or -1 in case of error
+ */
+int
+encode_pdu(dchat_pdu_t* pdu, char** pdu_str)
+{
+    char* pdu_raw;                   //Final PDU
+    int pdulen;                      //Total length of PDU
+
+    if ((pdulen = encode_pdu_head(pdu, &pdu_raw)) == -1)
+    {
+        return -1;
+    }
+
+    // (re)allocate memory for content
+    if ((pdu_raw = realloc(pdu_raw, pdulen + pdu->content_length + 1)) == NULL)
+    {
+        ui_fatal("Reallocation of pdu failed!");
+    }
+
+    // add content, which may be binary
+    if (pdu->content_length)
+    {
+        memcpy(pdu_raw + pdulen, pdu->content, pdu->content_length);
+    }
+
+    pdulen += pdu->content_length;
+    pdu_raw[pdulen] = '\0';
+    *pdu_str = pdu_raw;
+    // exclude \0
+    return pdulen;
+}
+
+
+/**
+ * Converts the headers of a PDU to a string.
+ * The headers are terminated by the empty line, so that the content can
+ * be written right after the string (see: send_pdu_file()).
+ * @param pdu      Pointer to a PDU structure holding the header data
+ * @param head_str Pointer to which the terminated string will be stored, has to be freed
+ * @return Length of the string or -1 in case of error
  */
 int
-write_pdu(int fd, dchat_pdu_t* pdu)
+encode_pdu_head(dchat_pdu_t* pdu, char** head_str)
 {
     dchat_v1_t proto;                //Available DChat headers
     char* header;                    //DChat header
@@ -449,8 +921,8 @@ write_pdu(int fd, dchat_pdu_t* pdu)
         }
     }
 
-    // (re)allocate memory for empty line and content
-    pdulen += pdu->content_length + 1;
+    // (re)allocate memory for empty line
+    pdulen += 1;
     pdu_raw = realloc(pdu_raw, pdulen);
 
     if (pdu_raw == NULL)
@@ -460,43 +932,160 @@ write_pdu(int fd, dchat_pdu_t* pdu)
 
     // add empty line
     strcat(pdu_raw, "\n");
-    // add content
-    strncat(pdu_raw, pdu->content, pdu->content_length);
+    *head_str = pdu_raw;
     // exclude \0
-    pdulen--;
-    //write pdu to file descriptor
-    ret = write(fd, pdu_raw, strlen(pdu_raw));
-    free(pdu_raw);
-    return pdulen;
+    return pdulen - 1;
 }
 
 
 /**
- * Parses the given value to a supported version of DChat
- * and sets, if valid, its value in the PDU structure.
- * @param value String to parse
- * @param pdu Pointer to PDU structure
- * @return 0 if value is a valid version, -1 otherwise
+ * Encodes a PDU as binary frame (DChat/2, see: decode_pdu_v2()).
+ * Onion-id, listening port, nickname and server are constant for a session
+ * and left out. The message id is reduced to its sequence number, if it has
+ * been created by the author.
+ * @param pdu   Pointer to a PDU structure holding the header and content data
+ * @param frame Pointer to which the frame will be stored, has to be freed
+ * @return Length of the frame or -1 in case of error
  */
 int
-ver_str_to_pdu(char* value, dchat_pdu_t* pdu)
+encode_pdu_v2(dchat_pdu_t* pdu, char** frame)
 {
-    char* version = "1.0";
+    int len; // length of frame without content
 
-    if (!strcmp(value, version))
+    if ((len = encode_pdu_v2_head(pdu, frame)) == -1)
     {
-        pdu->version = DCHAT_V1;
-        return 0;
+        return -1;
     }
 
-    return -1;
+    if ((*frame = realloc(*frame, len + pdu->content_length)) == NULL)
+    {
+        ui_fatal("Reallocation of binary PDU failed!");
+    }
+
+    if (pdu->content_length)
+    {
+        memcpy(*frame + len, pdu->content, pdu->content_length);
+    }
+
+    return len + pdu->content_length;
 }
 
 
 /**
- * Parses the given value to a supported content-type of DChat
- * and sets, if valid, its value in the PDU structure..
- * @param value String to parse
+ * Encodes a binary frame (DChat/2) up to its content, so that the
+ * content can be written right after it (see: send_pdu_file()).
+ * @param pdu   Pointer to a PDU structure holding the header data
+ * @param frame Pointer to which the frame will be stored, has to be freed
+ * @return Length of the frame without content or -1 in case of error
+ */
+int
+encode_pdu_v2_head(dchat_pdu_t* pdu, char** frame)
+{
+    unsigned char hdr[V2_MAX_HDR];         // fields ahead of the content
+    unsigned char prefix[MAX_VARINT_LEN];  // length of body
+    int hlen = 2;   // length of fields
+    int plen;       // length of prefix
+    uint64_t seq;   // sequence number of message id
+    char* author = pdu->onion_id;  // onion-id of the author
+    uint16_t aport = pdu->lport;   // listening port of the author
+
+    if (!is_valid_content_type(pdu->content_type) ||
+        !is_valid_content_length(pdu->content_type, pdu->content_length))
+    {
+        return -1;
+    }
+
+    hdr[0] = pdu->content_type;
+    hdr[1] = 0;
+
+    if (pdu->origin_id[0] != '\0')
+    {
+        hdr[1] |= V2_FLG_ORG;
+        hlen += put_varint(pdu->hop_limit, hdr + hlen);
+        hlen += put_v2_string(pdu->origin_id, ONION_ADDRLEN, hdr + hlen);
+        hlen += put_varint(pdu->origin_lport, hdr + hlen);
+        hlen += put_v2_string(pdu->origin_name, MAX_NICKNAME, hdr + hlen);
+        hlen += put_varint((uint64_t) timegm(&pdu->sent), hdr + hlen);
+        author = pdu->origin_id;
+        aport = pdu->origin_lport;
+    }
+
+    if (pdu->msg_id[0] != '\0')
+    {
+        if (get_msg_seq(pdu, author, aport, &seq) == 0)
+        {
+            hdr[1] |= V2_FLG_MSEQ;
+            hlen += put_varint(seq, hdr + hlen);
+        }
+        else
+        {
+            hdr[1] |= V2_FLG_MID;
+            hlen += put_v2_string(pdu->msg_id, MAX_MSGID_LEN, hdr + hlen);
+        }
+    }
+
+    if (pdu->frag_total)
+    {
+        hdr[1] |= V2_FLG_FRG;
+        hlen += put_varint(pdu->frag_id, hdr + hlen);
+        hlen += put_varint(pdu->frag_offset, hdr + hlen);
+        hlen += put_varint(pdu->frag_total, hdr + hlen);
+    }
+
+    if (pdu->has_crc)
+    {
+        hdr[1] |= V2_FLG_CRC;
+        hdr[hlen++] = pdu->crc >> 24;
+        hdr[hlen++] = pdu->crc >> 16;
+        hdr[hlen++] = pdu->crc >> 8;
+        hdr[hlen++] = pdu->crc;
+    }
+
+    if (pdu->encoding)
+    {
+        hdr[1] |= V2_FLG_DEF;
+    }
+
+    plen = put_varint(hlen + pdu->content_length, prefix);
+
+    if ((*frame = malloc(1 + plen + hlen)) == NULL)
+    {
+        ui_fatal("Memory allocation for binary PDU failed!");
+    }
+
+    (*frame)[0] = (char) V2_MAGIC;
+    memcpy(*frame + 1, prefix, plen);
+    memcpy(*frame + 1 + plen, hdr, hlen);
+    return 1 + plen + hlen;
+}
+
+
+/**
+ * Parses the given value to a supported version of DChat
+ * and sets, if valid, its value in the PDU structure.
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid version, -1 otherwise
+ */
+int
+ver_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    char* version = "1.0";
+
+    if (!strcmp(value, version))
+    {
+        pdu->version = DCHAT_V1;
+        return 0;
+    }
+
+    return -1;
+}
+
+
+/**
+ * Parses the given value to a supported content-type of DChat
+ * and sets, if valid, its value in the PDU structure..
+ * @param value String to parse
  * @param pdu Pointer to PDU structure
  * @return 0 if value is a valid content-type, -1 otherwise
  */
@@ -540,8 +1129,9 @@ ctl_str_to_pdu(char* value, dchat_pdu_t* pdu)
     // convert string to int
     length = (int) strtol(value, &ptr, 10);
 
-    // check if its a valid content-length
-    if (ptr[0] != '\0' || !is_valid_content_length(length))
+    // check if its a valid content-length, the content-type may follow,
+    // so the limit of its type is checked by read_pdu()
+    if (ptr[0] != '\0' || !is_valid_content_length(CTT_ID_BIN, length))
     {
         return -1;
     }
@@ -620,97 +1210,627 @@ nic_str_to_pdu(char* value, dchat_pdu_t* pdu)
     int len = strlen(value);
     pdu->nickname[0] = '\0';
 
-    if (len > MAX_NICKNAME)
+    if (len > MAX_NICKNAME)
+    {
+        len = MAX_NICKNAME;
+    }
+
+    // copy whole nickname
+    strncat(pdu->nickname, value, len);
+    return 0;
+}
+
+
+/**
+ * Parses the given value to a struct tm and sets its value,
+ * if valid, in the given PDU structure
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid datetime string, -1 otherwise
+ */
+int
+dat_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    if (strptime(value, "%a, %d %b %Y %H:%M:%S GMT",
+                 &pdu->sent) == NULL)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parses the given value to a server field and sets its value,
+ * if valid, in the given PDU structure.
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid server string, -1 otherwise
+ */
+int
+srv_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    if ((pdu->server = malloc(strlen(value) + 1)) == NULL)
+    {
+        ui_fatal("Memory allocation for server failed!");
+    }
+
+    pdu->server[0] = '\0';
+    strcat(pdu->server, value);
+    return 0;
+}
+
+
+/**
+ * Parses the given value to a hop limit and sets its value,
+ * if valid, in the given PDU structure.
+ * The hop limit specifies how many times a forwarded PDU may
+ * still be forwarded and lies between 1 and MAX_HOP_LIMIT.
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid hop limit, -1 otherwise
+ */
+int
+hop_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    int hop_limit;
+    char* ptr;
+    // convert string to int
+    hop_limit = (int) strtol(value, &ptr, 10);
+
+    if (ptr[0] != '\0' || hop_limit < 1 || hop_limit > MAX_HOP_LIMIT)
+    {
+        return -1;
+    }
+
+    pdu->hop_limit = hop_limit;
+    return 0;
+}
+
+
+/**
+ * Parses the given value to the origin of a forwarded PDU and sets
+ * its value, if valid, in the given PDU structure.
+ * The origin identifies the author of a PDU and has the form
+ * "<onion-id> <port> <nickname>", whereas the nickname is optional.
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid origin, -1 otherwise
+ */
+int
+org_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    char* onion_id; // onion address of author
+    char* port;     // listening port of author
+    char* save_ptr; // rest of value (nickname)
+    char* ptr;
+    int lport;
+
+    if ((onion_id = strtok_r(value, " ", &save_ptr)) == NULL ||
+        (port = strtok_r(NULL, " ", &save_ptr)) == NULL)
+    {
+        return -1;
+    }
+
+    if (strlen(onion_id) != ONION_ADDRLEN || !is_valid_onion(onion_id))
+    {
+        return -1;
+    }
+
+    lport = (int) strtol(port, &ptr, 10);
+
+    if (ptr[0] != '\0' || !is_valid_port(lport))
+    {
+        return -1;
+    }
+
+    pdu->origin_id[0] = '\0';
+    strncat(pdu->origin_id, onion_id, ONION_ADDRLEN);
+    pdu->origin_lport = lport;
+    pdu->origin_name[0] = '\0';
+    strncat(pdu->origin_name, save_ptr, MAX_NICKNAME);
+    return 0;
+}
+
+
+/**
+ * Parses the given value to a message id and sets its value,
+ * if valid, in the given PDU structure.
+ * A message id has the form "<onion-id> <port> <sequence number>",
+ * whereas onion-id and port identify the author of the message.
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid message id, -1 otherwise
+ */
+int
+mid_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    char* onion_id; // onion address of author
+    char* port;     // listening port of author
+    char* seq;      // sequence number
+    char* save_ptr;
+    char* ptr;
+    int lport;
+
+    if ((onion_id = strtok_r(value, " ", &save_ptr)) == NULL ||
+        (port = strtok_r(NULL, " ", &save_ptr)) == NULL ||
+        (seq = strtok_r(NULL, " ", &save_ptr)) == NULL)
+    {
+        return -1;
+    }
+
+    if (strlen(onion_id) != ONION_ADDRLEN || !is_valid_onion(onion_id))
+    {
+        return -1;
+    }
+
+    lport = (int) strtol(port, &ptr, 10);
+
+    if (ptr[0] != '\0' || !is_valid_port(lport))
+    {
+        return -1;
+    }
+
+    // sequence number must fit into 64 bits
+    errno = 0;
+    strtoull(seq, &ptr, 10);
+
+    if (ptr == seq || ptr[0] != '\0' || errno == ERANGE)
+    {
+        return -1;
+    }
+
+    snprintf(pdu->msg_id, sizeof(pdu->msg_id), "%s %d %s", onion_id, lport, seq);
+    return 0;
+}
+
+
+/**
+ * Parses the given value to a content encoding and sets, if valid,
+ * its value in the given PDU structure. The only encoding is
+ * ZC_ENCODING (see: zc_inflate()).
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid content encoding, -1 otherwise
+ */
+int
+cen_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    if (strcmp(value, ZC_ENCODING))
+    {
+        return -1;
+    }
+
+    pdu->encoding = 1;
+    return 0;
+}
+
+
+/**
+ * Parses the given value to the id of a fragmented message and sets,
+ * if valid, its value in the given PDU structure (see: fg_send()).
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid fragment id, -1 otherwise
+ */
+int
+fid_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    unsigned long id;
+    char* ptr;
+
+    errno = 0;
+    id = strtoul(value, &ptr, 10);
+
+    if (ptr == value || ptr[0] != '\0' || errno == ERANGE || id > UINT32_MAX)
+    {
+        return -1;
+    }
+
+    pdu->frag_id = id;
+    return 0;
+}
+
+
+/**
+ * Parses the given value to the offset of a fragment and sets, if valid,
+ * its value in the given PDU structure. The offset lies within the max.
+ * length of a fragmented message.
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid fragment offset, -1 otherwise
+ */
+int
+fof_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    long offset;
+    char* ptr;
+
+    offset = strtol(value, &ptr, 10);
+
+    if (ptr == value || ptr[0] != '\0' || offset < 0 || offset >= FG_MAX_MESSAGE)
+    {
+        return -1;
+    }
+
+    pdu->frag_offset = offset;
+    return 0;
+}
+
+
+/**
+ * Parses the given value to the length of a fragmented message and sets,
+ * if valid, its value in the given PDU structure. The length lies between
+ * 1 and FG_MAX_MESSAGE.
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid length, -1 otherwise
+ */
+int
+fto_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    long total;
+    char* ptr;
+
+    total = strtol(value, &ptr, 10);
+
+    if (ptr == value || ptr[0] != '\0' || total < 1 || total > FG_MAX_MESSAGE)
+    {
+        return -1;
+    }
+
+    pdu->frag_total = total;
+    return 0;
+}
+
+
+/**
+ * Parses the given value to the CRC-32C of the content (8 hex digits) and
+ * sets, if valid, its value in the given PDU structure.
+ * @param value String to parse
+ * @param pdu Pointer to PDU structure
+ * @return 0 if value is a valid checksum, -1 otherwise
+ */
+int
+crc_str_to_pdu(char* value, dchat_pdu_t* pdu)
+{
+    unsigned long crc;
+    char* ptr;
+
+    errno = 0;
+    crc = strtoul(value, &ptr, 16);
+
+    if (ptr == value || ptr[0] != '\0' || errno == ERANGE || crc > UINT32_MAX)
+    {
+        return -1;
+    }
+
+    pdu->crc = crc;
+    pdu->has_crc = 1;
+    return 0;
+}
+
+
+/**
+ * Converts the version field in the PDU to a string and sets the address of the given
+ * value parameter to this string.
+ * @param pdu Pointer to PDU structure
+ * @param value Double pointer to string
+ * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
+ * -1 in case of error (e.g. illegal value in pdu structure , ...)
+ */
+int
+ver_pdu_to_str(dchat_pdu_t* pdu, char** value)
+{
+    char* version = "1.0";
+
+    // nothing has been set
+    if (pdu->version == 0)
+    {
+        return 1;
+    }
+
+    // if version is V1
+    if (pdu->version == DCHAT_V1)
+    {
+        *value = malloc(strlen(version) + 1);
+
+        if (*value == NULL)
+        {
+            ui_fatal("Memory allocation for version failed!");
+        }
+
+        *value[0] = '\0';
+        strcat(*value, version);
+        return 0;
+    }
+
+    return -1;
+}
+
+
+/**
+ * Converts the content-type field in the PDU to a string and sets the
+ * address of the given value parameter to this string.
+ * @param pdu Pointer to PDU structure
+ * @param value Double pointer to string
+ * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
+ * -1 in case of error (e.g. illegal value in pdu structure , ...)
+ */
+int
+ctt_pdu_to_str(dchat_pdu_t* pdu, char** value)
+{
+    dchat_content_types_t content_types;
+    char* type;
+
+    // content type has not been set
+    if (pdu->content_type == 0)
+    {
+        return 1;
+    }
+
+    // init available content types
+    if (init_dchat_content_types(&content_types) == -1)
+    {
+        return -1;
+    }
+
+    // iterate through content-types and build a content type string
+    for (int i = 0; i < CTT_AMOUNT; i++)
+    {
+        if (content_types.type[i].ctt_id == pdu->content_type)
+        {
+            type = content_types.type[i].ctt_name;
+            *value = malloc(strlen(type) + 1);
+
+            if (*value == NULL)
+            {
+                ui_fatal("Memory allocation for content-type failed!");
+            }
+
+            *value[0] = '\0';
+            strncat(*value, type, strlen(type));
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ * Converts the content-length field in the PDU to a string and sets the
+ * address of the given value parameter to this string.
+ * @param pdu Pointer to PDU structure
+ * @param value Double pointer to string
+ * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
+ * -1 in case of error (e.g. illegal value in pdu structure , ...)
+ */
+int
+ctl_pdu_to_str(dchat_pdu_t* pdu, char** value)
+{
+    // check if content-length is valid
+    if (!is_valid_content_length(pdu->content_type, pdu->content_length))
+    {
+        return -1;
+    }
+
+    *value = malloc(MAX_INT_STR + 1);
+
+    if (*value == NULL)
+    {
+        ui_fatal("Memory allocation for content-length failed!");
+    }
+
+    snprintf(*value, MAX_INT_STR, "%d", pdu->content_length);
+    return 0;
+}
+
+
+/**
+ * Converts the onion-id field in the PDU to a string and sets the
+ * address of the given value parameter to this string.
+ * @param pdu Pointer to PDU structure
+ * @param value Double pointer to string
+ * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
+ * -1 in case of error (e.g. illegal value in pdu structure , ...)
+ */
+int
+oni_pdu_to_str(dchat_pdu_t* pdu, char** value)
+{
+    // no onion-id has been set
+    if (pdu->onion_id[0] == '\0')
+    {
+        return 1;
+    }
+
+    // check if set onion id is valid
+    if (!is_valid_onion(pdu->onion_id))
+    {
+        return -1;
+    }
+
+    //copy onion id
+    *value = malloc(strlen(pdu->onion_id) + 1);
+
+    if (*value == NULL)
+    {
+        ui_fatal("Memory allocation for onion-id failed!");
+    }
+
+    *value[0] = '\0';
+    strcat(*value, pdu->onion_id);
+    return 0;
+}
+
+
+/**
+ * Converts the listening-port field in the PDU to a string and sets the
+ * address of the given value parameter to this string.
+ * @param pdu Pointer to PDU structure
+ * @param value Double pointer to string
+ * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
+ * -1 in case of error (e.g. illegal value in pdu structure , ...)
+ */
+int
+lnp_pdu_to_str(dchat_pdu_t* pdu, char** value)
+{
+    // listening port has not been specified
+    if (pdu->lport == 0)
+    {
+        return 1;
+    }
+
+    // check if listening port is valid
+    if (!is_valid_port(pdu->lport))
+    {
+        return -1;
+    }
+
+    *value = malloc(MAX_INT_STR + 1);
+
+    if (*value == NULL)
+    {
+        ui_fatal("Memory allocation for listening-port failed!");
+    }
+
+    snprintf(*value, MAX_INT_STR, "%d", pdu->lport);
+    return 0;
+}
+
+
+/**
+ * Converts the nickname field in the PDU to a string and sets the
+ * address of the given value parameter to this string.
+ * @param pdu Pointer to PDU structure
+ * @param value Double pointer to string
+ * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
+ * -1 in case of error (e.g. illegal value in pdu structure , ...)
+ */
+int
+nic_pdu_to_str(dchat_pdu_t* pdu, char** value)
+{
+    if (pdu->nickname[0] == '\0')
+    {
+        return 1;
+    }
+
+    if (!is_valid_nickname(pdu->nickname))
+    {
+        return -1;
+    }
+
+    //copy nickname
+    *value = malloc(strlen(pdu->nickname) + 1);
+
+    if (*value == NULL)
     {
-        len = MAX_NICKNAME;
+        ui_fatal("Memory allocation for nickname failed!");
     }
 
-    // copy whole nickname
-    strncat(pdu->nickname, value, len);
+    *value[0] = '\0';
+    strcat(*value, pdu->nickname);
     return 0;
 }
 
 
 /**
- * Parses the given value to a struct tm and sets its value,
- * if valid, in the given PDU structure
- * @param value String to parse
+ * Converts the sent field in the PDU to a string and sets the
+ * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
- * @return 0 if value is a valid datetime string, -1 otherwise
+ * @param value Double pointer to string
+ * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
+ * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-dat_str_to_pdu(char* value, dchat_pdu_t* pdu)
+dat_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    if (strptime(value, "%a, %d %b %Y %H:%M:%S GMT",
-                 &pdu->sent) == NULL)
+    int max_len = 100;
+
+    // check if date field is empty
+    if (iszero(&pdu->sent, sizeof(pdu->sent)))
     {
-        return -1;
+        return 1;
+    }
+
+    *value = malloc(max_len);
+
+    if (*value == NULL)
+    {
+        ui_fatal("Memory allocation for date failed!");
     }
 
+    *value[0] = '\0';
+    strftime(*value, max_len, "%a, %d %b %Y %H:%M:%S GMT", &pdu->sent);
     return 0;
 }
 
+
 /**
- * Parses the given value to a server field and sets its value,
- * if valid, in the given PDU structure.
- * @param value String to parse
+ * Converts the server field in the PDU to a string and sets the
+ * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
- * @return 0 if value is a valid server string, -1 otherwise
+ * @param value Double pointer to string
+ * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
+ * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-srv_str_to_pdu(char* value, dchat_pdu_t* pdu)
+srv_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    if ((pdu->server = malloc(strlen(value) + 1)) == NULL)
+    if (pdu->server == NULL)
     {
-        ui_fatal("Memory allocation for server failed!");
+        return 1;
     }
 
-    pdu->server[0] = '\0';
-    strcat(pdu->server, value);
+    *value = malloc(strlen(pdu->server) + 1);
+
+    if (*value == NULL)
+    {
+        ui_fatal("Memory allocation for date failed!");
+    }
+
+    *value[0] = '\0';
+    strcat(*value, pdu->server);
     return 0;
 }
 
 
 /**
- * Converts the version field in the PDU to a string and sets the address of the given
- * value parameter to this string.
+ * Converts the hop limit field in the PDU to a string and sets the
+ * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
  * @param value Double pointer to string
  * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
  * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-ver_pdu_to_str(dchat_pdu_t* pdu, char** value)
+hop_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    char* version = "1.0";
-
-    // nothing has been set
-    if (pdu->version == 0)
+    // pdu will not be forwarded
+    if (pdu->hop_limit == 0)
     {
         return 1;
     }
 
-    // if version is V1
-    if (pdu->version == DCHAT_V1)
+    if (pdu->hop_limit < 0 || pdu->hop_limit > MAX_HOP_LIMIT)
     {
-        *value = malloc(strlen(version) + 1);
+        return -1;
+    }
 
-        if (*value == NULL)
-        {
-            ui_fatal("Memory allocation for version failed!");
-        }
+    *value = malloc(MAX_INT_STR + 1);
 
-        *value[0] = '\0';
-        strcat(*value, version);
-        return 0;
+    if (*value == NULL)
+    {
+        ui_fatal("Memory allocation for hop limit failed!");
     }
 
-    return -1;
+    snprintf(*value, MAX_INT_STR, "%d", pdu->hop_limit);
+    return 0;
 }
 
 
 /**
- * Converts the content-type field in the PDU to a string and sets the
+ * Converts the origin fields in the PDU to a string and sets the
  * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
  * @param value Double pointer to string
@@ -718,48 +1838,37 @@ ver_pdu_to_str(dchat_pdu_t* pdu, char** value)
  * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-ctt_pdu_to_str(dchat_pdu_t* pdu, char** value)
+org_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    dchat_content_types_t content_types;
-    char* type;
+    int len;
 
-    // content type has not been set
-    if (pdu->content_type == 0)
+    // pdu has not been forwarded
+    if (pdu->origin_id[0] == '\0')
     {
         return 1;
     }
 
-    // init available content types
-    if (init_dchat_content_types(&content_types) == -1)
+    if (!is_valid_onion(pdu->origin_id) || !is_valid_port(pdu->origin_lport))
     {
         return -1;
     }
 
-    // iterate through content-types and build a content type string
-    for (int i = 0; i < CTT_AMOUNT; i++)
-    {
-        if (content_types.type[i].ctt_id == pdu->content_type)
-        {
-            type = content_types.type[i].ctt_name;
-            *value = malloc(strlen(type) + 1);
-
-            if (*value == NULL)
-            {
-                ui_fatal("Memory allocation for content-type failed!");
-            }
+    // onion-id, port, nickname, two " " and \0
+    len = strlen(pdu->origin_id) + MAX_INT_STR + strlen(pdu->origin_name) + 3;
 
-            *value[0] = '\0';
-            strncat(*value, type, strlen(type));
-            return 0;
-        }
+    if ((*value = malloc(len)) == NULL)
+    {
+        ui_fatal("Memory allocation for origin failed!");
     }
 
-    return -1;
+    snprintf(*value, len, "%s %hu %s", pdu->origin_id, pdu->origin_lport,
+             pdu->origin_name);
+    return 0;
 }
 
 
 /**
- * Converts the content-length field in the PDU to a string and sets the
+ * Converts the message id field in the PDU to a string and sets the
  * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
  * @param value Double pointer to string
@@ -767,28 +1876,28 @@ ctt_pdu_to_str(dchat_pdu_t* pdu, char** value)
  * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-ctl_pdu_to_str(dchat_pdu_t* pdu, char** value)
+mid_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    // check if content-length is valid
-    if (!is_valid_content_length(pdu->content_length))
+    if (pdu->msg_id[0] == '\0')
     {
-        return -1;
+        return 1;
     }
 
-    *value = malloc(MAX_INT_STR + 1);
+    *value = malloc(strlen(pdu->msg_id) + 1);
 
     if (*value == NULL)
     {
-        ui_fatal("Memory allocation for content-length failed!");
+        ui_fatal("Memory allocation for message id failed!");
     }
 
-    snprintf(*value, MAX_INT_STR, "%d", pdu->content_length);
+    *value[0] = '\0';
+    strcat(*value, pdu->msg_id);
     return 0;
 }
 
 
 /**
- * Converts the onion-id field in the PDU to a string and sets the
+ * Converts the content encoding field in the PDU to a string and sets the
  * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
  * @param value Double pointer to string
@@ -796,36 +1905,29 @@ ctl_pdu_to_str(dchat_pdu_t* pdu, char** value)
  * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-oni_pdu_to_str(dchat_pdu_t* pdu, char** value)
+cen_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    // no onion-id has been set
-    if (pdu->onion_id[0] == '\0')
+    // content is sent as is
+    if (!pdu->encoding)
     {
         return 1;
     }
 
-    // check if set onion id is valid
-    if (!is_valid_onion(pdu->onion_id))
-    {
-        return -1;
-    }
-
-    //copy onion id
-    *value = malloc(strlen(pdu->onion_id) + 1);
+    *value = malloc(strlen(ZC_ENCODING) + 1);
 
     if (*value == NULL)
     {
-        ui_fatal("Memory allocation for onion-id failed!");
+        ui_fatal("Memory allocation for content encoding failed!");
     }
 
     *value[0] = '\0';
-    strcat(*value, pdu->onion_id);
+    strcat(*value, ZC_ENCODING);
     return 0;
 }
 
 
 /**
- * Converts the listening-port field in the PDU to a string and sets the
+ * Converts the fragment id field in the PDU to a string and sets the
  * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
  * @param value Double pointer to string
@@ -833,34 +1935,28 @@ oni_pdu_to_str(dchat_pdu_t* pdu, char** value)
  * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-lnp_pdu_to_str(dchat_pdu_t* pdu, char** value)
+fid_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    // listening port has not been specified
-    if (pdu->lport == 0)
+    // pdu is no fragment
+    if (!pdu->frag_total)
     {
         return 1;
     }
 
-    // check if listening port is valid
-    if (!is_valid_port(pdu->lport))
-    {
-        return -1;
-    }
-
     *value = malloc(MAX_INT_STR + 1);
 
     if (*value == NULL)
     {
-        ui_fatal("Memory allocation for listening-port failed!");
+        ui_fatal("Memory allocation for fragment id failed!");
     }
 
-    snprintf(*value, MAX_INT_STR, "%d", pdu->lport);
+    snprintf(*value, MAX_INT_STR, "%u", pdu->frag_id);
     return 0;
 }
 
 
 /**
- * Converts the nickname field in the PDU to a string and sets the
+ * Converts the fragment offset field in the PDU to a string and sets the
  * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
  * @param value Double pointer to string
@@ -868,34 +1964,33 @@ lnp_pdu_to_str(dchat_pdu_t* pdu, char** value)
  * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-nic_pdu_to_str(dchat_pdu_t* pdu, char** value)
+fof_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    if (pdu->nickname[0] == '\0')
+    // pdu is no fragment
+    if (!pdu->frag_total)
     {
         return 1;
     }
 
-    if (!is_valid_nickname(pdu->nickname))
+    if (pdu->frag_offset < 0 || pdu->frag_offset >= pdu->frag_total)
     {
         return -1;
     }
 
-    //copy nickname
-    *value = malloc(strlen(pdu->nickname) + 1);
+    *value = malloc(MAX_INT_STR + 1);
 
     if (*value == NULL)
     {
-        ui_fatal("Memory allocation for nickname failed!");
+        ui_fatal("Memory allocation for fragment offset failed!");
     }
 
-    *value[0] = '\0';
-    strcat(*value, pdu->nickname);
+    snprintf(*value, MAX_INT_STR, "%d", pdu->frag_offset);
     return 0;
 }
 
 
 /**
- * Converts the sent field in the PDU to a string and sets the
+ * Converts the fragment total field in the PDU to a string and sets the
  * address of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
  * @param value Double pointer to string
@@ -903,54 +1998,56 @@ nic_pdu_to_str(dchat_pdu_t* pdu, char** value)
  * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-dat_pdu_to_str(dchat_pdu_t* pdu, char** value)
+fto_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    int max_len = 100;
-
-    // check if date field is empty
-    if (iszero(&pdu->sent, sizeof(pdu->sent)))
+    // pdu is no fragment
+    if (!pdu->frag_total)
     {
         return 1;
     }
 
-    *value = malloc(max_len);
+    if (pdu->frag_total < 0 || pdu->frag_total > FG_MAX_MESSAGE)
+    {
+        return -1;
+    }
+
+    *value = malloc(MAX_INT_STR + 1);
 
     if (*value == NULL)
     {
-        ui_fatal("Memory allocation for date failed!");
+        ui_fatal("Memory allocation for fragment total failed!");
     }
 
-    *value[0] = '\0';
-    strftime(*value, max_len, "%a, %d %b %Y %H:%M:%S GMT", &pdu->sent);
+    snprintf(*value, MAX_INT_STR, "%d", pdu->frag_total);
     return 0;
 }
 
 
 /**
- * Converts the server field in the PDU to a string and sets the
- * address of the given value parameter to this string.
+ * Converts the CRC-32C field in the PDU to a string and sets the address
+ * of the given value parameter to this string.
  * @param pdu Pointer to PDU structure
  * @param value Double pointer to string
  * @return 1 field was not set in pdu structure, 0 on success (string must be freed),
  * -1 in case of error (e.g. illegal value in pdu structure , ...)
  */
 int
-srv_pdu_to_str(dchat_pdu_t* pdu, char** value)
+crc_pdu_to_str(dchat_pdu_t* pdu, char** value)
 {
-    if (pdu->server == NULL)
+    // content is sent without checksum
+    if (!pdu->has_crc)
     {
         return 1;
     }
 
-    *value = malloc(strlen(pdu->server) + 1);
+    *value = malloc(CK_STR_LEN + 1);
 
     if (*value == NULL)
     {
-        ui_fatal("Memory allocation for date failed!");
+        ui_fatal("Memory allocation for checksum failed!");
     }
 
-    *value[0] = '\0';
-    strcat(*value, pdu->server);
+    snprintf(*value, CK_STR_LEN + 1, "%08x", pdu->crc);
     return 0;
 }
 
@@ -976,6 +2073,8 @@ init_dchat_content_types(dchat_content_types_t* ctt)
         CONTENT_TYPE(CTT_ID_BIN, CTT_NAME_BIN),
         CONTENT_TYPE(CTT_ID_DSC, CTT_NAME_DSC),
         CONTENT_TYPE(CTT_ID_RPY, CTT_NAME_RPY),
+        CONTENT_TYPE(CTT_ID_DGS, CTT_NAME_DGS),
+        CONTENT_TYPE(CTT_ID_HLO, CTT_NAME_HLO)
     };
     temp_size = sizeof(temp) / sizeof(temp[0]);
 
@@ -1014,7 +2113,15 @@ init_dchat_v1(dchat_v1_t* proto)
         HEADER(HDR_ID_LNP, HDR_NAME_LNP, 1, lnp_str_to_pdu, lnp_pdu_to_str),
         HEADER(HDR_ID_NIC, HDR_NAME_NIC, 0, nic_str_to_pdu, nic_pdu_to_str),
         HEADER(HDR_ID_DAT, HDR_NAME_DAT, 0, dat_str_to_pdu, dat_pdu_to_str),
-        HEADER(HDR_ID_SRV, HDR_NAME_SRV, 0, srv_str_to_pdu, srv_pdu_to_str)
+        HEADER(HDR_ID_SRV, HDR_NAME_SRV, 0, srv_str_to_pdu, srv_pdu_to_str),
+        HEADER(HDR_ID_HOP, HDR_NAME_HOP, 0, hop_str_to_pdu, hop_pdu_to_str),
+        HEADER(HDR_ID_ORG, HDR_NAME_ORG, 0, org_str_to_pdu, org_pdu_to_str),
+        HEADER(HDR_ID_MID, HDR_NAME_MID, 0, mid_str_to_pdu, mid_pdu_to_str),
+        HEADER(HDR_ID_CEN, HDR_NAME_CEN, 0, cen_str_to_pdu, cen_pdu_to_str),
+        HEADER(HDR_ID_FID, HDR_NAME_FID, 0, fid_str_to_pdu, fid_pdu_to_str),
+        HEADER(HDR_ID_FOF, HDR_NAME_FOF, 0, fof_str_to_pdu, fof_pdu_to_str),
+        HEADER(HDR_ID_FTO, HDR_NAME_FTO, 0, fto_str_to_pdu, fto_pdu_to_str),
+        HEADER(HDR_ID_CRC, HDR_NAME_CRC, 0, crc_str_to_pdu, crc_pdu_to_str)
     };
     temp_size = sizeof(temp) / sizeof(temp[0]);
 
@@ -1127,6 +2234,21 @@ init_dchat_pdu_content(dchat_pdu_t* pdu, char* content, int len)
 }
 
 
+/**
+ * Initializes the message id of a DChat PDU.
+ * The message id consists of the onion-id and listening port of the PDU,
+ * which identify its author, and the given sequence number.
+ * @param pdu Pointer to PDU whose message id will be initialized
+ * @param seq Sequence number of the message
+ */
+void
+init_dchat_pdu_msg_id(dchat_pdu_t* pdu, uint64_t seq)
+{
+    snprintf(pdu->msg_id, sizeof(pdu->msg_id), "%s %hu %llu", pdu->onion_id,
+             pdu->lport, (unsigned long long) seq);
+}
+
+
 /**
  * Checks if the given version is a valid and supported DChat version.
  * @return 1 if valid, 0 otherwise
@@ -1184,9 +2306,19 @@ is_valid_termination(char* value)
 int
 is_valid_content_type(int content_type)
 {
-    if (content_type & CTT_MASK_ALL)
+    dchat_content_types_t ctt;
+
+    if (init_dchat_content_types(&ctt) == -1)
     {
-        return 1;
+        return 0;
+    }
+
+    for (int i = 0; i < CTT_AMOUNT; i++)
+    {
+        if (ctt.type[i].ctt_id && ctt.type[i].ctt_id == content_type)
+        {
+            return 1;
+        }
     }
 
     return 0;
@@ -1194,14 +2326,18 @@ is_valid_content_type(int content_type)
 
 
 /**
- * Checks if the given Content-Length is a valid DChat Content-Length.
- * Content-Length must be between 0 and MAX_CONTENT_LEN.
+ * Checks if the given content-length is valid for the given content-type.
+ * Content-Length must be between 0 and MAX_CONTENT_LEN, PDUs of type
+ * "application/octet" carry chunks of files and may be up to
+ * MAX_OCTET_LEN bytes long.
+ * @param content_type Content-type of the PDU
+ * @param ctl          Content-length to check
  * @return 1 if valid, 0 otherwise.
  */
 int
-is_valid_content_length(int ctl)
+is_valid_content_length(int content_type, int ctl)
 {
-    if (ctl >= 0 && ctl <= MAX_CONTENT_LEN)
+    if (ctl >= 0 && ctl <= (content_type == CTT_ID_BIN ? MAX_OCTET_LEN : MAX_CONTENT_LEN))
     {
         return 1;
     }
@@ -1308,3 +2444,107 @@ get_content_part(dchat_pdu_t* pdu, int offset, char term, char** content)
     (*content)[line_end + 1] = '\0';
     return line_end;
 }
+
+
+/**
+ *  Writes a string prefixed by its length (1 byte) to a binary frame.
+ *  @param str String to write
+ *  @param max Max. length of string
+ *  @param buf Buffer of at least max + 1 bytes
+ *  @return amount of bytes written
+ */
+int
+put_v2_string(char* str, int max, unsigned char* buf)
+{
+    int len = strnlen(str, max);
+
+    buf[0] = len;
+    memcpy(buf + 1, str, len);
+    return len + 1;
+}
+
+
+/**
+ *  Reads a string prefixed by its length (1 byte) from a binary frame.
+ *  @param buf Buffer to read from
+ *  @param len Amount of bytes available in buf
+ *  @param str Buffer of at least max + 1 bytes, will be terminated
+ *  @param max Max. length of string
+ *  @return amount of bytes read or -1 if the string is illegal
+ */
+int
+get_v2_string(unsigned char* buf, int len, char* str, int max)
+{
+    if (len < 1 || buf[0] > max || buf[0] + 1 > len || memchr(buf + 1, '\0', buf[0]))
+    {
+        return -1;
+    }
+
+    memcpy(str, buf + 1, buf[0]);
+    str[buf[0]] = '\0';
+    return buf[0] + 1;
+}
+
+
+/**
+ *  Extracts the sequence number of a message id, if the message id has
+ *  been created for the given author (see: init_dchat_pdu_msg_id()).
+ *  @param pdu      Pointer to PDU
+ *  @param onion_id Onion-id of the author
+ *  @param lport    Listening port of the author
+ *  @param seq      Pointer to which the sequence number will be stored
+ *  @return 0 on success, -1 if the message id has another form
+ */
+int
+get_msg_seq(dchat_pdu_t* pdu, char* onion_id, uint16_t lport, uint64_t* seq)
+{
+    char msg_id[MAX_MSGID_LEN + 1]; // message id rebuilt from its parts
+    unsigned long long val;
+    char* term;
+    char* num;
+
+    if ((num = strrchr(pdu->msg_id, ' ')) == NULL || !isdigit((unsigned char) num[1]))
+    {
+        return -1;
+    }
+
+    errno = 0;
+    val = strtoull(num + 1, &term, 10);
+
+    if (errno || *term != '\0')
+    {
+        return -1;
+    }
+
+    snprintf(msg_id, sizeof(msg_id), "%s %hu %llu", onion_id, lport, val);
+
+    if (strcmp(msg_id, pdu->msg_id))
+    {
+        return -1;
+    }
+
+    *seq = val;
+    return 0;
+}
+
+
+/**
+ * Compares the CRC-32C computed while the content of a PDU has been read
+ * with the one sent (see: read_pdu()).
+ * @param pdu Pointer to PDU carrying a checksum
+ * @param crc CRC-32C of the content read
+ * @return 0 if both match, -1 otherwise
+ */
+int
+verify_crc(dchat_pdu_t* pdu, uint32_t crc)
+{
+    if (crc != pdu->crc)
+    {
+        ui_log(LOG_ERR, "Content-CRC32C %08x of PDU does not match %08x!", pdu->crc, crc);
+        _cnf->ck.failed++;
+        return -1;
+    }
+
+    _cnf->ck.verified++;
+    return 0;
+}
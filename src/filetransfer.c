@@ -0,0 +1,1554 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file filetransfer.c
+ *  This file contains the transfer of files to contacts. A file is offered
+ *  with a manifest ("OFFER") and the receiver answers with the offset the
+ *  file is sent from ("ACCEPT"), which is the amount of bytes received in
+ *  an earlier, interrupted transfer. The file is then sent in chunks
+ *  ("DATA"), whose bytes are passed from the file to the socket by the
+ *  kernel. All PDUs are of type "application/octet" and start with a
+ *  control line. Files are only sent to contacts, whose hello offers
+ *  FT_OFFER, and only received if a download directory has been set.
+ *  The main loop sends chunks as long as the socket buffer of a contact
+ *  takes them, so that the connection is kept busy, but never a whole
+ *  file is buffered (see: ft_run()). The receiver acknowledges every
+ *  chunk written ("ACK"), which limits the chunks in flight to the amount
+ *  delivered within the round trip and the target latency of chat
+ *  messages (see: ft_window()). Chat messages written to a contact are
+ *  thereby never queued up behind more than that amount of chunks.
+ *  Contacts holding a chunk store (see: chunkstore.c) are sent the list of
+ *  the content-defined chunks of a file ahead of its manifest ("CHUNKS").
+ *  They copy the chunks they hold into the file and answer with a bitmap
+ *  of them ("HAVE") before the file is accepted. Both sides skip these
+ *  chunks, so that only the missing bytes of a file shared again or
+ *  changed slightly are sent. Every other chunk received is checked
+ *  against its hash and added to the store.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/sockios.h>
+
+#include "dchat_h/filetransfer.h"
+#include "dchat_h/types.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/contact.h"
+#include "dchat_h/consoleui.h"
+#include "dchat_h/util.h"
+
+
+/**
+ *  Ends all file transfers. Files not received completely are kept, so
+ *  that they can be resumed in a later session.
+ *  @param fl Pointer to file transfers
+ */
+void
+destroy_file_transfers(file_transfers_t* fl)
+{
+    while (fl->used)
+    {
+        ft_remove(fl, &fl->ft[0], 0);
+    }
+}
+
+
+/**
+ *  Offers a file to all contacts accepting files.
+ *  The id of the file is derived from its name, size and modification
+ *  time, so that the receiver recognizes a file it has received partially.
+ *  The contactlist has to be locked.
+ *  @param fl   Pointer to file transfers
+ *  @param path Path of file
+ *  @return amount of contacts the file has been offered to, -1 on error
+ */
+int
+ft_send(file_transfers_t* fl, char* path)
+{
+    file_transfer_t* t;
+    struct stat st;
+    char line[FT_MAX_LINE + 1]; // manifest
+    char* name;     // name of file without directory
+    uint32_t id;    // id of file
+    int fd;         // file to send
+    int sent = 0;   // amount of contacts the file has been offered to
+    cs_list_t* list = NULL; // chunks of file
+    contact_t* contact;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+    {
+        ui_log_errno(LOG_WARN, "Could not open '%s'!", path);
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        ui_log(LOG_WARN, "'%s' is not a regular file!", path);
+        close(fd);
+        return -1;
+    }
+
+    name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+
+    if (!is_valid_file_name(name))
+    {
+        ui_log(LOG_WARN, "The name of '%s' cannot be sent!", path);
+        close(fd);
+        return -1;
+    }
+
+    id = fnv_hash(FNV_OFFSET, name, strlen(name));
+    id = fnv_hash(id, &st.st_size, sizeof(st.st_size));
+    id = fnv_hash(id, &st.st_mtime, sizeof(st.st_mtime));
+
+    // the file is only chunked if a contact holds a chunk store
+    for (int i = 0; i < _cnf->cl.cl_size && list == NULL; i++)
+    {
+        contact = &_cnf->cl.contact[i];
+
+        if (contact->fd && contact->lport && contact->files && contact->chunks)
+        {
+            list = cs_chunk_file(fd, st.st_size);
+            break;
+        }
+    }
+
+    for (int i = 0; i < _cnf->cl.cl_size; i++)
+    {
+        contact = &_cnf->cl.contact[i];
+
+        if (!contact->fd || !contact->lport || !contact->files ||
+            ft_find(fl, i, id, FT_SEND) != NULL)
+        {
+            continue;
+        }
+
+        if ((t = ft_add(fl, i, id, FT_SEND)) == NULL)
+        {
+            ui_log(LOG_WARN, "Too many file transfers in progress!");
+            break;
+        }
+
+        // every transfer reads at its own offset (see: send_pdu_file())
+        if ((t->fd = dup(fd)) == -1)
+        {
+            ui_log_errno(LOG_ERR, "Could not duplicate file descriptor!");
+            ft_remove(fl, t, 0);
+            break;
+        }
+
+        strncat(t->name, name, FT_MAX_NAME);
+        t->size = st.st_size;
+
+        if (list != NULL && contact->chunks)
+        {
+            t->list = list;
+            list->refs++;
+
+            if ((t->held = calloc(list->count / 8 + 1, 1)) == NULL)
+            {
+                ui_fatal("Memory allocation for chunk bitmap failed!");
+            }
+
+            if (ft_send_chunks(i, t) == -1)
+            {
+                ft_remove(fl, t, 0);
+                continue;
+            }
+        }
+
+        snprintf(line, sizeof(line), FT_CMD_OFFER " %08x %lld %s\n", id,
+                 (long long) st.st_size, name);
+
+        if (ft_control(i, line, strlen(line)) == -1)
+        {
+            ft_remove(fl, t, 0);
+            continue;
+        }
+
+        sent++;
+    }
+
+    close(fd);
+    cs_release(list);
+
+    if (!sent)
+    {
+        ui_log(LOG_NOTICE, "No contact accepts files!");
+    }
+    else
+    {
+        ui_log(LOG_INFO, "Offered '%s' (%lld bytes) to %d contacts!", name,
+               (long long) st.st_size, sent);
+    }
+
+    return sent;
+}
+
+
+/**
+ *  Handles an "application/octet" PDU received from a contact.
+ *  The content starts with a control line (see: FT_CMD_*), the chunk of a
+ *  file follows the line of "DATA" PDUs. The contactlist has to be locked.
+ *  @param fl      Pointer to file transfers
+ *  @param n       Index of contact
+ *  @param content Content of PDU
+ *  @param len     Length of content
+ *  @return 0 on success, -1 on error
+ */
+int
+ft_receive(file_transfers_t* fl, int n, char* content, int len)
+{
+    file_transfer_t* t;
+    char line[FT_MAX_LINE + 1]; // control line
+    char* end;      // end of control line
+    unsigned int id;
+    long long val;  // size or offset
+    int first;      // first chunk of chunk list or bitmap
+    int count;      // amount of chunks
+    int pos = 0;    // position of file name in line
+
+    if ((end = memchr(content, '\n', len)) == NULL || end - content > FT_MAX_LINE)
+    {
+        ui_log(LOG_WARN, "Illegal file transfer PDU received!");
+        return -1;
+    }
+
+    memcpy(line, content, end - content);
+    line[end - content] = '\0';
+
+    if (sscanf(line, FT_CMD_OFFER " %8x %lld %n", &id, &val, &pos) == 2 && pos)
+    {
+        return ft_offer(fl, n, id, val, line + pos);
+    }
+
+    if (sscanf(line, FT_CMD_ACCEPT " %8x %lld", &id, &val) == 2)
+    {
+        return ft_accept(fl, n, id, val);
+    }
+
+    if (sscanf(line, FT_CMD_DATA " %8x %lld", &id, &val) == 2)
+    {
+        return ft_data(fl, n, id, val, end + 1, len - (end + 1 - content));
+    }
+
+    if (sscanf(line, FT_CMD_ACK " %8x %lld", &id, &val) == 2)
+    {
+        return ft_ack(fl, n, id, val);
+    }
+
+    if (sscanf(line, FT_CMD_CHUNKS " %8x %d %d", &id, &first, &count) == 3)
+    {
+        return ft_chunks(fl, n, id, first, count, end + 1, len - (end + 1 - content));
+    }
+
+    if (sscanf(line, FT_CMD_HAVE " %8x %d", &id, &first) == 2)
+    {
+        return ft_have(fl, n, id, first, end + 1, len - (end + 1 - content));
+    }
+
+    if (sscanf(line, FT_CMD_CANCEL " %8x", &id) == 1)
+    {
+        // chunks of a canceled file are never acknowledged
+        ft_purge(&_cnf->cl.contact[n].link, id);
+
+        if ((t = ft_find(fl, n, id, FT_SEND)) != NULL ||
+            (t = ft_find(fl, n, id, FT_RECV)) != NULL)
+        {
+            ui_log(LOG_INFO, "'%s' canceled the transfer of '%s'!",
+                   _cnf->cl.contact[n].name, t->name);
+            ft_remove(fl, t, 0);
+        }
+
+        return 0;
+    }
+
+    ui_log(LOG_WARN, "Unknown file transfer command '%s'!", line);
+    return -1;
+}
+
+
+/**
+ *  Sends the chunks of the accepted files. Chunks are sent to a contact
+ *  as long as its window and socket buffer take them, so that the socket
+ *  never blocks the main loop for long and the connection is kept busy.
+ *  The files sent to a contact take turns, one chunk each, so that a
+ *  large file does not hold up the others. PDUs held back for a contact
+ *  are written before each chunk (see: send_pdu_file()), chat messages
+ *  thereby take precedence over files.
+ *  Transfers of contacts, that have been removed, are ended.
+ *  The contactlist has to be locked.
+ *  @param fl Pointer to file transfers
+ *  @return microseconds until the socket buffers should be checked again
+ *  or -1 if no file is being sent
+ */
+long
+ft_run(file_transfers_t* fl)
+{
+    file_transfer_t* t;
+    long next;
+    int sent;   // a chunk has been sent or a transfer has ended in this turn
+    int ret;
+    int n;      // index of contact
+    int i;      // index of transfer
+
+    // the transfer ends with the connection of the contact, the last
+    // transfer has been moved to index i
+    for (i = 0; i < fl->used; i++)
+    {
+        if (ft_contact(&fl->ft[i]) == -1)
+        {
+            ft_remove(fl, &fl->ft[i], 0);
+            i--;
+        }
+    }
+
+    do
+    {
+        next = -1;
+        sent = 0;
+
+        // the turn starts after the transfer that has sent last, since
+        // room in the window is taken by the first transfer
+        for (int k = 0; k < fl->used; k++)
+        {
+            i = (fl->turn + k) % fl->used;
+            t = &fl->ft[i];
+
+            if (t->dir != FT_SEND || t->state != FT_ACTIVE || (n = ft_contact(t)) == -1)
+            {
+                continue;
+            }
+
+            if ((ret = ft_chunk(fl, t, n)) == -1)
+            {
+                ui_log(LOG_WARN, "Could not send '%s'!", t->name);
+                ft_remove(fl, t, 1);
+                sent = 1;
+                break;
+            }
+
+            if (ret > 0)
+            {
+                fl->turn = i + 1;
+                sent = 1;
+            }
+
+            // the transfers have been moved, so the turn is started again
+            if (t->offset == t->size)
+            {
+                ft_complete(fl, t);
+                break;
+            }
+
+            next = FT_POLL_US;
+        }
+    }
+    while (sent);
+
+    return next;
+}
+
+
+/**
+ *  Handles the manifest of a file offered by a contact.
+ *  The file is received into a partial file in the download directory.
+ *  If a partial file of the same file exists, the transfer is resumed
+ *  at its end. The partial file is preallocated to the size of the file.
+ *  If the chunk list of the file has been received, the chunks held in
+ *  the chunk store are copied into the partial file (see: ft_fill()).
+ *  @param fl   Pointer to file transfers
+ *  @param n    Index of contact
+ *  @param id   Id of file
+ *  @param size Size of file
+ *  @param name Name of file
+ *  @return 0 on success, -1 if the file has been declined
+ */
+int
+ft_offer(file_transfers_t* fl, int n, uint32_t id, off_t size, char* name)
+{
+    file_transfer_t* t;
+    char line[FT_MAX_LINE + 1];       // answer
+    char path[FT_MAX_FILE_PATH + 1];  // partial file
+    struct stat st;
+    cs_list_t* list = NULL; // chunk list sent ahead of the manifest
+    contact_t* contact = &_cnf->cl.contact[n];
+
+    snprintf(line, sizeof(line), FT_CMD_CANCEL " %08x\n", id);
+
+    // an offer of a file being received restarts its transfer
+    if ((t = ft_find(fl, n, id, FT_RECV)) != NULL)
+    {
+        if (t->state == FT_LISTED && t->recs == t->list->count)
+        {
+            list = t->list;
+            t->list = NULL;
+        }
+
+        ft_remove(fl, t, 0);
+    }
+
+    if (fl->dir[0] == '\0')
+    {
+        ui_log(LOG_NOTICE, "'%s' offered '%s' (%lld bytes), but files are declined "
+               "without download directory!", contact->name, name, (long long) size);
+        cs_release(list);
+        ft_control(n, line, strlen(line));
+        return -1;
+    }
+
+    if (!is_valid_file_name(name) || size < 0)
+    {
+        ui_log(LOG_WARN, "'%s' offered a file with an illegal name or size!", contact->name);
+        cs_release(list);
+        ft_control(n, line, strlen(line));
+        return -1;
+    }
+
+    if ((t = ft_add(fl, n, id, FT_RECV)) == NULL)
+    {
+        ui_log(LOG_WARN, "Too many file transfers in progress - declined '%s'!", name);
+        cs_release(list);
+        ft_control(n, line, strlen(line));
+        return -1;
+    }
+
+    strncat(t->name, name, FT_MAX_NAME);
+    t->size = size;
+    ft_part_path(fl, t, path);
+
+    // the chunks have to cover the file, otherwise it is received as a whole
+    if (list != NULL && (!list->count ||
+        list->chunk[list->count - 1].off + list->chunk[list->count - 1].len != size))
+    {
+        ui_log(LOG_WARN, "The chunk list of '%s' does not match its size!", name);
+        cs_release(list);
+        list = NULL;
+    }
+
+    if (list != NULL)
+    {
+        t->list = list;
+
+        if ((t->held = calloc(list->count / 8 + 1, 1)) == NULL)
+        {
+            ui_fatal("Memory allocation for chunk bitmap failed!");
+        }
+    }
+
+    if ((t->fd = open(path, O_RDWR | O_CREAT, 0600)) == -1 || fstat(t->fd, &st) == -1)
+    {
+        ui_log_errno(LOG_WARN, "Could not open '%s'!", path);
+        ft_remove(fl, t, 0);
+        ft_control(n, line, strlen(line));
+        return -1;
+    }
+
+    // an interrupted transfer leaves the bytes received (see: ft_remove()),
+    // a file of full size may be left by a crash and is received again
+    t->offset = st.st_size < size ? st.st_size : 0;
+    t->resumed = t->offset;
+
+    // reserve the whole file, so that chunks are written at their offset
+    // and a full disk is detected before the transfer starts
+    if (size && (errno = posix_fallocate(t->fd, 0, size)) != 0)
+    {
+        ui_log_errno(LOG_WARN, "Could not allocate %lld bytes for '%s'!", (long long) size,
+                     path);
+        ft_remove(fl, t, 0);
+        ft_control(n, line, strlen(line));
+        return -1;
+    }
+
+    t->state = FT_ACTIVE;
+
+    // the chunks held are skipped, the sender learns of them before the accept
+    if (t->list != NULL)
+    {
+        if (ft_fill(fl, t, n) == -1)
+        {
+            ft_remove(fl, t, 1);
+            return -1;
+        }
+
+        t->chunk = cs_find_chunk(t->list, t->offset, 0);
+        ft_skip(fl, t);
+    }
+
+    snprintf(line, sizeof(line), FT_CMD_ACCEPT " %08x %lld\n", id, (long long) t->offset);
+
+    if (ft_control(n, line, strlen(line)) == -1)
+    {
+        ft_remove(fl, t, 0);
+        return -1;
+    }
+
+    if (t->offset)
+    {
+        ui_log(LOG_INFO, "Resuming '%s' from '%s' at %lld of %lld bytes!", name,
+               contact->name, (long long) t->offset, (long long) size);
+    }
+    else
+    {
+        ui_log(LOG_INFO, "Receiving '%s' (%lld bytes) from '%s'!", name, (long long) size,
+               contact->name);
+    }
+
+    // empty files are complete at once
+    if (t->offset == t->size)
+    {
+        ft_complete(fl, t);
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Handles the answer of a contact to the manifest of a file. The file
+ *  will be sent from the given offset on (see: ft_run()).
+ *  @param fl     Pointer to file transfers
+ *  @param n      Index of contact
+ *  @param id     Id of file
+ *  @param offset Bytes the contact has received already
+ *  @return 0 on success, -1 on error
+ */
+int
+ft_accept(file_transfers_t* fl, int n, uint32_t id, off_t offset)
+{
+    file_transfer_t* t;
+    char line[FT_MAX_LINE + 1];
+
+    if ((t = ft_find(fl, n, id, FT_SEND)) == NULL || t->state != FT_OFFERED)
+    {
+        snprintf(line, sizeof(line), FT_CMD_CANCEL " %08x\n", id);
+        ft_control(n, line, strlen(line));
+        return 0;
+    }
+
+    if (offset < 0 || offset > t->size)
+    {
+        ui_log(LOG_WARN, "'%s' accepted '%s' at an illegal offset!",
+               _cnf->cl.contact[n].name, t->name);
+        ft_remove(fl, t, 1);
+        return -1;
+    }
+
+    t->state = FT_ACTIVE;
+    t->offset = offset;
+    t->resumed = offset;
+    clock_gettime(CLOCK_MONOTONIC, &t->started);
+
+    if (t->list != NULL)
+    {
+        t->chunk = cs_find_chunk(t->list, offset, 0);
+        ft_skip(fl, t);
+    }
+
+    if (offset)
+    {
+        ui_log(LOG_INFO, "Resuming '%s' to '%s' at %lld of %lld bytes!", t->name,
+               _cnf->cl.contact[n].name, (long long) offset, (long long) t->size);
+    }
+
+    if (t->offset == t->size)
+    {
+        ft_complete(fl, t);
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Writes a chunk of a file received from a contact at its offset.
+ *  Chunks arrive in order, since they are sent over the same connection.
+ *  The chunks of the chunk list, which have been received completely, are
+ *  checked and stored (see: ft_skip()).
+ *  @param fl     Pointer to file transfers
+ *  @param n      Index of contact
+ *  @param id     Id of file
+ *  @param offset Offset of chunk
+ *  @param data   Chunk
+ *  @param len    Length of chunk
+ *  @return 0 on success, -1 on error
+ */
+int
+ft_data(file_transfers_t* fl, int n, uint32_t id, off_t offset, char* data, int len)
+{
+    file_transfer_t* t;
+    char line[FT_MAX_LINE + 1];
+    ssize_t ret;
+
+    // a transfer only listed has neither been offered nor opened yet
+    if ((t = ft_find(fl, n, id, FT_RECV)) == NULL || t->state != FT_ACTIVE)
+    {
+        // the sender stops after the first chunk
+        snprintf(line, sizeof(line), FT_CMD_CANCEL " %08x\n", id);
+        ft_control(n, line, strlen(line));
+        return 0;
+    }
+
+    // chunks held by this client are never sent
+    if (offset != t->offset || len > ft_span(t, t->size - offset))
+    {
+        ui_log(LOG_WARN, "'%s' sent a chunk of '%s' at an unexpected offset!",
+               _cnf->cl.contact[n].name, t->name);
+        ft_remove(fl, t, 1);
+        return -1;
+    }
+
+    for (int b = 0; b < len; b += ret)
+    {
+        if ((ret = pwrite(t->fd, data + b, len - b, offset + b)) == -1)
+        {
+            ui_log_errno(LOG_WARN, "Could not write '%s'!", t->name);
+            ft_remove(fl, t, 1);
+            return -1;
+        }
+    }
+
+    t->offset += len;
+    fl->recv_bytes += len;
+    ft_skip(fl, t);
+    snprintf(line, sizeof(line), FT_CMD_ACK " %08x %lld\n", id, (long long) t->offset);
+
+    if (ft_control(n, line, strlen(line)) == -1)
+    {
+        ft_remove(fl, t, 0);
+        return -1;
+    }
+
+    if (t->offset == t->size)
+    {
+        ft_complete(fl, t);
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Sends the next chunk of a file, if the window and the socket buffer of
+ *  the contact have room for at least FT_MIN_CHUNK bytes. The chunk is
+ *  not larger than the room left, so that writing it does not block and
+ *  the chunks in flight do not exceed the window. It ends at the next
+ *  chunk held by the contact, which is skipped.
+ *  @param fl Pointer to file transfers
+ *  @param t  Pointer to transfer
+ *  @param n  Index of contact
+ *  @return amount of bytes of the file sent, 0 if the socket buffer is
+ *  full, -1 on error
+ */
+int
+ft_chunk(file_transfers_t* fl, file_transfer_t* t, int n)
+{
+    dchat_pdu_t pdu;
+    char line[FT_MAX_LINE + 1]; // control line of chunk
+    long len;       // length of chunk
+    long want;      // bytes up to the end of the file or the next chunk held
+
+    if ((len = ft_room(fl, n)) == -1)
+    {
+        return -1;
+    }
+
+    want = ft_span(t, t->size - t->offset < FT_CHUNK_LEN ? t->size - t->offset : FT_CHUNK_LEN);
+
+    if (len < FT_MIN_CHUNK && len < want)
+    {
+        return 0;
+    }
+
+    if (len > want)
+    {
+        len = want;
+    }
+
+    snprintf(line, sizeof(line), FT_CMD_DATA " %08x %lld\n", t->id, (long long) t->offset);
+
+    if (init_dchat_pdu(&pdu, DCHAT_V1, CTT_ID_BIN, _cnf->me.onion_id, _cnf->me.lport,
+                       _cnf->me.name) == -1)
+    {
+        return -1;
+    }
+
+    init_dchat_pdu_content(&pdu, line, strlen(line));
+
+    if (send_pdu_file(n, &pdu, t->fd, t->offset, len) == -1)
+    {
+        free_pdu(&pdu);
+        return -1;
+    }
+
+    free_pdu(&pdu);
+    t->offset += len;
+    fl->sent_bytes += len;
+    ft_track(&_cnf->cl.contact[n].link, t->id, t->offset, len);
+    ft_skip(fl, t);
+    return len;
+}
+
+
+/**
+ *  Calculates the bytes, that can be sent to a contact without blocking
+ *  and without exceeding the window of the contact.
+ *  @param fl Pointer to file transfers
+ *  @param n  Index of contact
+ *  @return amount of bytes, 0 if no chunk can be sent, -1 on error
+ */
+long
+ft_room(file_transfers_t* fl, int n)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    ft_link_t* link = &contact->link;
+    socklen_t optlen = sizeof(int);
+    int sndbuf;     // size of socket buffer
+    int queued;     // bytes in socket buffer
+    long len;
+
+    if (link->count == FT_MAX_INFLIGHT)
+    {
+        return 0;
+    }
+
+    if (getsockopt(contact->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen) == -1 ||
+        ioctl(contact->fd, SIOCOUTQ, &queued) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Could not determine room in socket buffer!");
+        return -1;
+    }
+
+    len = (long) sndbuf - queued - contact->olen - FT_MAX_LINE;
+
+    if (len > ft_window(fl, link) - link->inflight)
+    {
+        len = ft_window(fl, link) - link->inflight;
+    }
+
+    return len < 0 ? 0 : len;
+}
+
+
+/**
+ *  Adds a chunk sent to a contact to the chunks in flight.
+ *  @param link Pointer to chunks in flight to contact
+ *  @param id   Id of file
+ *  @param end  Offset of the end of the chunk, acknowledged by the contact
+ *  @param len  Length of chunk
+ */
+void
+ft_track(ft_link_t* link, uint32_t id, off_t end, int len)
+{
+    ft_sent_t* s = &link->sent[(link->head + link->count) % FT_MAX_INFLIGHT];
+
+    s->id = id;
+    s->end = end;
+    s->len = len;
+    s->delivered = link->delivered;
+    clock_gettime(CLOCK_MONOTONIC, &s->at);
+    link->count++;
+    link->inflight += len;
+}
+
+
+/**
+ *  Handles the acknowledgement of the chunks of a file written by a
+ *  contact. The round trip of each chunk and the bytes delivered in the
+ *  meantime give the delivery rate of the connection, whose max. is kept.
+ *  The max. decays slowly, so that the window shrinks if the connection
+ *  gets slower.
+ *  @param fl     Pointer to file transfers
+ *  @param n      Index of contact
+ *  @param id     Id of file
+ *  @param offset Bytes of the file written by the contact
+ *  @return 0
+ */
+int
+ft_ack(file_transfers_t* fl, int n, uint32_t id, off_t offset)
+{
+    ft_link_t* link = &_cnf->cl.contact[n].link;
+    ft_sent_t* s;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // chunks are acknowledged in the order they have been sent, chunks of
+    // files canceled in the meantime are not in flight anymore (see: ft_purge())
+    while (link->count)
+    {
+        s = &link->sent[link->head];
+
+        if (s->id != id || s->end > offset)
+        {
+            break;
+        }
+
+        ft_acked(link, &now);
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Removes the oldest chunk in flight to a contact, which has been
+ *  acknowledged, and updates the delivery rate and round trip.
+ *  @param link Pointer to chunks in flight to contact
+ *  @param now  Time the acknowledgement has been received
+ */
+void
+ft_acked(ft_link_t* link, struct timespec* now)
+{
+    ft_sent_t* s = &link->sent[link->head];
+    long rtt;   // round trip of chunk in us
+    long rate;  // delivery rate in bytes/s
+
+    link->head = (link->head + 1) % FT_MAX_INFLIGHT;
+    link->count--;
+    link->inflight -= s->len;
+    link->delivered += s->len;
+
+    rtt = (now->tv_sec - s->at.tv_sec) * 1000000L + (now->tv_nsec - s->at.tv_nsec) / 1000;
+    rtt = rtt < 1 ? 1 : rtt;
+    rate = (double) (link->delivered - s->delivered) * 1000000 / rtt;
+    link->rate = rate > link->rate ? rate : link->rate - link->rate / FT_RATE_DECAY;
+
+    // the circuit of a connection does not change, so the min. round
+    // trip is kept for the lifetime of the contact
+    if (!link->min_rtt || rtt < link->min_rtt)
+    {
+        link->min_rtt = rtt;
+    }
+
+    link->srtt = link->srtt ? (7 * link->srtt + rtt) / 8 : rtt;
+}
+
+
+/**
+ *  Handles records of the chunk list of a file, which a contact sends
+ *  ahead of the manifest. The first records start a transfer, which waits
+ *  for the manifest (see: FT_LISTED). Each record is the length of a chunk
+ *  in network byte order followed by its SHA-256. Chunk lists are ignored
+ *  without chunk store.
+ *  @param fl    Pointer to file transfers
+ *  @param n     Index of contact
+ *  @param id    Id of file
+ *  @param first Index of the first chunk of the records
+ *  @param count Amount of chunks of the file
+ *  @param data  Records
+ *  @param len   Length of records
+ *  @return 0 on success, -1 on error
+ */
+int
+ft_chunks(file_transfers_t* fl, int n, uint32_t id, int first, int count, char* data, int len)
+{
+    file_transfer_t* t;
+    int recs = len / CS_REC_LEN;
+
+    if (_cnf->cs.dir[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (count < 1 || count > CS_MAX_CHUNKS || first < 0 || len % CS_REC_LEN)
+    {
+        ui_log(LOG_WARN, "'%s' sent an illegal chunk list!", _cnf->cl.contact[n].name);
+        return -1;
+    }
+
+    if (!first)
+    {
+        if ((t = ft_find(fl, n, id, FT_RECV)) != NULL)
+        {
+            ft_remove(fl, t, 0);
+        }
+
+        // the manifest is declined, if there is no room for the transfer
+        if ((t = ft_add(fl, n, id, FT_RECV)) == NULL)
+        {
+            return 0;
+        }
+
+        t->state = FT_LISTED;
+        t->list = cs_new_list(count);
+    }
+    else if ((t = ft_find(fl, n, id, FT_RECV)) == NULL || t->state != FT_LISTED)
+    {
+        return 0;
+    }
+
+    if (first != t->recs || count != t->list->count || recs > count - first)
+    {
+        ui_log(LOG_WARN, "'%s' sent an illegal chunk list!", _cnf->cl.contact[n].name);
+        ft_remove(fl, t, 0);
+        return -1;
+    }
+
+    if (cs_decode(t->list, first, data, recs) == -1)
+    {
+        ui_log(LOG_WARN, "'%s' sent a chunk list with an illegal length!",
+               _cnf->cl.contact[n].name);
+        ft_remove(fl, t, 0);
+        return -1;
+    }
+
+    t->recs += recs;
+    return 0;
+}
+
+
+/**
+ *  Handles the bitmap of the chunks of a file held by a contact, which
+ *  has been sent before the contact accepted the file.
+ *  @param fl    Pointer to file transfers
+ *  @param n     Index of contact
+ *  @param id    Id of file
+ *  @param first Index of the chunk of the first bit, a multiple of 8
+ *  @param data  Bitmap, the lowest bit of a byte is the first chunk
+ *  @param len   Length of bitmap
+ *  @return 0 on success, -1 on error
+ */
+int
+ft_have(file_transfers_t* fl, int n, uint32_t id, int first, char* data, int len)
+{
+    file_transfer_t* t;
+
+    if ((t = ft_find(fl, n, id, FT_SEND)) == NULL || t->state != FT_OFFERED ||
+        t->list == NULL)
+    {
+        return 0;
+    }
+
+    if (first < 0 || first % 8 || first / 8 + len > t->list->count / 8 + 1)
+    {
+        ui_log(LOG_WARN, "'%s' sent an illegal bitmap of chunks of '%s'!",
+               _cnf->cl.contact[n].name, t->name);
+        ft_remove(fl, t, 1);
+        return -1;
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        t->held[first / 8 + i] |= data[i];
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Calculates the max. bytes of chunks in flight to a contact. The bytes
+ *  delivered within the min. round trip are in transit, all bytes above
+ *  queue up in the buffers along the connection. The bytes delivered
+ *  within the target latency are allowed to queue up, so that the
+ *  connection is kept busy and the window grows with each round trip
+ *  until the delivery rate does not increase anymore.
+ *  @param fl   Pointer to file transfers
+ *  @param link Pointer to chunks in flight to contact
+ *  @return window in bytes
+ */
+long
+ft_window(file_transfers_t* fl, ft_link_t* link)
+{
+    double wnd = (double) link->rate * (link->min_rtt + fl->latency * 1000L) / 1000000;
+
+    if (wnd < FT_MIN_WINDOW)
+    {
+        return FT_MIN_WINDOW;
+    }
+
+    return wnd > FT_MAX_WINDOW ? FT_MAX_WINDOW : (long) wnd;
+}
+
+
+/**
+ *  Removes the chunks of a file from the chunks in flight to a contact,
+ *  since a canceled file is not acknowledged anymore.
+ *  @param link Pointer to chunks in flight to contact
+ *  @param id   Id of file
+ */
+void
+ft_purge(ft_link_t* link, uint32_t id)
+{
+    ft_sent_t* s;
+    int kept = 0;   // chunks kept in flight
+
+    for (int i = 0; i < link->count; i++)
+    {
+        s = &link->sent[(link->head + i) % FT_MAX_INFLIGHT];
+
+        if (s->id == id)
+        {
+            link->inflight -= s->len;
+            continue;
+        }
+
+        link->sent[(link->head + kept++) % FT_MAX_INFLIGHT] = *s;
+    }
+
+    link->count = kept;
+}
+
+
+/**
+ *  Searches a transfer of a file with a contact.
+ *  @param fl  Pointer to file transfers
+ *  @param n   Index of contact
+ *  @param id  Id of file
+ *  @param dir Direction of transfer (see: FT_SEND, FT_RECV)
+ *  @return pointer to transfer or NULL if not found
+ */
+file_transfer_t*
+ft_find(file_transfers_t* fl, int n, uint32_t id, int dir)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    file_transfer_t* t;
+
+    for (int i = 0; i < fl->used; i++)
+    {
+        t = &fl->ft[i];
+
+        if (t->id == id && t->dir == dir && t->sock == contact->fd &&
+            t->lport == contact->lport && !strcmp(t->onion_id, contact->onion_id))
+        {
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ *  Adds a transfer of a file with a contact.
+ *  @param fl  Pointer to file transfers
+ *  @param n   Index of contact
+ *  @param id  Id of file
+ *  @param dir Direction of transfer (see: FT_SEND, FT_RECV)
+ *  @return pointer to transfer or NULL if too many transfers are in progress
+ */
+file_transfer_t*
+ft_add(file_transfers_t* fl, int n, uint32_t id, int dir)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    file_transfer_t* t;
+
+    if (fl->used == FT_MAX_TRANSFERS)
+    {
+        return NULL;
+    }
+
+    t = &fl->ft[fl->used++];
+    memset(t, 0, sizeof(*t));
+    t->id = id;
+    t->dir = dir;
+    t->state = FT_OFFERED;
+    strncat(t->onion_id, contact->onion_id, ONION_ADDRLEN);
+    t->lport = contact->lport;
+    t->sock = contact->fd;
+    t->fd = -1;
+    clock_gettime(CLOCK_MONOTONIC, &t->started);
+    return t;
+}
+
+
+/**
+ *  Searches the contact of a transfer in the contactlist. A transfer
+ *  belongs to the connection it has been started on.
+ *  @param t Pointer to transfer
+ *  @return index of contact or -1 if the connection has been closed
+ */
+int
+ft_contact(file_transfer_t* t)
+{
+    contact_t* contact;
+
+    for (int i = 0; i < _cnf->cl.cl_size; i++)
+    {
+        contact = &_cnf->cl.contact[i];
+
+        if (contact->fd && contact->fd == t->sock && contact->lport == t->lport &&
+            !strcmp(contact->onion_id, t->onion_id))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ *  Sends an "application/octet" PDU consisting of a control line only.
+ *  @param n    Index of contact
+ *  @param line Control line terminated by '\\n'
+ *  @param len  Length of line
+ *  @return length of PDU or -1 in case of error
+ */
+int
+ft_control(int n, char* line, int len)
+{
+    dchat_pdu_t pdu;
+    int ret;
+
+    if (init_dchat_pdu(&pdu, DCHAT_V1, CTT_ID_BIN, _cnf->me.onion_id, _cnf->me.lport,
+                       _cnf->me.name) == -1)
+    {
+        return -1;
+    }
+
+    init_dchat_pdu_content(&pdu, line, len);
+    ret = send_pdu(n, &pdu);
+    free_pdu(&pdu);
+    return ret;
+}
+
+
+/**
+ *  Sends the chunk list of a file to a contact, CS_MAX_RECS records per
+ *  PDU (see: ft_chunks()).
+ *  @param n Index of contact
+ *  @param t Pointer to transfer
+ *  @return 0 on success, -1 in case of error
+ */
+int
+ft_send_chunks(int n, file_transfer_t* t)
+{
+    char content[FT_MAX_LINE + CS_MAX_RECS * CS_REC_LEN];
+    int len;        // length of content
+    int recs;       // records of PDU
+
+    for (int first = 0; first < t->list->count; first += recs)
+    {
+        recs = t->list->count - first < CS_MAX_RECS ? t->list->count - first : CS_MAX_RECS;
+        len = snprintf(content, FT_MAX_LINE + 1, FT_CMD_CHUNKS " %08x %d %d\n", t->id, first,
+                       t->list->count);
+
+        len += cs_encode(t->list, first, recs, content + len);
+
+        if (ft_control(n, content, len) == -1)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Copies the chunks of a file held in the chunk store into its partial
+ *  file and sends the bitmap of them to the contact, CS_MAX_HAVE bytes per
+ *  PDU (see: ft_have()). Chunks in front of the offset, which have been
+ *  received already, are not copied.
+ *  @param fl Pointer to file transfers
+ *  @param t  Pointer to transfer
+ *  @param n  Index of contact
+ *  @return 0 on success, -1 on error
+ */
+int
+ft_fill(file_transfers_t* fl, file_transfer_t* t, int n)
+{
+    char buf[CS_MAX_CHUNK];             // chunk
+    char content[FT_MAX_LINE + CS_MAX_HAVE];
+    cs_chunk_t* c;
+    cs_entry_t* e;
+    ssize_t ret;
+    int first = cs_find_chunk(t->list, t->offset, 0);
+    int last = -1;      // last chunk held
+    long long bytes = 0;
+    int len;
+
+    for (int i = first; i < t->list->count; i++)
+    {
+        c = &t->list->chunk[i];
+
+        if ((e = cs_lookup(&_cnf->cs, c->hash)) == NULL || e->len != c->len ||
+            cs_read(&_cnf->cs, e, buf) == -1)
+        {
+            continue;
+        }
+
+        for (uint32_t b = 0; b < c->len; b += ret)
+        {
+            if ((ret = pwrite(t->fd, buf + b, c->len - b, c->off + b)) == -1)
+            {
+                ui_log_errno(LOG_WARN, "Could not write '%s'!", t->name);
+                return -1;
+            }
+        }
+
+        t->held[i / 8] |= 1 << (i % 8);
+        last = i;
+        bytes += c->len;
+        _cnf->cs.hits++;
+        _cnf->cs.hit_bytes += c->len;
+    }
+
+    if (last == -1)
+    {
+        return 0;
+    }
+
+    ui_log(LOG_INFO, "Took %lld bytes of '%s' from the chunk store!", bytes, t->name);
+
+    for (int b = first / 8; b <= last / 8; b += CS_MAX_HAVE)
+    {
+        len = snprintf(content, FT_MAX_LINE + 1, FT_CMD_HAVE " %08x %d\n", t->id, b * 8);
+
+        if (last / 8 + 1 - b < CS_MAX_HAVE)
+        {
+            memcpy(content + len, t->held + b, last / 8 + 1 - b);
+            len += last / 8 + 1 - b;
+        }
+        else
+        {
+            memcpy(content + len, t->held + b, CS_MAX_HAVE);
+            len += CS_MAX_HAVE;
+        }
+
+        if (ft_control(n, content, len) == -1)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Advances the chunk of a transfer to the chunk containing its offset.
+ *  The offset is moved past chunks held by the receiver, every other
+ *  chunk passed is checked and stored by the receiver (see: ft_verify()).
+ *  @param fl Pointer to file transfers
+ *  @param t  Pointer to transfer
+ */
+void
+ft_skip(file_transfers_t* fl, file_transfer_t* t)
+{
+    cs_chunk_t* c;
+
+    if (t->list == NULL)
+    {
+        return;
+    }
+
+    for (; t->chunk < t->list->count; t->chunk++)
+    {
+        c = &t->list->chunk[t->chunk];
+
+        if (t->held[t->chunk / 8] & (1 << (t->chunk % 8)))
+        {
+            if (c->off + c->len > t->offset)
+            {
+                fl->saved_bytes += c->off + c->len - t->offset;
+                t->offset = c->off + c->len;
+            }
+        }
+        else if (c->off + c->len > t->offset)
+        {
+            break;
+        }
+        else if (t->dir == FT_RECV)
+        {
+            ft_verify(t, c);
+        }
+    }
+}
+
+
+/**
+ *  Calculates the bytes of a file from the offset of a transfer up to the
+ *  next chunk held by the receiver.
+ *  @param t   Pointer to transfer
+ *  @param max Max. bytes returned
+ *  @return amount of bytes, at most max
+ */
+off_t
+ft_span(file_transfer_t* t, off_t max)
+{
+    cs_chunk_t* c;
+
+    if (t->list == NULL)
+    {
+        return max;
+    }
+
+    for (int i = t->chunk; i < t->list->count; i++)
+    {
+        c = &t->list->chunk[i];
+
+        if (c->off - t->offset >= max)
+        {
+            break;
+        }
+
+        if (t->held[i / 8] & (1 << (i % 8)))
+        {
+            return c->off - t->offset;
+        }
+    }
+
+    return max;
+}
+
+
+/**
+ *  Checks a chunk received completely against its hash and adds it to
+ *  the chunk store. The chunk is read back from the partial file, since
+ *  it may have been received in several pieces or sessions.
+ *  @param t Pointer to transfer
+ *  @param c Pointer to chunk
+ */
+void
+ft_verify(file_transfer_t* t, cs_chunk_t* c)
+{
+    char buf[CS_MAX_CHUNK];
+    unsigned char hash[CS_HASH_LEN];
+    ssize_t ret;
+
+    for (uint32_t b = 0; b < c->len; b += ret)
+    {
+        if ((ret = pread(t->fd, buf + b, c->len - b, c->off + b)) <= 0)
+        {
+            ui_log_errno(LOG_WARN, "Could not read '%s'!", t->name);
+            return;
+        }
+    }
+
+    cs_sha256((unsigned char*) buf, c->len, hash);
+
+    if (memcmp(hash, c->hash, CS_HASH_LEN))
+    {
+        ui_log(LOG_WARN, "The chunk at %lld of '%s' does not match its chunk list!",
+               (long long) c->off, t->name);
+        return;
+    }
+
+    cs_put(&_cnf->cs, hash, buf, c->len);
+}
+
+
+/**
+ *  Ends a transfer, whose file has been sent or received completely.
+ *  A received file is moved from its partial file to its name in the
+ *  download directory. Existing files are not overwritten, but the name
+ *  is numbered instead.
+ *  @param fl Pointer to file transfers
+ *  @param t  Pointer to transfer, removed from the transfers
+ *  @return 0 on success, -1 if the received file could not be moved
+ */
+int
+ft_complete(file_transfers_t* fl, file_transfer_t* t)
+{
+    char part[FT_MAX_FILE_PATH + 1];  // partial file
+    char path[FT_MAX_FILE_PATH + 1];  // received file
+    struct timespec now;
+    double secs;    // duration of transfer
+    int ret = -1;
+    int n = ft_contact(t);
+    char* peer = n != -1 ? _cnf->cl.contact[n].name : t->onion_id;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    secs = (now.tv_sec - t->started.tv_sec) + (now.tv_nsec - t->started.tv_nsec) / 1e9;
+
+    if (t->dir == FT_SEND)
+    {
+        ui_log(LOG_INFO, "Sent '%s' to '%s' (%lld bytes, %.1f KB/s)!", t->name, peer,
+               (long long) (t->size - t->resumed),
+               secs > 0 ? (t->size - t->resumed) / 1024.0 / secs : 0.0);
+        ret = 0;
+    }
+    else
+    {
+        ft_part_path(fl, t, part);
+
+        if ((ret = ft_move(fl, part, t->name, path)) == 0)
+        {
+            ui_log(LOG_INFO, "Received '%s' from '%s' (%lld bytes, %.1f KB/s)!", path, peer,
+                   (long long) (t->size - t->resumed),
+                   secs > 0 ? (t->size - t->resumed) / 1024.0 / secs : 0.0);
+        }
+    }
+
+    fl->completed += ret == 0;
+    ft_remove(fl, t, 0);
+    return ret;
+}
+
+
+/**
+ *  Moves a received file from its partial file to its name in the
+ *  download directory. Existing files are not overwritten, but the name
+ *  is numbered instead.
+ *  @param fl   Pointer to file transfers
+ *  @param part Path of partial file
+ *  @param name Name of file
+ *  @param path Buffer of at least FT_MAX_FILE_PATH + 1 bytes for the path
+ *  of the received file
+ *  @return 0 on success, -1 if the file could not be moved
+ */
+int
+ft_move(file_transfers_t* fl, char* part, char* name, char* path)
+{
+    int ret = -1;
+
+    for (int i = 0; i < FT_MAX_COPIES && ret == -1; i++)
+    {
+        if (!i)
+        {
+            snprintf(path, FT_MAX_FILE_PATH + 1, "%s/%s", fl->dir, name);
+        }
+        else
+        {
+            snprintf(path, FT_MAX_FILE_PATH + 1, "%s/%s.%d", fl->dir, name, i);
+        }
+
+        // link(2) fails instead of replacing an existing file
+        if ((ret = link(part, path)) == 0)
+        {
+            unlink(part);
+        }
+        else if (errno != EEXIST)
+        {
+            break;
+        }
+    }
+
+    if (ret == -1)
+    {
+        ui_log_errno(LOG_WARN, "Could not move '%s' to the download directory!", part);
+    }
+
+    return ret;
+}
+
+
+/**
+ *  Removes a transfer. A partial file keeps the bytes received, so that
+ *  the transfer is resumed at its end, if the file is offered again.
+ *  @param fl     Pointer to file transfers
+ *  @param t      Pointer to transfer
+ *  @param cancel If set, the contact is told to stop the transfer
+ */
+void
+ft_remove(file_transfers_t* fl, file_transfer_t* t, int cancel)
+{
+    char line[FT_MAX_LINE + 1];
+    int n;
+
+    if ((n = ft_contact(t)) != -1)
+    {
+        if (cancel)
+        {
+            snprintf(line, sizeof(line), FT_CMD_CANCEL " %08x\n", t->id);
+            ft_control(n, line, strlen(line));
+        }
+
+        // the contact stops acknowledging an interrupted file
+        if (t->dir == FT_SEND && t->offset < t->size)
+        {
+            ft_purge(&_cnf->cl.contact[n].link, t->id);
+        }
+    }
+
+    if (t->state == FT_ACTIVE && t->offset < t->size)
+    {
+        if (t->dir == FT_RECV && ftruncate(t->fd, t->offset) == -1)
+        {
+            ui_log_errno(LOG_WARN, "Could not truncate partial file of '%s'!", t->name);
+        }
+
+        ui_log(LOG_INFO, "Transfer of '%s' interrupted at %lld of %lld bytes!", t->name,
+               (long long) t->offset, (long long) t->size);
+    }
+
+    if (t->fd != -1)
+    {
+        close(t->fd);
+    }
+
+    cs_release(t->list);
+    free(t->held);
+
+    // keep the transfers compact by moving the last transfer
+    fl->used--;
+
+    if (t != &fl->ft[fl->used])
+    {
+        memcpy(t, &fl->ft[fl->used], sizeof(*t));
+    }
+}
+
+
+/**
+ *  Builds the path of the partial file of a received file. The id of the
+ *  file is part of the name, so that only the same file is resumed.
+ *  @param fl   Pointer to file transfers
+ *  @param t    Pointer to transfer
+ *  @param path Buffer of at least FT_MAX_FILE_PATH + 1 bytes
+ */
+void
+ft_part_path(file_transfers_t* fl, file_transfer_t* t, char* path)
+{
+    snprintf(path, FT_MAX_FILE_PATH + 1, "%s/%s.%08x" FT_PART_EXT, fl->dir, t->name, t->id);
+}
+
+
+/**
+ *  Checks if the given name can be used as name of a received file. The
+ *  name must not contain a directory, must not be hidden and must not
+ *  contain control characters.
+ *  @param name Name of file
+ *  @return 1 if valid, 0 otherwise
+ */
+int
+is_valid_file_name(char* name)
+{
+    int len = strlen(name);
+
+    if (!len || len > FT_MAX_NAME || name[0] == '.' || strchr(name, '/') != NULL)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        if ((unsigned char) name[i] < 0x20 || name[i] == 0x7F)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
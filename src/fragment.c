@@ -0,0 +1,304 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/** @file fragment.c
+ *  This file contains the fragmentation of messages, whose content exceeds
+ *  MAX_CONTENT_LEN (e.g. large pastes or contactlists). Clients offer to
+ *  accept fragments by FG_OFFER in the Server header of their hello. Every
+ *  fragment is a PDU with all headers of the message, up to FG_FRAG_LEN
+ *  bytes of its content and the headers Fragment-Id, Fragment-Offset and
+ *  Fragment-Total (DChat/1) or the flag V2_FLG_FRG (DChat/2). The receiver
+ *  reassembles the message before it is handled like any other PDU, so
+ *  that message ids, the log and forwarding only see whole messages.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dchat_h/fragment.h"
+#include "dchat_h/types.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/contact.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Sends a message as fragments to a contact. The fragments share the
+ *  headers and the content of the message and are passed one after the
+ *  other to send_pdu(), so that only a single fragment is encoded at once
+ *  and the coalesced PDUs are written whenever they reach the max. bytes
+ *  buffered. The contactlist has to be locked.
+ *  @param n   Index of contact
+ *  @param pdu Pointer to PDU, whose content exceeds MAX_CONTENT_LEN
+ *  @return length of all fragments or -1 on error
+ */
+int
+fg_send(int n, dchat_pdu_t* pdu)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    dchat_pdu_t frag;   // fragment
+    int off;            // offset of fragment
+    int len = 0;        // length of fragments sent
+    int ret;
+
+    if (!contact->fg.offered)
+    {
+        ui_log(LOG_ERR, "'%s' does not accept messages longer than %d bytes!",
+               contact->name, MAX_CONTENT_LEN);
+        return -1;
+    }
+
+    if (pdu->content_length > FG_MAX_MESSAGE)
+    {
+        ui_log(LOG_ERR, "Messages must not be longer than %d bytes!", FG_MAX_MESSAGE);
+        return -1;
+    }
+
+    memcpy(&frag, pdu, sizeof(frag));
+    frag.frag_id = contact->fg.next_id++;
+    frag.frag_total = pdu->content_length;
+
+    for (off = 0; off < pdu->content_length; off += frag.content_length)
+    {
+        frag.frag_offset = off;
+        frag.content = pdu->content + off;
+        frag.content_length = pdu->content_length - off < FG_FRAG_LEN ?
+                              pdu->content_length - off : FG_FRAG_LEN;
+
+        if ((ret = send_pdu(n, &frag)) == -1)
+        {
+            return -1;
+        }
+
+        len += ret;
+        _cnf->fg.fragments++;
+    }
+
+    _cnf->fg.sent++;
+    return len;
+}
+
+
+/**
+ *  Reassembles the messages of a contact from the fragments received.
+ *  The buffer of a message is allocated with its first fragment, every
+ *  fragment is copied to its offset right away. As soon as the last
+ *  fragment has been received, the PDU is replaced by the message, whose
+ *  content is the buffer. Fragments have to be received in order. Messages
+ *  exceeding the limits of the contact or of all contacts are dropped.
+ *  @param n   Index of contact
+ *  @param pdu Pointer to PDU received, freed unless 1 is returned
+ *  @return 1 if the PDU is a whole message (no fragment or the last one),
+ *          0 if the fragment has been kept or dropped, -1 if it is illegal
+ */
+int
+fg_receive(int n, dchat_pdu_t* pdu)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    fg_link_t* fl = &contact->fg;
+    fg_message_t* m;
+    dchat_pdu_t* head;  // first fragment
+
+    if (!pdu->frag_total)
+    {
+        return 1;
+    }
+
+    if (pdu->content_type == CTT_ID_BIN || !pdu->content_length ||
+        pdu->frag_offset + pdu->content_length > pdu->frag_total)
+    {
+        ui_log(LOG_ERR, "Illegal fragment received from '%s'!", contact->name);
+        free_pdu(pdu);
+        return -1;
+    }
+
+    if ((m = fg_find(fl, pdu->frag_id)) == NULL)
+    {
+        // rest of a message, that has been dropped
+        if (pdu->frag_offset)
+        {
+            free_pdu(pdu);
+            return 0;
+        }
+
+        if (fl->used == FG_MAX_PENDING || fl->bytes + pdu->frag_total > FG_PEER_BYTES ||
+            _cnf->fg.bytes + pdu->frag_total > FG_MAX_BYTES)
+        {
+            ui_log(LOG_WARN, "Message of '%s' dropped, too many bytes are being reassembled!",
+                   contact->name);
+            _cnf->fg.dropped++;
+            free_pdu(pdu);
+            return 0;
+        }
+
+        if ((head = malloc(sizeof(*head))) == NULL)
+        {
+            ui_fatal("Memory allocation for fragmented message failed!");
+        }
+
+        // the message keeps the headers of the first fragment
+        memcpy(head, pdu, sizeof(*head));
+
+        if ((head->content = malloc(pdu->frag_total + 1)) == NULL)
+        {
+            ui_fatal("Memory allocation for fragmented message failed!");
+        }
+
+        head->content_length = pdu->frag_total;
+        head->content[head->content_length] = '\0';
+        pdu->server = NULL;
+        m = &fl->msg[fl->used++];
+        m->id = pdu->frag_id;
+        m->head = head;
+        m->received = 0;
+        fl->bytes += pdu->frag_total;
+        _cnf->fg.bytes += pdu->frag_total;
+        _cnf->fg.peak = _cnf->fg.bytes > _cnf->fg.peak ? _cnf->fg.bytes : _cnf->fg.peak;
+    }
+    else if (pdu->frag_offset != m->received || pdu->frag_total != m->head->frag_total ||
+             pdu->content_type != m->head->content_type)
+    {
+        ui_log(LOG_ERR, "Fragment of '%s' does not continue its message!", contact->name);
+        fg_remove(fl, m);
+        free_pdu(pdu);
+        return -1;
+    }
+
+    memcpy(m->head->content + pdu->frag_offset, pdu->content, pdu->content_length);
+    m->received += pdu->content_length;
+    free_pdu(pdu);
+
+    if (m->received < m->head->frag_total)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &m->expires);
+        m->expires.tv_sec += FG_TIMEOUT;
+        return 0;
+    }
+
+    // hand over the buffer, the message is not copied again
+    memcpy(pdu, m->head, sizeof(*pdu));
+    pdu->frag_total = 0;
+    m->head->content = NULL;
+    m->head->server = NULL;
+    fg_remove(fl, m);
+    _cnf->fg.reassembled++;
+    return 1;
+}
+
+
+/**
+ *  Drops the messages of all contacts, whose next fragment has not been
+ *  received within FG_TIMEOUT seconds. The contactlist has to be locked.
+ *  @return microseconds until the next message expires or -1 if no
+ *  messages are being reassembled
+ */
+long
+fg_expire()
+{
+    struct timespec now;
+    long next = -1;  // time until the next message expires
+    long left;       // time until a message expires
+    fg_link_t* fl;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (int i = 0; i < _cnf->cl.cl_size; i++)
+    {
+        fl = &_cnf->cl.contact[i].fg;
+
+        for (int j = 0; j < fl->used; j++)
+        {
+            left = (fl->msg[j].expires.tv_sec - now.tv_sec) * 1000000 +
+                   (fl->msg[j].expires.tv_nsec - now.tv_nsec) / 1000;
+
+            if (left <= 0)
+            {
+                ui_log(LOG_WARN, "Message of '%s' dropped, fragments are missing!",
+                       _cnf->cl.contact[i].name);
+                _cnf->fg.expired++;
+                fg_remove(fl, &fl->msg[j--]);
+            }
+            else if (next == -1 || left < next)
+            {
+                next = left;
+            }
+        }
+    }
+
+    return next;
+}
+
+
+/**
+ *  Drops all messages of a connection being reassembled.
+ *  @param fl Pointer to fragmentation of the connection
+ */
+void
+fg_free(fg_link_t* fl)
+{
+    while (fl->used)
+    {
+        fg_remove(fl, &fl->msg[0]);
+    }
+}
+
+
+/**
+ *  Searches a message being reassembled.
+ *  @param fl Pointer to fragmentation of the connection
+ *  @param id Fragment-Id of the message
+ *  @return Pointer to message or NULL if not found
+ */
+fg_message_t*
+fg_find(fg_link_t* fl, uint32_t id)
+{
+    for (int i = 0; i < fl->used; i++)
+    {
+        if (fl->msg[i].id == id)
+        {
+            return &fl->msg[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ *  Removes a message being reassembled and frees its first fragment
+ *  including the buffer. The last message takes its place.
+ *  @param fl Pointer to fragmentation of the connection
+ *  @param m  Pointer to message
+ */
+void
+fg_remove(fg_link_t* fl, fg_message_t* m)
+{
+    fl->bytes -= m->head->frag_total;
+    _cnf->fg.bytes -= m->head->frag_total;
+    free_pdu(m->head);
+    free(m->head);
+    *m = fl->msg[--fl->used];
+}
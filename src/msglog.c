@@ -0,0 +1,968 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file msglog.c
+ *  This file contains the log of the chat messages sent and received. The
+ *  log consists of segment files in a directory, which are named after the
+ *  sequence number of their first record and mapped into memory. Every
+ *  message is appended as record to the last segment, which is rotated as
+ *  soon as it is full; only the newest ML_MAX_SEGMENTS segments are kept.
+ *  A sparse index of every segment locates the records by sequence number
+ *  and time. A contact, that has been connected, is asked to replay the
+ *  messages logged since the newest message of this log ("control/replay")
+ *  and answers with the records as text PDUs, which are written straight
+ *  from the mapped segments (see: ml_replay()). Replayed messages are
+ *  recognized as seen by their message ids, if they have been received
+ *  before.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dchat_h/msglog.h"
+#include "dchat_h/types.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/contact.h"
+#include "dchat_h/consoleui.h"
+#include "dchat_h/util.h"
+
+
+/**
+ *  Compares two sequence numbers for qsort(3).
+ */
+static int
+ml_cmp_seq(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+/**
+ *  Opens the message log in the log directory. All segments found are
+ *  mapped and indexed, all but the last one are sealed. The ids of the
+ *  messages, which will be replayed by contacts (see: ml_request()), are
+ *  marked as seen, so that they are not displayed again.
+ *  @param ml Pointer to message log
+ *  @return 0 on success, -1 on error
+ */
+int
+init_msg_log(msg_log_t* ml)
+{
+    DIR* dir;
+    struct dirent* ent;
+    uint64_t* first = NULL; // first sequence numbers of segments found
+    int amount = 0;         // amount of segments found
+    unsigned long long seq;
+    char path[ML_MAX_PATH + 32];
+    ml_segment_t* s;
+    ml_rec_t* r;
+    size_t off;
+    int pos;
+    int si;
+
+    ml->seg = NULL;
+    ml->used = 0;
+    ml->next_seq = 1;
+    ml->last_time = 0;
+
+    if (ml->dir[0] == '\0')
+    {
+        return 0;
+    }
+
+    if ((ml->seg = calloc(ML_MAX_SEGMENTS + 1, sizeof(ml_segment_t))) == NULL)
+    {
+        ui_fatal("Memory allocation for message log failed!");
+    }
+
+    if ((dir = opendir(ml->dir)) == NULL)
+    {
+        ui_log_errno(LOG_ERR, "Could not open message log '%s'!", ml->dir);
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+        pos = 0;
+
+        if (sscanf(ent->d_name, "%16llx%n", &seq, &pos) != 1 || pos != 16 ||
+            strcmp(ent->d_name + pos, ML_SEG_EXT))
+        {
+            continue;
+        }
+
+        if ((first = realloc(first, (amount + 1) * sizeof(uint64_t))) == NULL)
+        {
+            ui_fatal("Memory allocation for message log failed!");
+        }
+
+        first[amount++] = seq;
+    }
+
+    closedir(dir);
+    qsort(first, amount, sizeof(uint64_t), ml_cmp_seq);
+
+    for (int i = 0; i < amount; i++)
+    {
+        // segments above the limit have been left by an older version
+        if (amount - i > ML_MAX_SEGMENTS)
+        {
+            snprintf(path, sizeof(path), ML_SEG_NAME, ml->dir, (unsigned long long) first[i]);
+            unlink(path);
+            continue;
+        }
+
+        if (ml_open(ml, first[i]) == -1)
+        {
+            free(first);
+            return -1;
+        }
+
+        s = &ml->seg[ml->used - 1];
+
+        if (s->last)
+        {
+            ml->next_seq = s->last + 1;
+            ml->last_time = s->last_time;
+        }
+
+        // only the last segment stays writable
+        if (i < amount - 1 && ml_seal(s) == -1)
+        {
+            free(first);
+            return -1;
+        }
+    }
+
+    free(first);
+
+    // start a new segment, if there is none or the last one is full
+    if ((!ml->used && ml_open(ml, ml->next_seq) == -1) ||
+        (ml->seg[ml->used - 1].used + ML_MAX_RECORD > ML_SEGMENT_SIZE && ml_rotate(ml) == -1))
+    {
+        return -1;
+    }
+
+    // the messages replayed by contacts have been received already
+    if (ml->last_time && ml_find(ml, ml->last_time - ML_REPLAY_SLACK, 0, &si, &off) == 0)
+    {
+        for (; si < ml->used; si++, off = 0)
+        {
+            s = &ml->seg[si];
+
+            for (; off < s->used; off += ML_REC_SIZE(r->id_len, r->len))
+            {
+                r = (ml_rec_t*) (s->map + off);
+                check_seen(&_cnf->seen, (char*) (r + 1), r->id_len);
+            }
+        }
+    }
+
+    ui_log(LOG_INFO, "Message log '%s': %d segments, %zu bytes, %llu messages!", ml->dir,
+           ml->used, ml_size(ml), (unsigned long long) (ml->next_seq - ml->seg[0].first));
+    return 0;
+}
+
+
+/**
+ *  Closes the message log. The active segment is truncated to its
+ *  records, it will be extended again by the next session.
+ *  @param ml Pointer to message log
+ */
+void
+destroy_msg_log(msg_log_t* ml)
+{
+    for (int i = 0; i < ml->used; i++)
+    {
+        if (ml->seg[i].fd != -1)
+        {
+            ml_seal(&ml->seg[i]);
+        }
+
+        if (ml->seg[i].map != NULL)
+        {
+            munmap(ml->seg[i].map, ml->seg[i].size);
+        }
+    }
+
+    free(ml->seg);
+    ml->seg = NULL;
+    ml->used = 0;
+}
+
+
+/**
+ *  Appends a chat message to the message log. The record contains the
+ *  message as it will be replayed: with the author as origin, its date,
+ *  message id and a hop limit of 1, so that it is not forwarded again.
+ *  Records are replayed as single PDUs, so messages exceeding
+ *  MAX_CONTENT_LEN (see: fg_send()) are not logged.
+ *  @param ml  Pointer to message log
+ *  @param pdu Pointer to message sent or received
+ *  @return sequence number of the record, 0 if the log is disabled or the
+ *          message is too long, -1 on error
+ */
+int64_t
+ml_append(msg_log_t* ml, dchat_pdu_t* pdu)
+{
+    dchat_pdu_t rec;        // message as replayed
+    char buf[ML_MAX_RECORD];
+    int ids[] = { HDR_ID_CTT, HDR_ID_CTL, HDR_ID_DAT, HDR_ID_HOP, HDR_ID_ORG, HDR_ID_MID };
+    int id_len = strlen(pdu->msg_id);
+    int len;
+    size_t size;            // size of record
+    int64_t now = time(NULL);
+    ml_segment_t* s;
+    ml_rec_t* r;
+
+    if (!ml->used || pdu->content_length > MAX_CONTENT_LEN)
+    {
+        return 0;
+    }
+
+    if (init_dchat_pdu(&rec, DCHAT_V1, CTT_ID_TXT, _cnf->me.onion_id, _cnf->me.lport,
+                       _cnf->me.name) == -1)
+    {
+        return -1;
+    }
+
+    // the author of a forwarded message is its origin
+    if (pdu->origin_id[0] != '\0')
+    {
+        strncat(rec.origin_id, pdu->origin_id, ONION_ADDRLEN);
+        rec.origin_lport = pdu->origin_lport;
+        strncat(rec.origin_name, pdu->origin_name, MAX_NICKNAME);
+    }
+    else
+    {
+        strncat(rec.origin_id, pdu->onion_id, ONION_ADDRLEN);
+        rec.origin_lport = pdu->lport;
+        strncat(rec.origin_name, pdu->nickname, MAX_NICKNAME);
+    }
+
+    if (!iszero(&pdu->sent, sizeof(pdu->sent)))
+    {
+        memcpy(&rec.sent, &pdu->sent, sizeof(struct tm));
+    }
+
+    rec.hop_limit = 1;
+    strncat(rec.msg_id, pdu->msg_id, MAX_MSGID_LEN);
+    rec.content_length = pdu->content_length;
+
+    // headers, empty line and content
+    len = ml_headers(&rec, ids, sizeof(ids) / sizeof(ids[0]), buf,
+                     sizeof(buf) - pdu->content_length - id_len - sizeof(ml_rec_t) - ML_ALIGN);
+    free_pdu(&rec);
+
+    if (len == -1)
+    {
+        ui_log(LOG_WARN, "Could not log message '%s'!", pdu->msg_id);
+        return -1;
+    }
+
+    buf[len++] = '\n';
+    memcpy(buf + len, pdu->content, pdu->content_length);
+    len += pdu->content_length;
+    size = ML_REC_SIZE(id_len, len);
+
+    if (ml->seg[ml->used - 1].used + size > ml->seg[ml->used - 1].size && ml_rotate(ml) == -1)
+    {
+        return -1;
+    }
+
+    s = &ml->seg[ml->used - 1];
+
+    if (s->fd == -1)
+    {
+        return -1;
+    }
+
+    // the time of the records never decreases, so that they can be
+    // searched by time (see: ml_find())
+    now = now < ml->last_time ? ml->last_time : now;
+
+    if (!s->entries || s->used / ML_INDEX_STEP != s->index[s->entries - 1].off / ML_INDEX_STEP)
+    {
+        s->index[s->entries].seq = ml->next_seq;
+        s->index[s->entries].time = now;
+        s->index[s->entries++].off = s->used;
+    }
+
+    r = (ml_rec_t*) (s->map + s->used);
+    memcpy(r + 1, pdu->msg_id, id_len);
+    memcpy((char*) (r + 1) + id_len, buf, len);
+    r->len = len;
+    r->seq = ml->next_seq;
+    r->time = now;
+    r->id_len = id_len;
+    // the magic number is set last, it marks the record as complete
+    r->magic = ML_MAGIC;
+
+    s->used += size;
+    s->last = ml->next_seq++;
+    s->last_time = now;
+    ml->last_time = now;
+    ml->appended++;
+    return r->seq;
+}
+
+
+/**
+ *  Asks a contact to replay the messages missed since the newest message
+ *  of the log. The request reaches back ML_REPLAY_SLACK seconds, since the
+ *  clocks of the contacts differ.
+ *  @param ml Pointer to message log
+ *  @param n  Index of contact
+ *  @return 0 on success or if nothing is requested, -1 on error
+ */
+int
+ml_request(msg_log_t* ml, int n)
+{
+    char line[ML_MAX_LINE + 1];
+
+    if (!ml->used || !ml->last_time)
+    {
+        return 0;
+    }
+
+    snprintf(line, sizeof(line), ML_CMD_SINCE " %lld 0\n",
+             (long long) ml->last_time - ML_REPLAY_SLACK);
+    return ml_control(n, line);
+}
+
+
+/**
+ *  Handles a "control/replay" PDU received from a contact: a request to
+ *  replay messages or the answer to a request.
+ *  @param ml      Pointer to message log
+ *  @param n       Index of contact
+ *  @param content Content of PDU
+ *  @param len     Length of content
+ *  @return 0 on success, -1 on error
+ */
+int
+ml_receive(msg_log_t* ml, int n, char* content, int len)
+{
+    char line[ML_MAX_LINE + 1];
+    long long since;
+    unsigned long long seq;
+    int count;
+
+    if (len > ML_MAX_LINE)
+    {
+        ui_log(LOG_WARN, "Illegal replay PDU received!");
+        return -1;
+    }
+
+    memcpy(line, content, len);
+    line[len] = '\0';
+
+    if (sscanf(line, ML_CMD_SINCE " %lld %llu", &since, &seq) == 2)
+    {
+        return ml_replay(ml, n, since, seq);
+    }
+
+    // ask for the messages left out
+    if (sscanf(line, ML_CMD_MORE " %lld %llu %d", &since, &seq, &count) == 3)
+    {
+        snprintf(line, sizeof(line), ML_CMD_SINCE " %lld %llu\n", since, seq);
+        return ml_control(n, line);
+    }
+
+    if (sscanf(line, ML_CMD_DONE " %llu %d", &seq, &count) == 2)
+    {
+        return 0;
+    }
+
+    ui_log(LOG_WARN, "Unknown replay command '%s'!", line);
+    return -1;
+}
+
+
+/**
+ *  Replays the messages logged at or after the given time, whose sequence
+ *  number is greater than the given one, to a contact. Every record is
+ *  written as is from the mapped segment, preceded by the headers
+ *  identifying this client. At most ML_MAX_REPLAY messages are replayed,
+ *  the answer tells the contact where to continue ("MORE") or that all
+ *  messages have been replayed ("DONE"). Sealed segments are dropped from
+ *  memory after they have been written.
+ *  @param ml    Pointer to message log
+ *  @param n     Index of contact
+ *  @param since Time of the first message
+ *  @param after Sequence number of the last message replayed before
+ *  @return 0 on success, -1 on error
+ */
+int
+ml_replay(msg_log_t* ml, int n, int64_t since, uint64_t after)
+{
+    dchat_pdu_t me;             // headers identifying this client
+    char prefix[ML_MAX_RECORD];
+    int ids[] = { HDR_ID_VER, HDR_ID_ONI, HDR_ID_LNP, HDR_ID_NIC };
+    int plen;                   // length of prefix
+    struct iovec iov[ML_MAX_IOV];
+    int cnt = 0;                // buffers to write
+    int count = 0;              // messages replayed
+    char line[ML_MAX_LINE + 1];
+    ml_segment_t* s;
+    ml_rec_t* r;
+    size_t off;
+    int si;
+
+    ml->requests++;
+
+    if (ml->used && ml_find(ml, since, after, &si, &off) == 0)
+    {
+        if (init_dchat_pdu(&me, DCHAT_V1, CTT_ID_TXT, _cnf->me.onion_id, _cnf->me.lport,
+                           _cnf->me.name) == -1)
+        {
+            return -1;
+        }
+
+        plen = ml_headers(&me, ids, sizeof(ids) / sizeof(ids[0]), prefix, sizeof(prefix));
+        free_pdu(&me);
+
+        // PDUs held back have to be written ahead of the replayed ones
+        if (plen == -1 || flush_contact(n) == -1)
+        {
+            return -1;
+        }
+
+        for (; si < ml->used && count < ML_MAX_REPLAY; si++, off = 0)
+        {
+            s = &ml->seg[si];
+
+            for (; off < s->used && count < ML_MAX_REPLAY;
+                 off += ML_REC_SIZE(r->id_len, r->len))
+            {
+                r = (ml_rec_t*) (s->map + off);
+                iov[cnt].iov_base = prefix;
+                iov[cnt++].iov_len = plen;
+                iov[cnt].iov_base = (char*) (r + 1) + r->id_len;
+                iov[cnt++].iov_len = r->len;
+                after = r->seq;
+                count++;
+
+                if (cnt == ML_MAX_IOV && ml_write(_cnf->cl.contact[n].fd, iov, cnt) == -1)
+                {
+                    return -1;
+                }
+
+                cnt = cnt == ML_MAX_IOV ? 0 : cnt;
+            }
+
+            if (cnt && ml_write(_cnf->cl.contact[n].fd, iov, cnt) == -1)
+            {
+                return -1;
+            }
+
+            cnt = 0;
+
+            // sealed segments are read rarely, so they do not stay in memory
+            if (s->fd == -1 && s->map != NULL)
+            {
+                madvise(s->map, s->size, MADV_DONTNEED);
+            }
+        }
+    }
+
+    ml->replayed += count;
+
+    if (count == ML_MAX_REPLAY)
+    {
+        snprintf(line, sizeof(line), ML_CMD_MORE " %lld %llu %d\n", (long long) since,
+                 (unsigned long long) after, count);
+    }
+    else
+    {
+        snprintf(line, sizeof(line), ML_CMD_DONE " %llu %d\n", (unsigned long long) after,
+                 count);
+    }
+
+    return ml_control(n, line);
+}
+
+
+/**
+ *  Opens a segment and appends it to the segments of the log. A new
+ *  segment is created if it does not exist. The segment is preallocated to
+ *  ML_SEGMENT_SIZE, mapped writable and indexed.
+ *  @param ml    Pointer to message log
+ *  @param first Sequence number of the first record of the segment
+ *  @return 0 on success, -1 on error
+ */
+int
+ml_open(msg_log_t* ml, uint64_t first)
+{
+    char path[ML_MAX_PATH + 32];
+    ml_segment_t* s = &ml->seg[ml->used];
+
+    snprintf(path, sizeof(path), ML_SEG_NAME, ml->dir, (unsigned long long) first);
+    memset(s, 0, sizeof(*s));
+    s->first = first;
+    s->size = ML_SEGMENT_SIZE;
+
+    if ((s->fd = open(path, O_RDWR | O_CREAT, 0600)) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Could not open segment '%s'!", path);
+        return -1;
+    }
+
+    if (ftruncate(s->fd, s->size) == -1 ||
+        (s->map = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0)) ==
+        MAP_FAILED)
+    {
+        ui_log_errno(LOG_ERR, "Could not map segment '%s'!", path);
+        close(s->fd);
+        return -1;
+    }
+
+    ml->used++;
+    return ml_scan(ml, s);
+}
+
+
+/**
+ *  Walks the records of a segment and builds its sparse index. The
+ *  records end at the first invalid record, which is left by a crash
+ *  while the record has been written.
+ *  @param ml Pointer to message log
+ *  @param s  Pointer to segment
+ *  @return 0
+ */
+int
+ml_scan(msg_log_t* ml, ml_segment_t* s)
+{
+    ml_rec_t* r;
+    size_t size;    // size of record
+    uint64_t seq = s->first;
+
+    for (s->used = 0; s->used + sizeof(ml_rec_t) <= s->size; s->used += size)
+    {
+        r = (ml_rec_t*) (s->map + s->used);
+        size = ML_REC_SIZE(r->id_len, r->len);
+
+        if (r->magic != ML_MAGIC || size > ML_MAX_RECORD || s->used + size > s->size ||
+            r->seq < seq || r->time < s->last_time || r->time < ml->last_time)
+        {
+            break;
+        }
+
+        if (!s->entries || s->used / ML_INDEX_STEP !=
+            s->index[s->entries - 1].off / ML_INDEX_STEP)
+        {
+            s->index[s->entries].seq = r->seq;
+            s->index[s->entries].time = r->time;
+            s->index[s->entries++].off = s->used;
+        }
+
+        seq = r->seq + 1;
+        s->last = r->seq;
+        s->last_time = r->time;
+    }
+
+    // clear the rest of an invalid record, so that nothing is found behind
+    // the records appended from now on
+    if (s->used + sizeof(ml_rec_t) <= s->size)
+    {
+        memset(s->map + s->used, 0, sizeof(ml_rec_t));
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Seals a segment: it is truncated to its records and mapped read-only.
+ *  @param s Pointer to segment
+ *  @return 0 on success, -1 on error
+ */
+int
+ml_seal(ml_segment_t* s)
+{
+    munmap(s->map, s->size);
+    s->map = NULL;
+    s->size = s->used;
+
+    if (ftruncate(s->fd, s->used) == -1)
+    {
+        ui_log_errno(LOG_WARN, "Could not truncate segment %016llx!",
+                     (unsigned long long) s->first);
+    }
+
+    if (s->used &&
+        (s->map = mmap(NULL, s->used, PROT_READ, MAP_SHARED, s->fd, 0)) == MAP_FAILED)
+    {
+        ui_log_errno(LOG_ERR, "Could not map segment %016llx!", (unsigned long long) s->first);
+        s->map = NULL;
+        s->used = 0;
+        s->last = 0;
+        close(s->fd);
+        s->fd = -1;
+        return -1;
+    }
+
+    close(s->fd);
+    s->fd = -1;
+    return 0;
+}
+
+
+/**
+ *  Seals the active segment and starts a new one. If the log has reached
+ *  ML_MAX_SEGMENTS, the oldest segment is removed.
+ *  @param ml Pointer to message log
+ *  @return 0 on success, -1 on error
+ */
+int
+ml_rotate(msg_log_t* ml)
+{
+    char path[ML_MAX_PATH + 32];
+    ml_segment_t* s = &ml->seg[ml->used - 1];
+
+    if (s->fd != -1 && ml_seal(s) == -1)
+    {
+        return -1;
+    }
+
+    if (ml->used == ML_MAX_SEGMENTS)
+    {
+        s = &ml->seg[0];
+        snprintf(path, sizeof(path), ML_SEG_NAME, ml->dir, (unsigned long long) s->first);
+
+        if (s->map != NULL)
+        {
+            munmap(s->map, s->size);
+        }
+
+        if (unlink(path) == -1)
+        {
+            ui_log_errno(LOG_WARN, "Could not remove segment '%s'!", path);
+        }
+
+        memmove(&ml->seg[0], &ml->seg[1], (ml->used - 1) * sizeof(ml_segment_t));
+        ml->used--;
+        ml->removed++;
+    }
+
+    return ml_open(ml, ml->next_seq);
+}
+
+
+/**
+ *  Searches the first record logged at or after the given time, whose
+ *  sequence number is greater than the given one. Since neither the
+ *  sequence numbers nor the times of the records decrease, the segment is
+ *  found by its last record and the record is searched from the last
+ *  index entry before it.
+ *  @param ml    Pointer to message log
+ *  @param since Min. time of record
+ *  @param after Sequence number the record has to be greater than
+ *  @param si    Returns the index of the segment
+ *  @param off   Returns the offset of the record in the segment
+ *  @return 0 on success, -1 if there is no such record
+ */
+int
+ml_find(msg_log_t* ml, int64_t since, uint64_t after, int* si, size_t* off)
+{
+    ml_segment_t* s = NULL;
+    ml_rec_t* r;
+    int lo = 0;
+    int hi;
+    int mid;
+
+    for (*si = 0; *si < ml->used; (*si)++)
+    {
+        s = &ml->seg[*si];
+
+        if (s->last > after && s->last_time >= since)
+        {
+            break;
+        }
+    }
+
+    if (*si == ml->used)
+    {
+        return -1;
+    }
+
+    // first index entry matching
+    for (hi = s->entries; lo < hi;)
+    {
+        mid = (lo + hi) / 2;
+
+        if (s->index[mid].seq > after && s->index[mid].time >= since)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+
+    for (*off = lo ? s->index[lo - 1].off : 0; *off < s->used;
+         *off += ML_REC_SIZE(r->id_len, r->len))
+    {
+        r = (ml_rec_t*) (s->map + *off);
+
+        if (r->seq > after && r->time >= since)
+        {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ *  Returns the record of the given sequence number.
+ *  @param ml  Pointer to message log
+ *  @param seq Sequence number of record
+ *  @return pointer to record in the mapped segment, NULL if it has been
+ *          removed or does not exist
+ */
+ml_rec_t*
+ml_get(msg_log_t* ml, uint64_t seq)
+{
+    ml_rec_t* r;
+    size_t off;
+    int si;
+
+    if (!seq || ml_find(ml, 0, seq - 1, &si, &off) == -1)
+    {
+        return NULL;
+    }
+
+    r = (ml_rec_t*) (ml->seg[si].map + off);
+    return r->seq == seq ? r : NULL;
+}
+
+
+/**
+ *  Sends a "control/replay" PDU to a contact.
+ *  @param n    Index of contact
+ *  @param line Content of PDU
+ *  @return 0 on success, -1 on error
+ */
+int
+ml_control(int n, char* line)
+{
+    dchat_pdu_t pdu;
+    int ret;
+
+    if (init_dchat_pdu(&pdu, DCHAT_V1, CTT_ID_RPY, _cnf->me.onion_id, _cnf->me.lport,
+                       _cnf->me.name) == -1)
+    {
+        return -1;
+    }
+
+    init_dchat_pdu_content(&pdu, line, strlen(line));
+    ret = send_pdu(n, &pdu);
+    free_pdu(&pdu);
+    return ret;
+}
+
+
+/**
+ *  Encodes the given headers of a PDU. Headers not set are left out.
+ *  @param pdu    Pointer to PDU
+ *  @param ids    Ids of headers (see: HDR_ID_*)
+ *  @param amount Amount of headers
+ *  @param buf    Buffer for the header lines
+ *  @param size   Size of buffer
+ *  @return length of header lines, -1 on error or if the buffer is too small
+ */
+int
+ml_headers(dchat_pdu_t* pdu, int* ids, int amount, char* buf, int size)
+{
+    char* header;
+    int len = 0;
+    int hlen;
+    int ret;
+
+    for (int i = 0; i < amount; i++)
+    {
+        if ((ret = encode_header(pdu, ids[i], &header)) == -1)
+        {
+            return -1;
+        }
+
+        if (ret == 1)
+        {
+            continue;
+        }
+
+        if ((hlen = strlen(header)) >= size - len)
+        {
+            free(header);
+            return -1;
+        }
+
+        memcpy(buf + len, header, hlen);
+        len += hlen;
+        free(header);
+    }
+
+    return len;
+}
+
+
+/**
+ *  Writes buffers completely to a socket.
+ *  @param fd  Socket
+ *  @param iov Buffers, which are modified
+ *  @param cnt Amount of buffers
+ *  @return 0 on success, -1 on error
+ */
+int
+ml_write(int fd, struct iovec* iov, int cnt)
+{
+    ssize_t ret;
+
+    while (cnt)
+    {
+        if ((ret = writev(fd, iov, cnt)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            ui_log_errno(LOG_ERR, "Could not replay messages!");
+            return -1;
+        }
+
+        for (; cnt && (size_t) ret >= iov->iov_len; iov++, cnt--)
+        {
+            ret -= iov->iov_len;
+        }
+
+        if (cnt)
+        {
+            iov->iov_base = (char*) iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Returns the bytes of the records of all segments.
+ *  @param ml Pointer to message log
+ *  @return bytes of records
+ */
+size_t
+ml_size(msg_log_t* ml)
+{
+    size_t size = 0;
+
+    for (int i = 0; i < ml->used; i++)
+    {
+        size += ml->seg[i].used;
+    }
+
+    return size;
+}
+
+
+/**
+ *  Returns the content of the message of a record: the bytes behind the
+ *  empty line ending the headers.
+ *  @param r   Pointer to record
+ *  @param len Returns the length of the content
+ *  @return pointer to content in the record, NULL if the record is invalid
+ */
+char*
+ml_content(ml_rec_t* r, int* len)
+{
+    char* pdu = (char*) (r + 1) + r->id_len;
+    char* end = pdu + r->len;
+    char* line;
+
+    for (line = pdu; line < end; line++)
+    {
+        if ((line = memchr(line, '\n', end - line)) == NULL)
+        {
+            break;
+        }
+
+        // empty line
+        if (line + 1 < end && line[1] == '\n')
+        {
+            *len = end - line - 2;
+            return line + 2;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ *  Returns the value of a header of the message of a record.
+ *  @param r    Pointer to record
+ *  @param name Name of header (see: HDR_NAME_*)
+ *  @param len  Returns the length of the value
+ *  @return pointer to value in the record, NULL if the header is missing
+ */
+char*
+ml_header(ml_rec_t* r, char* name, int* len)
+{
+    char* line = (char*) (r + 1) + r->id_len;
+    char* end = line + r->len;
+    char* eol;
+    int nlen = strlen(name);
+
+    for (; line < end && *line != '\n'; line = eol + 1)
+    {
+        if ((eol = memchr(line, '\n', end - line)) == NULL)
+        {
+            break;
+        }
+
+        if (eol - line > nlen + 1 && !strncmp(line, name, nlen) && line[nlen] == ':')
+        {
+            for (line += nlen + 1; line < eol && *line == ' '; line++);
+
+            *len = eol - line;
+            return line;
+        }
+    }
+
+    return NULL;
+}
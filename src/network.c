@@ -31,88 +31,321 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 
 #include "dchat_h/network.h"
+#include "dchat_h/types.h"
 #include "dchat_h/consoleui.h"
+#include "dchat_h/util.h"
 
 
 /**
- * Writes a SOCKS PDU to the given socket.
- * @param s   Socket where the PDU will be written to
- * @param pdu SOCKS PDU that will be written
+ * Assembles a SOCKS request into a buffer.
+ * For SOCKS4a the buffer contains the CONNECT request (see: socks4a_pdu_t).
+ * For SOCKS5 the method selection is followed by the CONNECT request with
+ * the hostname as domain name, so that both are sent at once without
+ * waiting for the method reply. If a username is given, username/password
+ * authentication (RFC 1929) is offered as the only method and the
+ * credentials are sent in between, which lets TOR isolate the stream on
+ * circuits of its own (see: socks_isolation()).
+ * @param version  SOCKS version (SOCKS_VERSION or SOCKS5_VERSION)
+ * @param user     SOCKS5 username or empty string for no authentication
+ * @param hostname The hostname of the destination
+ * @param rport    The port to connect to
+ * @param buf      Buffer of at least SOCKS_MAX_REQ_LEN bytes
+ * @return length of request or -1 if the hostname or username is too long
+ */
+int
+build_socks_request(int version, char* user, char* hostname, uint16_t rport, uint8_t* buf)
+{
+    int hostlen = strlen(hostname);
+    int userlen = strlen(user);
+    int passlen = strlen(SOCKS_ISO_PASS);
+    uint16_t port = htons(rport);
+    uint32_t fakeip = htonl(SOCKS_FAKEIP);
+    int len = 0;
+
+    if (hostlen > SOCKS_MAX_HOSTLEN || userlen > SOCKS_MAX_USERLEN)
+    {
+        return -1;
+    }
+
+    if (version == SOCKS5_VERSION)
+    {
+        // method selection
+        buf[len++] = SOCKS5_VERSION;
+        buf[len++] = 1;
+
+        if (userlen)
+        {
+            buf[len++] = SOCKS5_USER_PASS;
+            // username/password authentication
+            buf[len++] = SOCKS5_AUTH_VERSION;
+            buf[len++] = userlen;
+            memcpy(buf + len, user, userlen);
+            len += userlen;
+            buf[len++] = passlen;
+            memcpy(buf + len, SOCKS_ISO_PASS, passlen);
+            len += passlen;
+        }
+        else
+        {
+            buf[len++] = SOCKS5_NO_AUTH;
+        }
+
+        // connect request
+        buf[len++] = SOCKS5_VERSION;
+        buf[len++] = SOCKS_CONNECT;
+        buf[len++] = 0x00;
+        buf[len++] = SOCKS5_ATYP_DOMAIN;
+        buf[len++] = hostlen;
+        memcpy(buf + len, hostname, hostlen);
+        len += hostlen;
+        memcpy(buf + len, &port, 2);
+        len += 2;
+    }
+    else
+    {
+        buf[len++] = SOCKS_VERSION;
+        buf[len++] = SOCKS_CONNECT;
+        memcpy(buf + len, &port, 2);
+        len += 2;
+        memcpy(buf + len, &fakeip, 4);
+        len += 4;
+        buf[len++] = SOCKS_DELIM;
+        memcpy(buf + len, hostname, hostlen);
+        len += hostlen;
+        buf[len++] = SOCKS_DELIM;
+    }
+
+    return len;
+}
+
+
+/**
+ * Writes a SOCKS request to the given socket with a single write.
+ * Optionally the first data of the connection is appended to the request
+ * (optimistic data), so that it reaches the destination without waiting
+ * for the SOCKS reply.
+ * @param s        Socket where the request will be written to
+ * @param version  SOCKS version (SOCKS_VERSION or SOCKS5_VERSION)
+ * @param user     SOCKS5 username or empty string for no authentication
+ * @param hostname The hostname of the destination
+ * @param rport    The port to connect to
+ * @param data     Optimistic data or NULL
+ * @param data_len Length of optimistic data
  * @return 0 on success, -1 in case of error
  */
 int
-write_socks4a(int s, socks4a_pdu_t* pdu)
+write_socks_request(int s, int version, char* user, char* hostname, uint16_t rport,
+                    char* data, int data_len)
 {
-    // convert ip and port to network byte order
-    uint16_t rport  = htons(pdu->port);
-    uint32_t fakeip = htonl(pdu->fakeip);
+    uint8_t* buf; // request and optimistic data
+    int len;      // length of request
+    int ret = 0;
 
-    if (write(s, &pdu->version, 1) == -1)
+    if ((buf = malloc(SOCKS_MAX_REQ_LEN + data_len)) == NULL)
     {
-        return -1;
+        ui_fatal("Memory allocation for SOCKS request failed!");
     }
-    else if (write(s, &pdu->command, 1) == -1)
+
+    if ((len = build_socks_request(version, user, hostname, rport, buf)) == -1)
     {
+        free(buf);
         return -1;
     }
-    else if (write(s, &rport, 2) == -1)
+
+    if (data != NULL)
     {
-        return -1;
+        memcpy(buf + len, data, data_len);
+        len += data_len;
     }
-    else if (write(s, &fakeip, 4) == -1)
+
+    if (write(s, buf, len) != len)
     {
-        return -1;
+        ret = -1;
     }
-    else if (write(s, &pdu->delim, 1) == -1)
+
+    free(buf);
+    return ret;
+}
+
+
+/**
+ * Determines the length of a SOCKS reply.
+ * The length of a SOCKS5 reply depends on the type of the bound address,
+ * therefore it can only be determined after the first bytes have been read.
+ * @param version SOCKS version (SOCKS_VERSION or SOCKS5_VERSION)
+ * @param auth    Username/password authentication has been requested
+ * @param reply   Bytes of the reply read so far
+ * @param len     Amount of bytes read so far
+ * @return amount of bytes to read in total (at least len + 1, if more bytes
+ * are needed to determine the length) or -1 if the reply is invalid
+ */
+int
+socks_reply_len(int version, int auth, uint8_t* reply, int len)
+{
+    int hdr = auth ? 2 + 2 + 4 : 2 + 4; // method (and auth) reply, reply header
+
+    if (version != SOCKS5_VERSION)
     {
-        return -1;
+        return SOCKS4_REPLY_LEN;
     }
-    else if (write(s, pdu->hostname, strlen(pdu->hostname)) == -1)
+
+    // the server does not answer to a refused method or authentication
+    if (len >= 2 && reply[1] == SOCKS5_NO_METHOD)
     {
-        return -1;
+        return len;
     }
-    else if (write(s, &pdu->delim, 1) == -1)
+
+    if (auth && len >= 4 && reply[3] != 0x00)
     {
-        return -1;
+        return len;
     }
 
-    return 0;
+    // reply header and first byte of address
+    if (len < hdr + 1)
+    {
+        return hdr + 1;
+    }
+
+    switch (reply[hdr - 1])
+    {
+        case SOCKS5_ATYP_IPV4:
+            return hdr + 4 + 2;
+
+        case SOCKS5_ATYP_DOMAIN:
+            return hdr + 1 + reply[hdr] + 2;
+
+        case SOCKS5_ATYP_IPV6:
+            return hdr + 16 + 2;
+
+        default:
+            return -1;
+    }
+}
+
+
+/**
+ * Determines the status of a complete SOCKS reply.
+ * @param version SOCKS version (SOCKS_VERSION or SOCKS5_VERSION)
+ * @param auth    Username/password authentication has been requested
+ * @param reply   SOCKS reply
+ * @return 0 if the request has been granted, otherwise the status code of
+ * the reply (see: parse_socks_status())
+ */
+int
+socks_reply_status(int version, int auth, uint8_t* reply)
+{
+    if (version != SOCKS5_VERSION)
+    {
+        return reply[1] == SOCKS4_GRANTED ? 0 : reply[1];
+    }
+
+    // method selection has been refused
+    if (reply[1] != (auth ? SOCKS5_USER_PASS : SOCKS5_NO_AUTH))
+    {
+        return SOCKS5_NO_METHOD;
+    }
+
+    if (!auth)
+    {
+        return reply[3];
+    }
+
+    if (reply[3] != 0x00)
+    {
+        return SOCKS5_AUTH_FAILED;
+    }
+
+    return reply[5];
 }
 
 
 /**
- * Reads a SOCKS response PDU from the given socket.
- * @param s Socket to read from
- * @param
+ * Reads a SOCKS reply from the given socket.
+ * Exactly the bytes of the reply are read, data of the destination
+ * following the reply is left in the socket.
+ * @param s       Socket to read from
+ * @param version SOCKS version (SOCKS_VERSION or SOCKS5_VERSION)
+ * @param auth    Username/password authentication has been requested
+ * @param reply   Buffer of at least SOCKS_MAX_REPLY_LEN bytes
+ * @return length of reply, 0 on EOF or -1 in case of error
  */
 int
-read_socks4a(int s, socks4a_pdu_t* pdu)
+read_socks_reply(int s, int version, int auth, uint8_t* reply)
 {
+    int len = 0; // bytes read
+    int want;    // length of reply
     int ret;
 
-    // read SOCKS4a response (see SOCKS4a protocol)
-    if ((ret = read(s, pdu, 8)) <= 0)
+    while ((want = socks_reply_len(version, auth, reply, len)) > len)
     {
-        //return ret;
+        if ((ret = read(s, reply + len, want - len)) <= 0)
+        {
+            return ret;
+        }
+
+        len += ret;
     }
 
-    // convert port and ip to host byte order
-    pdu->port   = ntohs(pdu->port);
-    pdu->fakeip = ntohl(pdu->fakeip);
-    return ret;
+    return want == -1 ? -1 : len;
 }
 
 
 /**
  * Parses given status and returns its corresponding status message.
- * @param status Status whose status message will be returned
+ * @param version SOCKS version (SOCKS_VERSION or SOCKS5_VERSION)
+ * @param status  Status whose status message will be returned
  * @param Status message
  */
 char*
-parse_socks_status(unsigned char status)
+parse_socks_status(int version, unsigned char status)
 {
+    if (version == SOCKS5_VERSION)
+    {
+        switch (status)
+        {
+            case 0x00:
+                return "Request granted";
+
+            case 0x01:
+                return "General failure";
+
+            case 0x02:
+                return "Connection not allowed by ruleset";
+
+            case 0x03:
+                return "Network unreachable";
+
+            case 0x04:
+                return "Host unreachable";
+
+            case 0x05:
+                return "Connection refused by destination host";
+
+            case 0x06:
+                return "TTL expired";
+
+            case 0x07:
+                return "Command not supported / protocol error";
+
+            case 0x08:
+                return "Address type not supported";
+
+            case SOCKS5_AUTH_FAILED:
+                return "Authentication failed";
+
+            case SOCKS5_NO_METHOD:
+                return "No acceptable authentication method";
+
+            default:
+                return "Unknown status";
+        }
+    }
+
     switch (status)
     {
         case 90:
@@ -133,81 +366,411 @@ parse_socks_status(unsigned char status)
 }
 
 
+/**
+ * Initializes the pool of TOR clients.
+ * If no TOR client has been added with the command line option, the
+ * default TOR client TOR_ADDR:TOR_PORT will be used. SOCKS4a is used,
+ * unless SOCKS5 has been chosen with the command line option or stream
+ * isolation is enabled, which requires SOCKS5 authentication.
+ * @param sp Pointer to SOCKS pool
+ * @return 0 on success, -1 in case of error
+ */
+int
+init_socks_pool(socks_pool_t* sp)
+{
+    char address[INET_ADDRSTRLEN + 7]; // default TOR client
+
+    if (!sp->used)
+    {
+        snprintf(address, sizeof(address), "%s:%d", TOR_ADDR, TOR_PORT);
+
+        if (add_socks_endpoint(sp, address) == -1)
+        {
+            ui_log(LOG_ERR, "Invalid TOR client address '%s'!", address);
+            return -1;
+        }
+    }
+
+    if (sp->isolate != SOCKS_ISO_NONE)
+    {
+        sp->version = SOCKS5_VERSION;
+    }
+    else if (!sp->version)
+    {
+        sp->version = SOCKS_VERSION;
+    }
+
+    if (pthread_mutex_init(&sp->sp_mx, NULL))
+    {
+        ui_log_errno(LOG_ERR, "Initialization of SOCKS pool mutex failed!");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Frees all resources of the pool of TOR clients.
+ * @param sp Pointer to SOCKS pool
+ */
+void
+destroy_socks_pool(socks_pool_t* sp)
+{
+    pthread_mutex_destroy(&sp->sp_mx);
+}
+
+
+/**
+ * Adds a TOR client to the pool.
+ * @param sp      Pointer to SOCKS pool
+ * @param address Address of TOR client: "<ip>:<port>", "<ip>" or "<port>",
+ *                whereas TOR_ADDR and TOR_PORT are used for missing parts
+ * @return 0 on success, -1 if the address is invalid or the pool is full
+ */
+int
+add_socks_endpoint(socks_pool_t* sp, char* address)
+{
+    char ip[INET_ADDRSTRLEN];    // ip address part
+    char* port;                  // port part
+    char* term;                  // end of port
+    long rport = TOR_PORT;
+    socks_endpoint_t* ep;
+
+    if (sp->used == SOCKS_MAX_ENDPOINTS)
+    {
+        return -1;
+    }
+
+    ip[0] = '\0';
+
+    if ((port = strchr(address, ':')) != NULL)
+    {
+        if (port - address >= INET_ADDRSTRLEN)
+        {
+            return -1;
+        }
+
+        strncat(ip, address, port - address);
+        port++;
+    }
+    else if (strchr(address, '.') != NULL)
+    {
+        strncat(ip, address, INET_ADDRSTRLEN - 1);
+    }
+    else
+    {
+        port = address;
+    }
+
+    if (port != NULL)
+    {
+        rport = strtol(port, &term, 10);
+
+        if (*term != '\0' || !is_valid_port(rport))
+        {
+            return -1;
+        }
+    }
+
+    ep = &sp->ep[sp->used];
+    memset(ep, 0, sizeof(*ep));
+
+    if (inet_pton(AF_INET, ip[0] != '\0' ? ip : TOR_ADDR, &ep->sa.sin_addr) != 1)
+    {
+        return -1;
+    }
+
+    ep->sa.sin_family = AF_INET;
+    ep->sa.sin_port = htons(rport);
+    sp->used++;
+    return 0;
+}
+
+
+/**
+ * Chooses the TOR client for a new SOCKS request.
+ * Out of all TOR clients, which are not skipped due to recent failures,
+ * the one with the least outstanding requests weighted with its circuit
+ * build time is chosen: (outstanding + 1) * (latency + 1). TOR clients
+ * without measured latency are tried first. If all TOR clients are
+ * skipped, the one whose retry time comes first is chosen, so that a
+ * request never fails without trying. The request has to be finished with
+ * release_socks_endpoint().
+ * @param sp    Pointer to SOCKS pool
+ * @param tried Bitmask of TOR clients which must not be chosen
+ * @param da    Pointer to which the address of the TOR client will be copied
+ * @return index of TOR client or -1 if all have been tried
+ */
+int
+acquire_socks_endpoint(socks_pool_t* sp, int tried, struct sockaddr_in* da)
+{
+    socks_endpoint_t* ep;  // candidate
+    socks_endpoint_t* cur; // best TOR client so far
+    time_t now = time(NULL);
+    int best = -1;
+
+    pthread_mutex_lock(&sp->sp_mx);
+
+    for (int i = 0; i < sp->used; i++)
+    {
+        if (tried & (1 << i))
+        {
+            continue;
+        }
+
+        ep = &sp->ep[i];
+        cur = &sp->ep[best == -1 ? i : best];
+
+        if (best == -1)
+        {
+            best = i;
+        }
+        // prefer TOR clients which are up
+        else if ((ep->down_until <= now) != (cur->down_until <= now))
+        {
+            if (ep->down_until <= now)
+            {
+                best = i;
+            }
+        }
+        else if (ep->down_until > now)
+        {
+            if (ep->down_until < cur->down_until)
+            {
+                best = i;
+            }
+        }
+        else if ((uint64_t) (ep->outstanding + 1) * (ep->latency + 1) <
+                 (uint64_t) (cur->outstanding + 1) * (cur->latency + 1))
+        {
+            best = i;
+        }
+    }
+
+    if (best != -1)
+    {
+        sp->ep[best].outstanding++;
+        memcpy(da, &sp->ep[best].sa, sizeof(*da));
+    }
+
+    pthread_mutex_unlock(&sp->sp_mx);
+    return best;
+}
+
+
+/**
+ * Finishes a SOCKS request and records its result.
+ * A TOR client which could not be reached or did not answer is skipped for
+ * SOCKS_RETRY seconds, which are doubled on every consecutive failure (at
+ * most SOCKS_RETRY_MAX). The circuit build time of granted requests is
+ * smoothed with the previous ones (weight 1/4), both for the TOR client and
+ * for the group of peers the request belongs to.
+ * @param sp      Pointer to SOCKS pool
+ * @param i       Index of TOR client returned by acquire_socks_endpoint()
+ * @param grp     Group of peers returned by socks_isolation()
+ * @param result  Result of the request (see: SOCKS_EP_*), canceled requests
+ *                are not recorded
+ * @param latency Duration of the request in ms
+ */
+void
+release_socks_endpoint(socks_pool_t* sp, int i, int grp, int result, uint32_t latency)
+{
+    socks_endpoint_t* ep = &sp->ep[i];
+    socks_group_t* g = &sp->grp[grp];
+    char ip[INET_ADDRSTRLEN]; // address of TOR client
+    int retry;                // seconds the TOR client will be skipped
+
+    pthread_mutex_lock(&sp->sp_mx);
+    ep->outstanding--;
+
+    if (result == SOCKS_EP_OK)
+    {
+        ep->latency = ep->granted ? (3 * (uint64_t) ep->latency + latency) / 4 : latency;
+        ep->granted++;
+        ep->fails_in_row = 0;
+        ep->down_until = 0;
+        g->latency = g->granted ? (3 * (uint64_t) g->latency + latency) / 4 : latency;
+        g->min_latency = !g->granted || latency < g->min_latency ? latency : g->min_latency;
+        g->max_latency = latency > g->max_latency ? latency : g->max_latency;
+        g->granted++;
+    }
+    else if (result == SOCKS_EP_REJECTED)
+    {
+        ep->fails_in_row = 0;
+        ep->down_until = 0;
+        g->rejected++;
+    }
+    else if (result == SOCKS_EP_FAILED)
+    {
+        ep->failed++;
+        g->failed++;
+        retry = SOCKS_RETRY << (ep->fails_in_row < 6 ? ep->fails_in_row : 6);
+        retry = retry < SOCKS_RETRY_MAX ? retry : SOCKS_RETRY_MAX;
+        ep->fails_in_row++;
+        ep->down_until = time(NULL) + retry;
+        inet_ntop(AF_INET, &ep->sa.sin_addr, ip, sizeof(ip));
+        ui_log(LOG_WARN, "TOR client '%s:%hu' is not answering - skipping it for %d seconds!",
+               ip, ntohs(ep->sa.sin_port), retry);
+    }
+
+    pthread_mutex_unlock(&sp->sp_mx);
+}
+
+
+/**
+ * Determines the SOCKS5 username of a connection according to the stream
+ * isolation policy. TOR does not share circuits between streams with
+ * different usernames, so peers are spread over several circuits and a
+ * congested circuit only slows down the peers using it. With
+ * SOCKS_ISO_PEER every peer gets a username of its own, otherwise peers are
+ * hashed into the given amount of groups.
+ * @param sp       Pointer to SOCKS pool
+ * @param hostname The hostname of the destination
+ * @param rport    The port to connect to
+ * @param user     Buffer of at least SOCKS_MAX_USERLEN + 1 bytes, to which the
+ *                 username or an empty string (no isolation) will be written
+ * @return group of peers the connection is reported in (see: socks_group_t)
+ */
+int
+socks_isolation(socks_pool_t* sp, char* hostname, uint16_t rport, char* user)
+{
+    uint32_t hash = fnv_hash(FNV_OFFSET, hostname, strlen(hostname));
+
+    hash = fnv_hash(hash, &rport, sizeof(rport));
+    user[0] = '\0';
+
+    if (sp->isolate == SOCKS_ISO_NONE)
+    {
+        return 0;
+    }
+
+    if (sp->isolate == SOCKS_ISO_PEER)
+    {
+        snprintf(user, SOCKS_MAX_USERLEN + 1, SOCKS_PEER_USER, hostname, rport);
+        return hash % SOCKS_MAX_GROUPS;
+    }
+
+    snprintf(user, SOCKS_MAX_USERLEN + 1, SOCKS_GROUP_USER, (int) (hash % sp->isolate));
+    return hash % sp->isolate;
+}
+
+
 /**
  * Creates a TOR socket.
  * This function creates a TOR socket by establishing a connection to the listening
- * address and port of the TOR client and sending a SOCKS connection request so that
- * a curcuit to the remote host will be created.
+ * address and port of a TOR client of the SOCKS pool (see: acquire_socks_endpoint())
+ * and sending a SOCKS connection request so that a curcuit to the remote host will
+ * be created. If the TOR client does not answer, the request fails over to the next
+ * TOR client.
  * @param hostname The hostname of the destination
  * @param rport    The port to connect to
+ * @param data     Optimistic data sent together with the SOCKS request or NULL
+ *                 (see: write_socks_request())
+ * @param data_len Length of optimistic data
  * @return open socket whose traffic will be relayed through TOR or -1 in case of error
  */
 int
-create_tor_socket(char* hostname, uint16_t rport)
+create_tor_socket(char* hostname, uint16_t rport, char* data, int data_len)
 {
-    int s;                 // tor socket
-    struct sockaddr_in da; // destination address to connec to
-    socks4a_pdu_t pdu;     // SOCKS request
+    struct sockaddr_in da;      // address of TOR client
+    struct timespec start, end; // duration of request
+    char user[SOCKS_MAX_USERLEN + 1]; // SOCKS5 username for stream isolation
+    int grp;                    // group of peers
+    int tried = 0;              // TOR clients tried
+    int s;                      // tor socket
+    int i;
     int ret;
-    memset(&da, 0, sizeof(da));
 
-    // socket address for connection to the TOR client
-    if (inet_pton(AF_INET, TOR_ADDR, &da.sin_addr) != 1)
+    grp = socks_isolation(&_cnf->socks, hostname, rport, user);
+
+    while ((i = acquire_socks_endpoint(&_cnf->socks, tried, &da)) != -1)
     {
-        ui_log(LOG_ERR, "Invalid ip address '%s'!", TOR_ADDR);
-        return -1;
+        tried |= 1 << i;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ret = try_tor_socket(&da, user, hostname, rport, data, data_len, &s);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        release_socks_endpoint(&_cnf->socks, i, grp, ret, (end.tv_sec - start.tv_sec) * 1000 +
+                               (end.tv_nsec - start.tv_nsec) / 1000000);
+
+        if (ret == SOCKS_EP_OK)
+        {
+            return s;
+        }
+
+        // the remote host is not reachable, other TOR clients will not help
+        if (ret == SOCKS_EP_REJECTED)
+        {
+            return -1;
+        }
     }
 
-    da.sin_family = AF_INET;
-    da.sin_port = htons(TOR_PORT);
+    ui_log(LOG_ERR, "None of the TOR clients is answering!");
+    return -1;
+}
+
+
+/**
+ * Sends a SOCKS connection request to a TOR client.
+ * @param da       Pointer to address of TOR client
+ * @param user     SOCKS5 username or empty string (see: socks_isolation())
+ * @param hostname The hostname of the destination
+ * @param rport    The port to connect to
+ * @param data     Optimistic data or NULL
+ * @param data_len Length of optimistic data
+ * @param s        Pointer to which the socket will be stored on success
+ * @return SOCKS_EP_OK if the request has been granted, SOCKS_EP_REJECTED if the TOR
+ * client rejected it or SOCKS_EP_FAILED if the TOR client did not answer
+ */
+int
+try_tor_socket(struct sockaddr_in* da, char* user, char* hostname, uint16_t rport,
+               char* data, int data_len, int* s)
+{
+    uint8_t reply[SOCKS_MAX_REPLY_LEN]; // SOCKS reply
+    int version = _cnf->socks.version;
+    int auth = user[0] != '\0';
+    int ret;
 
     // connect to TOR client
-    if ((s = connect_to((struct sockaddr*) &da)) == -1)
+    if ((*s = connect_to((struct sockaddr*) da)) == -1)
     {
         ui_log(LOG_ERR, "Could not create TOR socket!");
-        return -1;
+        return SOCKS_EP_FAILED;
     }
 
-    // craft SOCKS request pdu
-    memset(&pdu, 0, sizeof(pdu));
-    pdu.version = SOCKS_VERSION;
-    pdu.command = SOCKS_CONNECT;
-    pdu.port    = rport;
-    pdu.fakeip  = SOCKS_FAKEIP;
-    pdu.delim   = SOCKS_DELIM;
-    pdu.hostname = hostname;
-
     // send connection request to TOR
-    if (write_socks4a(s, &pdu) == -1)
+    if (write_socks_request(*s, version, user, hostname, rport, data, data_len) == -1)
     {
         ui_log_errno(LOG_ERR, "Could not write SOCKS connection request!");
-        return -1;
+        close(*s);
+        return SOCKS_EP_FAILED;
     }
 
     // read response code from TOR
-    memset(&pdu, 0, sizeof(pdu));
-
-    if ((ret = read_socks4a(s, &pdu)) == -1)
+    if ((ret = read_socks_reply(*s, version, auth, reply)) == -1)
     {
         ui_log(LOG_ERR, "Could not read SOCKS connection response!");
-        return -1;
+        close(*s);
+        return SOCKS_EP_FAILED;
     }
 
     if (!ret)
     {
         ui_log(LOG_ERR, "Connection to TOR client has been closed!");
-        return -1;
+        close(*s);
+        return SOCKS_EP_FAILED;
     }
 
-    if (pdu.command != 90)
+    if ((ret = socks_reply_status(version, auth, reply)))
     {
         ui_log(LOG_WARN,
-                "TOR Connection to remote host failed. Status code: %d - '%s'", pdu.command,
-                parse_socks_status(pdu.command));
-        return -1;
+                "TOR Connection to remote host failed. Status code: %d - '%s'", ret,
+                parse_socks_status(version, ret));
+        close(*s);
+        return SOCKS_EP_REJECTED;
     }
 
-    return s;
+    return SOCKS_EP_OK;
 }
 
 
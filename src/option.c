@@ -30,6 +30,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/stat.h>
 
 #include "dchat_h/option.h"
 #include "dchat_h/decoder.h"
@@ -83,7 +84,8 @@ get_short_options(cli_options_t* options)
 struct option*
 get_long_options(cli_options_t* options)
 {
-    struct option* long_options = malloc(CLI_OPT_AMOUNT * sizeof(struct option));
+    // getopt requires the last element to be filled with zeros
+    struct option* long_options = calloc(CLI_OPT_AMOUNT + 1, sizeof(struct option));
 
     if (long_options == NULL)
     {
@@ -122,6 +124,30 @@ init_cli_options(cli_options_t* options)
         OPTION(CLI_OPT_LPRT, CLI_LOPT_LPRT, CLI_OPT_ARG_LPRT, 0, "Set the local listening port.", lprt_parse),
         OPTION(CLI_OPT_RONI, CLI_LOPT_RONI, CLI_OPT_ARG_RONI, 0, "Set the onion id of the remote host to whom a connection should be established.", roni_parse),
         OPTION(CLI_OPT_RPRT, CLI_LOPT_RPRT, CLI_OPT_ARG_RPRT, 0, "Set the remote port of the remote host who will accept connections on this port.", rprt_parse),
+        OPTION(CLI_OPT_OVLY, CLI_LOPT_OVLY, CLI_OPT_ARG_OVLY, 0, "Connect to a bounded number of contacts and forward messages over several hops, instead of connecting to every contact.", ovly_parse),
+        OPTION(CLI_OPT_DEGR, CLI_LOPT_DEGR, CLI_OPT_ARG_DEGR, 0, "Set the max. number of contacts connected to in overlay mode.", degr_parse),
+        OPTION(CLI_OPT_FOUT, CLI_LOPT_FOUT, CLI_OPT_ARG_FOUT, 0, "Set the number of contacts a message is forwarded to in overlay mode.", fout_parse),
+        OPTION(CLI_OPT_SMEM, CLI_LOPT_SMEM, CLI_OPT_ARG_SMEM, 0, "Set the memory used to remember the ids of recently seen messages.", smem_parse),
+        OPTION(CLI_OPT_SFPR, CLI_LOPT_SFPR, CLI_OPT_ARG_SFPR, 0, "Set the rate of new messages falsely dropped as already seen.", sfpr_parse),
+        OPTION(CLI_OPT_CACHE, CLI_LOPT_CACHE, CLI_OPT_ARG_CACHE, 0, "Set the file contacts are cached in for later sessions.", cach_parse),
+        OPTION(CLI_OPT_SEEDS, CLI_LOPT_SEEDS, CLI_OPT_ARG_SEEDS, 0, "Set the file listing the seeds to bootstrap from.", seed_parse),
+        OPTION(CLI_OPT_SKEEP, CLI_LOPT_SKEEP, CLI_OPT_ARG_SKEEP, 0, "Set the number of fastest seeds to connect to.", skep_parse),
+        OPTION(CLI_OPT_TOR, CLI_LOPT_TOR, CLI_OPT_ARG_TOR, 0, "Add a TOR client to connect over, can be given several times.", tor_parse),
+        OPTION(CLI_OPT_SOCKS5, CLI_LOPT_SOCKS5, CLI_OPT_ARG_SOCKS5, 0, "Use SOCKS5 instead of SOCKS4a to talk to the TOR clients.", sck5_parse),
+        OPTION(CLI_OPT_OPTIM, CLI_LOPT_OPTIM, CLI_OPT_ARG_OPTIM, 0, "Send the hello along with the connect request, before the connection is established.", optm_parse),
+        OPTION(CLI_OPT_ISOL, CLI_LOPT_ISOL, CLI_OPT_ARG_ISOL, 0, "Spread contacts over several TOR circuits: 'peer' or the number of peer groups.", isol_parse),
+        OPTION(CLI_OPT_DIRECT, CLI_LOPT_DIRECT, CLI_OPT_ARG_DIRECT, 0, "Connect directly to the local addresses of the route file instead of using TOR (for testing).", dirc_parse),
+        OPTION(CLI_OPT_UNIX, CLI_LOPT_UNIX, CLI_OPT_ARG_UNIX, 0, "Accept connections on a unix socket as well, e.g. forwarded by TOR.", unix_parse),
+        OPTION(CLI_OPT_UONLY, CLI_LOPT_UONLY, CLI_OPT_ARG_UONLY, 0, "Accept connections on the unix socket only, not on the local port.", uonl_parse),
+        OPTION(CLI_OPT_COWIN, CLI_LOPT_COWIN, CLI_OPT_ARG_COWIN, 0, "Set the time PDUs to a contact are held back to be written together, 0 writes at once.", cwin_parse),
+        OPTION(CLI_OPT_COMAX, CLI_LOPT_COMAX, CLI_OPT_ARG_COMAX, 0, "Set the max. number of bytes held back for a contact.", cmax_parse),
+        OPTION(CLI_OPT_WARM, CLI_LOPT_WARM, CLI_OPT_ARG_WARM, 0, "Keep connections to the peers likely connected to next, built in advance.", warm_parse),
+        OPTION(CLI_OPT_TEXT, CLI_LOPT_TEXT, CLI_OPT_ARG_TEXT, 0, "Do not offer the binary framing DChat/2.0, always send text PDUs.", text_parse),
+        OPTION(CLI_OPT_DOWN, CLI_LOPT_DOWN, CLI_OPT_ARG_DOWN, 0, "Accept files sent by contacts and store them in this directory.", down_parse),
+        OPTION(CLI_OPT_LTCY, CLI_LOPT_LTCY, CLI_OPT_ARG_LTCY, 0, "Set the max. time chat messages queue up behind files being sent.", ltcy_parse),
+        OPTION(CLI_OPT_MLOG, CLI_LOPT_MLOG, CLI_OPT_ARG_MLOG, 0, "Log chat messages in this directory and replay them to contacts that missed them.", mlog_parse),
+        OPTION(CLI_OPT_ZMIN, CLI_LOPT_ZMIN, CLI_OPT_ARG_ZMIN, 0, "Deflate the content of PDUs of at least this length for contacts accepting it, 0 disables compression.", zmin_parse),
+        OPTION(CLI_OPT_CSTO, CLI_LOPT_CSTO, CLI_OPT_ARG_CSTO, 0, "Keep the chunks of received files up to this size in the download directory and skip them when files are received again, 0 disables the store.", csto_parse),
         OPTION(CLI_OPT_HELP, CLI_LOPT_HELP, CLI_OPT_ARG_HELP, 0, "Display help.", help_parse)
     };
     temp_size = sizeof(temp) / sizeof(temp[0]);
@@ -453,6 +479,661 @@ rprt_parse(char* value, int force)
 }
 
 
+/**
+ * Parses the terminal command line option to enable the overlay
+ * mode and stores it in the global dchat configuration.
+ * @param value Pointer to argument string (unused)
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+ovly_parse(char* value, int force)
+{
+    if (force || !_cnf->ovl.enabled)
+    {
+        _cnf->ovl.enabled = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the max.
+ * size of the active view in overlay mode and stores it in the
+ * global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+degr_parse(char* value, int force)
+{
+    char* term;
+    int degree = (int) strtol(value, &term, 10);
+
+    if (degree < 1 || degree > OVL_MAX_DEGREE || *term != '\0')
+    {
+        return -1;
+    }
+
+    if (force || !_cnf->ovl.degree)
+    {
+        _cnf->ovl.degree = degree;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the fanout
+ * of forwarded messages in overlay mode and stores it in the
+ * global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+fout_parse(char* value, int force)
+{
+    char* term;
+    int fanout = (int) strtol(value, &term, 10);
+
+    if (fanout < 1 || fanout > OVL_MAX_DEGREE || *term != '\0')
+    {
+        return -1;
+    }
+
+    if (force || !_cnf->ovl.fanout)
+    {
+        _cnf->ovl.fanout = fanout;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the memory
+ * of the seen-set in KB and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+smem_parse(char* value, int force)
+{
+    char* term;
+    long memory = strtol(value, &term, 10);
+
+    if (memory < 1 || memory > SEEN_MAX_MEMORY || *term != '\0')
+    {
+        return -1;
+    }
+
+    if (force || !_cnf->seen.memory)
+    {
+        _cnf->seen.memory = memory;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the false
+ * positive rate of the seen-set and stores it in the global dchat
+ * configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+sfpr_parse(char* value, int force)
+{
+    char* term;
+    double fpr = strtod(value, &term);
+
+    if (!(fpr > 0 && fpr < 1) || *term != '\0')
+    {
+        return -1;
+    }
+
+    if (force || _cnf->seen.fpr <= 0)
+    {
+        _cnf->seen.fpr = fpr;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the path of the
+ * contact cache file and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+cach_parse(char* value, int force)
+{
+    if (value[0] == '\0' || strlen(value) > CACHE_MAX_PATH)
+    {
+        return -1;
+    }
+
+    if (force || _cnf->cache.path[0] == '\0')
+    {
+        _cnf->cache.path[0] = '\0';
+        strncat(_cnf->cache.path, value, CACHE_MAX_PATH);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the path of the
+ * seed file and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+seed_parse(char* value, int force)
+{
+    if (value[0] == '\0' || strlen(value) > SEED_MAX_PATH)
+    {
+        return -1;
+    }
+
+    if (force || _cnf->seeds.path[0] == '\0')
+    {
+        _cnf->seeds.path[0] = '\0';
+        strncat(_cnf->seeds.path, value, SEED_MAX_PATH);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the amount of
+ * seeds kept as contacts and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+skep_parse(char* value, int force)
+{
+    char* term;
+    long keep = strtol(value, &term, 10);
+
+    if (keep < 1 || keep > SEED_MAX || *term != '\0')
+    {
+        return -1;
+    }
+
+    if (force || !_cnf->seeds.keep)
+    {
+        _cnf->seeds.keep = keep;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the address of a
+ * TOR client and adds it to the SOCKS pool in the global dchat
+ * configuration. Since the option may be given several times, every
+ * address is added.
+ * @param value Pointer to argument string
+ * @param force Unused, addresses are always added
+ * @return 0 on success or -1 on error.
+ */
+int
+tor_parse(char* value, int force)
+{
+    return add_socks_endpoint(&_cnf->socks, value);
+}
+
+
+/**
+ * Parses the terminal command line option to use SOCKS5 when
+ * connecting over the TOR clients and stores it in the global
+ * dchat configuration.
+ * @param value Pointer to argument string (unused)
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+sck5_parse(char* value, int force)
+{
+    if (force || _cnf->socks.version != SOCKS5_VERSION)
+    {
+        _cnf->socks.version = SOCKS5_VERSION;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line option to send the hello
+ * optimistically with the SOCKS request and stores it in the
+ * global dchat configuration.
+ * @param value Pointer to argument string (unused)
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+optm_parse(char* value, int force)
+{
+    if (force || !_cnf->socks.optimistic)
+    {
+        _cnf->socks.optimistic = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the stream
+ * isolation policy and stores it in the global dchat configuration.
+ * @param value Pointer to argument string: "peer" or number of groups
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+isol_parse(char* value, int force)
+{
+    char* term;
+    long groups;
+
+    if (!strcmp(value, "peer"))
+    {
+        groups = SOCKS_ISO_PEER;
+    }
+    else
+    {
+        groups = strtol(value, &term, 10);
+
+        if (groups < 1 || groups > SOCKS_MAX_GROUPS || *term != '\0')
+        {
+            return -1;
+        }
+    }
+
+    if (force || _cnf->socks.isolate == SOCKS_ISO_NONE)
+    {
+        _cnf->socks.isolate = groups;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the route file
+ * of the direct transport and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+dirc_parse(char* value, int force)
+{
+    if (value[0] == '\0' || strlen(value) > TP_MAX_PATH)
+    {
+        return -1;
+    }
+
+    if (force || _cnf->tp.path[0] == '\0')
+    {
+        _cnf->tp.path[0] = '\0';
+        strncat(_cnf->tp.path, value, TP_MAX_PATH);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the path of
+ * the listening unix socket and stores it in the global dchat
+ * configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+unix_parse(char* value, int force)
+{
+    if (value[0] == '\0' || strlen(value) > MAX_UNIX_PATH)
+    {
+        return -1;
+    }
+
+    if (force || _cnf->unix_path[0] == '\0')
+    {
+        _cnf->unix_path[0] = '\0';
+        strncat(_cnf->unix_path, value, MAX_UNIX_PATH);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line option to listen on the unix
+ * socket only and stores it in the global dchat configuration.
+ * @param value Pointer to argument string (unused)
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+uonl_parse(char* value, int force)
+{
+    if (force || !_cnf->unix_only)
+    {
+        _cnf->unix_only = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the coalescing
+ * window of PDUs and stores it in the global dchat configuration.
+ * @param value Pointer to argument string: microseconds, 0 to disable
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+cwin_parse(char* value, int force)
+{
+    char* term;
+    long window = strtol(value, &term, 10);
+
+    if (window < 0 || window > CO_MAX_WINDOW || *term != '\0' || value[0] == '\0')
+    {
+        return -1;
+    }
+
+    if (force || _cnf->co_window == -1)
+    {
+        _cnf->co_window = window;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the max. amount
+ * of coalesced bytes and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+cmax_parse(char* value, int force)
+{
+    char* term;
+    long bytes = strtol(value, &term, 10);
+
+    if (bytes < 1 || bytes > CO_MAX_BYTES || *term != '\0')
+    {
+        return -1;
+    }
+
+    if (force || !_cnf->co_max)
+    {
+        _cnf->co_max = bytes;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the amount of
+ * connections built in advance and stores it in the global dchat
+ * configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+warm_parse(char* value, int force)
+{
+    char* term;
+    long budget = strtol(value, &term, 10);
+
+    if (budget < 1 || budget > WP_MAX_CONNS || *term != '\0')
+    {
+        return -1;
+    }
+
+    if (force || !_cnf->wp.budget)
+    {
+        _cnf->wp.budget = budget;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line option to send text PDUs only
+ * and stores it in the global dchat configuration.
+ * @param value Pointer to argument string (unused)
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+text_parse(char* value, int force)
+{
+    if (force || !_cnf->text_only)
+    {
+        _cnf->text_only = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the download
+ * directory of received files and stores it in the global dchat
+ * configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+down_parse(char* value, int force)
+{
+    struct stat st;
+
+    if (value[0] == '\0' || strlen(value) > FT_MAX_PATH || stat(value, &st) == -1 ||
+        !S_ISDIR(st.st_mode))
+    {
+        return -1;
+    }
+
+    if (force || _cnf->ft.dir[0] == '\0')
+    {
+        _cnf->ft.dir[0] = '\0';
+        strncat(_cnf->ft.dir, value, FT_MAX_PATH);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the max. time
+ * chat messages queue up behind files being sent and stores it in the
+ * global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+ltcy_parse(char* value, int force)
+{
+    char* term;
+    long ms = strtol(value, &term, 10);
+
+    if (ms < 1 || ms > FT_MAX_LATENCY || *term != '\0')
+    {
+        return -1;
+    }
+
+    if (force || !_cnf->ft.latency)
+    {
+        _cnf->ft.latency = ms;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the directory of
+ * the message log and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+mlog_parse(char* value, int force)
+{
+    struct stat st;
+
+    if (value[0] == '\0' || strlen(value) > ML_MAX_PATH || stat(value, &st) == -1 ||
+        !S_ISDIR(st.st_mode))
+    {
+        return -1;
+    }
+
+    if (force || _cnf->ml.dir[0] == '\0')
+    {
+        _cnf->ml.dir[0] = '\0';
+        strncat(_cnf->ml.dir, value, ML_MAX_PATH);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the min. length of
+ * deflated content and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+zmin_parse(char* value, int force)
+{
+    char* term;
+    long min = strtol(value, &term, 10);
+
+    if (min < 0 || min > ZC_MAX_MIN || *term != '\0' || value[0] == '\0')
+    {
+        return -1;
+    }
+
+    if (force || _cnf->zc.min == -1)
+    {
+        _cnf->zc.min = min;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+/**
+ * Parses the terminal command line argument string to the size limit of
+ * the chunk store in MB and stores it in the global dchat configuration.
+ * @param value Pointer to argument string
+ * @param force If set parsed argument string will override
+ *              the corresponding settings in the global config
+ * @return 0 on success, 1 nothing has been done or -1 on error.
+ */
+int
+csto_parse(char* value, int force)
+{
+    char* term;
+    long size = strtol(value, &term, 10);
+
+    if (size < 0 || size > CS_MAX_SIZE || *term != '\0' || value[0] == '\0')
+    {
+        return -1;
+    }
+
+    if (force || _cnf->cs.max == -1)
+    {
+        _cnf->cs.max = size * 1048576LL;
+        return 0;
+    }
+
+    return 1;
+}
+
+
 /**
  * Parses the terminal command line string and if it is the
  * help option, the usage of this program will be printed.
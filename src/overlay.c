@@ -0,0 +1,494 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file overlay.c
+ *  This file contains the bounded-degree overlay mode of DChat. Instead of
+ *  connecting to every known contact (full-mesh), a client only keeps a small
+ *  active view of connected contacts and a passive view of backup addresses,
+ *  similar to HyParView. The active view is the contactlist itself, its size
+ *  is limited by the configured degree. Addresses received within
+ *  "control/discover" PDUs are stored in the passive view and are used to
+ *  refill the active view whenever a contact gets lost. Both views are mixed
+ *  by periodic shuffles and chat messages are forwarded over several hops.
+ *  All functions have to be called with the contactlist locked.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "dchat_h/overlay.h"
+#include "dchat_h/types.h"
+#include "dchat_h/contact.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/connector.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Initializes the overlay state within the global config.
+ *  Degree and fanout keep the values set by the command line options, if
+ *  they have not been set the defaults will be used.
+ *  @return 0 on success, -1 in case of error
+ */
+int
+init_overlay()
+{
+    overlay_t* ovl = &_cnf->ovl;
+
+    if (!ovl->degree)
+    {
+        ovl->degree = OVL_DEF_DEGREE;
+    }
+
+    if (!ovl->fanout)
+    {
+        ovl->fanout = OVL_DEF_FANOUT;
+    }
+
+    ovl->passive_used = 0;
+    ovl->next_timer = time(NULL) + OVL_TIMER_INTERVAL;
+    ovl->next_shuffle = time(NULL) + OVL_SHUFFLE_INTERVAL;
+    srand(time(NULL) ^ getpid());
+    return 0;
+}
+
+
+/**
+ *  Periodic maintenance of the overlay.
+ *  Refills the active view from the passive view and shuffles the views
+ *  with a random active contact every OVL_SHUFFLE_INTERVAL seconds. As long
+ *  as less than half of the active view is filled, it is refilled every
+ *  OVL_TIMER_INTERVAL seconds, so that new and isolated clients connect
+ *  quickly without contacts with a full active view being asked over and
+ *  over again. Calls within OVL_TIMER_INTERVAL seconds after the last run
+ *  do nothing, thus this function can be called after every iteration of
+ *  the main loop.
+ */
+void
+ovl_maintain()
+{
+    time_t now = time(NULL);
+
+    if (!_cnf->ovl.enabled || now < _cnf->ovl.next_timer)
+    {
+        return;
+    }
+
+    _cnf->ovl.next_timer = now + OVL_TIMER_INTERVAL;
+
+    if (now >= _cnf->ovl.next_shuffle)
+    {
+        _cnf->ovl.next_shuffle = now + OVL_SHUFFLE_INTERVAL;
+        ovl_fill_active();
+        ovl_shuffle();
+    }
+    else if (ovl_active_count(-1) * 2 < _cnf->ovl.degree)
+    {
+        ovl_fill_active();
+    }
+}
+
+
+/**
+ *  Refills the active view with random peers of the passive view.
+ *  Connection requests are queued until the amount of connected contacts
+ *  and pending connects reaches the degree. Peers taken from the passive
+ *  view are removed from it, they will be added again as soon as the
+ *  connection gets lost or is rejected.
+ *  @return amount of connection requests queued
+ */
+int
+ovl_fill_active()
+{
+    ovl_peer_t peer; // peer taken from passive view
+    int missing;     // free slots in the active view
+    int queued = 0;  // connection requests queued
+
+    missing = _cnf->ovl.degree - ovl_active_count(-1) - count_conn(&_cnf->cq);
+
+    while (missing > 0 && ovl_take_passive(&peer) == 0)
+    {
+        if (enqueue_conn(&_cnf->cq, peer.onion_id, peer.lport, NULL, 0,
+                         CONN_PRIO_DISCOVER) == 0)
+        {
+            missing--;
+            queued++;
+        }
+    }
+
+    return queued;
+}
+
+
+/**
+ *  Sends a random sample of both views to a random active contact.
+ *  The sample contains this client itself, active contacts and peers of the
+ *  passive view (at most OVL_SHUFFLE_LEN addresses) and is sent as
+ *  "control/discover" PDU. The receiver adds unknown addresses to its
+ *  passive view (see: receive_contacts()).
+ *  @return amount of bytes written, 0 if there is no active contact, -1 on error
+ */
+int
+ovl_shuffle()
+{
+    dchat_pdu_t pdu;    // pdu with the sample
+    contact_t sample[OVL_SHUFFLE_LEN]; // sampled addresses
+    char* contact_str;  // string representation of sampled address
+    int* peers;         // active contacts in random order
+    int peer_cnt;       // amount of active contacts
+    int sampled = 0;    // addresses added to the sample
+    int pdu_len = 0;    // content length of pdu
+    int offset;         // random offset within the passive view
+    int i;
+    int ret;
+
+    // the first of the randomly ordered contacts receives the sample
+    if ((peer_cnt = ovl_select_peers(-1, _cnf->cl.cl_size, &peers)) == 0)
+    {
+        free(peers);
+        return 0;
+    }
+
+    memset(sample, 0, sizeof(sample));
+    memcpy(&sample[sampled++], &_cnf->me, sizeof(contact_t));
+
+    // half of the sample are active contacts, ...
+    for (i = 1; i < peer_cnt && sampled < OVL_SHUFFLE_LEN / 2; i++)
+    {
+        memcpy(&sample[sampled++], &_cnf->cl.contact[peers[i]], sizeof(contact_t));
+    }
+
+    // ... the rest are passive peers
+    offset = rand();
+
+    for (i = 0; i < _cnf->ovl.passive_used && sampled < OVL_SHUFFLE_LEN; i++)
+    {
+        ovl_peer_t* peer = &_cnf->ovl.passive[(offset + i) % _cnf->ovl.passive_used];
+        strncat(sample[sampled].onion_id, peer->onion_id, ONION_ADDRLEN);
+        sample[sampled++].lport = peer->lport;
+    }
+
+    if (init_dchat_pdu(&pdu, 1.0, CTT_ID_DSC, _cnf->me.onion_id, _cnf->me.lport,
+                       _cnf->me.name) == -1)
+    {
+        free(peers);
+        return -1;
+    }
+
+    for (i = 0; i < sampled; i++)
+    {
+        if ((contact_str = contact_to_string(&sample[i])) == NULL)
+        {
+            continue;
+        }
+
+        pdu.content = realloc(pdu.content, pdu_len + strlen(contact_str) + 1);
+
+        if (pdu.content == NULL)
+        {
+            ui_fatal("Memory reallocation for shuffle failed!");
+        }
+
+        memcpy(pdu.content + pdu_len, contact_str, strlen(contact_str));
+        pdu_len += strlen(contact_str);
+        free(contact_str);
+    }
+
+    pdu.content_length = pdu_len;
+
+    if ((ret = send_pdu(peers[0], &pdu)) == -1)
+    {
+        ui_log(LOG_ERR, "Sending of shuffle failed!");
+    }
+
+    free(peers);
+    free_pdu(&pdu);
+    return ret;
+}
+
+
+/**
+ *  Decides if a contact, who sent us a hello, is added to the active view.
+ *  Contacts are always admitted as long as the active view is not full.
+ *  Otherwise a low priority neighbor request will be rejected, whereas a
+ *  high priority request (the contact has no other active contacts) or a
+ *  join (hello without neighbor request) will be admitted and a random
+ *  active contact will be dropped in turn.
+ *  @param n    Index of contact who sent the hello
+ *  @param prio Content of the hello (see: OVL_PRIO_*)
+ *  @return 0 if contact is admitted, -1 if it has been rejected
+ */
+int
+ovl_admit(int n, char* prio)
+{
+    int* peers;     // active contacts in random order
+    int peer_cnt;   // amount of active contacts
+
+    if (!_cnf->ovl.enabled || ovl_active_count(n) < _cnf->ovl.degree)
+    {
+        return 0;
+    }
+
+    if (!strcmp(prio, OVL_PRIO_LOW))
+    {
+        ui_log(LOG_INFO, "Active view is full - rejected '%s'!", _cnf->cl.contact[n].name);
+        return -1;
+    }
+
+    // drop a random active contact in favour of the new one
+    if ((peer_cnt = ovl_select_peers(n, _cnf->cl.cl_size, &peers)) > 0)
+    {
+        ui_log(LOG_INFO, "Active view is full - dropped '%s' in favour of '%s'!",
+               _cnf->cl.contact[peers[0]].name, _cnf->cl.contact[n].name);
+        ovl_del_contact(peers[0]);
+    }
+
+    free(peers);
+    return 0;
+}
+
+
+/**
+ *  Deletes a contact from the active view.
+ *  The contact will be deleted from the contactlist (see: del_contact()) and
+ *  in overlay mode its address will be moved to the passive view.
+ *  @param n Index of contact to delete
+ *  @return 0 on success, -1 if index is out of bounds
+ */
+int
+ovl_del_contact(int n)
+{
+    ovl_peer_t peer; // address of the deleted contact
+    int ret;
+
+    if (n < 0 || n >= _cnf->cl.cl_size)
+    {
+        return del_contact(n);
+    }
+
+    memset(&peer, 0, sizeof(peer));
+    strncat(peer.onion_id, _cnf->cl.contact[n].onion_id, ONION_ADDRLEN);
+    peer.lport = _cnf->cl.contact[n].lport;
+
+    if ((ret = del_contact(n)) == 0 && _cnf->ovl.enabled && peer.lport)
+    {
+        ovl_add_passive(peer.onion_id, peer.lport);
+    }
+
+    return ret;
+}
+
+
+/**
+ *  Adds an address to the passive view.
+ *  Addresses of this client, of active contacts and addresses already in the
+ *  passive view are skipped. If the passive view is full, a random peer will
+ *  be replaced.
+ *  @param onion_id Onion address of the peer
+ *  @param lport    Listening port of the peer
+ *  @return 0 if address has been added, 1 if it has been skipped
+ */
+int
+ovl_add_passive(char* onion_id, uint16_t lport)
+{
+    contact_t temp; // contact used for searching the contactlist
+    ovl_peer_t* peer;
+
+    if (!is_valid_onion(onion_id) || !is_valid_port(lport))
+    {
+        return 1;
+    }
+
+    memset(&temp, 0, sizeof(temp));
+    strncat(temp.onion_id, onion_id, ONION_ADDRLEN);
+    temp.lport = lport;
+
+    // ourself or already active
+    if (find_contact(&temp, 0) != -2 || ovl_find_passive(onion_id, lport) != -1)
+    {
+        return 1;
+    }
+
+    if (_cnf->ovl.passive_used < OVL_PASSIVE_SIZE)
+    {
+        peer = &_cnf->ovl.passive[_cnf->ovl.passive_used++];
+    }
+    else
+    {
+        peer = &_cnf->ovl.passive[rand() % OVL_PASSIVE_SIZE];
+    }
+
+    memset(peer, 0, sizeof(*peer));
+    strncat(peer->onion_id, onion_id, ONION_ADDRLEN);
+    peer->lport = lport;
+    return 0;
+}
+
+
+/**
+ *  Removes a random peer from the passive view.
+ *  @param peer Pointer where the removed peer will be copied to
+ *  @return 0 on success, -1 if the passive view is empty
+ */
+int
+ovl_take_passive(ovl_peer_t* peer)
+{
+    int n;
+
+    if (!_cnf->ovl.passive_used)
+    {
+        return -1;
+    }
+
+    n = rand() % _cnf->ovl.passive_used;
+    memcpy(peer, &_cnf->ovl.passive[n], sizeof(*peer));
+    // keep passive view compact by moving the last peer
+    _cnf->ovl.passive_used--;
+
+    if (n != _cnf->ovl.passive_used)
+    {
+        memcpy(&_cnf->ovl.passive[n], &_cnf->ovl.passive[_cnf->ovl.passive_used],
+               sizeof(*peer));
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Searches an address in the passive view.
+ *  @param onion_id Onion address of the peer
+ *  @param lport    Listening port of the peer
+ *  @return index of peer or -1 if not found
+ */
+int
+ovl_find_passive(char* onion_id, uint16_t lport)
+{
+    for (int i = 0; i < _cnf->ovl.passive_used; i++)
+    {
+        if (_cnf->ovl.passive[i].lport == lport &&
+            !strcmp(_cnf->ovl.passive[i].onion_id, onion_id))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ *  Counts the contacts of the active view.
+ *  Only contacts which have identified themselves count, since a peer may
+ *  keep a connection to us without a hello for later use (see: warmpool.c).
+ *  @param exclude Index of contact not to count, -1 to count all
+ *  @return amount of active contacts
+ */
+int
+ovl_active_count(int exclude)
+{
+    int cnt = 0;
+
+    for (int i = 0; i < _cnf->cl.cl_size; i++)
+    {
+        if (_cnf->cl.contact[i].fd && _cnf->cl.contact[i].lport && i != exclude)
+        {
+            cnt++;
+        }
+    }
+
+    return cnt;
+}
+
+
+/**
+ *  Selects random identified contacts of the active view.
+ *  The returned array contains the indices of all identified contacts in
+ *  random order, but only the first max of them are counted in the return
+ *  value. It has to be freed by the caller in any case.
+ *  @param exclude Index of contact not to select, -1 to select all
+ *  @param max     Max. amount of contacts to select (e.g. the fanout)
+ *  @param peers   Pointer where the array of indices will be stored
+ *  @return amount of contacts selected
+ */
+int
+ovl_select_peers(int exclude, int max, int** peers)
+{
+    int cnt = 0; // amount of identified contacts
+    int i, j, tmp;
+
+    if ((*peers = malloc((_cnf->cl.cl_size + 1) * sizeof(int))) == NULL)
+    {
+        ui_fatal("Memory allocation for overlay peers failed!");
+    }
+
+    for (i = 0; i < _cnf->cl.cl_size; i++)
+    {
+        if (_cnf->cl.contact[i].fd && _cnf->cl.contact[i].lport && i != exclude)
+        {
+            (*peers)[cnt++] = i;
+        }
+    }
+
+    // partial Fisher-Yates shuffle of the first max indices
+    for (i = 0; i < cnt && i < max; i++)
+    {
+        j = i + rand() % (cnt - i);
+        tmp = (*peers)[i];
+        (*peers)[i] = (*peers)[j];
+        (*peers)[j] = tmp;
+    }
+
+    return cnt < max ? cnt : max;
+}
+
+
+/**
+ *  Determines the neighbor priority of a hello.
+ *  In overlay mode, connects requested by the user join the overlay and are
+ *  sent with high priority, as well as connects of a client without any
+ *  other active contact. All other connects fill up the active view and are
+ *  sent with low priority.
+ *  @param n    Index of the contact we have connected to
+ *  @param prio Priority of the connection request (see: CONN_PRIO_*)
+ *  @return neighbor priority to send within the hello (see: OVL_PRIO_*)
+ */
+char*
+ovl_hello_prio(int n, int prio)
+{
+    if (!_cnf->ovl.enabled)
+    {
+        return OVL_PRIO_NONE;
+    }
+
+    if (prio == CONN_PRIO_USER || !ovl_active_count(n))
+    {
+        return OVL_PRIO_HIGH;
+    }
+
+    return OVL_PRIO_LOW;
+}
@@ -0,0 +1,376 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file reconnect.c
+ *  This file contains the reconnect scheduler. Contacts that have been lost
+ *  or could not be connected are retried with a capped exponential backoff
+ *  and jitter. Every loss and failed reconnect raises the failure score of
+ *  a contact, contacts exceeding RC_MAX_SCORE are given up. A contact that
+ *  stays connected for RC_STABLE_TIME seconds is forgotten.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "dchat_h/reconnect.h"
+#include "dchat_h/types.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Initializes an empty reconnect scheduler. In overlay mode the scheduler
+ *  is disabled, since lost neighbors are replaced from the passive view
+ *  (see: ovl_maintain()).
+ *  @param rl Pointer to reconnect scheduler
+ *  @return 0 on success, -1 in case of error
+ */
+int
+init_reconnects(reconnect_list_t* rl)
+{
+    memset(rl, 0, sizeof(*rl));
+    rl->enabled = !_cnf->ovl.enabled;
+
+    if (pthread_mutex_init(&rl->rc_mx, NULL))
+    {
+        ui_log_errno(LOG_ERR, "Initialization of reconnect mutex failed!");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Frees all resources of a reconnect scheduler.
+ *  @param rl Pointer to reconnect scheduler
+ */
+void
+destroy_reconnects(reconnect_list_t* rl)
+{
+    pthread_mutex_destroy(&rl->rc_mx);
+}
+
+
+/**
+ *  Schedules the reconnect of a contact, whose connection has been lost.
+ *  If the contact has been reconnected recently, but the connection did not
+ *  become stable, the backoff of the failed reconnects is kept, so that a
+ *  flapping contact is not reconnected over and over again.
+ *  @param rl       Pointer to reconnect scheduler
+ *  @param onion_id Onion address of the contact
+ *  @param lport    Listening port of the contact
+ */
+void
+rc_lost(reconnect_list_t* rl, char* onion_id, uint16_t lport)
+{
+    reconnect_t* rc;
+    struct timespec now;
+
+    if (!rl->enabled)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&rl->rc_mx);
+
+    if ((rc = rc_get(rl, onion_id, lport, 1)) != NULL && rc->state == RC_UP)
+    {
+        if (now.tv_sec - rc->due.tv_sec >= RC_STABLE_TIME)
+        {
+            rc->attempts = 0;
+            rc->score = 0;
+        }
+
+        rc->prio = CONN_PRIO_RECONNECT;
+        rc->score += RC_LOST_SCORE;
+
+        if (rc->score > RC_MAX_SCORE)
+        {
+            ui_log(LOG_INFO, "Giving up reconnecting '%s:%hu'!", onion_id, lport);
+            rl->dropped++;
+            rc_remove(rl, rc);
+        }
+        else
+        {
+            rc->state = RC_WAITING;
+            rc_schedule(rc, &now);
+        }
+    }
+
+    pthread_mutex_unlock(&rl->rc_mx);
+}
+
+
+/**
+ *  Records the result of a connect.
+ *  A lost contact, that has been connected, will be forgotten as soon as
+ *  its connection is stable (see: rc_run()). If a connect requested by the
+ *  user, from the contact cache or by the scheduler fails, the contact will
+ *  be retried after a backoff, that doubles with every failure.
+ *  @param rl       Pointer to reconnect scheduler
+ *  @param onion_id Onion address of the contact
+ *  @param lport    Listening port of the contact
+ *  @param prio     Priority of the connect (see: CONN_PRIO_*)
+ *  @param result   Result of the connect, -1 if it failed
+ *  @return 1 if a reconnect has been scheduled, 0 otherwise
+ */
+int
+rc_result(reconnect_list_t* rl, char* onion_id, uint16_t lport, int prio, int result)
+{
+    reconnect_t* rc;
+    struct timespec now;
+    int ret = 0;
+
+    if (!rl->enabled)
+    {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&rl->rc_mx);
+
+    // discovered contacts are announced again by other contacts anyway
+    if ((rc = rc_get(rl, onion_id, lport, result == -1 &&
+                     prio != CONN_PRIO_DISCOVER)) == NULL)
+    {
+        pthread_mutex_unlock(&rl->rc_mx);
+        return 0;
+    }
+
+    if (result != -1)
+    {
+        if (rc->state != RC_UP)
+        {
+            rl->healed += rc->attempts || rc->score;
+            rc->state = RC_UP;
+            rc->due = now;
+        }
+    }
+    else
+    {
+        rc->attempts++;
+        rc->score += RC_FAIL_SCORE;
+
+        if (rc->score > RC_MAX_SCORE)
+        {
+            ui_log(LOG_INFO, "Giving up reconnecting '%s:%hu'!", onion_id, lport);
+            rl->dropped++;
+            rc_remove(rl, rc);
+        }
+        else
+        {
+            if (rc->prio > prio || rc->state == RC_UP)
+            {
+                rc->prio = prio;
+            }
+
+            rc->state = RC_WAITING;
+            rc_schedule(rc, &now);
+            ret = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&rl->rc_mx);
+    return ret;
+}
+
+
+/**
+ *  Queues the reconnects, whose backoff has passed, and forgets contacts,
+ *  whose connection is stable. If the connection queue is full, the
+ *  reconnect is postponed.
+ *  @param rl Pointer to reconnect scheduler
+ *  @param cq Pointer to connection queue
+ *  @return microseconds until the next reconnect is due or -1 if no
+ *  reconnect is waiting
+ */
+long
+rc_run(reconnect_list_t* rl, conn_queue_t* cq)
+{
+    reconnect_t* rc;
+    struct timespec now;
+    long next = -1; // time until the next reconnect is due
+    long left;      // time until the reconnect of a contact is due
+
+    if (!rl->enabled)
+    {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&rl->rc_mx);
+
+    for (int i = 0; i < rl->used; i++)
+    {
+        rc = &rl->peer[i];
+
+        if (rc->state == RC_UP && now.tv_sec - rc->due.tv_sec >= RC_STABLE_TIME)
+        {
+            // the last peer has been moved to index i
+            rc_remove(rl, rc);
+            i--;
+            continue;
+        }
+
+        if (rc->state != RC_WAITING)
+        {
+            continue;
+        }
+
+        left = (rc->due.tv_sec - now.tv_sec) * 1000000 +
+               (rc->due.tv_nsec - now.tv_nsec) / 1000;
+
+        if (left <= 0)
+        {
+            if (enqueue_conn(cq, rc->onion_id, rc->lport, NULL, 0, rc->prio) != -1)
+            {
+                ui_log(LOG_INFO, "Reconnecting '%s:%hu'!", rc->onion_id, rc->lport);
+                rc->state = RC_QUEUED;
+                rl->scheduled++;
+                continue;
+            }
+
+            rc_schedule(rc, &now);
+            left = (rc->due.tv_sec - now.tv_sec) * 1000000 +
+                   (rc->due.tv_nsec - now.tv_nsec) / 1000;
+        }
+
+        if (next == -1 || left < next)
+        {
+            next = left;
+        }
+    }
+
+    pthread_mutex_unlock(&rl->rc_mx);
+    return next;
+}
+
+
+/**
+ *  Searches a contact in the reconnect scheduler.
+ *  If the scheduler is full, a new contact replaces the waiting contact with
+ *  the highest failure score. Caller must hold the mutex of the scheduler.
+ *  @param rl       Pointer to reconnect scheduler
+ *  @param onion_id Onion address of the contact
+ *  @param lport    Listening port of the contact
+ *  @param add      If set, the contact will be added if not found
+ *  @return pointer to contact or NULL if not found and not added
+ */
+reconnect_t*
+rc_get(reconnect_list_t* rl, char* onion_id, uint16_t lport, int add)
+{
+    reconnect_t* rc = NULL;
+
+    for (int i = 0; i < rl->used; i++)
+    {
+        if (rl->peer[i].lport == lport && !strcmp(rl->peer[i].onion_id, onion_id))
+        {
+            return &rl->peer[i];
+        }
+    }
+
+    if (!add)
+    {
+        return NULL;
+    }
+
+    if (rl->used < RC_MAX_PEERS)
+    {
+        rc = &rl->peer[rl->used++];
+    }
+    else
+    {
+        // replace the worst contact, that is not in progress
+        for (int i = 0; i < rl->used; i++)
+        {
+            if (rl->peer[i].state != RC_QUEUED &&
+                (rc == NULL || rl->peer[i].score > rc->score))
+            {
+                rc = &rl->peer[i];
+            }
+        }
+
+        if (rc == NULL)
+        {
+            return NULL;
+        }
+
+        rl->dropped++;
+    }
+
+    memset(rc, 0, sizeof(*rc));
+    strncat(rc->onion_id, onion_id, ONION_ADDRLEN);
+    rc->lport = lport;
+    rc->prio  = CONN_PRIO_RECONNECT;
+    rc->state = RC_UP;
+    clock_gettime(CLOCK_MONOTONIC, &rc->due);
+    return rc;
+}
+
+
+/**
+ *  Sets the time of the next reconnect of a contact.
+ *  The backoff doubles with every failed reconnect up to RC_MAX_MS. Only
+ *  the first half of it is fixed, the second half is random, so that
+ *  contacts lost at the same time are spread out.
+ *  @param rc  Pointer to contact
+ *  @param now Current time (CLOCK_MONOTONIC)
+ */
+void
+rc_schedule(reconnect_t* rc, struct timespec* now)
+{
+    long backoff = RC_MAX_MS; // backoff in ms
+
+    if (rc->attempts < RC_MAX_SHIFT && ((long) RC_BASE_MS << rc->attempts) < RC_MAX_MS)
+    {
+        backoff = (long) RC_BASE_MS << rc->attempts;
+    }
+
+    backoff = backoff / 2 + rand() % (backoff / 2 + 1);
+    rc->due.tv_sec  = now->tv_sec + backoff / 1000;
+    rc->due.tv_nsec = now->tv_nsec + (backoff % 1000) * 1000000;
+    rc->due.tv_sec += rc->due.tv_nsec / 1000000000;
+    rc->due.tv_nsec %= 1000000000;
+}
+
+
+/**
+ *  Removes a contact from the reconnect scheduler.
+ *  Caller must hold the mutex of the scheduler.
+ *  @param rl Pointer to reconnect scheduler
+ *  @param rc Pointer to contact
+ */
+void
+rc_remove(reconnect_list_t* rl, reconnect_t* rc)
+{
+    // keep the scheduler compact by moving the last contact
+    rl->used--;
+
+    if (rc != &rl->peer[rl->used])
+    {
+        memcpy(rc, &rl->peer[rl->used], sizeof(*rc));
+    }
+}
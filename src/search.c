@@ -0,0 +1,975 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+/** @file search.c
+ *  This file contains the full-text index of the message log. The terms of
+ *  every message logged are added to the posting lists of the index as the
+ *  message arrives (see: si_add()). The index is kept in a file in the
+ *  directory of the message log, which is mapped at startup; the messages
+ *  logged after it has been written are indexed from the log. A query
+ *  ("/search") intersects the posting lists of its terms and displays the
+ *  newest messages found straight from the mapped segments of the log.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dchat_h/search.h"
+#include "dchat_h/types.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/consoleui.h"
+#include "dchat_h/util.h"
+
+
+/**
+ *  Compares the terms of two posting lists for qsort(3).
+ */
+static int
+si_cmp_list(const void* a, const void* b)
+{
+    return strcmp((*(si_list_t* const*) a)->token, (*(si_list_t* const*) b)->token);
+}
+
+
+/**
+ *  Writes a buffer completely to a file at the given offset.
+ *  @param fd  File
+ *  @param buf Buffer
+ *  @param len Length of buffer
+ *  @param off Offset in file
+ *  @return 0 on success, -1 on error
+ */
+static int
+si_pwrite(int fd, void* buf, size_t len, off_t off)
+{
+    ssize_t ret;
+
+    while (len)
+    {
+        if ((ret = pwrite(fd, buf, len, off)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return -1;
+        }
+
+        buf = (char*) buf + ret;
+        len -= ret;
+        off += ret;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Opens the full-text index of the message log. The index file is mapped
+ *  and the messages logged after it has been written are indexed. The
+ *  index is disabled if the message log is.
+ *  @param si Pointer to search index
+ *  @param ml Pointer to message log
+ *  @return 0 on success, -1 on error
+ */
+int
+init_search_index(search_index_t* si, msg_log_t* ml)
+{
+    ml_segment_t* s;
+    ml_rec_t* r;
+    char* content;
+    int len;
+    size_t off;
+    int seg;
+
+    memset(si, 0, sizeof(*si));
+
+    if (!ml->used)
+    {
+        return 0;
+    }
+
+    snprintf(si->path, sizeof(si->path), SI_FILE_NAME, ml->dir);
+
+    if ((si->list = calloc(SI_MIN_LISTS, sizeof(si_list_t))) == NULL)
+    {
+        ui_fatal("Memory allocation for search index failed!");
+    }
+
+    si->cap = SI_MIN_LISTS;
+
+    // the index of a log, that has been removed, is rebuilt
+    if (si_load(si) == -1 || si->last >= ml->next_seq)
+    {
+        if (si->map != NULL)
+        {
+            munmap(si->map, si->size);
+        }
+
+        si->map = NULL;
+        si->term = NULL;
+        si->terms = 0;
+        si->last = 0;
+    }
+
+    if (ml_find(ml, 0, si->last, &seg, &off) == 0)
+    {
+        for (; seg < ml->used; seg++, off = 0)
+        {
+            s = &ml->seg[seg];
+
+            for (; off < s->used; off += ML_REC_SIZE(r->id_len, r->len))
+            {
+                r = (ml_rec_t*) (s->map + off);
+
+                if ((content = ml_content(r, &len)) != NULL &&
+                    si_add(si, ml, r->seq, content, len) == -1)
+                {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    ui_log(LOG_INFO, "Search index '%s': %u terms, %lu messages indexed from the log!",
+           si->path, si->terms, si->indexed);
+    return 0;
+}
+
+
+/**
+ *  Merges the new posting lists into the index file and closes the index.
+ *  @param si Pointer to search index
+ *  @param ml Pointer to message log
+ */
+void
+destroy_search_index(search_index_t* si, msg_log_t* ml)
+{
+    if (si->path[0] == '\0')
+    {
+        return;
+    }
+
+    si_merge(si, ml);
+
+    for (int i = 0; i < si->cap; i++)
+    {
+        free(si->list[i].post);
+    }
+
+    if (si->map != NULL)
+    {
+        munmap(si->map, si->size);
+    }
+
+    free(si->list);
+    si->list = NULL;
+    si->map = NULL;
+    si->path[0] = '\0';
+}
+
+
+/**
+ *  Adds the terms of a message, that has been logged, to the index. The
+ *  new posting lists are merged into the index file as soon as they
+ *  exceed SI_MERGE_BYTES.
+ *  @param si      Pointer to search index
+ *  @param ml      Pointer to message log
+ *  @param seq     Sequence number of the record of the message
+ *  @param content Content of message
+ *  @param len     Length of content
+ *  @return 0 on success or if the index is disabled, -1 on error
+ */
+int
+si_add(search_index_t* si, msg_log_t* ml, uint64_t seq, char* content, int len)
+{
+    char token[SI_MAX_TOKEN + 1];
+    char* end = content + len;
+
+    // messages are indexed in the order they have been logged
+    if (si->path[0] == '\0' || seq <= si->last)
+    {
+        return 0;
+    }
+
+    while (si_token(&content, end, token))
+    {
+        si_post(si, token, seq);
+    }
+
+    si->last = seq;
+    si->indexed++;
+
+    if (si->bytes >= SI_MERGE_BYTES)
+    {
+        return si_merge(si, ml);
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Appends a message to the new posting list of a term.
+ *  @param si    Pointer to search index
+ *  @param token Term
+ *  @param seq   Sequence number of the message
+ *  @return 0
+ */
+int
+si_post(search_index_t* si, char* token, uint64_t seq)
+{
+    si_list_t* l = si_list(si, token, 1);
+    int len;
+
+    // term occurs several times in the message
+    if (l->count && l->last == seq)
+    {
+        return 0;
+    }
+
+    if (l->len + MAX_VARINT_LEN > l->size)
+    {
+        l->size = l->size ? l->size * 2 : SI_MIN_POSTINGS;
+
+        if ((l->post = realloc(l->post, l->size)) == NULL)
+        {
+            ui_fatal("Memory allocation for posting list failed!");
+        }
+    }
+
+    // the first message of the list is stored as is
+    len = put_varint(l->count ? seq - l->last : seq, l->post + l->len);
+    l->len += len;
+    l->count++;
+    l->last = seq;
+    si->bytes += len;
+    return 0;
+}
+
+
+/**
+ *  Merges the new posting lists with the lists of the index file into a
+ *  new index file, which replaces the old one. The messages of segments,
+ *  that have been removed from the log, are dropped from the lists.
+ *  @param si Pointer to search index
+ *  @param ml Pointer to message log
+ *  @return 0 on success or if there is nothing to merge, -1 on error
+ */
+int
+si_merge(search_index_t* si, msg_log_t* ml)
+{
+    char tmp[sizeof(si->path) + sizeof(SI_TMP_EXT)];
+    si_list_t** sorted;         // new posting lists sorted by term
+    int amount = 0;             // amount of new posting lists
+    si_term_t* table;           // terms of new index file
+    uint32_t terms = 0;         // amount of terms of new index file
+    si_hdr_t hdr;
+    uint64_t* seqs = NULL;      // decoded posting list
+    int size = 0;               // size of seqs
+    int count;                  // messages in seqs
+    int skip;                   // messages of removed segments in seqs
+    unsigned char* buf = NULL;  // encoded posting list
+    int bsize = 0;              // size of buf
+    int len;
+    uint64_t first = ml->used ? ml->seg[0].first : 0;
+    size_t off;
+    uint32_t i = 0;
+    int j = 0;
+    int cmp;
+    int fd;
+    int ret = 0;
+
+    if (si->path[0] == '\0' || !si->lists)
+    {
+        return 0;
+    }
+
+    if ((sorted = malloc(si->lists * sizeof(si_list_t*))) == NULL ||
+        (table = calloc(si->terms + si->lists, sizeof(si_term_t))) == NULL)
+    {
+        ui_fatal("Memory allocation for search index failed!");
+    }
+
+    for (int k = 0; k < si->cap; k++)
+    {
+        if (si->list[k].token[0] != '\0')
+        {
+            sorted[amount++] = &si->list[k];
+        }
+    }
+
+    qsort(sorted, amount, sizeof(si_list_t*), si_cmp_list);
+    snprintf(tmp, sizeof(tmp), "%s" SI_TMP_EXT, si->path);
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Could not create search index '%s'!", tmp);
+        free(sorted);
+        free(table);
+        return -1;
+    }
+
+    // the posting lists follow the terms, some of which may be dropped
+    off = sizeof(si_hdr_t) + (si->terms + si->lists) * sizeof(si_term_t);
+
+    while (i < si->terms || j < amount)
+    {
+        cmp = i == si->terms ? 1 : j == amount ? -1 : strcmp(si->term[i].token,
+                                                             sorted[j]->token);
+        count = 0;
+
+        if (cmp <= 0)
+        {
+            strcpy(table[terms].token, si->term[i].token);
+
+            if (si->term[i].off + si->term[i].len > si->size ||
+                (count = si_decode(si->map + si->term[i].off, si->term[i].len, &seqs, 0,
+                                   &size)) == -1)
+            {
+                count = 0;
+            }
+
+            i++;
+        }
+
+        // the new messages follow the messages of the index file
+        if (cmp >= 0)
+        {
+            strcpy(table[terms].token, sorted[j]->token);
+
+            if ((len = si_decode(sorted[j]->post, sorted[j]->len, &seqs, count, &size)) != -1)
+            {
+                count = len;
+            }
+
+            j++;
+        }
+
+        for (skip = 0; skip < count && seqs[skip] < first; skip++);
+
+        if (skip == count)
+        {
+            continue;
+        }
+
+        if ((count - skip) * MAX_VARINT_LEN > bsize)
+        {
+            bsize = (count - skip) * MAX_VARINT_LEN;
+
+            if ((buf = realloc(buf, bsize)) == NULL)
+            {
+                ui_fatal("Memory allocation for posting list failed!");
+            }
+        }
+
+        len = si_encode(seqs + skip, count - skip, buf);
+
+        if (si_pwrite(fd, buf, len, off) == -1)
+        {
+            ret = -1;
+            break;
+        }
+
+        table[terms].off = off;
+        table[terms].len = len;
+        table[terms++].count = count - skip;
+        off += len;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SI_MAGIC, sizeof(hdr.magic));
+    hdr.last = si->last;
+    hdr.terms = terms;
+
+    if (ret == -1 || si_pwrite(fd, &hdr, sizeof(hdr), 0) == -1 ||
+        si_pwrite(fd, table, terms * sizeof(si_term_t), sizeof(hdr)) == -1 ||
+        fdatasync(fd) == -1)
+    {
+        ui_log_errno(LOG_ERR, "Could not write search index '%s'!", tmp);
+        ret = -1;
+    }
+
+    close(fd);
+    free(sorted);
+    free(table);
+    free(seqs);
+    free(buf);
+
+    if (ret == -1 || rename(tmp, si->path) == -1)
+    {
+        if (ret != -1)
+        {
+            ui_log_errno(LOG_ERR, "Could not replace search index '%s'!", si->path);
+        }
+
+        unlink(tmp);
+        return -1;
+    }
+
+    if (si->map != NULL)
+    {
+        munmap(si->map, si->size);
+    }
+
+    for (int k = 0; k < si->cap; k++)
+    {
+        free(si->list[k].post);
+    }
+
+    memset(si->list, 0, si->cap * sizeof(si_list_t));
+    si->lists = 0;
+    si->bytes = 0;
+    si->merges++;
+    return si_load(si);
+}
+
+
+/**
+ *  Maps the index file read-only.
+ *  @param si Pointer to search index
+ *  @return 0 on success or if there is no index file, -1 on error or if
+ *          the file is invalid
+ */
+int
+si_load(search_index_t* si)
+{
+    struct stat st;
+    si_hdr_t* hdr;
+    int fd;
+
+    si->map = NULL;
+    si->term = NULL;
+    si->terms = 0;
+
+    if ((fd = open(si->path, O_RDONLY)) == -1)
+    {
+        if (errno == ENOENT)
+        {
+            return 0;
+        }
+
+        ui_log_errno(LOG_WARN, "Could not open search index '%s'!", si->path);
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(si_hdr_t) ||
+        (si->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        ui_log_errno(LOG_WARN, "Could not map search index '%s'!", si->path);
+        si->map = NULL;
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    si->size = st.st_size;
+    hdr = (si_hdr_t*) si->map;
+
+    if (memcmp(hdr->magic, SI_MAGIC, sizeof(hdr->magic)) ||
+        sizeof(si_hdr_t) + (size_t) hdr->terms * sizeof(si_term_t) > si->size)
+    {
+        ui_log(LOG_WARN, "Invalid search index '%s'!", si->path);
+        return -1;
+    }
+
+    // the terms are looked up in random order
+    madvise(si->map, si->size, MADV_RANDOM);
+    si->term = (si_term_t*) (hdr + 1);
+    si->terms = hdr->terms;
+    si->last = hdr->last;
+    return 0;
+}
+
+
+/**
+ *  Searches the messages containing all terms of a query and displays the
+ *  newest SI_MAX_RESULTS of them, which are still in the log.
+ *  @param si    Pointer to search index
+ *  @param ml    Pointer to message log
+ *  @param query Terms separated by spaces or punctuation
+ *  @return 0 on success, 1 if the query has no term, -1 on error
+ */
+int
+si_query(search_index_t* si, msg_log_t* ml, char* query)
+{
+    struct timespec start;
+    struct timespec now;
+    uint64_t* seqs;
+    int count;
+    int shown = 0;
+    int k;
+
+    if (si->path[0] == '\0')
+    {
+        ui_log(LOG_WARN, "Messages can only be searched with a message log!");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if ((count = si_search(si, query, &seqs)) == -1)
+    {
+        return 1;
+    }
+
+    // newest messages still in the log
+    for (k = count; k > 0 && shown < SI_MAX_RESULTS; k--)
+    {
+        if (ml_get(ml, seqs[k - 1]) != NULL)
+        {
+            seqs[count - ++shown] = seqs[k - 1];
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (k = count - shown; k < count; k++)
+    {
+        si_print(ml, seqs[k]);
+    }
+
+    ui_log(LOG_NOTICE, "%d messages found in %ld us, %d displayed", count,
+           (now.tv_sec - start.tv_sec) * 1000000L + (now.tv_nsec - start.tv_nsec) / 1000, shown);
+    free(seqs);
+    si->queries++;
+    return 0;
+}
+
+
+/**
+ *  Searches the messages containing all terms of a query. The posting
+ *  lists are intersected starting with the shortest one.
+ *  @param si    Pointer to search index
+ *  @param query Terms separated by spaces or punctuation
+ *  @param seqs  Returns the sequence numbers of the messages in ascending
+ *               order, which have to be freed
+ *  @return amount of messages found, -1 if the query has no term
+ */
+int
+si_search(search_index_t* si, char* query, uint64_t** seqs)
+{
+    char token[SI_MAX_TOKEN + 1];
+    char* end = query + strlen(query);
+    uint64_t* lists[SI_MAX_TERMS];
+    int counts[SI_MAX_TERMS];
+    int terms = 0;
+    int shortest = 0;
+    uint64_t* l;
+    int count;
+
+    while (terms < SI_MAX_TERMS && si_token(&query, end, token))
+    {
+        counts[terms] = si_postings(si, token, &lists[terms]);
+
+        if (counts[terms] < counts[shortest])
+        {
+            shortest = terms;
+        }
+
+        terms++;
+    }
+
+    if (!terms)
+    {
+        return -1;
+    }
+
+    l = lists[shortest];
+    lists[shortest] = lists[0];
+    lists[0] = l;
+    count = counts[shortest];
+    counts[shortest] = counts[0];
+
+    for (int k = 1; k < terms; k++)
+    {
+        count = si_intersect(lists[0], count, lists[k], counts[k]);
+        free(lists[k]);
+    }
+
+    *seqs = lists[0];
+    return count;
+}
+
+
+/**
+ *  Returns the posting list of a term: the messages of the index file
+ *  followed by the new messages.
+ *  @param si    Pointer to search index
+ *  @param token Term
+ *  @param seqs  Returns the sequence numbers of the messages, which have to
+ *               be freed
+ *  @return amount of messages
+ */
+int
+si_postings(search_index_t* si, char* token, uint64_t** seqs)
+{
+    si_term_t* t;
+    si_list_t* l;
+    int count = 0;
+    int size = 0;
+    int ret;
+
+    *seqs = NULL;
+
+    if ((t = si_term(si, token)) != NULL && t->off + t->len <= si->size &&
+        (ret = si_decode(si->map + t->off, t->len, seqs, 0, &size)) != -1)
+    {
+        count = ret;
+    }
+
+    if ((l = si_list(si, token, 0)) != NULL &&
+        (ret = si_decode(l->post, l->len, seqs, count, &size)) != -1)
+    {
+        count = ret;
+    }
+
+    return count;
+}
+
+
+/**
+ *  Intersects two ascending lists of sequence numbers. Every number of the
+ *  first, shorter list is searched in the second one by galloping from the
+ *  position of its predecessor, so that a short list is intersected with a
+ *  long one in logarithmic time per number.
+ *  @param a  First list, which is replaced by the intersection
+ *  @param na Length of first list
+ *  @param b  Second list
+ *  @param nb Length of second list
+ *  @return length of intersection
+ */
+int
+si_intersect(uint64_t* a, int na, uint64_t* b, int nb)
+{
+    int n = 0;
+    int lo = 0;
+    int hi;
+    int mid;
+    int step;
+
+    for (int i = 0; i < na && lo < nb; i++)
+    {
+        for (step = 1; lo + step < nb && b[lo + step] < a[i]; step *= 2);
+
+        // first number of b not less than a[i] is in [lo, hi]
+        for (hi = lo + step < nb ? lo + step : nb; lo < hi;)
+        {
+            mid = (lo + hi) / 2;
+
+            if (b[mid] < a[i])
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        if (lo < nb && b[lo] == a[i])
+        {
+            a[n++] = a[i];
+        }
+    }
+
+    return n;
+}
+
+
+/**
+ *  Displays a message of the log with the time it has been logged and the
+ *  nickname of its author.
+ *  @param ml  Pointer to message log
+ *  @param seq Sequence number of the record
+ */
+void
+si_print(msg_log_t* ml, uint64_t seq)
+{
+    ml_rec_t* r;
+    char date[32];
+    struct tm tm;
+    time_t t;
+    char* origin;
+    char* name;
+    int olen;
+    char* content;
+    int len;
+
+    if ((r = ml_get(ml, seq)) == NULL || (content = ml_content(r, &len)) == NULL)
+    {
+        return;
+    }
+
+    t = r->time;
+    localtime_r(&t, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+    // origin: onion-id, port and nickname
+    if ((origin = ml_header(r, HDR_NAME_ORG, &olen)) == NULL)
+    {
+        origin = "";
+        olen = 0;
+    }
+
+    name = origin;
+
+    for (int spaces = 0; spaces < 2 && (name = memchr(name, ' ', origin + olen - name)) != NULL;
+         spaces++)
+    {
+        name++;
+    }
+
+    if (name == NULL || name == origin + olen)
+    {
+        name = origin;
+        olen = strcspn(origin, " \n");
+    }
+    else
+    {
+        olen -= name - origin;
+    }
+
+    for (; len && isspace((unsigned char) content[len - 1]); len--);
+
+    ui_log(LOG_NOTICE, "[%s] %.*s: %.*s", date, olen, name, len, content);
+}
+
+
+/**
+ *  Reads the next term of a text: a word of letters and digits, which is
+ *  converted to lowercase and cut to SI_MAX_TOKEN bytes. Bytes of UTF-8
+ *  sequences are part of words. Words shorter than SI_MIN_TOKEN are
+ *  skipped.
+ *  @param p     Pointer to the position in the text, which is advanced
+ *  @param end   End of text
+ *  @param token Buffer of SI_MAX_TOKEN + 1 bytes for the term
+ *  @return length of term, 0 if the text has no more terms
+ */
+int
+si_token(char** p, char* end, char* token)
+{
+    unsigned char c;
+    int len;
+
+    while (*p < end)
+    {
+        for (len = 0; *p < end; (*p)++)
+        {
+            c = **p;
+
+            if (!isalnum(c) && c < 0x80)
+            {
+                break;
+            }
+
+            if (len < SI_MAX_TOKEN)
+            {
+                token[len++] = tolower(c);
+            }
+        }
+
+        if (*p < end)
+        {
+            (*p)++;
+        }
+
+        if (len >= SI_MIN_TOKEN)
+        {
+            token[len] = '\0';
+            return len;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Searches the new posting list of a term in the hash table.
+ *  @param si     Pointer to search index
+ *  @param token  Term
+ *  @param create Adds an empty list if the term is not found
+ *  @return pointer to posting list, NULL if it is not found
+ */
+si_list_t*
+si_list(search_index_t* si, char* token, int create)
+{
+    uint32_t mask = si->cap - 1;
+    uint32_t i = fnv_hash(FNV_OFFSET, token, strlen(token)) & mask;
+    si_list_t* old = si->list;
+    int cap = si->cap;
+
+    for (; si->list[i].token[0] != '\0'; i = (i + 1) & mask)
+    {
+        if (!strcmp(si->list[i].token, token))
+        {
+            return &si->list[i];
+        }
+    }
+
+    if (!create)
+    {
+        return NULL;
+    }
+
+    // the table is kept at most 3/4 full
+    if ((si->lists + 1) * 4 > si->cap * 3)
+    {
+        if ((si->list = calloc(cap * 2, sizeof(si_list_t))) == NULL)
+        {
+            ui_fatal("Memory allocation for search index failed!");
+        }
+
+        si->cap = cap * 2;
+        si->lists = 0;
+
+        for (int k = 0; k < cap; k++)
+        {
+            if (old[k].token[0] != '\0')
+            {
+                *si_list(si, old[k].token, 1) = old[k];
+            }
+        }
+
+        free(old);
+        return si_list(si, token, 1);
+    }
+
+    strcpy(si->list[i].token, token);
+    si->lists++;
+    return &si->list[i];
+}
+
+
+/**
+ *  Searches a term in the sorted terms of the index file.
+ *  @param si    Pointer to search index
+ *  @param token Term
+ *  @return pointer to term, NULL if it is not found
+ */
+si_term_t*
+si_term(search_index_t* si, char* token)
+{
+    uint32_t lo = 0;
+    uint32_t hi = si->terms;
+    uint32_t mid;
+    int cmp;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if (!(cmp = strncmp(token, si->term[mid].token, SI_MAX_TOKEN + 1)))
+        {
+            return &si->term[mid];
+        }
+
+        if (cmp < 0)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ *  Decodes a posting list and appends its sequence numbers to an array.
+ *  @param post  Posting list
+ *  @param len   Bytes of posting list
+ *  @param seqs  Array, which is grown as needed
+ *  @param count Sequence numbers in the array
+ *  @param size  Size of the array, which is updated
+ *  @return amount of sequence numbers in the array, -1 if the list is
+ *          invalid
+ */
+int
+si_decode(unsigned char* post, int len, uint64_t** seqs, int count, int* size)
+{
+    uint64_t seq = 0;
+    uint64_t delta;
+    int n;
+
+    for (int pos = 0; pos < len; pos += n)
+    {
+        if ((n = get_varint(post + pos, len - pos, &delta)) == -1)
+        {
+            return -1;
+        }
+
+        if (count == *size)
+        {
+            *size = *size ? *size * 2 : SI_MIN_POSTINGS;
+
+            if ((*seqs = realloc(*seqs, *size * sizeof(uint64_t))) == NULL)
+            {
+                ui_fatal("Memory allocation for posting list failed!");
+            }
+        }
+
+        seq += delta;
+        (*seqs)[count++] = seq;
+    }
+
+    return count;
+}
+
+
+/**
+ *  Encodes ascending sequence numbers as posting list (see: si_post()).
+ *  @param seqs  Sequence numbers
+ *  @param count Amount of sequence numbers
+ *  @param buf   Buffer of at least count * MAX_VARINT_LEN bytes
+ *  @return bytes of posting list
+ */
+int
+si_encode(uint64_t* seqs, int count, unsigned char* buf)
+{
+    uint64_t prev = 0;
+    int len = 0;
+
+    for (int k = 0; k < count; k++)
+    {
+        len += put_varint(seqs[k] - prev, buf + len);
+        prev = seqs[k];
+    }
+
+    return len;
+}
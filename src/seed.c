@@ -0,0 +1,497 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file seed.c
+ *  This file contains the bootstrap from a list of seeds. All seeds of the
+ *  seed file are probed at once: for each of them a non-blocking connection
+ *  to a TOR client of the SOCKS pool is opened and a SOCKS request is sent.
+ *  The seeds whose circuits are built first are added as contacts, all
+ *  other probes are canceled, so that the startup only waits for the
+ *  fastest seeds.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dchat_h/seed.h"
+#include "dchat_h/dchat.h"
+#include "dchat_h/types.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/cache.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Reads the seed file.
+ *  Each line of the seed file contains the onion address and optionally
+ *  the listening port of a seed: "<onion-id> [<port>]\n". Empty lines and
+ *  lines starting with '#' are skipped, invalid lines are skipped with a
+ *  warning. If no port is given, DEFAULT_PORT will be used.
+ *  @param sl Pointer to seed list, whose path has been set
+ *  @return amount of seeds read, -1 if file could not be read
+ */
+int
+read_seeds(seed_list_t* sl)
+{
+    FILE* f;           // seed file stream
+    char* line;        // read line of seed file
+    char* onion_id;    // onion address of seed
+    char* port;        // port of seed
+    char* save;        // context of strtok_r
+    char* term;        // end of port
+    long lport;        // parsed port
+    int lctr = 0;      // line counter
+
+    if ((f = fopen(sl->path, "r")) == NULL)
+    {
+        ui_log_errno(LOG_ERR, "Could not read seed file '%s'!", sl->path);
+        return -1;
+    }
+
+    while (read_line(fileno(f), &line) > 0)
+    {
+        lctr++;
+
+        if ((onion_id = strtok_r(line, " \t\r\n", &save)) == NULL || onion_id[0] == '#')
+        {
+            free(line);
+            continue;
+        }
+
+        lport = DEFAULT_PORT;
+
+        if ((port = strtok_r(NULL, " \t\r\n", &save)) != NULL)
+        {
+            lport = strtol(port, &term, 10);
+
+            if (*term != '\0')
+            {
+                lport = 0;
+            }
+        }
+
+        if (!is_valid_onion(onion_id) || !is_valid_port(lport) ||
+            strtok_r(NULL, " \t\r\n", &save) != NULL)
+        {
+            ui_log(LOG_WARN, "Invalid seed in line '%d' of seed file!", lctr);
+        }
+        else if (sl->used == SEED_MAX)
+        {
+            ui_log(LOG_WARN, "More than %d seeds - skipped line '%d' of seed file!",
+                   SEED_MAX, lctr);
+        }
+        else
+        {
+            memset(&sl->seed[sl->used], 0, sizeof(seed_t));
+            strncat(sl->seed[sl->used].onion_id, onion_id, ONION_ADDRLEN);
+            sl->seed[sl->used].lport = lport;
+            sl->seed[sl->used].fd = -1;
+            sl->used++;
+        }
+
+        free(line);
+    }
+
+    fclose(f);
+    return sl->used;
+}
+
+
+/**
+ *  Starts the thread probing the seeds (see: th_probe_seeds()).
+ *  In overlay mode at most as many seeds as fit into the active view are
+ *  kept.
+ *  @param sl Pointer to seed list
+ *  @return 0 on success or if there are no seeds, -1 in case of error
+ */
+int
+start_seed_probe(seed_list_t* sl)
+{
+    if (!sl->used)
+    {
+        return 0;
+    }
+
+    if (!sl->keep)
+    {
+        sl->keep = SEED_DEF_KEEP;
+    }
+
+    if (_cnf->ovl.enabled && sl->keep > _cnf->ovl.degree)
+    {
+        sl->keep = _cnf->ovl.degree;
+    }
+
+    if (pthread_create(&sl->probe_th, NULL, th_probe_seeds, sl))
+    {
+        ui_log_errno(LOG_ERR, "Creation of seed probe thread failed!");
+        return -1;
+    }
+
+    sl->probing = 1;
+    return 0;
+}
+
+
+/**
+ *  Cancels and joins the thread probing the seeds.
+ *  @param sl Pointer to seed list
+ */
+void
+destroy_seeds(seed_list_t* sl)
+{
+    if (sl->probing)
+    {
+        pthread_cancel(sl->probe_th);
+        pthread_join(sl->probe_th, NULL);
+        sl->probing = 0;
+    }
+}
+
+
+/**
+ *  Thread function that probes all seeds concurrently.
+ *  The probes are driven by poll(2) until `keep` seeds completed the SOCKS
+ *  handshake, all probes finished or SEED_TIMEOUT seconds passed. A seed
+ *  completing the handshake is added as contact (see: add_tor_contact())
+ *  as long as less than `keep` seeds have been added. All remaining probes
+ *  are canceled. Connect times and failures are recorded in the contact
+ *  cache.
+ *  @param arg Pointer to seed list
+ *  @return NULL
+ */
+void*
+th_probe_seeds(void* arg)
+{
+    seed_list_t* sl = arg;
+    seed_t* seed;
+    struct pollfd pfd[SEED_MAX]; // sockets of pending probes
+    int idx[SEED_MAX];           // index of seed of each socket
+    struct timespec end;         // end of probe
+    time_t deadline = time(NULL) + SEED_TIMEOUT;
+    char c = '1';                // signal that a new contact has been added
+    int nfds;
+    int ret;
+    int i;
+    pthread_cleanup_push(cleanup_th_probe_seeds, sl);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    for (i = 0; i < sl->used; i++)
+    {
+        // skip ourself
+        if (sl->seed[i].lport == _cnf->me.lport &&
+            !strcmp(sl->seed[i].onion_id, _cnf->me.onion_id))
+        {
+            sl->seed[i].state = SEED_DONE;
+        }
+        else if (start_probe(&sl->seed[i]) == -1)
+        {
+            sl->failed++;
+        }
+    }
+
+    while (sl->kept < sl->keep && time(NULL) < deadline)
+    {
+        for (nfds = 0, i = 0; i < sl->used; i++)
+        {
+            if (sl->seed[i].state == SEED_CONNECTING || sl->seed[i].state == SEED_REQUESTED)
+            {
+                pfd[nfds].fd = sl->seed[i].fd;
+                pfd[nfds].events = sl->seed[i].state == SEED_CONNECTING ? POLLOUT : POLLIN;
+                pfd[nfds].revents = 0;
+                idx[nfds++] = i;
+            }
+        }
+
+        // all probes finished
+        if (!nfds)
+        {
+            break;
+        }
+
+        if (poll(pfd, nfds, 1000) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            ui_log_errno(LOG_ERR, "poll() failed while probing seeds!");
+            break;
+        }
+
+        for (i = 0; i < nfds && sl->kept < sl->keep; i++)
+        {
+            if (!pfd[i].revents)
+            {
+                continue;
+            }
+
+            seed = &sl->seed[idx[i]];
+
+            if ((ret = continue_probe(seed, pfd[i].revents)) == -1)
+            {
+                sl->failed++;
+                cache_failure(&_cnf->cache, seed->onion_id, seed->lport);
+            }
+            else if (ret == 1)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                cache_success(&_cnf->cache, seed->onion_id, seed->lport,
+                              (end.tv_sec - seed->start.tv_sec) * 1000 +
+                              (end.tv_nsec - seed->start.tv_nsec) / 1000000);
+
+                // socket is closed by add_tor_contact() on error
+                if (add_tor_contact(seed->fd, seed->onion_id, seed->lport, CONN_PRIO_USER, 0) >= 0)
+                {
+                    ui_log(LOG_INFO, "Connected to seed '%s:%hu'!", seed->onion_id, seed->lport);
+                    sl->kept++;
+
+                    if (write(_cnf->cl_change[1], &c, sizeof(c)) == -1)
+                    {
+                        ui_log(LOG_WARN, "Could not write to change pipe!");
+                    }
+                }
+
+                seed->fd = -1;
+            }
+        }
+    }
+
+    pthread_cleanup_pop(1);
+    return NULL;
+}
+
+
+/**
+ *  Starts the probe of a seed by connecting to a TOR client of the SOCKS
+ *  pool without blocking (see: acquire_socks_endpoint()). With the direct
+ *  transport the seed itself is connected to (see: direct_route()).
+ *  @param seed Pointer to seed
+ *  @return 0 on success, -1 in case of error
+ */
+int
+start_probe(seed_t* seed)
+{
+    struct sockaddr_in da; // socket address of TOR client
+
+    seed->state = SEED_DONE;
+    seed->ep = -1;
+
+    if (!_cnf->tp.transport.socks &&
+        direct_route(&_cnf->tp, seed->onion_id, seed->lport, &da) == -1)
+    {
+        ui_log(LOG_ERR, "No route to seed '%s:%hu'!", seed->onion_id, seed->lport);
+        return -1;
+    }
+
+    if ((seed->fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+    {
+        ui_log_errno(LOG_ERR, "socket() failed in start_probe()");
+        return -1;
+    }
+
+    if (_cnf->tp.transport.socks)
+    {
+        seed->grp = socks_isolation(&_cnf->socks, seed->onion_id, seed->lport, seed->user);
+        seed->ep = acquire_socks_endpoint(&_cnf->socks, 0, &da);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &seed->start);
+
+    if (fcntl(seed->fd, F_SETFL, fcntl(seed->fd, F_GETFL) | O_NONBLOCK) == -1 ||
+        (connect(seed->fd, (struct sockaddr*) &da, sizeof(da)) == -1 &&
+         errno != EINPROGRESS))
+    {
+        ui_log_errno(LOG_ERR, "Could not connect to TOR client!");
+        release_probe(seed, SOCKS_EP_FAILED);
+        close(seed->fd);
+        seed->fd = -1;
+        return -1;
+    }
+
+    seed->state = SEED_CONNECTING;
+    return 0;
+}
+
+
+/**
+ *  Continues the probe of a seed, whose socket is ready.
+ *  As soon as the connection to the TOR client has been established, the
+ *  SOCKS request is sent (with the direct transport the handshake is
+ *  completed by the connect). Afterwards the SOCKS response is read. If the
+ *  request has been granted, the socket is switched back to blocking mode.
+ *  @param seed    Pointer to seed
+ *  @param revents Events returned by poll(2)
+ *  @return 1 if the handshake has been completed, 0 if it is still in
+ *  progress or -1 if it failed (socket will be closed)
+ */
+int
+continue_probe(seed_t* seed, short revents)
+{
+    int version = _cnf->socks.version;
+    int auth = seed->user[0] != '\0';
+    int err = 0;       // error of non-blocking connect
+    socklen_t len = sizeof(err);
+    int result = SOCKS_EP_FAILED; // result recorded in the SOCKS pool
+    int want;          // length of SOCKS response
+    int ret;
+
+    if (seed->state == SEED_CONNECTING)
+    {
+        if (getsockopt(seed->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err)
+        {
+            ui_log(LOG_ERR, "Could not connect to TOR client!");
+            ret = -1;
+        }
+        // direct transport, the seed itself has been connected to
+        else if (!_cnf->tp.transport.socks)
+        {
+            fcntl(seed->fd, F_SETFL, fcntl(seed->fd, F_GETFL) & ~O_NONBLOCK);
+            seed->state = SEED_DONE;
+            return 1;
+        }
+        else
+        {
+            // the request fits into the empty socket buffer
+            if ((ret = write_socks_request(seed->fd, version, seed->user, seed->onion_id,
+                                           seed->lport, NULL, 0)) == -1)
+            {
+                ui_log_errno(LOG_ERR, "Could not write SOCKS connection request!");
+            }
+
+            seed->state = SEED_REQUESTED;
+        }
+    }
+    else
+    {
+        // read no more than the response, so that data of the seed is kept
+        want = socks_reply_len(version, auth, seed->resp, seed->resp_len);
+
+        if ((ret = read(seed->fd, seed->resp + seed->resp_len, want - seed->resp_len)) <= 0)
+        {
+            if (ret == -1 && errno == EAGAIN)
+            {
+                return 0;
+            }
+
+            ret = -1;
+        }
+        else if ((want = socks_reply_len(version, auth, seed->resp, seed->resp_len += ret)) == -1)
+        {
+            ui_log(LOG_ERR, "Invalid SOCKS response for seed '%s:%hu'!", seed->onion_id,
+                   seed->lport);
+            ret = -1;
+        }
+        else if (seed->resp_len < want)
+        {
+            ret = 0;
+        }
+        else if ((ret = socks_reply_status(version, auth, seed->resp)))
+        {
+            ui_log(LOG_WARN, "Seed '%s:%hu' not reachable. Status code: %d - '%s'",
+                   seed->onion_id, seed->lport, ret, parse_socks_status(version, ret));
+            result = SOCKS_EP_REJECTED;
+            ret = -1;
+        }
+        else
+        {
+            fcntl(seed->fd, F_SETFL, fcntl(seed->fd, F_GETFL) & ~O_NONBLOCK);
+            seed->state = SEED_DONE;
+            release_probe(seed, SOCKS_EP_OK);
+            return 1;
+        }
+    }
+
+    if (ret == -1)
+    {
+        release_probe(seed, result);
+        close(seed->fd);
+        seed->fd = -1;
+        seed->state = SEED_DONE;
+    }
+
+    return ret == -1 ? -1 : 0;
+}
+
+
+/**
+ *  Records the result of a probe in the SOCKS pool, unless the seed has
+ *  been connected to directly.
+ *  @param seed   Pointer to seed
+ *  @param result Result of the probe (see: SOCKS_EP_*)
+ */
+void
+release_probe(seed_t* seed, int result)
+{
+    struct timespec now;
+
+    if (seed->ep == -1)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    release_socks_endpoint(&_cnf->socks, seed->ep, seed->grp, result,
+                           (now.tv_sec - seed->start.tv_sec) * 1000 +
+                           (now.tv_nsec - seed->start.tv_nsec) / 1000000);
+}
+
+
+/**
+ *  Cancels all probes, which are still in progress.
+ *  @param sl Pointer to seed list
+ */
+void
+cancel_probes(seed_list_t* sl)
+{
+    for (int i = 0; i < sl->used; i++)
+    {
+        if (sl->seed[i].state == SEED_CONNECTING || sl->seed[i].state == SEED_REQUESTED)
+        {
+            release_probe(&sl->seed[i], SOCKS_EP_CANCELED);
+            close(sl->seed[i].fd);
+            sl->seed[i].fd = -1;
+            sl->seed[i].state = SEED_DONE;
+            sl->canceled++;
+        }
+    }
+}
+
+
+/**
+ *  Cleanup handler of the probe thread, cancels all remaining probes.
+ *  @param arg Pointer to seed list
+ */
+void
+cleanup_th_probe_seeds(void* arg)
+{
+    cancel_probes(arg);
+}
@@ -0,0 +1,179 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file seen.c
+ *  This file contains the set of recently seen message ids, which is used
+ *  to drop duplicates of messages that reach a client over several paths.
+ *  The set is a time-bucketed Bloom filter: its memory is fixed, lookups
+ *  take constant time and ids are forgotten after a while. Memory and false
+ *  positive rate are configurable, the amount of hash functions and the
+ *  capacity of the buckets are derived from them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dchat_h/seen.h"
+#include "dchat_h/util.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Initializes a seen-set.
+ *  Memory and false positive rate keep the values set by the command line
+ *  options, if they have not been set the defaults will be used. Since a
+ *  lookup checks every bucket, each bucket uses a false positive rate of
+ *  fpr / SEEN_BUCKETS. The amount of hash functions k is the smallest
+ *  one with 2^-k below this rate, the capacity of a bucket with m bits is
+ *  m * ln(2) / k ids, which is the optimum for k hash functions.
+ *  @param ss Pointer to seen-set
+ *  @return 0 on success, -1 in case of error
+ */
+int
+init_seen(seen_set_t* ss)
+{
+    double rate; // false positive rate per bucket
+
+    if (!ss->memory)
+    {
+        ss->memory = SEEN_DEF_MEMORY;
+    }
+
+    if (ss->fpr <= 0)
+    {
+        ss->fpr = SEEN_DEF_FPR;
+    }
+
+    ss->bucket_bits = ss->memory * 1024 * 8 / SEEN_BUCKETS;
+
+    for (ss->hashes = 0, rate = 1; rate > ss->fpr / SEEN_BUCKETS &&
+         ss->hashes < SEEN_MAX_HASHES; rate /= 2)
+    {
+        ss->hashes++;
+    }
+
+    ss->capacity = (int) (ss->bucket_bits * SEEN_LN2 / ss->hashes);
+
+    if ((ss->bits = calloc(ss->memory, 1024)) == NULL)
+    {
+        ui_log_errno(LOG_ERR, "Memory allocation for seen-set failed!");
+        return -1;
+    }
+
+    ss->current = 0;
+    ss->inserted = 0;
+    ss->bucket_start = time(NULL);
+    return 0;
+}
+
+
+/**
+ *  Frees all resources of a seen-set.
+ *  @param ss Pointer to seen-set
+ */
+void
+destroy_seen(seen_set_t* ss)
+{
+    free(ss->bits);
+    ss->bits = NULL;
+}
+
+
+/**
+ *  Checks if an id has been seen before and adds it to the seen-set.
+ *  The bit positions are derived from two FNV-1a hashes of the id (double
+ *  hashing), thus a lookup takes constant time. The id is considered seen,
+ *  if all of its bits are set in one of the buckets. Otherwise it will be
+ *  added to the current bucket.
+ *  @param ss  Pointer to seen-set
+ *  @param id  Id to check
+ *  @param len Length of id
+ *  @return 1 if id has (probably) been seen before, 0 otherwise
+ */
+int
+check_seen(seen_set_t* ss, char* id, int len)
+{
+    uint32_t h1, h2; // hashes of id
+    uint8_t* bucket; // bits of a bucket
+    size_t bit;      // index of bit within a bucket
+    int b, i;
+
+    if (time(NULL) - ss->bucket_start >= SEEN_BUCKET_SECS ||
+        ss->inserted >= ss->capacity)
+    {
+        rotate_seen(ss);
+    }
+
+    ss->lookups++;
+    h1 = fnv_hash(FNV_OFFSET, id, len);
+    // second hash must be odd, so that all bits can be reached
+    h2 = fnv_hash(h1, id, len) | 1;
+
+    for (b = 0; b < SEEN_BUCKETS; b++)
+    {
+        bucket = ss->bits + b * (ss->bucket_bits / 8);
+
+        for (i = 0; i < ss->hashes; i++)
+        {
+            bit = (h1 + (uint32_t) i * h2) % ss->bucket_bits;
+
+            if (!(bucket[bit / 8] & (1 << (bit % 8))))
+            {
+                break;
+            }
+        }
+
+        if (i == ss->hashes)
+        {
+            ss->dups++;
+            return 1;
+        }
+    }
+
+    bucket = ss->bits + ss->current * (ss->bucket_bits / 8);
+
+    for (i = 0; i < ss->hashes; i++)
+    {
+        bit = (h1 + (uint32_t) i * h2) % ss->bucket_bits;
+        bucket[bit / 8] |= 1 << (bit % 8);
+    }
+
+    ss->inserted++;
+    return 0;
+}
+
+
+/**
+ *  Clears the oldest bucket of a seen-set and makes it the current one.
+ *  @param ss Pointer to seen-set
+ */
+void
+rotate_seen(seen_set_t* ss)
+{
+    ss->current = (ss->current + 1) % SEEN_BUCKETS;
+    memset(ss->bits + ss->current * (ss->bucket_bits / 8), 0, ss->bucket_bits / 8);
+    ss->inserted = 0;
+    ss->bucket_start = time(NULL);
+}
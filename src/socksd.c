@@ -0,0 +1,598 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file socksd.c
+ *  This file contains a SOCKS4a/5 stand-in for a TOR client, used to
+ *  load-test DChat on a single host. Every destination is mapped to a local
+ *  address keeping the requested port. The time TOR needs to build circuits
+ *  and to connect streams is emulated: a stream is delayed by the connect
+ *  time plus a random jitter, and additionally by the circuit build time, if
+ *  no circuit has been built for its isolation key (SOCKS username) within
+ *  the last SD_DIRTINESS seconds. A percentage of streams can be rejected
+ *  and the bandwidth of a stream can be limited.
+ *
+ *  Usage: dchat-socksd [-a ADDR] [-c MS] [-d MS] [-j MS] [-f PERCENT] [-b KBPS]
+ *         [IP:]PORT
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dchat_h/socksd.h"
+
+
+static sd_conf_t sd_;   //!< configuration of the stand-in
+
+
+/**
+ *  Prints the usage of the stand-in and exits.
+ *  @param name Name of the program
+ */
+static void
+sd_usage(char* name)
+{
+    fprintf(stderr, "Usage: %s [-a ADDR] [-c MS] [-d MS] [-j MS] [-f PERCENT] "
+            "[-b KBPS] [IP:]PORT\n"
+            "    -a  address every destination is mapped to (default %s)\n"
+            "    -c  time to build a circuit per isolation key in ms\n"
+            "    -d  time to connect a stream in ms\n"
+            "    -j  max. random delay added to every stream in ms\n"
+            "    -f  percentage of streams rejected\n"
+            "    -b  max. KB/s relayed per stream and direction\n", name, SD_DEF_TARGET);
+    exit(EXIT_FAILURE);
+}
+
+
+/**
+ *  Parses a non-negative integer command line argument.
+ *  @param value Argument string
+ *  @param max   Max. valid value
+ *  @return parsed value or -1 if invalid
+ */
+static int
+sd_parse_int(char* value, long max)
+{
+    char* term;
+    long n = strtol(value, &term, 10);
+
+    return *term != '\0' || n < 0 || n > max ? -1 : (int) n;
+}
+
+
+int
+main(int argc, char** argv)
+{
+    char* port;         // port part of listening address
+    int opt;            // option character
+    int s;              // listening socket
+    int c;              // accepted socket
+    int* arg;           // socket passed to stream thread
+    int on = 1;
+    pthread_t th;
+    pthread_attr_t attr;
+
+    memset(&sd_, 0, sizeof(sd_));
+    inet_pton(AF_INET, SD_DEF_TARGET, &sd_.target);
+    sd_.listen.sin_family = AF_INET;
+    inet_pton(AF_INET, TOR_ADDR, &sd_.listen.sin_addr);
+
+    while ((opt = getopt(argc, argv, "a:c:d:j:f:b:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'a':
+                if (inet_pton(AF_INET, optarg, &sd_.target) != 1)
+                {
+                    sd_usage(argv[0]);
+                }
+
+                break;
+
+            case 'c':
+                sd_.circuit_ms = sd_parse_int(optarg, 3600000);
+                break;
+
+            case 'd':
+                sd_.connect_ms = sd_parse_int(optarg, 3600000);
+                break;
+
+            case 'j':
+                sd_.jitter_ms = sd_parse_int(optarg, 3600000);
+                break;
+
+            case 'f':
+                sd_.fail_pct = sd_parse_int(optarg, 100);
+                break;
+
+            case 'b':
+                sd_.kbps = sd_parse_int(optarg, 10000000);
+                break;
+
+            default:
+                sd_usage(argv[0]);
+        }
+
+        if (sd_.circuit_ms == -1 || sd_.connect_ms == -1 || sd_.jitter_ms == -1 ||
+            sd_.fail_pct == -1 || sd_.kbps == -1)
+        {
+            sd_usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        sd_usage(argv[0]);
+    }
+
+    // listening address: "<ip>:<port>" or "<port>"
+    if ((port = strchr(argv[optind], ':')) != NULL)
+    {
+        *port++ = '\0';
+
+        if (inet_pton(AF_INET, argv[optind], &sd_.listen.sin_addr) != 1)
+        {
+            sd_usage(argv[0]);
+        }
+    }
+    else
+    {
+        port = argv[optind];
+    }
+
+    if ((opt = sd_parse_int(port, 65535)) < 1)
+    {
+        sd_usage(argv[0]);
+    }
+
+    sd_.listen.sin_port = htons(opt);
+    signal(SIGPIPE, SIG_IGN);
+    srand(time(NULL) ^ getpid());
+    pthread_mutex_init(&sd_.sd_mx, NULL);
+
+    if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+        bind(s, (struct sockaddr*) &sd_.listen, sizeof(sd_.listen)) == -1 ||
+        listen(s, SD_BACKLOG) == -1)
+    {
+        perror("Could not create listening socket");
+        return EXIT_FAILURE;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    for (;;)
+    {
+        if ((c = accept(s, NULL, NULL)) == -1)
+        {
+            if (errno != EINTR && errno != ECONNABORTED)
+            {
+                perror("accept() failed");
+            }
+
+            continue;
+        }
+
+        if ((arg = malloc(sizeof(int))) == NULL)
+        {
+            close(c);
+            continue;
+        }
+
+        *arg = c;
+
+        if (pthread_create(&th, &attr, th_stream, arg))
+        {
+            perror("Could not create stream thread");
+            close(c);
+            free(arg);
+        }
+    }
+}
+
+
+/**
+ *  Thread function serving one SOCKS connection.
+ *  The request is read, the stream is delayed (see: stream_delay()) and
+ *  afterwards connected to the local address, which is relayed until one
+ *  side closes the connection.
+ *  @param arg Pointer to accepted socket, freed by the thread
+ *  @return NULL
+ */
+void*
+th_stream(void* arg)
+{
+    int c = *(int*) arg;                // socket of client
+    int d = -1;                         // socket of destination
+    char user[SOCKS_MAX_USERLEN + 1];   // isolation key
+    struct sockaddr_in da;              // local address of destination
+    struct timespec delay;
+    uint16_t rport;                     // requested port
+    int version;                        // SOCKS version of client
+    int ms;                             // delay of stream
+
+    free(arg);
+
+    if ((version = read_request(c, &rport, user)) == -1)
+    {
+        close(c);
+        return NULL;
+    }
+
+    ms = stream_delay(user);
+    delay.tv_sec = ms / 1000;
+    delay.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&delay, NULL);
+
+    memset(&da, 0, sizeof(da));
+    da.sin_family = AF_INET;
+    da.sin_addr = sd_.target;
+    da.sin_port = htons(rport);
+
+    if ((sd_.fail_pct && rand() % 100 < sd_.fail_pct) ||
+        (d = socket(AF_INET, SOCK_STREAM, 0)) == -1 ||
+        connect(d, (struct sockaddr*) &da, sizeof(da)) == -1)
+    {
+        write_reply(c, version, 0);
+    }
+    else if (write_reply(c, version, 1) != -1)
+    {
+        relay(c, d);
+    }
+
+    if (d != -1)
+    {
+        close(d);
+    }
+
+    close(c);
+    return NULL;
+}
+
+
+/**
+ *  Reads exactly the given amount of bytes.
+ *  @param fd  File descriptor to read from
+ *  @param buf Buffer
+ *  @param len Amount of bytes to read
+ *  @return 0 on success, -1 on error or EOF
+ */
+int
+read_full(int fd, void* buf, int len)
+{
+    int ret;
+
+    while (len > 0)
+    {
+        if ((ret = read(fd, buf, len)) <= 0)
+        {
+            return -1;
+        }
+
+        buf = (char*) buf + ret;
+        len -= ret;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Reads a SOCKS4a or SOCKS5 CONNECT request.
+ *  For SOCKS5 the method selection is answered, username/password
+ *  authentication is preferred and always accepted. For SOCKS4a the user
+ *  id is used as username.
+ *  @param fd    Socket of client
+ *  @param rport Pointer to which the requested port will be written
+ *  @param user  Buffer of at least SOCKS_MAX_USERLEN + 1 bytes, to which the
+ *               username will be written
+ *  @return SOCKS version of client or -1 in case of error
+ */
+int
+read_request(int fd, uint16_t* rport, char* user)
+{
+    uint8_t buf[SOCKS_MAX_HOSTLEN + 1];
+    uint8_t reply[2];
+    int n;
+
+    user[0] = '\0';
+
+    if (read_full(fd, buf, 1) == -1)
+    {
+        return -1;
+    }
+
+    if (buf[0] == SOCKS_VERSION)
+    {
+        // command, port and ip
+        if (read_full(fd, buf, 7) == -1 || buf[0] != SOCKS_CONNECT)
+        {
+            return -1;
+        }
+
+        memcpy(rport, buf + 1, 2);
+        *rport = ntohs(*rport);
+
+        // user id and hostname, both terminated by SOCKS_DELIM
+        for (int field = 0; field < 2; field++)
+        {
+            for (n = 0; ; n++)
+            {
+                if (n > SOCKS_MAX_HOSTLEN || read_full(fd, buf + n, 1) == -1)
+                {
+                    return -1;
+                }
+
+                if (buf[n] == SOCKS_DELIM)
+                {
+                    break;
+                }
+            }
+
+            if (!field)
+            {
+                memcpy(user, buf, n + 1);
+            }
+        }
+
+        return SOCKS_VERSION;
+    }
+
+    if (buf[0] != SOCKS5_VERSION || read_full(fd, buf, 1) == -1 ||
+        read_full(fd, buf + 1, buf[0]) == -1)
+    {
+        return -1;
+    }
+
+    reply[0] = SOCKS5_VERSION;
+    reply[1] = memchr(buf + 1, SOCKS5_USER_PASS, buf[0]) ? SOCKS5_USER_PASS :
+               memchr(buf + 1, SOCKS5_NO_AUTH, buf[0]) ? SOCKS5_NO_AUTH : SOCKS5_NO_METHOD;
+
+    if (write(fd, reply, 2) != 2 || reply[1] == SOCKS5_NO_METHOD)
+    {
+        return -1;
+    }
+
+    if (reply[1] == SOCKS5_USER_PASS)
+    {
+        // version and username
+        if (read_full(fd, buf, 2) == -1 || read_full(fd, user, buf[1]) == -1)
+        {
+            return -1;
+        }
+
+        user[buf[1]] = '\0';
+
+        // password
+        if (read_full(fd, buf, 1) == -1 || read_full(fd, buf + 1, buf[0]) == -1)
+        {
+            return -1;
+        }
+
+        reply[0] = SOCKS5_AUTH_VERSION;
+        reply[1] = 0x00;
+
+        if (write(fd, reply, 2) != 2)
+        {
+            return -1;
+        }
+    }
+
+    // version, command, reserved and address type
+    if (read_full(fd, buf, 4) == -1 || buf[1] != SOCKS_CONNECT)
+    {
+        return -1;
+    }
+
+    if (buf[3] == SOCKS5_ATYP_DOMAIN)
+    {
+        n = read_full(fd, buf, 1) == -1 ? -1 : buf[0];
+    }
+    else
+    {
+        n = buf[3] == SOCKS5_ATYP_IPV4 ? 4 : buf[3] == SOCKS5_ATYP_IPV6 ? 16 : -1;
+    }
+
+    if (n == -1 || read_full(fd, buf, n) == -1 || read_full(fd, rport, 2) == -1)
+    {
+        return -1;
+    }
+
+    *rport = ntohs(*rport);
+    return SOCKS5_VERSION;
+}
+
+
+/**
+ *  Writes the reply to a CONNECT request.
+ *  @param fd      Socket of client
+ *  @param version SOCKS version of client
+ *  @param granted Request has been granted
+ *  @return 0 on success, -1 in case of error
+ */
+int
+write_reply(int fd, int version, int granted)
+{
+    uint8_t reply[10] = { 0 };
+    int len;
+
+    if (version == SOCKS5_VERSION)
+    {
+        reply[0] = SOCKS5_VERSION;
+        reply[1] = granted ? 0x00 : 0x04; // host unreachable
+        reply[3] = SOCKS5_ATYP_IPV4;
+        len = 10;
+    }
+    else
+    {
+        reply[1] = granted ? SOCKS4_GRANTED : SOCKS4_GRANTED + 1;
+        len = SOCKS4_REPLY_LEN;
+    }
+
+    return write(fd, reply, len) == len ? 0 : -1;
+}
+
+
+/**
+ *  Determines the delay of a new stream.
+ *  Every stream is delayed by the connect time and a random jitter. If no
+ *  circuit has been built for the isolation key within SD_DIRTINESS
+ *  seconds, the circuit build time is added and the circuit is remembered.
+ *  @param user Isolation key (SOCKS username)
+ *  @return delay in ms
+ */
+int
+stream_delay(char* user)
+{
+    time_t now = time(NULL);
+    int ms = sd_.connect_ms;
+    int c = -1;     // circuit of isolation key
+    int oldest = 0; // circuit replaced if the table is full
+
+    if (sd_.jitter_ms)
+    {
+        ms += rand() % (sd_.jitter_ms + 1);
+    }
+
+    pthread_mutex_lock(&sd_.sd_mx);
+
+    for (int i = 0; i < sd_.used && c == -1; i++)
+    {
+        if (!strcmp(sd_.circuit[i].key, user))
+        {
+            c = i;
+        }
+        else if (sd_.circuit[i].built < sd_.circuit[oldest].built)
+        {
+            oldest = i;
+        }
+    }
+
+    if (c == -1)
+    {
+        c = sd_.used < SD_MAX_CIRCUITS ? sd_.used++ : oldest;
+        sd_.circuit[c].key[0] = '\0';
+        strncat(sd_.circuit[c].key, user, SOCKS_MAX_USERLEN);
+        sd_.circuit[c].built = 0;
+    }
+
+    // build a new circuit, if there is none or it is too old for new streams
+    if (now - sd_.circuit[c].built >= SD_DIRTINESS)
+    {
+        ms += sd_.circuit_ms;
+        sd_.circuit[c].built = now;
+    }
+
+    pthread_mutex_unlock(&sd_.sd_mx);
+    return ms;
+}
+
+
+/**
+ *  Relays data between two sockets until one of them is closed. If the
+ *  bandwidth is limited, a direction is not read from until the data
+ *  relayed so far would have been sent at that bandwidth. The data
+ *  queues up in the socket buffers meanwhile, like in the buffers of TOR.
+ *  @param a First socket
+ *  @param b Second socket
+ */
+void
+relay(int a, int b)
+{
+    struct pollfd pfd[2] = { { a, POLLIN, 0 }, { b, POLLIN, 0 } };
+    char buf[SD_RELAY_BUF];
+    struct timespec ts;
+    long long now;              // current time in us
+    long long due[2] = { 0 };   // time a direction may be read again in us
+    int timeout;                // ms until a direction may be read again
+    int len;
+    int off;
+    int ret;
+
+    for (;;)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+        timeout = -1;
+
+        for (int i = 0; i < 2; i++)
+        {
+            pfd[i].events = POLLIN;
+
+            if (due[i] > now)
+            {
+                pfd[i].events = 0;
+
+                if (timeout == -1 || (due[i] - now) / 1000 + 1 < timeout)
+                {
+                    timeout = (due[i] - now) / 1000 + 1;
+                }
+            }
+        }
+
+        if (poll(pfd, 2, timeout) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return;
+        }
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (!pfd[i].revents)
+            {
+                continue;
+            }
+
+            if ((len = read(pfd[i].fd, buf, sizeof(buf))) <= 0)
+            {
+                return;
+            }
+
+            for (off = 0; off < len; off += ret)
+            {
+                if ((ret = write(pfd[!i].fd, buf + off, len - off)) <= 0)
+                {
+                    return;
+                }
+            }
+
+            if (sd_.kbps)
+            {
+                due[i] = (due[i] > now ? due[i] : now) + len * 1000LL / sd_.kbps;
+            }
+        }
+    }
+}
@@ -0,0 +1,1392 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+
+/** @file swarm.c
+ *  This file contains the distribution of files by swarms. A file shared
+ *  with /share is announced to all contacts joining swarms ("SWARM"), who
+ *  fetch its chunk list (see: chunkstore.c) from a member and announce the
+ *  swarm to their contacts in turn, so that every client connected to a
+ *  member joins the swarm. The file is split into pieces of
+ *  SW_PIECE_CHUNKS chunks. Members tell each other the pieces they hold
+ *  and request missing pieces from every member holding them, the piece
+ *  held by the fewest members first, so that each piece is spread before
+ *  the common ones are copied again. A piece received is announced to all
+ *  members at once and can be requested from the receiver, the file is
+ *  thereby passed on by all members instead of being sent by its origin
+ *  to every client. Chunks are sent like the chunks of a file transfer:
+ *  passed from the file to the socket, within the window of the contact
+ *  (see: ft_room()), and acknowledged by the receiver. Every chunk is
+ *  checked against its hash, written at its offset and added to the chunk
+ *  store; chunks held in the store are not requested again.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "dchat_h/swarm.h"
+#include "dchat_h/types.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/contact.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Returns the current time in seconds (CLOCK_MONOTONIC).
+ */
+static time_t
+sw_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+
+/**
+ *  Ends all swarms. Files not received completely are dropped, their
+ *  chunks are kept in the chunk store.
+ *  @param sl Pointer to swarms
+ */
+void
+destroy_swarms(swarms_t* sl)
+{
+    while (sl->used)
+    {
+        sw_remove(sl, &sl->sw[0]);
+    }
+}
+
+
+/**
+ *  Shares a file with all contacts joining swarms. The file is chunked and
+ *  announced to the contacts by the main loop (see: sw_run()).
+ *  The contactlist has to be locked.
+ *  @param sl   Pointer to swarms
+ *  @param path Path of file
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_share(swarms_t* sl, char* path)
+{
+    swarm_t* s;
+    cs_list_t* list;
+    struct stat st;
+    unsigned char hash[CS_HASH_LEN];
+    char* recs;     // encoded chunk list
+    char* name;     // name of file without directory
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+    {
+        ui_log_errno(LOG_WARN, "Could not open '%s'!", path);
+        return -1;
+    }
+
+    name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || !st.st_size)
+    {
+        ui_log(LOG_WARN, "'%s' is not a regular file or empty!", path);
+        close(fd);
+        return -1;
+    }
+
+    if (!is_valid_file_name(name))
+    {
+        ui_log(LOG_WARN, "The name of '%s' cannot be sent!", path);
+        close(fd);
+        return -1;
+    }
+
+    if ((list = cs_chunk_file(fd, st.st_size)) == NULL)
+    {
+        ui_log(LOG_WARN, "'%s' is too large to be shared!", path);
+        close(fd);
+        return -1;
+    }
+
+    if ((recs = malloc(list->count * CS_REC_LEN)) == NULL)
+    {
+        ui_fatal("Memory allocation for chunk list failed!");
+    }
+
+    cs_sha256((unsigned char*) recs, cs_encode(list, 0, list->count, recs), hash);
+    free(recs);
+
+    if (sw_find(sl, (uint32_t) hash[0] << 24 | hash[1] << 16 | hash[2] << 8 | hash[3]) != NULL)
+    {
+        ui_log(LOG_NOTICE, "'%s' is shared already!", path);
+        cs_release(list);
+        close(fd);
+        return -1;
+    }
+
+    if ((s = sw_add(sl, hash, st.st_size, list->count, name)) == NULL)
+    {
+        ui_log(LOG_WARN, "Too many swarms!");
+        cs_release(list);
+        close(fd);
+        return -1;
+    }
+
+    cs_release(s->list);
+    s->list = list;
+    s->recs = list->count;
+    s->fd = fd;
+    s->complete = 1;
+    s->held = s->pieces;
+    memset(s->have, 0xff, s->pieces / 8 + 1);
+
+    ui_log(LOG_INFO, "Sharing '%s' (%lld bytes, %d pieces) as swarm %08x!", name,
+           (long long) st.st_size, s->pieces, s->id);
+    return 0;
+}
+
+
+/**
+ *  Handles an "application/octet" PDU of a swarm received from a contact.
+ *  The content starts with a control line (see: SW_CMD_*).
+ *  The contactlist has to be locked.
+ *  @param sl      Pointer to swarms
+ *  @param n       Index of contact
+ *  @param content Content of PDU
+ *  @param len     Length of content
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_receive(swarms_t* sl, int n, char* content, int len)
+{
+    char line[SW_MAX_LINE + 1]; // control line
+    char hex[2 * CS_HASH_LEN + 1];
+    unsigned char hash[CS_HASH_LEN];
+    char* end;      // end of control line
+    char* data;     // bytes following the line
+    int dlen;       // amount of bytes following the line
+    unsigned int id;
+    long long size;
+    int val;        // index of first chunk, piece or chunk
+    int count;
+    int pos = 0;    // position of file name in line
+
+    if ((end = memchr(content, '\n', len)) == NULL || end - content > SW_MAX_LINE)
+    {
+        ui_log(LOG_WARN, "Illegal swarm PDU received!");
+        return -1;
+    }
+
+    memcpy(line, content, end - content);
+    line[end - content] = '\0';
+    data = end + 1;
+    dlen = len - (end + 1 - content);
+
+    if (sscanf(line, SW_CMD_SWARM " %64s %lld %d %n", hex, &size, &count, &pos) == 3 && pos)
+    {
+        if (cs_parse_hash(hex, hash) == -1)
+        {
+            ui_log(LOG_WARN, "Illegal swarm announced!");
+            return -1;
+        }
+
+        return sw_swarm(sl, n, hash, size, count, line + pos);
+    }
+
+    if (sscanf(line, SW_CMD_LIST " %8x", &id) == 1)
+    {
+        return sw_list(sl, n, id);
+    }
+
+    if (sscanf(line, SW_CMD_RECS " %8x %d", &id, &val) == 2)
+    {
+        return sw_recs(sl, n, id, val, data, dlen);
+    }
+
+    if (sscanf(line, SW_CMD_BITS " %8x %d", &id, &val) == 2)
+    {
+        return sw_bits(sl, n, id, val, data, dlen);
+    }
+
+    if (sscanf(line, SW_CMD_GOT " %8x %d", &id, &val) == 2)
+    {
+        return sw_got(sl, n, id, val);
+    }
+
+    if (sscanf(line, SW_CMD_GET " %8x %d", &id, &val) == 2)
+    {
+        return sw_get(sl, n, id, val);
+    }
+
+    if (sscanf(line, SW_CMD_DATA " %8x %d", &id, &val) == 2)
+    {
+        return sw_data(sl, n, id, val, data, dlen);
+    }
+
+    if (sscanf(line, SW_CMD_ACK " %8x %d", &id, &val) == 2)
+    {
+        return sw_ack(n, id, val);
+    }
+
+    ui_log(LOG_WARN, "Unknown swarm command '%s'!", line);
+    return -1;
+}
+
+
+/**
+ *  Runs the swarms: peers, whose connection has been closed, are dropped,
+ *  swarms are announced to new contacts, pieces are requested from peers
+ *  and the pieces requested by peers are sent, as long as the window and
+ *  socket buffer of the peers take them (see: ft_run()).
+ *  The contactlist has to be locked.
+ *  @param sl Pointer to swarms
+ *  @return microseconds until the socket buffers should be checked again
+ *  or -1 if no piece is being sent
+ */
+long
+sw_run(swarms_t* sl)
+{
+    swarm_t* s;
+    sw_peer_t* p;
+    contact_t* contact;
+    char line[SW_MAX_LINE + 1];
+    time_t now = sw_now();
+    long next = -1;
+    int sent;   // a chunk has been sent in this turn
+    int ret;
+    int n;
+
+    for (int i = 0; i < sl->used; i++)
+    {
+        s = &sl->sw[i];
+
+        for (int k = 0; k < SW_MAX_PEERS; k++)
+        {
+            if (s->peer[k].used && sw_contact(&s->peer[k]) == -1)
+            {
+                sw_drop_peer(s, k);
+            }
+        }
+
+        // the chunk list is asked for again from another peer
+        if (s->recs < s->list->count)
+        {
+            if (s->peer[s->asked].used && s->peer[s->asked].joined &&
+                now - s->asked_at < SW_TIMEOUT)
+            {
+                continue;
+            }
+
+            for (int k = 1; k <= SW_MAX_PEERS; k++)
+            {
+                p = &s->peer[(s->asked + k) % SW_MAX_PEERS];
+
+                if (p->used && p->joined && (n = sw_contact(p)) != -1)
+                {
+                    s->asked = (s->asked + k) % SW_MAX_PEERS;
+                    s->asked_at = now;
+                    s->recs = 0;
+                    snprintf(line, sizeof(line), SW_CMD_LIST " %08x\n", s->id);
+                    sw_control(n, line, strlen(line));
+                    break;
+                }
+            }
+
+            continue;
+        }
+
+        // members announce the swarm to every contact joining swarms
+        for (n = 0; n < _cnf->cl.cl_size; n++)
+        {
+            contact = &_cnf->cl.contact[n];
+
+            if (contact->fd && contact->lport && contact->swarms &&
+                ((ret = sw_peer(s, n, 1)) != -1) && !s->peer[ret].announced)
+            {
+                sw_announce(s, ret, n);
+            }
+        }
+
+        if (s->complete)
+        {
+            continue;
+        }
+
+        // pieces, that are not received in time, are requested again
+        if (s->checked != now)
+        {
+            s->checked = now;
+
+            for (int k = 0; k < s->pieces; k++)
+            {
+                if (s->pending[k] && now - s->since[k] >= SW_TIMEOUT)
+                {
+                    p = &s->peer[s->pending[k] - 1];
+                    ui_log(LOG_INFO, "Piece %d of '%s' has not been received in time!", k,
+                           s->name);
+                    p->requests--;
+                    p->dirty = 1;
+                    s->pending[k] = 0;
+                }
+            }
+        }
+
+        for (int k = 0; k < SW_MAX_PEERS; k++)
+        {
+            if (s->peer[k].used && s->peer[k].dirty && (n = sw_contact(&s->peer[k])) != -1)
+            {
+                sw_request(s, k, n);
+            }
+        }
+    }
+
+    do
+    {
+        sent = 0;
+
+        for (int i = 0; i < sl->used; i++)
+        {
+            s = &sl->sw[i];
+
+            for (int k = 0; k < SW_MAX_PEERS; k++)
+            {
+                p = &s->peer[k];
+
+                if (!p->used || !p->qlen || (n = sw_contact(p)) == -1)
+                {
+                    continue;
+                }
+
+                if ((ret = sw_serve(sl, s, p, n)) == -1)
+                {
+                    ui_log(LOG_WARN, "Could not send '%s' to the swarm!", s->name);
+                    p->qlen = 0;
+                    continue;
+                }
+
+                sent |= ret > 0;
+                next = p->qlen ? FT_POLL_US : next;
+            }
+        }
+    }
+    while (sent);
+
+    return next;
+}
+
+
+/**
+ *  Handles the announcement of a swarm by a contact, which is a member of
+ *  the swarm. An unknown swarm is joined, if a download directory has
+ *  been set, and its chunk list is asked for. The contact becomes a peer
+ *  of the swarm and is told the pieces held.
+ *  @param sl    Pointer to swarms
+ *  @param n     Index of contact
+ *  @param hash  SHA-256 of chunk list
+ *  @param size  Size of file
+ *  @param count Amount of chunks
+ *  @param name  Name of file
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_swarm(swarms_t* sl, int n, unsigned char* hash, off_t size, int count, char* name)
+{
+    swarm_t* s;
+    char line[SW_MAX_LINE + 1];
+    contact_t* contact = &_cnf->cl.contact[n];
+    int p;  // index of peer
+
+    if ((s = sw_find(sl, (uint32_t) hash[0] << 24 | hash[1] << 16 | hash[2] << 8 | hash[3]))
+        == NULL)
+    {
+        if (_cnf->ft.dir[0] == '\0')
+        {
+            return 0;
+        }
+
+        // chunks are between 1 and CS_MAX_CHUNK bytes long
+        if (!is_valid_file_name(name) || count < 1 || count > CS_MAX_CHUNKS || size < count ||
+            size > (off_t) count * CS_MAX_CHUNK)
+        {
+            ui_log(LOG_WARN, "'%s' announced a swarm with an illegal name or size!",
+                   contact->name);
+            return -1;
+        }
+
+        if ((s = sw_add(sl, hash, size, count, name)) == NULL)
+        {
+            ui_log(LOG_WARN, "Too many swarms - not joining '%s'!", name);
+            return 0;
+        }
+
+        ui_log(LOG_INFO, "Joining the swarm of '%s' (%lld bytes) announced by '%s'!", name,
+               (long long) size, contact->name);
+    }
+    else if (memcmp(s->hash, hash, CS_HASH_LEN))
+    {
+        return 0;
+    }
+
+    if ((p = sw_peer(s, n, 1)) == -1)
+    {
+        return 0;
+    }
+
+    if (s->peer[p].joined)
+    {
+        return 0;
+    }
+
+    s->peer[p].joined = 1;
+    s->peer[p].dirty = 1;
+
+    // the chunk list of a new swarm is asked for from the first member
+    if (s->recs < s->list->count && s->asked_at == 0)
+    {
+        s->asked = p;
+        s->asked_at = sw_now();
+        snprintf(line, sizeof(line), SW_CMD_LIST " %08x\n", s->id);
+        return sw_control(n, line, strlen(line)) == -1 ? -1 : 0;
+    }
+
+    if (s->peer[p].announced)
+    {
+        return sw_send_bits(s, n);
+    }
+
+    // members announce the swarm after its chunk list has been received
+    return s->recs == s->list->count ? sw_announce(s, p, n) : 0;
+}
+
+
+/**
+ *  Sends the chunk list of a swarm to a contact, CS_MAX_RECS records per
+ *  PDU. The list is only sent, if it has been received completely.
+ *  @param sl Pointer to swarms
+ *  @param n  Index of contact
+ *  @param id Id of swarm
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_list(swarms_t* sl, int n, uint32_t id)
+{
+    swarm_t* s;
+    char content[SW_MAX_LINE + CS_MAX_RECS * CS_REC_LEN];
+    int len;    // length of content
+    int recs;   // records of PDU
+
+    if ((s = sw_find(sl, id)) == NULL || s->recs < s->list->count)
+    {
+        return 0;
+    }
+
+    for (int first = 0; first < s->list->count; first += recs)
+    {
+        recs = s->list->count - first < CS_MAX_RECS ? s->list->count - first : CS_MAX_RECS;
+        len = snprintf(content, SW_MAX_LINE + 1, SW_CMD_RECS " %08x %d\n", s->id, first);
+        len += cs_encode(s->list, first, recs, content + len);
+
+        if (sw_control(n, content, len) == -1)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Handles records of the chunk list of a swarm sent by the peer asked
+ *  for it. The complete list has to match the hash of the swarm, then the
+ *  file is opened and announced to the contacts (see: sw_run()).
+ *  @param sl    Pointer to swarms
+ *  @param n     Index of contact
+ *  @param id    Id of swarm
+ *  @param first Index of the first chunk of the records
+ *  @param data  Records
+ *  @param len   Length of records
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_recs(swarms_t* sl, int n, uint32_t id, int first, char* data, int len)
+{
+    swarm_t* s;
+    unsigned char hash[CS_HASH_LEN];
+    char* recs;     // encoded chunk list
+    cs_chunk_t* last;
+    int amount = len / CS_REC_LEN;
+
+    if ((s = sw_find(sl, id)) == NULL || s->recs == s->list->count ||
+        sw_peer(s, n, 0) != s->asked)
+    {
+        return 0;
+    }
+
+    if (len % CS_REC_LEN || first != s->recs || amount > s->list->count - first ||
+        cs_decode(s->list, first, data, amount) == -1)
+    {
+        ui_log(LOG_WARN, "'%s' sent an illegal chunk list!", _cnf->cl.contact[n].name);
+        s->asked_at = 1;
+        return -1;
+    }
+
+    if ((s->recs += amount) < s->list->count)
+    {
+        return 0;
+    }
+
+    if ((recs = malloc(s->list->count * CS_REC_LEN)) == NULL)
+    {
+        ui_fatal("Memory allocation for chunk list failed!");
+    }
+
+    cs_sha256((unsigned char*) recs, cs_encode(s->list, 0, s->list->count, recs), hash);
+    free(recs);
+    last = &s->list->chunk[s->list->count - 1];
+
+    // the list is asked for from the next peer (see: sw_run())
+    if (memcmp(hash, s->hash, CS_HASH_LEN) || last->off + last->len != s->size)
+    {
+        ui_log(LOG_WARN, "'%s' sent a chunk list not matching the swarm of '%s'!",
+               _cnf->cl.contact[n].name, s->name);
+        s->recs = 0;
+        s->asked_at = 1;
+        return -1;
+    }
+
+    if (sw_open(s) == -1)
+    {
+        sw_remove(sl, s);
+        return -1;
+    }
+
+    for (int p = 0; p < SW_MAX_PEERS; p++)
+    {
+        s->peer[p].dirty = 1;
+    }
+
+    return s->held == s->pieces ? sw_finish(sl, s) : 0;
+}
+
+
+/**
+ *  Handles the bitmap of the pieces held by a peer, which is sent when
+ *  the peer learns of the membership of this client.
+ *  @param sl    Pointer to swarms
+ *  @param n     Index of contact
+ *  @param id    Id of swarm
+ *  @param first Index of the piece of the first bit, a multiple of 8
+ *  @param data  Bitmap, the lowest bit of a byte is the first piece
+ *  @param len   Length of bitmap
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_bits(swarms_t* sl, int n, uint32_t id, int first, char* data, int len)
+{
+    swarm_t* s;
+    sw_peer_t* p;
+    int k;
+
+    if ((s = sw_find(sl, id)) == NULL || (k = sw_peer(s, n, 0)) == -1)
+    {
+        return 0;
+    }
+
+    if (first < 0 || first % 8 || first / 8 + len > s->pieces / 8 + 1)
+    {
+        ui_log(LOG_WARN, "'%s' sent an illegal bitmap of pieces of '%s'!",
+               _cnf->cl.contact[n].name, s->name);
+        return -1;
+    }
+
+    p = &s->peer[k];
+
+    for (int i = first; i < first + 8 * len && i < s->pieces; i++)
+    {
+        if (data[(i - first) / 8] & (1 << (i % 8)) && !(p->have[i / 8] & (1 << (i % 8))))
+        {
+            p->have[i / 8] |= 1 << (i % 8);
+            p->pieces++;
+            s->avail[i]++;
+        }
+    }
+
+    p->dirty = 1;
+    return 0;
+}
+
+
+/**
+ *  Handles the announcement of a piece received by a peer.
+ *  @param sl    Pointer to swarms
+ *  @param n     Index of contact
+ *  @param id    Id of swarm
+ *  @param piece Index of piece
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_got(swarms_t* sl, int n, uint32_t id, int piece)
+{
+    swarm_t* s;
+    sw_peer_t* p;
+    int k;
+
+    if ((s = sw_find(sl, id)) == NULL || (k = sw_peer(s, n, 0)) == -1)
+    {
+        return 0;
+    }
+
+    if (piece < 0 || piece >= s->pieces)
+    {
+        ui_log(LOG_WARN, "'%s' announced an illegal piece of '%s'!",
+               _cnf->cl.contact[n].name, s->name);
+        return -1;
+    }
+
+    p = &s->peer[k];
+
+    if (!(p->have[piece / 8] & (1 << (piece % 8))))
+    {
+        p->have[piece / 8] |= 1 << (piece % 8);
+        p->pieces++;
+        s->avail[piece]++;
+        p->dirty = 1;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Handles the request of a piece by a peer. The pieces requested are
+ *  sent in the order of their requests (see: sw_serve()).
+ *  @param sl    Pointer to swarms
+ *  @param n     Index of contact
+ *  @param id    Id of swarm
+ *  @param piece Index of piece
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_get(swarms_t* sl, int n, uint32_t id, int piece)
+{
+    swarm_t* s;
+    sw_peer_t* p;
+    int k;
+
+    if ((s = sw_find(sl, id)) == NULL || (k = sw_peer(s, n, 0)) == -1)
+    {
+        return 0;
+    }
+
+    p = &s->peer[k];
+
+    // only pieces announced are requested, a peer never has more requests
+    if (piece < 0 || piece >= s->pieces || !(s->have[piece / 8] & (1 << (piece % 8))) ||
+        p->qlen == SW_MAX_REQUESTS)
+    {
+        ui_log(LOG_WARN, "'%s' requested an illegal piece of '%s'!",
+               _cnf->cl.contact[n].name, s->name);
+        return -1;
+    }
+
+    if (!p->qlen)
+    {
+        p->cursor = piece * SW_PIECE_CHUNKS;
+    }
+
+    p->queue[(p->qhead + p->qlen++) % SW_MAX_REQUESTS] = piece;
+    return 0;
+}
+
+
+/**
+ *  Handles a chunk of a piece sent by a peer. The chunk is acknowledged in
+ *  any case, so that the window of the peer is kept (see: ft_acked()). It
+ *  is written, if it is the next chunk of a piece requested from the peer
+ *  and matches its hash. A piece received completely is announced to all
+ *  peers.
+ *  @param sl    Pointer to swarms
+ *  @param n     Index of contact
+ *  @param id    Id of swarm
+ *  @param chunk Index of chunk
+ *  @param data  Chunk
+ *  @param len   Length of chunk
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_data(swarms_t* sl, int n, uint32_t id, int chunk, char* data, int len)
+{
+    swarm_t* s;
+    sw_peer_t* p;
+    cs_chunk_t* c;
+    char line[SW_MAX_LINE + 1];
+    unsigned char hash[CS_HASH_LEN];
+    ssize_t ret;
+    int piece = chunk / SW_PIECE_CHUNKS;
+    int k;
+
+    snprintf(line, sizeof(line), SW_CMD_ACK " %08x %d\n", id, chunk);
+
+    if (sw_control(n, line, strlen(line)) == -1)
+    {
+        return -1;
+    }
+
+    // chunks of pieces, that have been requested again, are dropped
+    if ((s = sw_find(sl, id)) == NULL || s->recs < s->list->count || chunk < 0 ||
+        chunk >= s->list->count || (k = sw_peer(s, n, 0)) == -1 ||
+        s->pending[piece] != k + 1 || s->next[piece] != chunk)
+    {
+        return 0;
+    }
+
+    p = &s->peer[k];
+    c = &s->list->chunk[chunk];
+    cs_sha256((unsigned char*) data, len, hash);
+
+    if (len != (int) c->len || memcmp(hash, c->hash, CS_HASH_LEN))
+    {
+        ui_log(LOG_WARN, "'%s' sent a damaged chunk of '%s'!", _cnf->cl.contact[n].name,
+               s->name);
+        s->pending[piece] = 0;
+        p->requests--;
+        p->dirty = 1;
+        return 0;
+    }
+
+    for (int b = 0; b < len; b += ret)
+    {
+        if ((ret = pwrite(s->fd, data + b, len - b, c->off + b)) == -1)
+        {
+            ui_log_errno(LOG_WARN, "Could not write '%s'!", s->name);
+            sw_remove(sl, s);
+            return -1;
+        }
+    }
+
+    cs_put(&_cnf->cs, hash, data, len);
+    s->down += len;
+    p->down += len;
+    sl->down_bytes += len;
+
+    if (++s->next[piece] < s->list->count && s->next[piece] % SW_PIECE_CHUNKS)
+    {
+        return 0;
+    }
+
+    s->pending[piece] = 0;
+    s->have[piece / 8] |= 1 << (piece % 8);
+    s->held++;
+    p->requests--;
+    p->dirty = 1;
+    snprintf(line, sizeof(line), SW_CMD_GOT " %08x %d\n", id, piece);
+
+    for (k = 0; k < SW_MAX_PEERS; k++)
+    {
+        if (s->peer[k].used && s->peer[k].joined && (n = sw_contact(&s->peer[k])) != -1)
+        {
+            sw_control(n, line, strlen(line));
+        }
+    }
+
+    return s->held == s->pieces ? sw_finish(sl, s) : 0;
+}
+
+
+/**
+ *  Handles the acknowledgement of a chunk of a swarm. Chunks are
+ *  acknowledged in the order they have been sent (see: ft_ack()).
+ *  @param n     Index of contact
+ *  @param id    Id of swarm
+ *  @param chunk Index of chunk
+ *  @return 0
+ */
+int
+sw_ack(int n, uint32_t id, int chunk)
+{
+    ft_link_t* link = &_cnf->cl.contact[n].link;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (link->count && link->sent[link->head].id == id && link->sent[link->head].end == chunk)
+    {
+        ft_acked(link, &now);
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Requests pieces from a peer, until SW_MAX_REQUESTS pieces are pending.
+ *  The piece held by the fewest peers is requested first, pieces held by
+ *  as many peers are picked at random, so that peers do not request the
+ *  same pieces.
+ *  @param s Pointer to swarm
+ *  @param p Index of peer
+ *  @param n Index of contact
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_request(swarm_t* s, int p, int n)
+{
+    sw_peer_t* peer = &s->peer[p];
+    char line[SW_MAX_LINE + 1];
+    int best;   // rarest piece
+    int start;  // piece the search starts at
+    int k;
+
+    peer->dirty = 0;
+
+    while (peer->requests < SW_MAX_REQUESTS && peer->joined)
+    {
+        best = -1;
+        start = rand() % s->pieces;
+
+        for (int i = 0; i < s->pieces; i++)
+        {
+            k = (start + i) % s->pieces;
+
+            if (s->have[k / 8] & (1 << (k % 8)) || s->pending[k] ||
+                !(peer->have[k / 8] & (1 << (k % 8))))
+            {
+                continue;
+            }
+
+            if (best == -1 || s->avail[k] < s->avail[best])
+            {
+                best = k;
+            }
+        }
+
+        if (best == -1)
+        {
+            break;
+        }
+
+        s->pending[best] = p + 1;
+        s->since[best] = sw_now();
+        s->next[best] = best * SW_PIECE_CHUNKS;
+        peer->requests++;
+        snprintf(line, sizeof(line), SW_CMD_GET " %08x %d\n", s->id, best);
+
+        if (sw_control(n, line, strlen(line)) == -1)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Sends the next chunk of the pieces requested by a peer, if the window
+ *  and the socket buffer of the peer have room for it (see: ft_room()).
+ *  @param sl Pointer to swarms
+ *  @param s  Pointer to swarm
+ *  @param p  Pointer to peer
+ *  @param n  Index of contact
+ *  @return amount of bytes sent, 0 if there is no room, -1 on error
+ */
+int
+sw_serve(swarms_t* sl, swarm_t* s, sw_peer_t* p, int n)
+{
+    dchat_pdu_t pdu;
+    char line[SW_MAX_LINE + 1];
+    cs_chunk_t* c = &s->list->chunk[p->cursor];
+    long room;
+
+    if ((room = ft_room(&_cnf->ft, n)) == -1)
+    {
+        return -1;
+    }
+
+    if (room < c->len)
+    {
+        return 0;
+    }
+
+    snprintf(line, sizeof(line), SW_CMD_DATA " %08x %d\n", s->id, p->cursor);
+
+    if (init_dchat_pdu(&pdu, DCHAT_V1, CTT_ID_BIN, _cnf->me.onion_id, _cnf->me.lport,
+                       _cnf->me.name) == -1)
+    {
+        return -1;
+    }
+
+    init_dchat_pdu_content(&pdu, line, strlen(line));
+
+    if (send_pdu_file(n, &pdu, s->fd, c->off, c->len) == -1)
+    {
+        free_pdu(&pdu);
+        return -1;
+    }
+
+    free_pdu(&pdu);
+    ft_track(&_cnf->cl.contact[n].link, s->id, p->cursor, c->len);
+    s->up += c->len;
+    p->up += c->len;
+    sl->up_bytes += c->len;
+
+    // the next piece requested starts with its first chunk
+    if (++p->cursor == s->list->count || !(p->cursor % SW_PIECE_CHUNKS))
+    {
+        p->qhead = (p->qhead + 1) % SW_MAX_REQUESTS;
+
+        if (--p->qlen)
+        {
+            p->cursor = p->queue[p->qhead] * SW_PIECE_CHUNKS;
+        }
+    }
+
+    return c->len;
+}
+
+
+/**
+ *  Opens the partial file of a swarm, whose chunk list has been received.
+ *  The file is preallocated, the chunks held in the chunk store are
+ *  copied into it and pieces copied completely are held.
+ *  @param s Pointer to swarm
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_open(swarm_t* s)
+{
+    char path[FT_MAX_FILE_PATH + 1];
+    char buf[CS_MAX_CHUNK];
+    cs_chunk_t* c;
+    cs_entry_t* e;
+    long long bytes = 0;    // bytes taken from the chunk store
+    int chunks = 0;         // chunks of the current piece taken from the store
+    ssize_t ret;
+
+    sw_part_path(s, path);
+
+    if ((s->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1)
+    {
+        ui_log_errno(LOG_WARN, "Could not open '%s'!", path);
+        return -1;
+    }
+
+    if ((errno = posix_fallocate(s->fd, 0, s->size)) != 0)
+    {
+        ui_log_errno(LOG_WARN, "Could not allocate %lld bytes for '%s'!",
+                     (long long) s->size, path);
+        return -1;
+    }
+
+    for (int i = 0; i < s->list->count; i++)
+    {
+        c = &s->list->chunk[i];
+        chunks = i % SW_PIECE_CHUNKS ? chunks : 0;
+
+        if ((e = cs_lookup(&_cnf->cs, c->hash)) == NULL || e->len != c->len ||
+            cs_read(&_cnf->cs, e, buf) == -1)
+        {
+            continue;
+        }
+
+        for (uint32_t b = 0; b < c->len; b += ret)
+        {
+            if ((ret = pwrite(s->fd, buf + b, c->len - b, c->off + b)) == -1)
+            {
+                ui_log_errno(LOG_WARN, "Could not write '%s'!", path);
+                return -1;
+            }
+        }
+
+        bytes += c->len;
+        _cnf->cs.hits++;
+        _cnf->cs.hit_bytes += c->len;
+
+        if (++chunks == SW_PIECE_CHUNKS || i == s->list->count - 1)
+        {
+            // the last piece may have less chunks
+            if (chunks == i % SW_PIECE_CHUNKS + 1)
+            {
+                s->have[i / SW_PIECE_CHUNKS / 8] |= 1 << (i / SW_PIECE_CHUNKS % 8);
+                s->held++;
+            }
+        }
+    }
+
+    if (bytes)
+    {
+        ui_log(LOG_INFO, "Took %lld bytes of '%s' from the chunk store!", bytes, s->name);
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Moves the file of a swarm, that has been received completely, to the
+ *  download directory. The swarm is kept, so that the file is passed on
+ *  to the peers still missing pieces.
+ *  @param sl Pointer to swarms
+ *  @param s  Pointer to swarm
+ *  @return 0 on success, -1 if the file could not be moved
+ */
+int
+sw_finish(swarms_t* sl, swarm_t* s)
+{
+    char part[FT_MAX_FILE_PATH + 1];  // partial file
+    char path[FT_MAX_FILE_PATH + 1];  // received file
+    struct timespec now;
+    double secs;    // time since the swarm has been joined
+    int peers = 0;  // peers pieces have been received from
+
+    s->complete = 1;
+    sw_part_path(s, part);
+
+    if (ft_move(&_cnf->ft, part, s->name, path) == -1)
+    {
+        return -1;
+    }
+
+    for (int k = 0; k < SW_MAX_PEERS; k++)
+    {
+        peers += s->peer[k].used && s->peer[k].down;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    secs = (now.tv_sec - s->started.tv_sec) + (now.tv_nsec - s->started.tv_nsec) / 1e9;
+    ui_log(LOG_INFO, "Received '%s' from the swarm (%lu bytes from %d peers, %.1f KB/s)!",
+           path, s->down, peers, secs > 0 ? s->down / 1024.0 / secs : 0.0);
+    sl->completed++;
+    return 0;
+}
+
+
+/**
+ *  Searches a swarm.
+ *  @param sl Pointer to swarms
+ *  @param id Id of swarm
+ *  @return pointer to swarm or NULL if not found
+ */
+swarm_t*
+sw_find(swarms_t* sl, uint32_t id)
+{
+    for (int i = 0; i < sl->used; i++)
+    {
+        if (sl->sw[i].id == id)
+        {
+            return &sl->sw[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ *  Adds a swarm. Its chunk list is empty and no piece is held.
+ *  @param sl    Pointer to swarms
+ *  @param hash  SHA-256 of chunk list
+ *  @param size  Size of file
+ *  @param count Amount of chunks
+ *  @param name  Name of file
+ *  @return pointer to swarm or NULL if there are too many swarms
+ */
+swarm_t*
+sw_add(swarms_t* sl, unsigned char* hash, off_t size, int count, char* name)
+{
+    swarm_t* s;
+
+    if (sl->used == SW_MAX_SWARMS)
+    {
+        return NULL;
+    }
+
+    s = &sl->sw[sl->used++];
+    memset(s, 0, sizeof(*s));
+    s->id = (uint32_t) hash[0] << 24 | hash[1] << 16 | hash[2] << 8 | hash[3];
+    memcpy(s->hash, hash, CS_HASH_LEN);
+    strncat(s->name, name, FT_MAX_NAME);
+    s->size = size;
+    s->list = cs_new_list(count);
+    s->pieces = (count + SW_PIECE_CHUNKS - 1) / SW_PIECE_CHUNKS;
+    s->fd = -1;
+    clock_gettime(CLOCK_MONOTONIC, &s->started);
+
+    if ((s->have = calloc(s->pieces / 8 + 1, 1)) == NULL ||
+        (s->avail = calloc(s->pieces, sizeof(*s->avail))) == NULL ||
+        (s->pending = calloc(s->pieces, sizeof(*s->pending))) == NULL ||
+        (s->since = calloc(s->pieces, sizeof(*s->since))) == NULL ||
+        (s->next = calloc(s->pieces, sizeof(*s->next))) == NULL)
+    {
+        ui_fatal("Memory allocation for swarm failed!");
+    }
+
+    return s;
+}
+
+
+/**
+ *  Removes a swarm. The partial file of a swarm not received completely is
+ *  removed, since its chunks are kept in the chunk store.
+ *  @param sl Pointer to swarms
+ *  @param s  Pointer to swarm
+ */
+void
+sw_remove(swarms_t* sl, swarm_t* s)
+{
+    char path[FT_MAX_FILE_PATH + 1];
+
+    if (!s->complete && s->fd != -1)
+    {
+        sw_part_path(s, path);
+        unlink(path);
+    }
+
+    if (s->fd != -1)
+    {
+        close(s->fd);
+    }
+
+    for (int k = 0; k < SW_MAX_PEERS; k++)
+    {
+        free(s->peer[k].have);
+    }
+
+    cs_release(s->list);
+    free(s->have);
+    free(s->avail);
+    free(s->pending);
+    free(s->since);
+    free(s->next);
+
+    // keep the swarms compact by moving the last swarm
+    sl->used--;
+
+    if (s != &sl->sw[sl->used])
+    {
+        memcpy(s, &sl->sw[sl->used], sizeof(*s));
+    }
+}
+
+
+/**
+ *  Searches the peer of a contact in a swarm.
+ *  @param s   Pointer to swarm
+ *  @param n   Index of contact
+ *  @param add If set, the contact is added, if it is not a peer yet
+ *  @return index of peer or -1 if not found or there are too many peers
+ */
+int
+sw_peer(swarm_t* s, int n, int add)
+{
+    contact_t* contact = &_cnf->cl.contact[n];
+    sw_peer_t* p;
+    int free_slot = -1;
+
+    for (int k = 0; k < SW_MAX_PEERS; k++)
+    {
+        p = &s->peer[k];
+
+        if (!p->used)
+        {
+            free_slot = free_slot == -1 ? k : free_slot;
+            continue;
+        }
+
+        if (p->sock == contact->fd && p->lport == contact->lport &&
+            !strcmp(p->onion_id, contact->onion_id))
+        {
+            return k;
+        }
+    }
+
+    if (!add || free_slot == -1)
+    {
+        return -1;
+    }
+
+    p = &s->peer[free_slot];
+    memset(p, 0, sizeof(*p));
+    p->used = 1;
+    strncat(p->onion_id, contact->onion_id, ONION_ADDRLEN);
+    p->lport = contact->lport;
+    p->sock = contact->fd;
+
+    if ((p->have = calloc(s->pieces / 8 + 1, 1)) == NULL)
+    {
+        ui_fatal("Memory allocation for swarm peer failed!");
+    }
+
+    return free_slot;
+}
+
+
+/**
+ *  Drops a peer of a swarm, whose connection has been closed. The pieces
+ *  requested from the peer are requested from other peers.
+ *  @param s Pointer to swarm
+ *  @param p Index of peer
+ */
+void
+sw_drop_peer(swarm_t* s, int p)
+{
+    sw_peer_t* peer = &s->peer[p];
+
+    for (int i = 0; i < s->pieces; i++)
+    {
+        if (s->pending[i] == p + 1)
+        {
+            s->pending[i] = 0;
+        }
+
+        if (peer->have[i / 8] & (1 << (i % 8)))
+        {
+            s->avail[i]--;
+        }
+    }
+
+    for (int k = 0; k < SW_MAX_PEERS; k++)
+    {
+        s->peer[k].dirty = 1;
+    }
+
+    free(peer->have);
+    memset(peer, 0, sizeof(*peer));
+}
+
+
+/**
+ *  Searches the contact of a peer in the contactlist. A peer belongs to
+ *  the connection it has been added on.
+ *  @param p Pointer to peer
+ *  @return index of contact or -1 if the connection has been closed
+ */
+int
+sw_contact(sw_peer_t* p)
+{
+    contact_t* contact;
+
+    for (int i = 0; i < _cnf->cl.cl_size; i++)
+    {
+        contact = &_cnf->cl.contact[i];
+
+        if (contact->fd && contact->fd == p->sock && contact->lport == p->lport &&
+            !strcmp(contact->onion_id, p->onion_id))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ *  Announces a swarm to a contact and tells it the pieces held.
+ *  @param s Pointer to swarm
+ *  @param p Index of peer of contact
+ *  @param n Index of contact
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_announce(swarm_t* s, int p, int n)
+{
+    char line[SW_MAX_LINE + 1];
+    int len;
+
+    len = snprintf(line, sizeof(line), SW_CMD_SWARM " ");
+
+    for (int i = 0; i < CS_HASH_LEN; i++)
+    {
+        len += snprintf(line + len, sizeof(line) - len, "%02x", s->hash[i]);
+    }
+
+    len += snprintf(line + len, sizeof(line) - len, " %lld %d %s\n", (long long) s->size,
+                    s->list->count, s->name);
+    s->peer[p].announced = 1;
+    return sw_control(n, line, len) == -1 ? -1 : sw_send_bits(s, n);
+}
+
+
+/**
+ *  Sends the bitmap of the pieces held to a contact, CS_MAX_HAVE bytes
+ *  per PDU. Nothing is sent, if no piece is held.
+ *  @param s Pointer to swarm
+ *  @param n Index of contact
+ *  @return 0 on success, -1 on error
+ */
+int
+sw_send_bits(swarm_t* s, int n)
+{
+    char content[SW_MAX_LINE + CS_MAX_HAVE];
+    int bytes = s->pieces / 8 + 1;
+    int len;
+
+    for (int b = 0; s->held && b < bytes; b += CS_MAX_HAVE)
+    {
+        len = snprintf(content, SW_MAX_LINE + 1, SW_CMD_BITS " %08x %d\n", s->id, b * 8);
+        memcpy(content + len, s->have + b, bytes - b < CS_MAX_HAVE ? bytes - b : CS_MAX_HAVE);
+        len += bytes - b < CS_MAX_HAVE ? bytes - b : CS_MAX_HAVE;
+
+        if (sw_control(n, content, len) == -1)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Sends an "application/octet" PDU of a swarm (see: ft_control()).
+ *  @param n    Index of contact
+ *  @param line Control line terminated by '\\n', followed by data
+ *  @param len  Length of line and data
+ *  @return length of PDU or -1 in case of error
+ */
+int
+sw_control(int n, char* line, int len)
+{
+    return ft_control(n, line, len);
+}
+
+
+/**
+ *  Builds the path of the partial file of a swarm.
+ *  @param s    Pointer to swarm
+ *  @param path Buffer of at least FT_MAX_FILE_PATH + 1 bytes
+ */
+void
+sw_part_path(swarm_t* s, char* path)
+{
+    snprintf(path, FT_MAX_FILE_PATH + 1, "%s/%s.%08x" FT_PART_EXT, _cnf->ft.dir, s->name,
+             s->id);
+}
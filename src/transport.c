@@ -0,0 +1,307 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file transport.c
+ *  This file contains the transports outgoing connections are created with.
+ *  By default connections are relayed by TOR. The direct transport connects
+ *  to local addresses looked up in a route file instead, so that many
+ *  clients can be run and load-tested on one host without a TOR network.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dchat_h/transport.h"
+#include "dchat_h/types.h"
+#include "dchat_h/decoder.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Selects the transport for outgoing connections.
+ *  If a route file has been set with the command line option, the direct
+ *  transport will be used and its routes are read, otherwise connections
+ *  are relayed by TOR.
+ *  @param tc Pointer to transport configuration
+ *  @return 0 on success, -1 in case of error
+ */
+int
+init_transport(transport_conf_t* tc)
+{
+    // available transports
+    transport_t transports[] =
+    {
+        { TP_ID_TOR, "tor", 1, create_tor_socket },
+        { TP_ID_DIRECT, "direct", 0, create_direct_socket }
+    };
+
+    if (tc->path[0] == '\0')
+    {
+        tc->transport = transports[TP_ID_TOR];
+        return 0;
+    }
+
+    tc->transport = transports[TP_ID_DIRECT];
+
+    if (read_routes(tc) == -1)
+    {
+        return -1;
+    }
+
+    ui_log(LOG_INFO, "Read %d routes from '%s' - connecting directly!", tc->used,
+           tc->path);
+    return 0;
+}
+
+
+/**
+ *  Frees all resources of the transport configuration.
+ *  @param tc Pointer to transport configuration
+ */
+void
+destroy_transport(transport_conf_t* tc)
+{
+    free(tc->route);
+    tc->route = NULL;
+    tc->used = tc->size = 0;
+}
+
+
+/**
+ *  Reads the route file of the direct transport.
+ *  Each line maps an onion address and optionally a listening port to a
+ *  local address: "<onion-id>|* [<port>] <ip>[:<port>]\n". The onion
+ *  address TP_ROUTE_ANY matches every address. If the local port is
+ *  missing, the listening port of the contact is kept. Empty lines and
+ *  lines starting with '#' are skipped, invalid lines are skipped with a
+ *  warning.
+ *  @param tc Pointer to transport configuration, whose path has been set
+ *  @return amount of routes read, -1 if file could not be read
+ */
+int
+read_routes(transport_conf_t* tc)
+{
+    FILE* f;           // route file stream
+    char* line;        // read line of route file
+    char* tok[4];      // fields of line
+    char* port;        // port of local address
+    char* save;        // context of strtok_r
+    char* term;        // end of port
+    long lport;        // listening port
+    long dport;        // port of local address
+    int ntok;          // amount of fields
+    int valid;         // line is valid so far
+    int lctr = 0;      // line counter
+    direct_route_t* r;
+
+    if ((f = fopen(tc->path, "r")) == NULL)
+    {
+        ui_log_errno(LOG_ERR, "Could not read route file '%s'!", tc->path);
+        return -1;
+    }
+
+    while (read_line(fileno(f), &line) > 0)
+    {
+        lctr++;
+
+        for (ntok = 0; ntok < 4; ntok++)
+        {
+            if ((tok[ntok] = strtok_r(ntok ? NULL : line, " \t\r\n", &save)) == NULL)
+            {
+                break;
+            }
+        }
+
+        if (!ntok || tok[0][0] == '#')
+        {
+            free(line);
+            continue;
+        }
+
+        lport = dport = 0;
+        valid = ntok == 2 || ntok == 3;
+
+        if (valid && ntok == 3)
+        {
+            lport = strtol(tok[1], &term, 10);
+            valid = *term == '\0' && is_valid_port(lport);
+        }
+
+        if (valid && (port = strchr(tok[ntok - 1], ':')) != NULL)
+        {
+            *port++ = '\0';
+            dport = strtol(port, &term, 10);
+            valid = *term == '\0' && is_valid_port(dport);
+        }
+
+        if (tc->used == tc->size)
+        {
+            tc->size += TP_INIT_ROUTES;
+
+            if ((tc->route = realloc(tc->route, tc->size * sizeof(direct_route_t))) == NULL)
+            {
+                ui_fatal("Memory reallocation for route table failed!");
+            }
+        }
+
+        r = &tc->route[tc->used];
+        memset(r, 0, sizeof(*r));
+
+        if (!valid || (!is_valid_onion(tok[0]) && strcmp(tok[0], TP_ROUTE_ANY)) ||
+            inet_pton(AF_INET, tok[ntok - 1], &r->sa.sin_addr) != 1)
+        {
+            ui_log(LOG_WARN, "Invalid route in line '%d' of route file!", lctr);
+        }
+        else
+        {
+            strncat(r->onion_id, tok[0], ONION_ADDRLEN);
+            r->lport = lport;
+            r->sa.sin_family = AF_INET;
+            r->sa.sin_port = htons(dport);
+            tc->used++;
+        }
+
+        free(line);
+    }
+
+    fclose(f);
+    return tc->used;
+}
+
+
+/**
+ *  Creates a connected socket to a contact with the transport in use.
+ *  @param hostname Onion address of the contact
+ *  @param rport    Listening port of the contact
+ *  @param data     Data sent right after the connect or NULL
+ *  @param data_len Length of data
+ *  @return connected socket or -1 in case of error
+ */
+int
+create_peer_socket(char* hostname, uint16_t rport, char* data, int data_len)
+{
+    return _cnf->tp.transport.connect(hostname, rport, data, data_len);
+}
+
+
+/**
+ *  Creates a direct TCP connection to the local address of a contact (see:
+ *  direct_route()).
+ *  @param hostname Onion address of the contact
+ *  @param rport    Listening port of the contact
+ *  @param data     Data sent right after the connect or NULL
+ *  @param data_len Length of data
+ *  @return connected socket or -1 in case of error
+ */
+int
+create_direct_socket(char* hostname, uint16_t rport, char* data, int data_len)
+{
+    struct sockaddr_in da; // local address of contact
+    int s;
+
+    if (direct_route(&_cnf->tp, hostname, rport, &da) == -1)
+    {
+        ui_log(LOG_ERR, "No route to '%s:%hu'!", hostname, rport);
+        return -1;
+    }
+
+    if ((s = connect_to((struct sockaddr*) &da)) == -1)
+    {
+        return -1;
+    }
+
+    if (data != NULL && write(s, data, data_len) != data_len)
+    {
+        ui_log_errno(LOG_ERR, "Could not write to '%s:%hu'!", hostname, rport);
+        close(s);
+        return -1;
+    }
+
+    return s;
+}
+
+
+/**
+ *  Looks up the local address of a contact in the route table.
+ *  Routes for the onion address are preferred over TP_ROUTE_ANY and routes
+ *  for the listening port over routes for every port.
+ *  @param tc       Pointer to transport configuration
+ *  @param hostname Onion address of the contact
+ *  @param rport    Listening port of the contact
+ *  @param da       Pointer to which the local address will be copied
+ *  @return 0 on success, -1 if there is no route
+ */
+int
+direct_route(transport_conf_t* tc, char* hostname, uint16_t rport, struct sockaddr_in* da)
+{
+    direct_route_t* best = NULL; // most specific route so far
+    int best_score = -1;
+    int score;
+
+    for (int i = 0; i < tc->used; i++)
+    {
+        if (tc->route[i].lport && tc->route[i].lport != rport)
+        {
+            continue;
+        }
+
+        if (!strcmp(tc->route[i].onion_id, hostname))
+        {
+            score = 2;
+        }
+        else if (!strcmp(tc->route[i].onion_id, TP_ROUTE_ANY))
+        {
+            score = 0;
+        }
+        else
+        {
+            continue;
+        }
+
+        score += tc->route[i].lport != 0;
+
+        if (score > best_score)
+        {
+            best = &tc->route[i];
+            best_score = score;
+        }
+    }
+
+    if (best == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(da, &best->sa, sizeof(*da));
+
+    if (!da->sin_port)
+    {
+        da->sin_port = htons(rport);
+    }
+
+    return 0;
+}
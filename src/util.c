@@ -30,6 +30,8 @@
 #include <ctype.h>
 #include <errno.h>
 
+#include "dchat_h/util.h"
+
 
 /**
  *  Define the maximum of two given integers.
@@ -108,3 +110,76 @@ iszero(void* ptr, int n )
 
     return 1;
 }
+
+
+/**
+ *  Continues a 32 bit FNV-1a hash over n bytes of memory.
+ *  To hash several memory areas, the result of the previous call
+ *  is passed as hash, the first call starts with FNV_OFFSET.
+ *  @param hash Hash calculated so far
+ *  @param data Pointer to memory
+ *  @param len  Amount of bytes to hash
+ *  @return updated hash
+ */
+uint32_t
+fnv_hash(uint32_t hash, void* data, int len)
+{
+    unsigned char* bptr = (unsigned char*) data;
+
+    while (len--)
+    {
+        hash ^= *bptr++;
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+
+/**
+ *  Encodes an unsigned integer as varint: 7 bits per byte, least
+ *  significant group first, the high bit is set on all but the last byte.
+ *  @param value Integer to encode
+ *  @param buf   Buffer of at least MAX_VARINT_LEN bytes
+ *  @return amount of bytes written
+ */
+int
+put_varint(uint64_t value, unsigned char* buf)
+{
+    int len = 0;
+
+    while (value >= 0x80)
+    {
+        buf[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+
+    buf[len++] = value;
+    return len;
+}
+
+
+/**
+ *  Decodes a varint (see: put_varint()).
+ *  @param buf   Buffer to decode from
+ *  @param len   Amount of bytes available in buf
+ *  @param value Pointer to which the integer will be stored
+ *  @return amount of bytes read or -1 if buf does not hold a valid varint
+ */
+int
+get_varint(unsigned char* buf, int len, uint64_t* value)
+{
+    *value = 0;
+
+    for (int i = 0; i < len && i < MAX_VARINT_LEN; i++)
+    {
+        *value |= (uint64_t) (buf[i] & 0x7F) << (7 * i);
+
+        if (!(buf[i] & 0x80))
+        {
+            return i + 1;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,516 @@
+/*
+ *  Copyright (c) 2014 Christoph Mahrl
+ *
+ *  This file is part of DChat.
+ *
+ *  DChat is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  DChat is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with DChat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/** @file warmpool.c
+ *  This file contains the pool of connections built in advance. Connecting
+ *  to a hidden service takes several seconds for the SOCKS handshake and
+ *  the rendezvous. A thread therefore keeps connections to the peers most
+ *  likely connected to next: the peers of the passive view in overlay mode
+ *  and the best peers of the contact cache. A connect to one of these peers
+ *  claims the ready connection instead of building a new one.
+ *  The remote client treats a ready connection like any other accepted
+ *  connection and sends its hello, which is read as soon as the connection
+ *  has been claimed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include "dchat_h/warmpool.h"
+#include "dchat_h/types.h"
+#include "dchat_h/contact.h"
+#include "dchat_h/cache.h"
+#include "dchat_h/connector.h"
+#include "dchat_h/transport.h"
+#include "dchat_h/consoleui.h"
+
+
+/**
+ *  Initializes an empty pool of connections built in advance.
+ *  The budget has been set by the command line option.
+ *  @param wp Pointer to warm pool
+ *  @return 0 on success, -1 in case of error
+ */
+int
+init_warm_pool(warm_pool_t* wp)
+{
+    int budget = wp->budget;
+
+    memset(wp, 0, sizeof(*wp));
+    wp->budget = budget;
+
+    if (pthread_mutex_init(&wp->wp_mx, NULL))
+    {
+        ui_log_errno(LOG_ERR, "Initialization of warm pool mutex failed!");
+        return -1;
+    }
+
+    if (pthread_cond_init(&wp->wp_cv, NULL))
+    {
+        ui_log_errno(LOG_ERR, "Initialization of warm pool condition failed!");
+        pthread_mutex_destroy(&wp->wp_mx);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Starts the thread building the connections, if a budget has been set.
+ *  @param wp Pointer to warm pool
+ *  @return 0 on success or if disabled, -1 in case of error
+ */
+int
+start_warm_pool(warm_pool_t* wp)
+{
+    if (!wp->budget)
+    {
+        return 0;
+    }
+
+    if (pthread_create(&wp->warm_th, NULL, th_warm_pool, wp))
+    {
+        ui_log_errno(LOG_ERR, "Creation of warm pool thread failed!");
+        return -1;
+    }
+
+    wp->running = 1;
+    return 0;
+}
+
+
+/**
+ *  Cancels and joins the thread building the connections and closes all
+ *  ready connections.
+ *  @param wp Pointer to warm pool
+ */
+void
+destroy_warm_pool(warm_pool_t* wp)
+{
+    if (wp->running)
+    {
+        pthread_cancel(wp->warm_th);
+        pthread_join(wp->warm_th, NULL);
+        wp->running = 0;
+    }
+
+    while (wp->used)
+    {
+        wp_remove(wp, wp->used - 1);
+    }
+
+    pthread_cond_destroy(&wp->wp_cv);
+    pthread_mutex_destroy(&wp->wp_mx);
+}
+
+
+/**
+ *  Thread function that keeps the pool filled.
+ *  Every WP_INTERVAL seconds, or as soon as a connection has been claimed,
+ *  connections that are no longer usable are closed and new connections
+ *  are built one after another until the budget is reached.
+ *  @param arg Pointer to warm pool
+ */
+void*
+th_warm_pool(void* arg)
+{
+    warm_pool_t* wp = arg;
+    struct timespec until; // end of wait
+
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, NULL);
+
+    for (;;)
+    {
+        wp_check(wp);
+        wp_fill(wp);
+
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += WP_INTERVAL;
+        pthread_mutex_lock(&wp->wp_mx);
+        // unlock pool if thread gets canceled while waiting
+        pthread_cleanup_push(unlock_warm_pool, wp);
+        pthread_cond_timedwait(&wp->wp_cv, &wp->wp_mx, &until);
+        pthread_cleanup_pop(1);
+    }
+
+    return NULL;
+}
+
+
+/**
+ *  Takes the ready connection to a peer out of the pool.
+ *  @param wp       Pointer to warm pool
+ *  @param onion_id Onion address of the peer
+ *  @param lport    Listening port of the peer
+ *  @return connected socket or -1 if there is no usable connection
+ */
+int
+wp_claim(warm_pool_t* wp, char* onion_id, uint16_t lport)
+{
+    int i;
+    int s = -1;
+
+    if (!wp->budget)
+    {
+        return -1;
+    }
+
+    pthread_mutex_lock(&wp->wp_mx);
+
+    if ((i = wp_find(wp, onion_id, lport)) != -1)
+    {
+        s = wp->conn[i].fd;
+        // keep the socket open
+        wp->conn[i].fd = -1;
+        wp_remove(wp, i);
+
+        if (wp_is_alive(s))
+        {
+            wp->claimed++;
+        }
+        else
+        {
+            close(s);
+            wp->expired++;
+            s = -1;
+        }
+
+        // build a replacement
+        pthread_cond_signal(&wp->wp_cv);
+    }
+
+    pthread_mutex_unlock(&wp->wp_mx);
+    return s;
+}
+
+
+/**
+ *  Closes all ready connections, that have been closed by the peer, have
+ *  exceeded WP_MAX_AGE or lead to a peer, that is a contact by now.
+ *  @param wp Pointer to warm pool
+ */
+void
+wp_check(warm_pool_t* wp)
+{
+    contact_t temp;     // peer of a connection
+    time_t now = time(NULL);
+
+    memset(&temp, 0, sizeof(temp));
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_mutex_lock(&_cnf->cl.cl_mx);
+    pthread_mutex_lock(&wp->wp_mx);
+
+    for (int i = wp->used - 1; i >= 0; i--)
+    {
+        temp.onion_id[0] = '\0';
+        strncat(temp.onion_id, wp->conn[i].onion_id, ONION_ADDRLEN);
+        temp.lport = wp->conn[i].lport;
+
+        if (now - wp->conn[i].built >= WP_MAX_AGE || !wp_is_alive(wp->conn[i].fd) ||
+            find_contact(&temp, 0) != -2)
+        {
+            wp_remove(wp, i);
+            wp->expired++;
+        }
+    }
+
+    pthread_mutex_unlock(&wp->wp_mx);
+    pthread_mutex_unlock(&_cnf->cl.cl_mx);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+}
+
+
+/**
+ *  Builds connections to the best candidates until the budget is reached.
+ *  The connections are built one after another, so that the pool does not
+ *  cause a burst of circuit builds. Addresses that could not be connected
+ *  are not retried for WP_RETRY_TIME seconds.
+ *  @param wp Pointer to warm pool
+ *  @return amount of connections built
+ */
+int
+wp_fill(warm_pool_t* wp)
+{
+    ovl_peer_t* cand;   // candidates in order of preference
+    int cnt;            // amount of candidates
+    int built = 0;      // connections built
+    int missing;        // free slots of the pool
+    int s;
+    warm_conn_t* wc;
+    struct timespec start, end; // duration of connect
+
+    cnt = wp_candidates(wp, &cand);
+
+    for (int i = 0; i < cnt; i++)
+    {
+        pthread_mutex_lock(&wp->wp_mx);
+        missing = wp->budget - wp->used;
+        pthread_mutex_unlock(&wp->wp_mx);
+
+        if (missing <= 0)
+        {
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if ((s = create_peer_socket(cand[i].onion_id, cand[i].lport, NULL, 0)) == -1)
+        {
+            cache_failure(&_cnf->cache, cand[i].onion_id, cand[i].lport);
+        }
+        else
+        {
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            cache_success(&_cnf->cache, cand[i].onion_id, cand[i].lport,
+                          (end.tv_sec - start.tv_sec) * 1000 +
+                          (end.tv_nsec - start.tv_nsec) / 1000000);
+        }
+
+        pthread_mutex_lock(&wp->wp_mx);
+
+        if (s == -1)
+        {
+            wc = &wp->failed[wp->failed_next];
+            wp->failed_next = (wp->failed_next + 1) % WP_MAX_FAILED;
+        }
+        else
+        {
+            wc = &wp->conn[wp->used++];
+            wp->built++;
+            built++;
+        }
+
+        memset(wc, 0, sizeof(*wc));
+        strncat(wc->onion_id, cand[i].onion_id, ONION_ADDRLEN);
+        wc->lport = cand[i].lport;
+        wc->fd = s;
+        wc->built = time(NULL);
+        pthread_mutex_unlock(&wp->wp_mx);
+    }
+
+    free(cand);
+    return built;
+}
+
+
+/**
+ *  Determines the peers to build connections to, in order of preference:
+ *  the peers of the passive view (in overlay mode), which will be connected
+ *  as soon as the active view has a free slot, followed by the best peers
+ *  of the contact cache. Peers that are ourself, already contacts, queued
+ *  for connecting, already in the pool or failed recently are skipped.
+ *  @param wp   Pointer to warm pool
+ *  @param cand Pointer to which the allocated candidates will be stored
+ *  @return amount of candidates
+ */
+int
+wp_candidates(warm_pool_t* wp, ovl_peer_t** cand)
+{
+    cache_rec_t* recs;  // best cached peers
+    int rcnt;           // amount of cached peers
+    ovl_peer_t* all;    // candidates before filtering
+    int acnt = 0;       // amount of candidates before filtering
+    int cnt = 0;        // amount of candidates
+    contact_t temp;     // candidate
+    time_t now = time(NULL);
+    int j;
+
+    rcnt = cache_select(&_cnf->cache, wp->budget * 2 + WP_MAX_FAILED, &recs);
+
+    if ((all = malloc((OVL_PASSIVE_SIZE + rcnt) * sizeof(ovl_peer_t))) == NULL ||
+        (*cand = malloc((OVL_PASSIVE_SIZE + rcnt) * sizeof(ovl_peer_t))) == NULL)
+    {
+        ui_fatal("Memory allocation for warm pool candidates failed!");
+    }
+
+    memset(&temp, 0, sizeof(temp));
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_mutex_lock(&_cnf->cl.cl_mx);
+
+    for (int i = 0; _cnf->ovl.enabled && i < _cnf->ovl.passive_used; i++)
+    {
+        memcpy(&all[acnt++], &_cnf->ovl.passive[i], sizeof(ovl_peer_t));
+    }
+
+    for (int i = 0; i < rcnt; i++)
+    {
+        memset(&all[acnt], 0, sizeof(ovl_peer_t));
+        strncat(all[acnt].onion_id, recs[i].onion_id, ONION_ADDRLEN);
+        all[acnt++].lport = recs[i].lport;
+    }
+
+    pthread_mutex_lock(&_cnf->cq.cq_mx);
+    pthread_mutex_lock(&wp->wp_mx);
+
+    for (int i = 0; i < acnt; i++)
+    {
+        temp.onion_id[0] = '\0';
+        strncat(temp.onion_id, all[i].onion_id, ONION_ADDRLEN);
+        temp.lport = all[i].lport;
+
+        // skip ourself, contacts and connects in progress
+        if ((temp.lport == _cnf->me.lport && !strcmp(temp.onion_id, _cnf->me.onion_id)) ||
+            find_contact(&temp, 0) != -2 || find_conn(&_cnf->cq, temp.onion_id, temp.lport) != -1 ||
+            wp_find(wp, temp.onion_id, temp.lport) != -1 ||
+            wp_is_failed(wp, temp.onion_id, temp.lport, now))
+        {
+            continue;
+        }
+
+        // a cached peer may be in the passive view as well
+        for (j = 0; j < cnt; j++)
+        {
+            if ((*cand)[j].lport == temp.lport && !strcmp((*cand)[j].onion_id, temp.onion_id))
+            {
+                break;
+            }
+        }
+
+        if (j == cnt)
+        {
+            memcpy(&(*cand)[cnt++], &all[i], sizeof(ovl_peer_t));
+        }
+    }
+
+    pthread_mutex_unlock(&wp->wp_mx);
+    pthread_mutex_unlock(&_cnf->cq.cq_mx);
+    pthread_mutex_unlock(&_cnf->cl.cl_mx);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    free(all);
+    free(recs);
+    return cnt;
+}
+
+
+/**
+ *  Searches the ready connection to a peer.
+ *  Caller must hold the mutex of the pool.
+ *  @param wp       Pointer to warm pool
+ *  @param onion_id Onion address of the peer
+ *  @param lport    Listening port of the peer
+ *  @return index of connection or -1 if not found
+ */
+int
+wp_find(warm_pool_t* wp, char* onion_id, uint16_t lport)
+{
+    for (int i = 0; i < wp->used; i++)
+    {
+        if (wp->conn[i].lport == lport && !strcmp(wp->conn[i].onion_id, onion_id))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+/**
+ *  Checks if building a connection to a peer failed recently.
+ *  Caller must hold the mutex of the pool.
+ *  @param wp       Pointer to warm pool
+ *  @param onion_id Onion address of the peer
+ *  @param lport    Listening port of the peer
+ *  @param now      Current time
+ *  @return 1 if the peer failed within WP_RETRY_TIME seconds, 0 otherwise
+ */
+int
+wp_is_failed(warm_pool_t* wp, char* onion_id, uint16_t lport, time_t now)
+{
+    for (int i = 0; i < WP_MAX_FAILED; i++)
+    {
+        if (wp->failed[i].lport == lport && !strcmp(wp->failed[i].onion_id, onion_id) &&
+            now - wp->failed[i].built < WP_RETRY_TIME)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ *  Checks if a ready connection is still usable: it must not have been
+ *  closed by the peer and must not have queued up more than WP_MAX_PENDING
+ *  bytes (e.g. chat messages sent to it in full-mesh mode), which would
+ *  eventually block the peer.
+ *  @param fd Socket of connection
+ *  @return 1 if usable, 0 otherwise
+ */
+int
+wp_is_alive(int fd)
+{
+    char c;
+    int pending = 0; // unread bytes
+    ssize_t ret = recv(fd, &c, sizeof(c), MSG_PEEK | MSG_DONTWAIT);
+
+    if (ret == 0 || (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        return 0;
+    }
+
+    return ioctl(fd, FIONREAD, &pending) == -1 || pending <= WP_MAX_PENDING;
+}
+
+
+/**
+ *  Removes a ready connection from the pool and closes its socket.
+ *  Caller must hold the mutex of the pool.
+ *  @param wp Pointer to warm pool
+ *  @param i  Index of connection
+ */
+void
+wp_remove(warm_pool_t* wp, int i)
+{
+    if (wp->conn[i].fd != -1)
+    {
+        close(wp->conn[i].fd);
+    }
+
+    // keep the pool compact by moving the last connection
+    wp->used--;
+
+    if (i != wp->used)
+    {
+        memcpy(&wp->conn[i], &wp->conn[wp->used], sizeof(warm_conn_t));
+    }
+}
+
+
+/**
+ *  Cleanup handler that unlocks the mutex of a warm pool.
+ *  @param arg Pointer to warm pool
+ */
+void
+unlock_warm_pool(void* arg)
+{
+    pthread_mutex_unlock(&((warm_pool_t*) arg)->wp_mx);
+}